@@ -19,12 +19,293 @@ enum GLSL_COMPILER_FLAG
     GLSL_COMPILER_FLAG_NONE = 0,
     GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY = 1 << 0, // write disassembly to stderr
     GLSL_COMPILER_FLAG_PRINT_DISASSEMBLY_TO_STDERR = 1 << 0,
+    GLSL_COMPILER_FLAG_USE_COMPILE_ARENA = 1 << 1, // allocate the AST and IR from one arena which is released in one go after linking
+    GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS = 1 << 2, // log allocation counts and peak heap usage of the compile
+    GLSL_COMPILER_FLAG_PACK_ALU_GROUPS = 1 << 3, // schedule ALU instructions with a lookahead that fills more of the 5 slots of each ALU group
+    GLSL_COMPILER_FLAG_GROUP_KCACHE_LINES = 1 << 4, // schedule ALU instructions which read the same uniform cache lines together so fewer ALU clauses are needed
+    GLSL_COMPILER_FLAG_HOIST_FETCHES = 1 << 5, // compute texture and vertex fetch addresses first and batch the fetches into few large clauses, limited by the registers the results occupy
+    GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS = 1 << 6, // keep indexed temporary arrays in GPRs with relative addressing while they fit into the GPR budget, instead of using scratch memory for arrays above 40 elements
+    GLSL_COMPILER_FLAG_DIRECT_PIPELINE = 1 << 7, // translate the linked NIR with an explicit shader key, without the state tracker variant and gallium CSO bookkeeping. Produces the same code
+    GLSL_COMPILER_FLAG_OPTIMIZE_SIZE = 1 << 8, // favour small programs: limited loop unrolling, repeated literals loaded once into a register and branches instead of predication for large bodies. The regular compile is kept if it is smaller
 };
 
+// a set of preprocessor defines applied to one shader permutation
+// each entry is either "NAME" or "NAME=VALUE"
+typedef struct
+{
+    const char* const* defines;
+    uint32_t defineCount;
+}GLSL_DEFINE_SET;
+
+// a uniform (or uniform block member) with a value that is known at compile time
+// values are raw 32bit components (floats as their bit pattern), arrays are tightly packed and matrices are column-major
+typedef struct
+{
+    const char* name;
+    const uint32_t* values;
+    uint32_t valueCount;
+}GLSL_UNIFORM_SPECIALIZATION;
+
+// render target setup that pixel shaders are compiled for. Color outputs without a bound color buffer are not exported
+typedef struct
+{
+    uint32_t colorBufferCount; // number of bound color buffers (1-8), 0 = one per color output of the shader
+    uint32_t dualSourceBlend; // non-zero: the output with index 1 of location 0 is the second blend source. Requires colorBufferCount 1
+    uint32_t alphaToOne; // non-zero: alpha is exported as 1.0
+}GLSL_PIXEL_SHADER_KEY;
+
+// name lookup tables
+// a minimal perfect hash over the names of a shader's uniform blocks, uniform vars, samplers and attributes
+// lookups cost one hash and a single integer compare. Tables can also be stored in .gsh files and used without loading the compiler
+enum GLSL_SHADER_VAR_KIND
+{
+    GLSL_SHADER_VAR_KIND_NONE = 0, // empty slot
+    GLSL_SHADER_VAR_KIND_UNIFORM_BLOCK = 1,
+    GLSL_SHADER_VAR_KIND_UNIFORM_VAR = 2,
+    GLSL_SHADER_VAR_KIND_SAMPLER = 3,
+    GLSL_SHADER_VAR_KIND_ATTRIB = 4,
+};
+
+typedef struct
+{
+    uint32_t nameHashHigh;
+    uint32_t nameHashLow;
+    uint16_t kind; // GLSL_SHADER_VAR_KIND
+    uint16_t index; // index into the var array of the shader (uniformBlocks, uniformVars, samplerVars or attribVars)
+    int32_t location; // uniform block location, uniform var offset, sampler location or attribute location
+}GLSL_LOOKUP_ENTRY;
+
+#define GLSL_LOOKUP_TABLE_MAGIC 0x474C5554 // 'GLUT'
+
+// followed by uint32_t displacements[bucketCount] and GLSL_LOOKUP_ENTRY slots[slotCount]. Both counts are powers of two
+typedef struct GLSL_LOOKUP_TABLE
+{
+    uint32_t magic;
+    uint32_t bucketCount;
+    uint32_t slotCount;
+    uint32_t entryCount;
+}GLSL_LOOKUP_TABLE;
+
+static inline uint32_t GLSL_GetLookupTableSize(const GLSL_LOOKUP_TABLE* table)
+{
+    return sizeof(GLSL_LOOKUP_TABLE) + table->bucketCount * sizeof(uint32_t) + table->slotCount * sizeof(GLSL_LOOKUP_ENTRY);
+}
+
+// the hash can be computed once (e.g. when the renderer is initialized) and then be reused for every lookup
+static inline uint64_t GLSL_HashShaderVarName(GLSL_SHADER_VAR_KIND kind, const char* name)
+{
+    uint64_t h = 0xCBF29CE484222325ull ^ ((uint64_t)kind * 0x9E3779B97F4A7C15ull); // FNV-1a
+    while (*name)
+    {
+        h ^= (uint8_t)*name++;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+static inline uint64_t GLSL_MixLookupHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint32_t GLSL_GetLookupTableBucket(uint64_t nameHash, uint32_t bucketCount)
+{
+    return (uint32_t)(GLSL_MixLookupHash(nameHash) >> 32) & (bucketCount - 1);
+}
+
+static inline uint32_t GLSL_GetLookupTableSlot(uint64_t nameHash, uint32_t displacement, uint32_t slotCount)
+{
+    return (uint32_t)GLSL_MixLookupHash(nameHash + (uint64_t)displacement * 0x9E3779B97F4A7C15ull) & (slotCount - 1);
+}
+
+static inline const GLSL_LOOKUP_ENTRY* GLSL_LookupShaderVarByHash(const GLSL_LOOKUP_TABLE* table, uint64_t nameHash)
+{
+    const uint32_t* displacements = (const uint32_t*)(table + 1);
+    const GLSL_LOOKUP_ENTRY* slots = (const GLSL_LOOKUP_ENTRY*)(displacements + table->bucketCount);
+    uint32_t bucket = GLSL_GetLookupTableBucket(nameHash, table->bucketCount);
+    const GLSL_LOOKUP_ENTRY* entry = slots + GLSL_GetLookupTableSlot(nameHash, displacements[bucket], table->slotCount);
+    if (entry->nameHashHigh != (uint32_t)(nameHash >> 32) || entry->nameHashLow != (uint32_t)nameHash)
+        return nullptr;
+    return entry;
+}
+
+// codegen metrics of a compiled program
+typedef struct
+{
+    uint32_t ndw; // program size in dwords
+    uint32_t gprCount;
+    uint32_t stackSize;
+    uint32_t cfCount; // control flow instructions, clause instructions are not included
+    uint32_t aluClauseCount;
+    uint32_t fetchClauseCount;
+    uint32_t aluCount;
+    uint32_t aluGroupCount; // VLIW instruction groups
+    uint32_t literalCount;
+    uint32_t texCount;
+    uint32_t vtxCount;
+    uint32_t kcacheSplitCount; // ALU clauses which were ended because no constant cache line was left for the next instructions
+    uint32_t scratchSize; // scratch memory per thread in vec4 units, non-zero if indexed arrays did not stay in GPRs
+}GLSL_PROGRAM_STATS;
+
+typedef struct
+{
+    GLSL_PROGRAM_STATS backend; // as emitted by the r600 backend
+    GLSL_PROGRAM_STATS optimized; // after the sb optimizer, equal to backend if sb did not run
+    uint32_t sbOptimized;
+    uint32_t gprBudget; // budget the shader was compiled with, 0 if none was set. optimized.gprCount is the achieved count
+    uint32_t preprocessMicroseconds; // time spent in the preprocessor, part of compileMicroseconds
+    uint32_t compileMicroseconds; // time of the whole compile from GLSL source to the final program
+    uint32_t sizeBaselineNdw; // program size in dwords of the regular compile if GLSL_COMPILER_FLAG_OPTIMIZE_SIZE was set, 0 otherwise. optimized.ndw is the size that was kept
+    uint32_t preprocessPath; // GLSL_PREPROCESS_PATH
+    uint32_t rematerializedCount; // values the register pressure scheduling recomputed next to their readers instead of keeping them live
+}GLSL_SHADER_STATS;
+
+enum GLSL_PREPROCESS_PATH
+{
+    GLSL_PREPROCESS_PATH_GLCPP = 0,
+    GLSL_PREPROCESS_PATH_PASSTHROUGH = 1, // only #version/#extension/#line and comments, glcpp was skipped
+    GLSL_PREPROCESS_PATH_CACHED = 2, // glcpp output of an earlier compile of the same source was reused
+};
+
+enum GLSL_ESTIMATE_BOTTLENECK
+{
+    GLSL_ESTIMATE_BOTTLENECK_ALU = 0,
+    GLSL_ESTIMATE_BOTTLENECK_FETCH = 1,
+    GLSL_ESTIMATE_BOTTLENECK_LATENCY = 2, // not enough resident wavefronts to hide fetch and clause switch latency
+};
+
+// static performance estimate of a compiled program, without running it on a GPU
+// cycles are per wavefront of 64 threads on one SIMD. The cost model approximates the R700 shader core and is meant for
+// ranking shader variants and catching regressions, not for absolute timings. Branches and loop bodies are counted once
+typedef struct
+{
+    uint32_t cycles; // average cost per wavefront with the SIMD shared by all resident wavefronts
+    uint32_t serialCycles; // cost of a single wavefront with every latency exposed
+    uint32_t aluCycles;
+    uint32_t fetchCycles;
+    uint32_t cfCycles; // control flow instructions and exports
+    uint32_t latencyCycles; // fetch, clause switch and constant cache latency
+    uint32_t aluGroupCount;
+    uint32_t aluSlotCount; // used slots out of aluGroupCount * 5
+    uint32_t transCount; // instructions in the trans slot
+    uint32_t literalCount;
+    uint32_t clauseCount;
+    uint32_t clauseSwitchCount; // changes between ALU and fetch clauses
+    uint32_t kcacheLoadCount; // constant cache lines locked by an ALU clause which the previous ALU clause did not hold
+    uint32_t texCount;
+    uint32_t vtxCount;
+    uint32_t exportCount; // exported registers
+    uint32_t gprCount;
+    uint32_t wavefronts; // resident wavefronts per SIMD the GPR count allows
+    uint32_t bottleneck; // GLSL_ESTIMATE_BOTTLENECK
+    uint32_t hasFlowControl;
+}GLSL_PROGRAM_ESTIMATE;
+
+#define GLSL_RUN_MAX_LANES 64
+
+// host execution of a compiled program, see GLSL_RunVertexShader
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    const float* texels; // RGBA, row by row. A single mip level which is sampled with repeat wrapping
+    uint32_t bilinear; // otherwise point sampling
+}GLSL_RUN_TEXTURE;
+
+typedef struct
+{
+    const uint32_t* data; // in host byte order
+    uint32_t size; // in bytes
+}GLSL_RUN_BUFFER;
+
+typedef struct
+{
+    uint32_t laneCount; // threads of the wavefront, 1 to GLSL_RUN_MAX_LANES. For derivatives every 4 lanes form a 2x2 quad
+    const uint32_t* inputGprs; // initial registers as raw bits, laid out as [lane][inputGprCount][4]. The other registers start as 0
+    uint32_t inputGprCount;
+    const GLSL_RUN_BUFFER* uniformBlocks; // indexed by binding, loose uniforms are in block 15
+    uint32_t uniformBlockCount;
+    const GLSL_RUN_TEXTURE* textures; // indexed by sampler location
+    uint32_t textureCount;
+    uint32_t maxLoopIterations; // per loop, 0 selects 65536
+}GLSL_RUN_INPUT;
+
+// dynamic counts of a CF instruction
+typedef struct
+{
+    uint32_t executeCount; // how often the instruction was reached, clauses without active lanes are skipped
+    uint32_t activeLaneCount; // summed over all executions
+    uint32_t aluGroupCount;
+    uint32_t aluCount;
+    uint32_t fetchCount;
+}GLSL_RUN_CF_STATS;
+
+typedef struct
+{
+    uint32_t success;
+    char error[256]; // reason if the program could not be run
+    uint64_t killedLanes;
+    // exported registers as raw bits, [lane][4]. Masked components and lanes which did not export are 0
+    uint32_t colorMask; // bit per render target
+    uint32_t colors[8][GLSL_RUN_MAX_LANES][4];
+    uint32_t depthExported;
+    uint32_t depth[GLSL_RUN_MAX_LANES];
+    uint32_t positionMask; // position, point size and clip distances
+    uint32_t positions[4][GLSL_RUN_MAX_LANES][4];
+    uint32_t paramMask;
+    uint32_t params[32][GLSL_RUN_MAX_LANES][4];
+    // dynamic instruction counts of the whole wavefront
+    uint32_t cfExecuteCount;
+    uint32_t aluGroupCount;
+    uint32_t aluCount;
+    uint32_t texCount;
+    uint32_t vtxCount;
+    uint32_t cfCount;
+    GLSL_RUN_CF_STATS* cfStats; // indexed by CF instruction
+}GLSL_RUN_RESULT;
+
 inline GX2VertexShader* (*GLSL_CompileVertexShader)(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
 inline GX2PixelShader* (*GLSL_CompilePixelShader)(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
 inline void (*GLSL_FreeVertexShader)(GX2VertexShader* shader);
 inline void (*GLSL_FreePixelShader)(GX2PixelShader* shader);
+// compile one shader per define set. Returns a table with defineSetCount entries, permutations which result in identical programs share the same shader object
+inline GX2VertexShader** (*GLSL_CompileVertexShaderPermutations)(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+inline GX2PixelShader** (*GLSL_CompilePixelShaderPermutations)(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+inline void (*GLSL_FreeVertexShaderPermutations)(GX2VertexShader** shaderTable, uint32_t count);
+inline void (*GLSL_FreePixelShaderPermutations)(GX2PixelShader** shaderTable, uint32_t count);
+// uniforms which are baked into the program as constants by all following compiles. Specialized uniforms are not listed in the shader's uniformVars
+// the list is copied. Pass a count of 0 to clear it
+inline void (*GLSL_SetUniformSpecializations)(const GLSL_UNIFORM_SPECIALIZATION* specializations, uint32_t count);
+// maximum number of GPRs for all following compiles, 0 to disable. Shaders above the budget are recompiled with register pressure
+// scheduling, rematerialization of constant values and without the sb optimizer. The variant with the fewest GPRs is kept if none fits
+inline void (*GLSL_SetGprBudget)(uint32_t gprCount);
+// render target setup for all following pixel shader compiles. The key is copied, pass nullptr to restore the default
+inline void (*GLSL_SetPixelShaderKey)(const GLSL_PIXEL_SHADER_KEY* key);
+// add or replace a virtual include file for all following compiles, pass source nullptr to remove it. Paths are absolute, e.g. "/lib/lighting.glsl"
+// shaders include it with #include "/lib/lighting.glsl" after enabling GL_ARB_shading_language_include. Returns false if the path is invalid
+// the preprocessed expansion of an include is cached, including it again with the same macros defined is close to free
+inline bool (*GLSL_SetInclude)(const char* path, const char* source);
+// build a name lookup table for a compiled shader. Free with GLSL_FreeLookupTable
+inline GLSL_LOOKUP_TABLE* (*GLSL_CreateVertexShaderLookupTable)(const GX2VertexShader* shader);
+inline GLSL_LOOKUP_TABLE* (*GLSL_CreatePixelShaderLookupTable)(const GX2PixelShader* shader);
+inline void (*GLSL_FreeLookupTable)(GLSL_LOOKUP_TABLE* table);
+// returns nullptr if the shader has no var of that kind and name
+inline const GLSL_LOOKUP_ENTRY* (*GLSL_LookupShaderVar)(const GLSL_LOOKUP_TABLE* table, GLSL_SHADER_VAR_KIND kind, const char* name);
+// stats of the last shader compiled with GLSL_CompileVertexShader or GLSL_CompilePixelShader. Returns false if no shader was compiled yet
+inline bool (*GLSL_GetLastShaderStats)(GLSL_SHADER_STATS* stats);
+// estimate the cost of a compiled shader. With printListing an annotated listing of every clause and a summary are written to stderr
+// returns false if the program could not be decoded
+inline bool (*GLSL_EstimateVertexShader)(const GX2VertexShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+inline bool (*GLSL_EstimatePixelShader)(const GX2PixelShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+// run a compiled shader on the CPU as one wavefront. Returns nullptr for invalid arguments, otherwise a result which has to be freed
+// with GLSL_FreeRunResult. Vertex shaders start after the fetch shader call, inputGprs has to hold the vertex index in R0 and the attributes
+// Pixel shader inputs are already interpolated, starting at R0
+inline GLSL_RUN_RESULT* (*GLSL_RunVertexShader)(const GX2VertexShader* shader, const GLSL_RUN_INPUT* input);
+inline GLSL_RUN_RESULT* (*GLSL_RunPixelShader)(const GX2PixelShader* shader, const GLSL_RUN_INPUT* input);
+inline void (*GLSL_FreeRunResult)(GLSL_RUN_RESULT* result);
 inline void (*__GLSL_DestroyGLSLCompiler)();
 
 #ifndef GLSL_COMPILER_CAFE_RPL
@@ -36,6 +317,24 @@ extern "C"
     GX2PixelShader* CompilePixelShader(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
     void FreeVertexShader(GX2VertexShader* shader);
     void FreePixelShader(GX2PixelShader* shader);
+    GX2VertexShader** CompileVertexShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+    GX2PixelShader** CompilePixelShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+    void FreeVertexShaderPermutations(GX2VertexShader** shaderTable, uint32_t count);
+    void FreePixelShaderPermutations(GX2PixelShader** shaderTable, uint32_t count);
+    void SetUniformSpecializations(const GLSL_UNIFORM_SPECIALIZATION* specializations, uint32_t count);
+    void SetGprBudget(uint32_t gprCount);
+    void SetPixelShaderKey(const GLSL_PIXEL_SHADER_KEY* key);
+    bool SetInclude(const char* path, const char* source);
+    GLSL_LOOKUP_TABLE* CreateVertexShaderLookupTable(const GX2VertexShader* shader);
+    GLSL_LOOKUP_TABLE* CreatePixelShaderLookupTable(const GX2PixelShader* shader);
+    void FreeLookupTable(GLSL_LOOKUP_TABLE* table);
+    const GLSL_LOOKUP_ENTRY* LookupShaderVar(const GLSL_LOOKUP_TABLE* table, GLSL_SHADER_VAR_KIND kind, const char* name);
+    bool GetLastShaderStats(GLSL_SHADER_STATS* stats);
+    bool EstimateVertexShader(const GX2VertexShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+    bool EstimatePixelShader(const GX2PixelShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+    GLSL_RUN_RESULT* RunVertexShader(const GX2VertexShader* shader, const GLSL_RUN_INPUT* input);
+    GLSL_RUN_RESULT* RunPixelShader(const GX2PixelShader* shader, const GLSL_RUN_INPUT* input);
+    void FreeRunResult(GLSL_RUN_RESULT* result);
 };
 #endif
 
@@ -59,6 +358,24 @@ static inline bool GLSL_Init()
     OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "CompilePixelShader", (void**)&GLSL_CompilePixelShader);
     OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreeVertexShader", (void**)&GLSL_FreeVertexShader);
     OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreePixelShader", (void**)&GLSL_FreePixelShader);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "CompileVertexShaderPermutations", (void**)&GLSL_CompileVertexShaderPermutations);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "CompilePixelShaderPermutations", (void**)&GLSL_CompilePixelShaderPermutations);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreeVertexShaderPermutations", (void**)&GLSL_FreeVertexShaderPermutations);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreePixelShaderPermutations", (void**)&GLSL_FreePixelShaderPermutations);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "SetUniformSpecializations", (void**)&GLSL_SetUniformSpecializations);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "SetGprBudget", (void**)&GLSL_SetGprBudget);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "SetPixelShaderKey", (void**)&GLSL_SetPixelShaderKey);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "SetInclude", (void**)&GLSL_SetInclude);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "CreateVertexShaderLookupTable", (void**)&GLSL_CreateVertexShaderLookupTable);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "CreatePixelShaderLookupTable", (void**)&GLSL_CreatePixelShaderLookupTable);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreeLookupTable", (void**)&GLSL_FreeLookupTable);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "LookupShaderVar", (void**)&GLSL_LookupShaderVar);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "GetLastShaderStats", (void**)&GLSL_GetLastShaderStats);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "EstimateVertexShader", (void**)&GLSL_EstimateVertexShader);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "EstimatePixelShader", (void**)&GLSL_EstimatePixelShader);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "RunVertexShader", (void**)&GLSL_RunVertexShader);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "RunPixelShader", (void**)&GLSL_RunPixelShader);
+    OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "FreeRunResult", (void**)&GLSL_FreeRunResult);
     OSDynLoad_FindExport(s_glslCompilerModule, OS_DYNLOAD_EXPORT_FUNC, "DestroyGLSLCompiler", (void**)&__GLSL_DestroyGLSLCompiler);
 #else
     _InitGLSLCompiler = InitGLSLCompiler;
@@ -66,6 +383,24 @@ static inline bool GLSL_Init()
     GLSL_CompilePixelShader = CompilePixelShader;
     GLSL_FreeVertexShader = FreeVertexShader;
     GLSL_FreePixelShader = FreePixelShader;
+    GLSL_CompileVertexShaderPermutations = CompileVertexShaderPermutations;
+    GLSL_CompilePixelShaderPermutations = CompilePixelShaderPermutations;
+    GLSL_FreeVertexShaderPermutations = FreeVertexShaderPermutations;
+    GLSL_FreePixelShaderPermutations = FreePixelShaderPermutations;
+    GLSL_SetUniformSpecializations = SetUniformSpecializations;
+    GLSL_SetGprBudget = SetGprBudget;
+    GLSL_SetPixelShaderKey = SetPixelShaderKey;
+    GLSL_SetInclude = SetInclude;
+    GLSL_CreateVertexShaderLookupTable = CreateVertexShaderLookupTable;
+    GLSL_CreatePixelShaderLookupTable = CreatePixelShaderLookupTable;
+    GLSL_FreeLookupTable = FreeLookupTable;
+    GLSL_LookupShaderVar = LookupShaderVar;
+    GLSL_GetLastShaderStats = GetLastShaderStats;
+    GLSL_EstimateVertexShader = EstimateVertexShader;
+    GLSL_EstimatePixelShader = EstimatePixelShader;
+    GLSL_RunVertexShader = RunVertexShader;
+    GLSL_RunPixelShader = RunPixelShader;
+    GLSL_FreeRunResult = FreeRunResult;
     __GLSL_DestroyGLSLCompiler = DestroyGLSLCompiler;
 #endif
     _InitGLSLCompiler();
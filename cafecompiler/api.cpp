@@ -23,6 +23,22 @@ size_t _strlcpy(char *dst, const char *src, size_t size);
 CafeGLSLCompiler *s_compiler{};
 int s_compilerRefCount{0};
 
+void _DestroyPermutationWorkers();
+GX2VertexShader** _CompileVertexShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+GX2PixelShader** _CompilePixelShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+void _FreeVertexShaderPermutations(GX2VertexShader** shaderTable, uint32_t count);
+void _FreePixelShaderPermutations(GX2PixelShader** shaderTable, uint32_t count);
+void _SetPermutationWorkerOptions(const CafeGLSLCompiler::CompileOptions& options);
+GLSL_LOOKUP_TABLE* _CreateVertexShaderLookupTable(const GX2VertexShader* shader);
+GLSL_LOOKUP_TABLE* _CreatePixelShaderLookupTable(const GX2PixelShader* shader);
+void _FreeLookupTable(GLSL_LOOKUP_TABLE* table);
+const GLSL_LOOKUP_ENTRY* _LookupShaderVar(const GLSL_LOOKUP_TABLE* table, GLSL_SHADER_VAR_KIND kind, const char* name);
+bool _EstimateVertexShader(CafeGLSLCompiler* compiler, const GX2VertexShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+bool _EstimatePixelShader(CafeGLSLCompiler* compiler, const GX2PixelShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing);
+GLSL_RUN_RESULT* _RunVertexShader(CafeGLSLCompiler* compiler, const GX2VertexShader* shader, const GLSL_RUN_INPUT* input);
+GLSL_RUN_RESULT* _RunPixelShader(CafeGLSLCompiler* compiler, const GX2PixelShader* shader, const GLSL_RUN_INPUT* input);
+void _FreeRunResult(GLSL_RUN_RESULT* result);
+
 void _InitGLSLCompiler()
 {
     s_compiler = new CafeGLSLCompiler();
@@ -35,8 +51,11 @@ void _DestroyGLSLCompiler()
     s_compilerRefCount--;
     if (s_compilerRefCount != 0)
         return;
+    _DestroyPermutationWorkers();
     delete s_compiler;
     s_compiler = nullptr;
+    // the permutation workers and the compile server share the caches too, they are gone by now
+    CafeGLSLCompiler::ReleaseSharedCaches();
 }
 
 #if defined(__WUT__)
@@ -68,28 +87,132 @@ static_assert(offsetof(CafeGLSLCompiler::PSRegs, spi_input_z) == offsetof(GX2Pix
 
 #endif
 
-bool _CompileShader(const char* shaderSource, CafeGLSLCompiler::SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength)
+// the default compile is above the GPR budget. Try the register pressure variants in order of increasing code quality loss and keep
+// the first one which fits. If none does, the variant with the fewest GPRs (then the smallest program) is recompiled and kept
+static bool _CompileShaderForGprBudget(CafeGLSLCompiler* compiler, const char* shaderSource, CafeGLSLCompiler::SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+{
+    static const CafeGLSLCompiler::RegisterPressureVariant variants[] = {
+        {false, false}, // default, already compiled
+        {true, false},
+        {true, true},
+    };
+    const uint32_t variantCount = sizeof(variants) / sizeof(variants[0]);
+    const uint32_t gprBudget = compiler->options.gprBudget;
+    uint32_t bestVariant = 0;
+    GLSL_PROGRAM_STATS best = compiler->lastShaderStats.optimized;
+    uint32_t currentVariant = 0;
+    for (uint32_t i = 1; i < variantCount && best.gprCount > gprBudget; i++)
+    {
+        compiler->registerPressureVariant = variants[i];
+        bool success = compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags);
+        compiler->registerPressureVariant = {};
+        if (!success)
+        {
+            compiler->CleanupCurrentProgram();
+            return false;
+        }
+        currentVariant = i;
+        GLSL_SHADER_STATS stats;
+        compiler->GetShaderStats(stats);
+        if (stats.optimized.gprCount < best.gprCount || (stats.optimized.gprCount == best.gprCount && stats.optimized.ndw < best.ndw))
+        {
+            bestVariant = i;
+            best = stats.optimized;
+            compiler->lastShaderStats = stats;
+        }
+    }
+    if (currentVariant != bestVariant)
+    {
+        compiler->registerPressureVariant = variants[bestVariant];
+        bool success = compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags);
+        compiler->registerPressureVariant = {};
+        if (!success)
+        {
+            compiler->CleanupCurrentProgram();
+            return false;
+        }
+    }
+    if (best.gprCount > gprBudget)
+        DebugLog("GPR budget of %u not met, the shader uses %u GPRs", gprBudget, best.gprCount);
+    return true;
+}
+
+// the size mode trades loop unrolling and predication for smaller code, which isn't always a win since unrolled loops can fold
+// to less code than the loop itself. Compile the regular program first and keep whichever of the two is smaller
+static bool _CompileShaderForSize(CafeGLSLCompiler* compiler, const char* shaderSource, CafeGLSLCompiler::SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG& flags, uint32_t& baselineNdw)
 {
-    if (!s_compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength))
+    const GLSL_COMPILER_FLAG baselineFlags = (GLSL_COMPILER_FLAG)(flags & ~GLSL_COMPILER_FLAG_OPTIMIZE_SIZE);
+    if (!compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, baselineFlags))
+    {
+        compiler->CleanupCurrentProgram();
+        return false;
+    }
+    GLSL_SHADER_STATS baselineStats;
+    compiler->GetShaderStats(baselineStats);
+    baselineNdw = baselineStats.optimized.ndw;
+    if (!compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags))
     {
-        s_compiler->CleanupCurrentProgram();
+        compiler->CleanupCurrentProgram();
         return false;
     }
+    GLSL_SHADER_STATS sizeStats;
+    compiler->GetShaderStats(sizeStats);
+    if (sizeStats.optimized.ndw > baselineStats.optimized.ndw)
+    {
+        flags = baselineFlags;
+        if (!compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags))
+        {
+            compiler->CleanupCurrentProgram();
+            return false;
+        }
+    }
     return true;
 }
 
-GX2VertexShader* _CompileVertexShader(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+bool _CompileShader(CafeGLSLCompiler* compiler, const char* shaderSource, CafeGLSLCompiler::SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
 {
-    if(!_CompileShader(shaderSource, CafeGLSLCompiler::SHADER_TYPE::VERTEX_SHADER, infoLogOut, infoLogMaxLength))
+    uint32_t sizeBaselineNdw = 0;
+    if (flags & GLSL_COMPILER_FLAG_OPTIMIZE_SIZE)
+    {
+        if (!_CompileShaderForSize(compiler, shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags, sizeBaselineNdw))
+            return false;
+    }
+    else if (!compiler->CompileGLSL(shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags))
+    {
+        compiler->CleanupCurrentProgram();
+        return false;
+    }
+    if (flags & GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS)
+    {
+        const CafeGLSLCompiler::AllocStats& stats = compiler->lastAllocStats;
+        DebugLog("Allocations: %llu heap, %llu arena, %llu linear. Peak heap usage: %lld bytes, %lld bytes retained until cleanup", (unsigned long long)stats.heapAllocCount,
+                 (unsigned long long)stats.arenaAllocCount, (unsigned long long)stats.linearAllocCount, (long long)stats.peakHeapBytes, (long long)stats.retainedHeapBytes);
+    }
+    compiler->GetShaderStats(compiler->lastShaderStats);
+    uint32_t gprBudget = compiler->options.gprBudget;
+    if (gprBudget != 0 && compiler->lastShaderStats.optimized.gprCount > gprBudget &&
+        !_CompileShaderForGprBudget(compiler, shaderSource, shaderType, infoLogOut, infoLogMaxLength, flags))
+        return false;
+    compiler->lastShaderStats.gprBudget = gprBudget;
+    compiler->lastShaderStats.sizeBaselineNdw = sizeBaselineNdw;
+    if (compiler->lastShaderStats.optimized.scratchSize != 0)
+        DebugLog("Indexed arrays use %u vec4 of scratch memory per thread%s", compiler->lastShaderStats.optimized.scratchSize,
+                 (flags & GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS) ? ", they don't fit into the GPR budget" : "");
+    compiler->hasShaderStats = true;
+    return true;
+}
+
+GX2VertexShader* _CompileVertexShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+{
+    if(!_CompileShader(compiler, shaderSource, CafeGLSLCompiler::SHADER_TYPE::VERTEX_SHADER, infoLogOut, infoLogMaxLength, flags))
         return nullptr;
     GX2VertexShader* vs = (GX2VertexShader*)malloc(sizeof(GX2VertexShader));
     memset(vs, 0, sizeof(GX2VertexShader));
     // init program data
     uint32_t* programPtr;
     uint32_t programSize;
-    s_compiler->GetShaderBytecode(programPtr, programSize);
-    vs->program = aligned_alloc(0x100, programSize);
-    memcpy(vs->program, programPtr, programSize);
+    compiler->GetShaderBytecode(programPtr, programSize);
+    vs->program = programPtr;
     vs->size = programSize;
 #ifdef __WUT__
     GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, vs->program, vs->size);
@@ -98,18 +221,18 @@ GX2VertexShader* _CompileVertexShader(const char* shaderSource, char* infoLogOut
     vs->mode = GX2_SHADER_MODE_UNIFORM_BLOCK;
     // set regs
     CafeGLSLCompiler::VSRegs vsRegs;
-    s_compiler->GetVertexShaderRegs(vsRegs);
+    compiler->GetVertexShaderRegs(vsRegs);
     memcpy(&vs->regs, &vsRegs, sizeof(vsRegs));
     // set vars
-    s_compiler->GetVertexShaderVars(vs);
+    compiler->GetVertexShaderVars(vs);
     // get disassembly if requested
     fprintf(stderr, "Shader compile flags: %08x\n", (unsigned int)flags);
     if(flags & GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY)
     {
-        s_compiler->PrintShaderDisassembly();
+        compiler->PrintShaderDisassembly();
     }
     // clean up
-    s_compiler->CleanupCurrentProgram();
+    compiler->CleanupCurrentProgram();
     // DEBUG
     /*
     DebugLog("_CompileVertexShader debug printing regs:");
@@ -121,18 +244,17 @@ GX2VertexShader* _CompileVertexShader(const char* shaderSource, char* infoLogOut
     return vs;
 }
 
-GX2PixelShader* _CompilePixelShader(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+GX2PixelShader* _CompilePixelShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
 {
-    if(!_CompileShader(shaderSource, CafeGLSLCompiler::SHADER_TYPE::PIXEL_SHADER, infoLogOut, infoLogMaxLength))
+    if(!_CompileShader(compiler, shaderSource, CafeGLSLCompiler::SHADER_TYPE::PIXEL_SHADER, infoLogOut, infoLogMaxLength, flags))
         return nullptr;
     GX2PixelShader* ps = (GX2PixelShader*)malloc(sizeof(GX2PixelShader));
     memset(ps, 0, sizeof(GX2PixelShader));
     // init program data
     uint32_t* programPtr;
     uint32_t programSize;
-    s_compiler->GetShaderBytecode(programPtr, programSize);
-    ps->program = aligned_alloc(0x100, programSize);
-    memcpy(ps->program, programPtr, programSize);
+    compiler->GetShaderBytecode(programPtr, programSize);
+    ps->program = programPtr;
     ps->size = programSize;
 #ifdef __WUT__
     GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, ps->program, ps->size);
@@ -140,17 +262,17 @@ GX2PixelShader* _CompilePixelShader(const char* shaderSource, char* infoLogOut,
     ps->mode = GX2_SHADER_MODE_UNIFORM_BLOCK;
     // set regs
     CafeGLSLCompiler::PSRegs psRegs;
-    s_compiler->GetPixelShaderRegs(psRegs);
+    compiler->GetPixelShaderRegs(psRegs);
     memcpy(&ps->regs, &psRegs, sizeof(psRegs));
     // set vars (uniform locations etc)
-    s_compiler->GetPixelShaderVars(ps);
+    compiler->GetPixelShaderVars(ps);
     // get disassembly if requested
     if(flags & GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY)
     {
-        s_compiler->PrintShaderDisassembly();
+        compiler->PrintShaderDisassembly();
     }
     // clean up
-    s_compiler->CleanupCurrentProgram();
+    compiler->CleanupCurrentProgram();
     // DEBUG
     /*
     DebugLog("_CompilePixelShader debug printing regs:");
@@ -199,6 +321,48 @@ void _FreePixelShader(GX2PixelShader* shader)
     free(shader);
 }
 
+void _SetUniformSpecializations(const GLSL_UNIFORM_SPECIALIZATION* specializations, uint32_t count)
+{
+    CafeGLSLCompiler::CompileOptions& options = s_compiler->options;
+    options.uniformSpecializations.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        CafeGLSLCompiler::UniformSpecialization spec;
+        spec.name = specializations[i].name;
+        spec.values.assign(specializations[i].values, specializations[i].values + specializations[i].valueCount);
+        options.uniformSpecializations.emplace_back(std::move(spec));
+    }
+    _SetPermutationWorkerOptions(options);
+}
+
+void _SetGprBudget(uint32_t gprCount)
+{
+    s_compiler->options.gprBudget = gprCount;
+    _SetPermutationWorkerOptions(s_compiler->options);
+}
+
+void _SetPixelShaderKey(const GLSL_PIXEL_SHADER_KEY* key)
+{
+    s_compiler->options.pixelShaderKey = key ? *key : GLSL_PIXEL_SHADER_KEY{};
+    _SetPermutationWorkerOptions(s_compiler->options);
+}
+
+bool _SetInclude(const char* path, const char* source)
+{
+    if (!s_compiler->SetInclude(path, source))
+        return false;
+    _SetPermutationWorkerOptions(s_compiler->options);
+    return true;
+}
+
+bool _GetLastShaderStats(GLSL_SHADER_STATS* stats)
+{
+    if (!s_compiler->hasShaderStats)
+        return false;
+    *stats = s_compiler->lastShaderStats;
+    return true;
+}
+
 void TestCompiler();
 
 #define API_EXPORT     __attribute__ ((__used__)) __attribute__ ((visibility ("default")))
@@ -222,12 +386,12 @@ extern "C"
 
     API_EXPORT GX2VertexShader* CompileVertexShader(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
     {
-       return _CompileVertexShader(shaderSource, infoLogOut, infoLogMaxLength, flags);
+       return _CompileVertexShader(s_compiler, shaderSource, infoLogOut, infoLogMaxLength, flags);
     }
 
     API_EXPORT GX2PixelShader* CompilePixelShader(const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
     {
-       return _CompilePixelShader(shaderSource, infoLogOut, infoLogMaxLength, flags);
+       return _CompilePixelShader(s_compiler, shaderSource, infoLogOut, infoLogMaxLength, flags);
     }
 
     API_EXPORT void FreeVertexShader(GX2VertexShader* shader)
@@ -240,6 +404,96 @@ extern "C"
         _FreePixelShader(shader);
     }
 
+    API_EXPORT GX2VertexShader** CompileVertexShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+    {
+        return _CompileVertexShaderPermutations(shaderSource, defineSets, defineSetCount, infoLogOut, infoLogMaxLength, flags);
+    }
+
+    API_EXPORT GX2PixelShader** CompilePixelShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+    {
+        return _CompilePixelShaderPermutations(shaderSource, defineSets, defineSetCount, infoLogOut, infoLogMaxLength, flags);
+    }
+
+    API_EXPORT void FreeVertexShaderPermutations(GX2VertexShader** shaderTable, uint32_t count)
+    {
+        _FreeVertexShaderPermutations(shaderTable, count);
+    }
+
+    API_EXPORT void FreePixelShaderPermutations(GX2PixelShader** shaderTable, uint32_t count)
+    {
+        _FreePixelShaderPermutations(shaderTable, count);
+    }
+
+    API_EXPORT void SetUniformSpecializations(const GLSL_UNIFORM_SPECIALIZATION* specializations, uint32_t count)
+    {
+        _SetUniformSpecializations(specializations, count);
+    }
+
+    API_EXPORT void SetGprBudget(uint32_t gprCount)
+    {
+        _SetGprBudget(gprCount);
+    }
+
+    API_EXPORT void SetPixelShaderKey(const GLSL_PIXEL_SHADER_KEY* key)
+    {
+        _SetPixelShaderKey(key);
+    }
+
+    API_EXPORT bool SetInclude(const char* path, const char* source)
+    {
+        return _SetInclude(path, source);
+    }
+
+    API_EXPORT GLSL_LOOKUP_TABLE* CreateVertexShaderLookupTable(const GX2VertexShader* shader)
+    {
+        return _CreateVertexShaderLookupTable(shader);
+    }
+
+    API_EXPORT GLSL_LOOKUP_TABLE* CreatePixelShaderLookupTable(const GX2PixelShader* shader)
+    {
+        return _CreatePixelShaderLookupTable(shader);
+    }
+
+    API_EXPORT void FreeLookupTable(GLSL_LOOKUP_TABLE* table)
+    {
+        _FreeLookupTable(table);
+    }
+
+    API_EXPORT const GLSL_LOOKUP_ENTRY* LookupShaderVar(const GLSL_LOOKUP_TABLE* table, GLSL_SHADER_VAR_KIND kind, const char* name)
+    {
+        return _LookupShaderVar(table, kind, name);
+    }
+
+    API_EXPORT bool GetLastShaderStats(GLSL_SHADER_STATS* stats)
+    {
+        return _GetLastShaderStats(stats);
+    }
+
+    API_EXPORT bool EstimateVertexShader(const GX2VertexShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing)
+    {
+        return _EstimateVertexShader(s_compiler, shader, estimate, printListing);
+    }
+
+    API_EXPORT bool EstimatePixelShader(const GX2PixelShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing)
+    {
+        return _EstimatePixelShader(s_compiler, shader, estimate, printListing);
+    }
+
+    API_EXPORT GLSL_RUN_RESULT* RunVertexShader(const GX2VertexShader* shader, const GLSL_RUN_INPUT* input)
+    {
+        return _RunVertexShader(s_compiler, shader, input);
+    }
+
+    API_EXPORT GLSL_RUN_RESULT* RunPixelShader(const GX2PixelShader* shader, const GLSL_RUN_INPUT* input)
+    {
+        return _RunPixelShader(s_compiler, shader, input);
+    }
+
+    API_EXPORT void FreeRunResult(GLSL_RUN_RESULT* result)
+    {
+        _FreeRunResult(result);
+    }
+
 #if defined(__WUT__)
     int rpl_entry(OSDynLoad_Module module, OSDynLoad_EntryReason reason)
     {
@@ -6,6 +6,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 #include "util/macros.h"
 #include "util/format/u_format.h"
@@ -73,6 +78,8 @@ size_t _strlcpy(char *dst, const char *src, size_t size)
 
 #define LATTE_FAMILY_CHIP CHIP_RV730
 #define LATTE_GFX_LEVEL R700
+#define MAX_ALLOCATABLE_GPRS 124 // the sfn register allocator leaves the top GPRs to the clause temporaries
+#define ARRAY_GPR_HEADROOM 16 // GPRs of the budget which indexed arrays kept in GPRs leave to the other values
 
 int posix_memalign(void **memptr, size_t alignment, size_t size)
 {
@@ -126,6 +133,9 @@ CafeGLSLCompiler::~CafeGLSLCompiler()
 	CleanupCurrentProgram();
 	r600Screen->b.b.destroy(&r600Screen->b.b); // also deletes r600Ctx and isa?
 	r600Screen = nullptr;
+	_mesa_destroy_shader_includes(glCtx->Shared);
+	simple_mtx_destroy(&glCtx->Shared->ShaderIncludeMutex);
+	free(glCtx->Shared);
 	free(this->glCtx);
 	free(stContext);
 	if(r600Ctx->sb_context)
@@ -149,9 +159,50 @@ pipe_shader_type GetMesaShaderType(CafeGLSLCompiler::SHADER_TYPE shaderType)
 	return MESA_SHADER_VERTEX;
 }
 
-bool CafeGLSLCompiler::CompileGLSL(const char *shaderSource, SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength)
+bool CafeGLSLCompiler::CompileGLSL(const char *shaderSource, SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
 {
 	CleanupCurrentProgram();
+	auto compileStart = std::chrono::steady_clock::now();
+	// ralloc only counts while it is asked to, the common compile doesn't pay for it. A failed compile leaves counting on until the next one
+	const bool collectAllocStats = (flags & GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS) != 0;
+	struct ralloc_stats allocStats;
+	if (collectAllocStats)
+		ralloc_reset_stats();
+	else
+		ralloc_stop_stats();
+	ralloc_get_stats(&allocStats);
+	int64_t startHeapBytes = allocStats.heap_bytes;
+	glCtx->Const.GLSLUseCompileArena = (flags & GLSL_COMPILER_FLAG_USE_COMPILE_ARENA) != 0;
+	r600Ctx->sched_flags = 0;
+	if (flags & GLSL_COMPILER_FLAG_PACK_ALU_GROUPS)
+		r600Ctx->sched_flags |= R600_SCHED_PACK_ALU_GROUPS;
+	if (flags & GLSL_COMPILER_FLAG_GROUP_KCACHE_LINES)
+		r600Ctx->sched_flags |= R600_SCHED_GROUP_KCACHE_LINES;
+	if (flags & GLSL_COMPILER_FLAG_HOIST_FETCHES)
+		r600Ctx->sched_flags |= R600_SCHED_HOIST_FETCHES;
+	// fewer clauses also means fewer CF instructions, so the size mode groups by cache lines too
+	const bool optimizeSize = (flags & GLSL_COMPILER_FLAG_OPTIMIZE_SIZE) != 0;
+	if (optimizeSize)
+		r600Ctx->sched_flags |= R600_SCHED_OPTIMIZE_SIZE | R600_SCHED_GROUP_KCACHE_LINES;
+	r600Screen->b.nir_options.optimize_size = optimizeSize;
+	r600Screen->b.nir_options_fs.optimize_size = optimizeSize;
+	if (registerPressureVariant.minimizeRegisters)
+		r600Ctx->sched_flags |= R600_SCHED_MIN_REGISTERS;
+	// leave some registers of the budget to the values outside of the arrays
+	const uint32_t maxGprs = options.gprBudget != 0 ? options.gprBudget : MAX_ALLOCATABLE_GPRS;
+	r600Ctx->max_array_gprs = 0;
+	if (flags & GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS)
+		r600Ctx->max_array_gprs = maxGprs > ARRAY_GPR_HEADROOM ? maxGprs - ARRAY_GPR_HEADROOM : 1;
+	r600Screen->b.debug_flags = registerPressureVariant.disableSb ? 0 : DBG_NIR_SB;
+	r600Ctx->ps_nr_cbufs = std::min<uint32_t>(options.pixelShaderKey.colorBufferCount, 8);
+	r600Ctx->ps_dual_source_blend = options.pixelShaderKey.dualSourceBlend != 0;
+	r600Ctx->ps_alpha_to_one = options.pixelShaderKey.alphaToOne != 0;
+	// every program is translated to exactly one variant, the backend can lower the NIR without cloning it
+	r600Ctx->nir_in_place = translateNirInPlace;
+	stContext->skip_default_variant = (flags & GLSL_COMPILER_FLAG_DIRECT_PIPELINE) != 0;
+	specializedWords.clear();
+	specializedUniforms.clear();
+	_SyncIncludes();
 	lastCompiledShaderType = shaderType;
 	pipe_shader_type mesaShaderType = GetMesaShaderType(shaderType);
 	shProg = _mesa_new_shader_program(0);
@@ -169,6 +220,9 @@ bool CafeGLSLCompiler::CompileGLSL(const char *shaderSource, SHADER_TYPE shaderT
 	/* compile */
 	_mesa_clear_shader_program_data(glCtx, shProg); // necessary?
 	_mesa_glsl_compile_shader(glCtx, shader, false, false, true);
+	lastPreprocessNanoseconds = shader->PreprocessNanoseconds;
+	static_assert(PREPROCESS_PASSTHROUGH == GLSL_PREPROCESS_PATH_PASSTHROUGH && PREPROCESS_CACHED == GLSL_PREPROCESS_PATH_CACHED);
+	lastPreprocessPath = (uint32_t)shader->PreprocessPath;
 
 	if (shader->CompileStatus != COMPILE_SUCCESS)
 	{
@@ -200,13 +254,33 @@ bool CafeGLSLCompiler::CompileGLSL(const char *shaderSource, SHADER_TYPE shaderT
 		return false;
 	}
 
+	if (stContext->skip_default_variant && !_CreateDirectPipeShader())
+	{
+		DebugLogNoFormat("Failed to translate the linked shader");
+		_strlcpy(infoLogOut, "Failed to translate the linked shader", infoLogMaxLength);
+		CleanupCurrentProgram();
+		return false;
+	}
+
+	lastAllocStats = {};
+	if (collectAllocStats)
+	{
+		ralloc_get_stats(&allocStats);
+		lastAllocStats.heapAllocCount = allocStats.malloc_count;
+		lastAllocStats.arenaAllocCount = allocStats.arena_count;
+		lastAllocStats.linearAllocCount = allocStats.linear_count;
+		lastAllocStats.peakHeapBytes = allocStats.peak_heap_bytes - startHeapBytes;
+		lastAllocStats.retainedHeapBytes = allocStats.heap_bytes - startHeapBytes;
+		ralloc_stop_stats();
+	}
+	lastCompileNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - compileStart).count();
 	return true;
 }
 
 static void GetShaderBinary(struct r600_pipe_shader *shader, uint32_t *&programPtr, uint32_t &programSize)
 {
 	programSize = shader->shader.bc.ndw * 4;
-	programPtr = (uint32_t *)align_calloc(programSize, 0x100); // use ExpDefaultHeap alloc here?
+	programPtr = (uint32_t *)aligned_alloc(0x100, programSize); // use ExpDefaultHeap alloc here?
 	if (R600_BIG_ENDIAN)
 	{
 		for (uint32_t i = 0; i < shader->shader.bc.ndw; ++i)
@@ -218,9 +292,66 @@ static void GetShaderBinary(struct r600_pipe_shader *shader, uint32_t *&programP
 	}
 }
 
+// hands the finalized NIR of the linked program straight to the r600 backend. Unlike st_precompile_shader_variant there
+// is no st variant, no CSO and the key is not derived from the bound state of the pipe context
+bool CafeGLSLCompiler::_CreateDirectPipeShader()
+{
+	gl_program* prog = GetCurrentGLProgram();
+	assert(prog->nir && !prog->variants && !directSelector);
+	pipe_shader_state state{};
+	state.type = PIPE_SHADER_IR_NIR;
+	state.ir.nir = prog->nir;
+	state.stream_output = prog->state.stream_output;
+	prog->nir = nullptr; // owned by the selector now
+	directSelector = r600_create_shader_selector(&r600Ctx->b.b, &state, GetMesaShaderType(lastCompiledShaderType));
+	union r600_shader_key key;
+	r600_shader_precompile_key(&r600Ctx->b.b, directSelector, &key);
+	return r600_create_shader_variant(&r600Ctx->b.b, directSelector, &key) == 0;
+}
+
+void CafeGLSLCompiler::ReleaseSharedCaches()
+{
+	_mesa_glsl_release_preprocess_cache();
+}
+
+bool CafeGLSLCompiler::SetInclude(const char* path, const char* source)
+{
+	if (!_mesa_set_shader_include(glCtx, path, source))
+		return false;
+	if (source)
+		registeredIncludes[path] = options.includes[path] = source;
+	else
+	{
+		registeredIncludes.erase(path);
+		options.includes.erase(path);
+	}
+	return true;
+}
+
+// the permutation workers only receive the options, bring the include tree of the context up to date with them
+void CafeGLSLCompiler::_SyncIncludes()
+{
+	if (registeredIncludes == options.includes)
+		return;
+	for (auto& it : registeredIncludes)
+	{
+		if (options.includes.find(it.first) == options.includes.end())
+			_mesa_set_shader_include(glCtx, it.first.c_str(), nullptr);
+	}
+	for (auto& it : options.includes)
+	{
+		auto registered = registeredIncludes.find(it.first);
+		if (registered == registeredIncludes.end() || registered->second != it.second)
+			_mesa_set_shader_include(glCtx, it.first.c_str(), it.second.c_str());
+	}
+	registeredIncludes = options.includes;
+}
+
 r600_pipe_shader* CafeGLSLCompiler::GetCurrentPipeShader()
 {
     assert(shProg->data->LinkStatus == LINKING_SUCCESS);
+    if (directSelector)
+        return directSelector->current;
     gl_linked_shader *shader = nullptr;
     for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
     {
@@ -256,6 +387,51 @@ bool CafeGLSLCompiler::GetShaderBytecode(uint32_t *&programPtr, uint32_t &progra
 	return true;
 }
 
+static void GetProgramStats(const struct r600_bytecode_stats& bcStats, GLSL_PROGRAM_STATS& stats)
+{
+	stats.ndw = bcStats.ndw;
+	stats.gprCount = bcStats.ngpr;
+	stats.stackSize = bcStats.nstack;
+	stats.cfCount = bcStats.ncf;
+	stats.aluClauseCount = bcStats.nalu_clauses;
+	stats.fetchClauseCount = bcStats.nfetch_clauses;
+	stats.aluCount = bcStats.nalu;
+	stats.aluGroupCount = bcStats.nalu_groups;
+	stats.literalCount = bcStats.nliterals;
+	stats.texCount = bcStats.ntex;
+	stats.vtxCount = bcStats.nvtx;
+	stats.kcacheSplitCount = bcStats.nkcache_splits;
+}
+
+void CafeGLSLCompiler::GetShaderStats(GLSL_SHADER_STATS& stats)
+{
+	struct r600_pipe_shader* pipeShader = GetCurrentPipeShader();
+	struct r600_bytecode* bc = &pipeShader->shader.bc;
+	if (bc->sb_optimized)
+	{
+		GetProgramStats(bc->sb_src_stats, stats.backend);
+		GetProgramStats(bc->sb_opt_stats, stats.optimized);
+		stats.sbOptimized = 1;
+	}
+	else
+	{
+		// without sb the cf list still describes the final program
+		struct r600_bytecode_stats bcStats;
+		r600_bytecode_collect_stats(bc, &bcStats);
+		GetProgramStats(bcStats, stats.backend);
+		stats.optimized = stats.backend;
+		stats.sbOptimized = 0;
+	}
+	// sb doesn't change the scratch layout
+	stats.backend.scratchSize = pipeShader->scratch_space_needed;
+	stats.optimized.scratchSize = pipeShader->scratch_space_needed;
+	stats.preprocessMicroseconds = (uint32_t)(lastPreprocessNanoseconds / 1000);
+	stats.preprocessPath = lastPreprocessPath;
+	stats.rematerializedCount = bc->nrematerialized;
+	stats.compileMicroseconds = (uint32_t)(lastCompileNanoseconds / 1000);
+	stats.sizeBaselineNdw = 0; // set by the caller which compiled the baseline
+}
+
 #ifdef __WUT__
 int _stderr_write_callback(struct _reent *r, void *, const char *data, int len)
 {
@@ -385,6 +561,11 @@ void CafeGLSLCompiler::_InitGLContext()
     const int CAFE_MAX_TEXTURE_UNITS_PER_STAGE = 18;
     const int CAFE_MAX_VERTEX_STREAMS = 32;
 
+    // only the shader include tree of the shared state is used
+    ctx->Shared = (gl_shared_state*)calloc(1, sizeof(gl_shared_state));
+    simple_mtx_init(&ctx->Shared->ShaderIncludeMutex, mtx_plain);
+    _mesa_init_shader_includes(ctx->Shared);
+
     // taken from the standalone compiler
 	ctx->Extensions.ARB_ES3_compatibility = true;
 	ctx->Extensions.ARB_ES3_1_compatibility = true;
@@ -789,6 +970,8 @@ void CafeGLSLCompiler::_InitStateContext()
 	glCtx->st = stContext;
 	stContext->ctx = glCtx;
 	stContext->screen = &r600Screen->b.b;
+	// each program is compiled into a single variant, st_finalize_program doesn't keep a serialized copy of the NIR
+	stContext->single_variant = true;
 
 	r600Ctx = (r600_context *)malloc(sizeof(r600_context));
 	memset(r600Ctx, 0, sizeof(r600_context));
@@ -809,10 +992,19 @@ void CafeGLSLCompiler::_InitStateContext()
 	memset(r600Isa, 0, sizeof(r600_isa));
 	r600Ctx->isa = r600Isa;
 	r600_isa_init(r600Ctx, r600Ctx->isa);
+
+	// uniform specialization is resolved by us since the backend has no access to the uniform names
+	r600Ctx->get_uniform_specializations = _GetUniformSpecializations;
+	r600Ctx->uniform_specialization_data = this;
 }
 
 void CafeGLSLCompiler::CleanupCurrentProgram()
 {
+	if (directSelector)
+	{
+		r600_delete_shader_selector(&r600Ctx->b.b, directSelector);
+		directSelector = nullptr;
+	}
 	if (!shProg)
 		return;
 	// free IR
@@ -1010,9 +1202,13 @@ void CafeGLSLCompiler::GetPixelShaderRegs(PSRegs& psRegs)
     /* cb_shader_mask */
 	psRegs.cb_shader_mask = rshader->ps_color_export_mask; // unsure
     /* cb_shader_control */
-	uint32_t multiwrite = rshader->nr_ps_color_exports > 1 ? 1 : 0;
-	psRegs.cb_shader_control = S_028808_MULTIWRITE_ENABLE(multiwrite); 
-	psRegs.cb_shader_control |= 1; // GX2 seems to set this. In Mesa this is documented as S_028808_FOG_ENABLE
+	// one RTn_ENABLE bit per exported color buffer
+	psRegs.cb_shader_control = S_0287A0_RT0_ENABLE(1); // GX2 always enables RT0
+	for (unsigned int i = 1; i < 8; i++)
+	{
+		if (rshader->ps_color_export_mask & (0xFu << (i * 4)))
+			psRegs.cb_shader_control |= S_0287A0_RT0_ENABLE(1) << i;
+	}
 	// more fields todo ?
     /* db_shader_control */
 	psRegs.db_shader_control = 0;
@@ -1214,6 +1410,149 @@ GX2ShaderVarType GetGX2TypeFromGLSLTypeInfo(glsl_base_type baseType, uint32_t ve
     return GX2_SHADER_VAR_TYPE_FLOAT;
 }
 
+// constant buffer indices as they appear in the NIR which is passed to the backend
+// see nir_lower_uniforms_to_ubo.c and gl_nir_lower_buffers.c
+#define CAFE_DEFAULT_BLOCK_BUFFER_INDEX (0x80 + 15)
+#define CAFE_UNIFORM_BLOCK_BUFFER_INDEX_BASE (0x80)
+
+void CafeGLSLCompiler::_GetUniformSpecializations(void* data, r600_uniform_specialization** list, unsigned* count)
+{
+    CafeGLSLCompiler* compiler = (CafeGLSLCompiler*)data;
+    compiler->ResolveUniformSpecializations();
+    *list = compiler->specializedWords.data();
+    *count = (unsigned)compiler->specializedWords.size();
+}
+
+// translate the specialized uniform names into the buffer words read by the shader
+// this runs during linking, right before the backend translates the shader
+void CafeGLSLCompiler::ResolveUniformSpecializations()
+{
+    specializedWords.clear();
+    specializedUniforms.clear();
+    if (options.uniformSpecializations.empty())
+        return;
+    gl_linked_shader* linkedShader = nullptr;
+    for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
+    {
+        if (shProg->_LinkedShaders[i])
+            linkedShader = shProg->_LinkedShaders[i];
+    }
+    assert(linkedShader);
+    gl_program* glProg = linkedShader->Program;
+
+    for (auto& spec : options.uniformSpecializations)
+    {
+        // uniform arrays may also be referenced by their first element
+        std::string name = spec.name;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            name.resize(name.size() - 3);
+        const gl_uniform_storage* uniform = nullptr;
+        for (unsigned i = 0; i < shProg->data->NumUniformStorage; i++)
+        {
+            if (strcmp(shProg->data->UniformStorage[i].name.string, name.c_str()) == 0)
+            {
+                uniform = &shProg->data->UniformStorage[i];
+                break;
+            }
+        }
+        if (!uniform)
+            continue; // not used by this shader
+        const glsl_type* type = uniform->type;
+        if (type->base_type != GLSL_TYPE_FLOAT && type->base_type != GLSL_TYPE_INT && type->base_type != GLSL_TYPE_UINT && type->base_type != GLSL_TYPE_BOOL)
+        {
+            DebugLog("Uniform specialization: %s has an unsupported type", spec.name.c_str());
+            continue;
+        }
+        uint32_t numRows = type->vector_elements;
+        uint32_t numColumns = type->matrix_columns;
+        uint32_t numElements = std::max(uniform->array_elements, 1u);
+        if (spec.values.size() != numRows * numColumns * numElements)
+        {
+            DebugLog("Uniform specialization: %s expects %u values but got %u", spec.name.c_str(), numRows * numColumns * numElements, (uint32_t)spec.values.size());
+            continue;
+        }
+
+        uint32_t bufferIndex;
+        uint32_t baseOffset;
+        uint32_t elementStride;
+        uint32_t columnStride;
+        uint32_t rowStride = 4;
+        if (uniform->block_index < 0)
+        {
+            // default block, uses the same layout as the uniform storage
+            if (uniform->num_driver_storage == 0)
+                continue;
+            const gl_uniform_driver_storage& storage = uniform->driver_storage[0];
+            bufferIndex = CAFE_DEFAULT_BLOCK_BUFFER_INDEX;
+            baseOffset = (uint32_t)((uint8_t*)storage.data - (uint8_t*)glProg->Parameters->ParameterValues);
+            elementStride = storage.element_stride;
+            columnStride = storage.vector_stride;
+        }
+        else
+        {
+            // uniform block member. Blocks with an instance name are indexed by their position in the program's block list
+            const gl_uniform_block* block = &shProg->data->UniformBlocks[uniform->block_index];
+            size_t blockNameLen = strlen(block->name.string);
+            bool hasInstanceName = strncmp(uniform->name.string, block->name.string, blockNameLen) == 0 && uniform->name.string[blockNameLen] == '.';
+            bufferIndex = block->Binding + CAFE_UNIFORM_BLOCK_BUFFER_INDEX_BASE;
+            if (hasInstanceName)
+            {
+                for (unsigned i = 0; i < glProg->info.num_ubos; i++)
+                {
+                    if (glProg->sh.UniformBlocks[i] == block)
+                        bufferIndex = i;
+                }
+            }
+            baseOffset = uniform->offset;
+            elementStride = uniform->array_stride;
+            columnStride = uniform->matrix_stride;
+            if (uniform->row_major)
+                std::swap(columnStride, rowStride);
+        }
+
+        SpecializedUniform specializedUniform;
+        specializedUniform.storage = uniform;
+        specializedUniform.firstWord = (uint32_t)specializedWords.size();
+        specializedUniform.wordCount = (uint32_t)spec.values.size();
+        specializedUniforms.emplace_back(specializedUniform);
+        uint32_t valueIndex = 0;
+        for (uint32_t e = 0; e < numElements; e++)
+        {
+            for (uint32_t c = 0; c < numColumns; c++)
+            {
+                for (uint32_t r = 0; r < numRows; r++)
+                {
+                    r600_uniform_specialization word{};
+                    word.buffer_index = bufferIndex;
+                    word.offset = baseOffset + e * elementStride + c * columnStride + r * rowStride;
+                    word.value = spec.values[valueIndex++];
+                    // default block booleans are stored the same way glUniform would store them
+                    if (type->base_type == GLSL_TYPE_BOOL && uniform->block_index < 0)
+                        word.value = word.value ? glCtx->Const.UniformBooleanTrue : 0;
+                    specializedWords.emplace_back(word);
+                }
+            }
+        }
+    }
+}
+
+// true if all accesses to the uniform were replaced with constants
+bool CafeGLSLCompiler::IsUniformSpecialized(const gl_uniform_storage* uniform)
+{
+    for (auto& specializedUniform : specializedUniforms)
+    {
+        if (specializedUniform.storage != uniform)
+            continue;
+        for (uint32_t i = 0; i < specializedUniform.wordCount; i++)
+        {
+            if (specializedWords[specializedUniform.firstWord + i].still_loaded)
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
 void CafeGLSLCompiler::GetShaderIOInfo(CafeShaderIOInfo& shaderIOInfo)
 {
     memset(&shaderIOInfo, 0, sizeof(CafeShaderIOInfo));
@@ -1376,7 +1715,7 @@ void CafeGLSLCompiler::GetShaderIOInfo(CafeShaderIOInfo& shaderIOInfo)
             {
                 int32_t uniformOffset = getUniformOffset(glProg, shProg, var);
 
-                if(uniformOffset >= 0)
+                if(uniformOffset >= 0 && !IsUniformSpecialized(var))
                 {
                     trackUniformVariable(shaderIOInfo, rname.string, uniformOffset, var->array_elements, -1, GetGX2TypeFromGLSLTypeInfo(var->type->base_type, var->type->vector_elements, var->type->matrix_columns));
                 }
@@ -1519,3 +1858,48 @@ void CafeGLSLCompiler::GetPixelShaderVarsDebug(GX2PixelShader* ps)
     // but these might be for dynamic binding?
 
 }*/
+
+double BenchmarkTypeLookups(uint32_t threadCount, uint32_t lookupsPerThread)
+{
+	glsl_type_singleton_init_or_ref();
+	// the first round creates the types, so the measured rounds only hit existing ones
+	const glsl_type* elementTypes[] = {glsl_type::float_type, glsl_type::vec4_type, glsl_type::ivec2_type, glsl_type::mat4_type};
+	auto lookupRound = [&](uint32_t seed) {
+		uintptr_t sum = 0;
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			uint32_t v = seed + i;
+			sum += (uintptr_t)glsl_type::get_array_instance(elementTypes[v & 3], 1 + (v >> 2) % 16);
+			sum += (uintptr_t)glsl_type::get_instance(GLSL_TYPE_FLOAT, 4, 2 + (v & 1) + (v & 2) / 2, 16 + (v & 4) * 4, (v & 8) != 0);
+		}
+		return sum;
+	};
+	for (uint32_t seed = 0; seed < 64; seed++)
+		lookupRound(seed);
+
+	std::atomic<uint32_t> readyCount{0};
+	std::atomic<bool> start{false};
+	std::atomic<uintptr_t> checksum{0};
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]() {
+			readyCount++;
+			while (!start.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			uintptr_t sum = 0;
+			for (uint32_t i = 0; i < lookupsPerThread / 128; i++)
+				sum += lookupRound(t * 7 + i);
+			checksum += sum;
+		});
+	}
+	while (readyCount.load() != threadCount)
+		std::this_thread::yield();
+	auto startTime = std::chrono::steady_clock::now();
+	start.store(true, std::memory_order_release);
+	for (auto& thread : threads)
+		thread.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+	glsl_type_singleton_decref();
+	return (double)(lookupsPerThread / 128 * 128) * threadCount / elapsed.count();
+}
@@ -1,4 +1,7 @@
 #include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
 #include "gx2_definitions.h"
 #include "CafeGLSLCompiler.h"
 
@@ -44,11 +47,43 @@ public:
         PIXEL_SHADER,
     };
 
+    struct UniformSpecialization
+    {
+        std::string name;
+        std::vector<uint32_t> values;
+    };
+
+    // ralloc statistics of a compile, see ralloc_get_stats
+    struct AllocStats
+    {
+        uint64_t heapAllocCount;
+        uint64_t arenaAllocCount;
+        uint64_t linearAllocCount;
+        int64_t peakHeapBytes; // relative to the heap usage at the start of the compile
+        int64_t retainedHeapBytes; // still owned when the compile returns, released by CleanupCurrentProgram
+    };
+
+    // settings which apply to every following compile
+    struct CompileOptions
+    {
+        std::vector<UniformSpecialization> uniformSpecializations;
+        uint32_t gprBudget{}; // 0 = no budget
+        GLSL_PIXEL_SHADER_KEY pixelShaderKey{}; // all zero = derived from the shader outputs
+        std::map<std::string, std::string> includes; // virtual include files by absolute path
+    };
+
+    // backend settings which trade code quality for fewer GPRs, used when a compile is above the GPR budget
+    struct RegisterPressureVariant
+    {
+        bool minimizeRegisters; // register pressure scheduling and rematerialization in the sfn scheduler
+        bool disableSb; // sb reschedules and reallocates registers on its own
+    };
+
 	CafeGLSLCompiler();
     ~CafeGLSLCompiler();
 
-    bool CompileGLSL(const char *shaderSource, SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength);
-    bool GetShaderBytecode(uint32_t *&programPtr, uint32_t &programSize);
+    bool CompileGLSL(const char *shaderSource, SHADER_TYPE shaderType, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags = GLSL_COMPILER_FLAG_NONE);
+    bool GetShaderBytecode(uint32_t *&programPtr, uint32_t &programSize); // programPtr is allocated with aligned_alloc and owned by the caller
     void PrintShaderDisassembly(); // outputs to stderr
 
     void GetVertexShaderRegs(VSRegs& vsRegs);
@@ -57,6 +92,14 @@ public:
     void GetVertexShaderVars(GX2VertexShader *vs);
     void GetPixelShaderVars(GX2PixelShader* ps);
 
+    void GetShaderStats(GLSL_SHADER_STATS& stats);
+
+    // adds, replaces or with source nullptr removes a virtual include file. Returns false if the path is invalid
+    bool SetInclude(const char* path, const char* source);
+
+    // frees the preprocessor output cached across compiles. The cache is shared by all instances, only call this once the last one is gone
+    static void ReleaseSharedCaches();
+
 
 
     void CleanupCurrentProgram();
@@ -68,9 +111,25 @@ private:
 
     void GetShaderIOInfo(struct CafeShaderIOInfo& shaderIOInfo);
 
+    bool _CreateDirectPipeShader();
+    void _SyncIncludes();
     struct r600_pipe_shader* GetCurrentPipeShader();
 	struct gl_program* GetCurrentGLProgram();
 
+    // uniform specialization
+    static void _GetUniformSpecializations(void* data, struct r600_uniform_specialization** list, unsigned* count);
+    void ResolveUniformSpecializations();
+    bool IsUniformSpecialized(const struct gl_uniform_storage* uniform);
+
+    struct SpecializedUniform
+    {
+        const struct gl_uniform_storage* storage;
+        uint32_t firstWord;
+        uint32_t wordCount;
+    };
+    std::vector<struct r600_uniform_specialization> specializedWords; // passed to the backend
+    std::vector<SpecializedUniform> specializedUniforms;
+
 public:
 	SHADER_TYPE lastCompiledShaderType{};
 	// GLSL
@@ -84,5 +143,19 @@ public:
 	struct st_context* stContext;
 	// shader
 	struct gl_shader_program* shProg{};
+	struct r600_pipe_shader_selector* directSelector{}; // set if the program was compiled with GLSL_COMPILER_FLAG_DIRECT_PIPELINE
+	CompileOptions options;
+	std::map<std::string, std::string> registeredIncludes; // include files of the GL context, updated from options.includes on compile
+	RegisterPressureVariant registerPressureVariant{}; // applies to the next CompileGLSL
+	AllocStats lastAllocStats{}; // of the last successful CompileGLSL
+	uint64_t lastPreprocessNanoseconds{}; // of the last successful CompileGLSL
+	uint32_t lastPreprocessPath{}; // GLSL_PREPROCESS_PATH
+	uint64_t lastCompileNanoseconds{};
+	GLSL_SHADER_STATS lastShaderStats{}; // of the last shader compiled through the API
+	bool hasShaderStats{};
+	bool translateNirInPlace{true}; // the r600 backend lowers the NIR of the program instead of a clone. Produces the same code
 };
 
+// type registry microbenchmark. Every thread looks up the same existing array and explicit stride matrix types
+// returns the combined lookups per second
+double BenchmarkTypeLookups(uint32_t threadCount, uint32_t lookupsPerThread);
@@ -0,0 +1,385 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+
+struct CorpusMetric
+{
+    const char* name;
+    uint32_t GLSL_PROGRAM_STATS::*field;
+};
+
+// lower is better for all of them
+static const CorpusMetric kCorpusMetrics[] =
+{
+    {"ndw", &GLSL_PROGRAM_STATS::ndw},
+    {"gpr", &GLSL_PROGRAM_STATS::gprCount},
+    {"stack", &GLSL_PROGRAM_STATS::stackSize},
+    {"cf", &GLSL_PROGRAM_STATS::cfCount},
+    {"alu_clauses", &GLSL_PROGRAM_STATS::aluClauseCount},
+    {"fetch_clauses", &GLSL_PROGRAM_STATS::fetchClauseCount},
+    {"alu", &GLSL_PROGRAM_STATS::aluCount},
+    {"alu_groups", &GLSL_PROGRAM_STATS::aluGroupCount},
+    {"literals", &GLSL_PROGRAM_STATS::literalCount},
+    {"tex", &GLSL_PROGRAM_STATS::texCount},
+    {"vtx", &GLSL_PROGRAM_STATS::vtxCount},
+    {"kcache_splits", &GLSL_PROGRAM_STATS::kcacheSplitCount},
+    {"scratch", &GLSL_PROGRAM_STATS::scratchSize},
+};
+
+// the optimized program is what runs on the GPU, the backend numbers show what sb had to work with
+static const char* kBackendPrefix = "src_";
+
+static bool EndsWith(const std::string& str, const char* suffix)
+{
+    size_t len = strlen(suffix);
+    return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+static void CollectCorpusFiles(const std::string& directory, const std::string& relativePath, std::vector<std::string>& files)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> entries;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        entries.emplace_back(entry->d_name);
+    }
+    closedir(dir);
+    // sorted so that stats files of different runs can be diffed as text too
+    std::sort(entries.begin(), entries.end());
+    for (const auto& entry : entries)
+    {
+        std::string path = directory + "/" + entry;
+        std::string name = relativePath.empty() ? entry : relativePath + "/" + entry;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            CollectCorpusFiles(path, name, files);
+        else
+            files.emplace_back(name);
+    }
+}
+
+bool CompileShaderCorpus(const std::string& directory, GLSL_COMPILER_FLAG flags, std::vector<CorpusShaderStats>& results, std::vector<std::string>& failedShaders, std::string& error)
+{
+    struct stat st;
+    if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        error = "Corpus directory not found: " + directory;
+        return false;
+    }
+    std::vector<std::string> files;
+    CollectCorpusFiles(directory, "", files);
+    char infoLogBuffer[1024];
+    for (const auto& name : files)
+    {
+        bool isVertexShader = EndsWith(name, ".vs") || EndsWith(name, ".vert");
+        bool isPixelShader = EndsWith(name, ".ps") || EndsWith(name, ".fs") || EndsWith(name, ".frag");
+        if (!isVertexShader && !isPixelShader)
+            continue;
+        std::ifstream file(directory + "/" + name);
+        if (!file.is_open())
+        {
+            failedShaders.emplace_back(name);
+            continue;
+        }
+        std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        CorpusShaderStats shaderStats{name, {}};
+        bool compiled;
+        if (isVertexShader)
+        {
+            GX2VertexShader* vs = GLSL_CompileVertexShader(source.c_str(), infoLogBuffer, sizeof(infoLogBuffer), flags);
+            compiled = vs && GLSL_GetLastShaderStats(&shaderStats.stats);
+            if (vs)
+                GLSL_FreeVertexShader(vs);
+        }
+        else
+        {
+            GX2PixelShader* ps = GLSL_CompilePixelShader(source.c_str(), infoLogBuffer, sizeof(infoLogBuffer), flags);
+            compiled = ps && GLSL_GetLastShaderStats(&shaderStats.stats);
+            if (ps)
+                GLSL_FreePixelShader(ps);
+        }
+        if (!compiled)
+        {
+            failedShaders.emplace_back(name);
+            continue;
+        }
+        results.emplace_back(std::move(shaderStats));
+    }
+    return true;
+}
+
+bool WriteCorpusStats(const std::string& path, const std::vector<CorpusShaderStats>& results)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+    file << "shader\tsb";
+    for (const auto& metric : kCorpusMetrics)
+        file << "\t" << metric.name;
+    for (const auto& metric : kCorpusMetrics)
+        file << "\t" << kBackendPrefix << metric.name;
+    file << "\n";
+    for (const auto& result : results)
+    {
+        file << result.name << "\t" << result.stats.sbOptimized;
+        for (const auto& metric : kCorpusMetrics)
+            file << "\t" << result.stats.optimized.*metric.field;
+        for (const auto& metric : kCorpusMetrics)
+            file << "\t" << result.stats.backend.*metric.field;
+        file << "\n";
+    }
+    return file.good();
+}
+
+static std::vector<std::string> SplitTabs(const std::string& line)
+{
+    std::vector<std::string> columns;
+    std::istringstream lineStream(line);
+    std::string column;
+    while (std::getline(lineStream, column, '\t'))
+        columns.emplace_back(column);
+    return columns;
+}
+
+bool ReadCorpusStats(const std::string& path, std::vector<CorpusShaderStats>& results, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        error = "Failed to open stats file: " + path;
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    std::vector<std::string> header = SplitTabs(line);
+    if (header.empty() || header[0] != "shader")
+    {
+        error = "Not a stats file: " + path;
+        return false;
+    }
+    // map each column to a field, unknown columns are skipped
+    std::vector<uint32_t GLSL_PROGRAM_STATS::*> fields(header.size(), nullptr);
+    std::vector<bool> isBackend(header.size(), false);
+    for (size_t i = 1; i < header.size(); i++)
+    {
+        std::string name = header[i];
+        if (name.compare(0, strlen(kBackendPrefix), kBackendPrefix) == 0)
+        {
+            name = name.substr(strlen(kBackendPrefix));
+            isBackend[i] = true;
+        }
+        for (const auto& metric : kCorpusMetrics)
+        {
+            if (name == metric.name)
+                fields[i] = metric.field;
+        }
+    }
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> columns = SplitTabs(line);
+        if (columns.empty() || columns[0].empty())
+            continue;
+        CorpusShaderStats result{columns[0], {}};
+        for (size_t i = 1; i < columns.size() && i < header.size(); i++)
+        {
+            uint32_t value = (uint32_t)strtoul(columns[i].c_str(), nullptr, 10);
+            if (header[i] == "sb")
+                result.stats.sbOptimized = value;
+            else if (fields[i])
+            {
+                GLSL_PROGRAM_STATS& programStats = isBackend[i] ? result.stats.backend : result.stats.optimized;
+                programStats.*fields[i] = value;
+            }
+        }
+        results.emplace_back(std::move(result));
+    }
+    return true;
+}
+
+static std::string FormatDelta(uint64_t before, uint64_t after)
+{
+    char buffer[64];
+    if (before == 0)
+        snprintf(buffer, sizeof(buffer), "%s", after == 0 ? "+0.00%" : "n/a");
+    else
+        snprintf(buffer, sizeof(buffer), "%+.2f%%", ((double)after - (double)before) * 100.0 / (double)before);
+    return buffer;
+}
+
+static double AverageSlots(uint64_t aluCount, uint64_t aluGroupCount)
+{
+    return aluGroupCount ? (double)aluCount / (double)aluGroupCount : 0.0;
+}
+
+struct CorpusMetricTotals
+{
+    uint64_t before{};
+    uint64_t after{};
+    uint32_t helped{};
+    uint32_t hurt{};
+};
+
+uint32_t PrintCorpusStatsDiff(const std::vector<CorpusShaderStats>& baseline, const std::vector<CorpusShaderStats>& results)
+{
+    std::map<std::string, const GLSL_SHADER_STATS*> baselineByName;
+    for (const auto& entry : baseline)
+        baselineByName[entry.name] = &entry.stats;
+
+    const size_t metricCount = sizeof(kCorpusMetrics) / sizeof(kCorpusMetrics[0]);
+    std::vector<CorpusMetricTotals> optimizedTotals(metricCount), backendTotals(metricCount);
+    std::vector<std::string> newShaders;
+    uint32_t comparedCount = 0;
+    uint32_t hurtShaders = 0;
+    uint32_t helpedShaders = 0;
+    for (const auto& result : results)
+    {
+        auto it = baselineByName.find(result.name);
+        if (it == baselineByName.end())
+        {
+            newShaders.emplace_back(result.name);
+            continue;
+        }
+        const GLSL_SHADER_STATS& before = *it->second;
+        baselineByName.erase(it);
+        comparedCount++;
+        std::string changes;
+        bool hurt = false;
+        bool helped = false;
+        for (size_t i = 0; i < metricCount; i++)
+        {
+            const CorpusMetric& metric = kCorpusMetrics[i];
+            uint32_t b = before.optimized.*metric.field;
+            uint32_t a = result.stats.optimized.*metric.field;
+            optimizedTotals[i].before += b;
+            optimizedTotals[i].after += a;
+            if (a != b)
+            {
+                (a > b ? optimizedTotals[i].hurt : optimizedTotals[i].helped)++;
+                (a > b ? hurt : helped) = true;
+                char buffer[128];
+                snprintf(buffer, sizeof(buffer), "%s%s %u -> %u (%s)", changes.empty() ? "" : ", ", metric.name, b, a, FormatDelta(b, a).c_str());
+                changes += buffer;
+            }
+            uint32_t backendBefore = before.backend.*metric.field;
+            uint32_t backendAfter = result.stats.backend.*metric.field;
+            backendTotals[i].before += backendBefore;
+            backendTotals[i].after += backendAfter;
+            if (backendAfter != backendBefore)
+                (backendAfter > backendBefore ? backendTotals[i].hurt : backendTotals[i].helped)++;
+        }
+        if (before.sbOptimized != result.stats.sbOptimized)
+        {
+            changes += changes.empty() ? "" : ", ";
+            changes += result.stats.sbOptimized ? "now optimized by sb" : "no longer optimized by sb";
+        }
+        if (!changes.empty())
+            printf("%s: %s\n", result.name.c_str(), changes.c_str());
+        hurtShaders += hurt ? 1 : 0;
+        helpedShaders += (helped && !hurt) ? 1 : 0;
+    }
+
+    printf("\nTotals of %u shaders in both sets (%u helped, %u with at least one worse metric):\n", comparedCount, helpedShaders, hurtShaders);
+    printf("%-20s %12s %12s %10s %8s %8s\n", "metric", "baseline", "current", "delta", "helped", "hurt");
+    auto printTotals = [&](const char* prefix, const std::vector<CorpusMetricTotals>& totals)
+    {
+        for (size_t i = 0; i < metricCount; i++)
+        {
+            std::string name = std::string(prefix) + kCorpusMetrics[i].name;
+            printf("%-20s %12llu %12llu %10s %8u %8u\n", name.c_str(), (unsigned long long)totals[i].before, (unsigned long long)totals[i].after,
+                   FormatDelta(totals[i].before, totals[i].after).c_str(), totals[i].helped, totals[i].hurt);
+        }
+    };
+    printTotals("", optimizedTotals);
+    printTotals(kBackendPrefix, backendTotals);
+
+    size_t aluIndex = 0, aluGroupIndex = 0;
+    for (size_t i = 0; i < metricCount; i++)
+    {
+        if (kCorpusMetrics[i].field == &GLSL_PROGRAM_STATS::aluCount)
+            aluIndex = i;
+        else if (kCorpusMetrics[i].field == &GLSL_PROGRAM_STATS::aluGroupCount)
+            aluGroupIndex = i;
+    }
+    auto printSlotsPerGroup = [&](const char* prefix, const std::vector<CorpusMetricTotals>& totals)
+    {
+        std::string name = std::string(prefix) + "alu_per_group";
+        printf("%-20s %12.3f %12.3f\n", name.c_str(), AverageSlots(totals[aluIndex].before, totals[aluGroupIndex].before),
+               AverageSlots(totals[aluIndex].after, totals[aluGroupIndex].after));
+    };
+    printSlotsPerGroup("", optimizedTotals);
+    printSlotsPerGroup(kBackendPrefix, backendTotals);
+
+    if (!newShaders.empty())
+    {
+        printf("\nNot in baseline:\n");
+        for (const auto& name : newShaders)
+            printf("  %s\n", name.c_str());
+    }
+    if (!baselineByName.empty())
+    {
+        printf("\nMissing compared to baseline:\n");
+        for (const auto& entry : baselineByName)
+            printf("  %s\n", entry.first.c_str());
+    }
+    return hurtShaders;
+}
+
+void PrintCorpusAluPacking(const std::vector<CorpusShaderStats>& results)
+{
+    uint64_t aluCount = 0, aluGroupCount = 0, backendAluCount = 0, backendAluGroupCount = 0;
+    for (const auto& result : results)
+    {
+        aluCount += result.stats.optimized.aluCount;
+        aluGroupCount += result.stats.optimized.aluGroupCount;
+        backendAluCount += result.stats.backend.aluCount;
+        backendAluGroupCount += result.stats.backend.aluGroupCount;
+    }
+    printf("ALU slots per group: %.3f in %llu groups (backend %.3f in %llu groups)\n",
+           AverageSlots(aluCount, aluGroupCount), (unsigned long long)aluGroupCount,
+           AverageSlots(backendAluCount, backendAluGroupCount), (unsigned long long)backendAluGroupCount);
+}
+
+void PrintCorpusCompileTime(const std::vector<CorpusShaderStats>& results)
+{
+    uint64_t compileMicroseconds = 0, preprocessMicroseconds = 0;
+    for (const auto& result : results)
+    {
+        compileMicroseconds += result.stats.compileMicroseconds;
+        preprocessMicroseconds += result.stats.preprocessMicroseconds;
+    }
+    printf("Compile time: %.3f ms, preprocessing %.3f ms (%.1f%%)\n", compileMicroseconds / 1000.0, preprocessMicroseconds / 1000.0,
+           compileMicroseconds ? preprocessMicroseconds * 100.0 / compileMicroseconds : 0.0);
+}
+
+void PrintCorpusSizeReduction(const std::vector<CorpusShaderStats>& results)
+{
+    uint64_t baselineNdw = 0, optimizedNdw = 0;
+    uint32_t smallerCount = 0;
+    for (const auto& result : results)
+    {
+        if (result.stats.sizeBaselineNdw == 0)
+            continue;
+        baselineNdw += result.stats.sizeBaselineNdw;
+        optimizedNdw += result.stats.optimized.ndw;
+        if (result.stats.optimized.ndw < result.stats.sizeBaselineNdw)
+            smallerCount++;
+    }
+    if (baselineNdw == 0)
+        return;
+    printf("Program size: %llu dwords, %llu without size optimization (%.1f%%), %u shaders smaller\n", (unsigned long long)optimizedNdw,
+           (unsigned long long)baselineNdw, (optimizedNdw * 100.0 / baselineNdw) - 100.0, smallerCount);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gx2_definitions.h"
+#include "CafeGLSLCompiler.h"
+
+// codegen quality tracking. A corpus of shaders is compiled and the metrics of every program are stored in a stats file
+// which can be compared against the stats of a previous compiler version
+
+struct CorpusShaderStats
+{
+    std::string name; // path relative to the corpus directory
+    GLSL_SHADER_STATS stats;
+};
+
+// compiles every .vs/.vert (vertex) and .ps/.fs/.frag (pixel) file below the directory. Shaders which fail to compile are added to failedShaders
+bool CompileShaderCorpus(const std::string& directory, GLSL_COMPILER_FLAG flags, std::vector<CorpusShaderStats>& results, std::vector<std::string>& failedShaders, std::string& error);
+
+// tab separated with a header line. Columns are matched by name when reading so older files stay comparable
+bool WriteCorpusStats(const std::string& path, const std::vector<CorpusShaderStats>& results);
+bool ReadCorpusStats(const std::string& path, std::vector<CorpusShaderStats>& results, std::string& error);
+
+// prints per shader and aggregate deltas to stdout. Returns the number of shaders with at least one worse metric
+uint32_t PrintCorpusStatsDiff(const std::vector<CorpusShaderStats>& baseline, const std::vector<CorpusShaderStats>& results);
+
+// prints the average number of used slots per ALU group (out of 5) of the optimized and the backend programs
+void PrintCorpusAluPacking(const std::vector<CorpusShaderStats>& results);
+
+// prints the total compile time of the corpus and the part of it spent in the preprocessor. Timings are not part of the stats file
+void PrintCorpusCompileTime(const std::vector<CorpusShaderStats>& results);
+
+// with GLSL_COMPILER_FLAG_OPTIMIZE_SIZE, prints the total program size of the corpus against the size of the regular compiles
+void PrintCorpusSizeReduction(const std::vector<CorpusShaderStats>& results);
@@ -0,0 +1,359 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "cafe_glsl_compiler.h"
+
+#include "gallium/drivers/r600/r600_isa.h"
+#include "gallium/drivers/r600/r700_sq.h"
+
+// static performance estimate of a final program
+// the program is decoded from the shader binary since sb rebuilds the bytecode and the backend's cf lists no longer match it
+// all costs are per wavefront of 64 threads on one SIMD. The numbers approximate the R700 shader core Latte is based on
+// and are meant for ranking variants of a shader against each other, not for predicting absolute timings
+
+static const uint32_t kAluSrcLiteral = 253; // V_SQ_ALU_SRC_LITERAL
+
+static const uint32_t kAluGroupCycles = 4; // 16 VLIW5 units per SIMD
+static const uint32_t kFetchCycles = 16; // 4 texture units per SIMD
+static const uint32_t kClauseIssueCycles = 4; // every CF instruction
+static const uint32_t kExportCycles = 4; // per exported register
+static const uint32_t kClauseSwitchLatency = 40; // switching between ALU and fetch clauses
+static const uint32_t kFetchLatency = 160; // until the results of a fetch clause are available
+static const uint32_t kKcacheLoadLatency = 40; // per constant cache line locked by an ALU clause
+
+// occupancy
+static const uint32_t kGprsPerSimd = 256;
+static const uint32_t kClauseTempGprs = 8; // 4 clause temporaries for each of the two wavefronts executing ALU clauses
+static const uint32_t kMaxWavefronts = 16;
+
+struct KcacheLine
+{
+    uint32_t bank;
+    uint32_t line;
+
+    bool operator==(const KcacheLine& other) const { return bank == other.bank && line == other.line; }
+};
+
+class ProgramEstimator
+{
+public:
+    ProgramEstimator(struct r600_isa* isa, const void* program, uint32_t size, bool printListing)
+        : isa(isa), program((const uint8_t*)program), ndw(size / 4), printListing(printListing) {}
+
+    bool Run(uint32_t gprCount, GLSL_PROGRAM_ESTIMATE& estimate);
+
+private:
+    uint32_t Dword(uint32_t i) const // programs are stored little-endian
+    {
+        const uint8_t* p = program + i * 4;
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    bool EstimateAluClause(uint32_t addr, uint32_t slotCount, uint32_t& groupCount);
+    bool EstimateFetchClause(uint32_t cfOp, uint32_t addr, uint32_t fetchCount);
+    void LockKcache(uint32_t w0, uint32_t w1, uint32_t& loadCount);
+
+    struct r600_isa* isa;
+    const uint8_t* program;
+    uint32_t ndw;
+    bool printListing;
+
+    GLSL_PROGRAM_ESTIMATE est{};
+    std::vector<KcacheLine> kcacheLines; // held by the last ALU clause
+};
+
+static bool LookupCfOp(struct r600_isa* isa, uint32_t opcode, bool isAlu, uint32_t& op)
+{
+    uint32_t index = isAlu ? opcode + 0x80 : opcode;
+    if (index >= 256 || isa->cf_map[index] == 0)
+        return false;
+    op = isa->cf_map[index] - 1;
+    return true;
+}
+
+static bool LookupAluOp(struct r600_isa* isa, uint32_t opcode, bool isOp3, uint32_t& op)
+{
+    const unsigned* map = isOp3 ? isa->alu_op3_map : isa->alu_op2_map;
+    if (opcode >= 256 || map[opcode] == 0)
+        return false;
+    op = map[opcode] - 1;
+    return true;
+}
+
+void ProgramEstimator::LockKcache(uint32_t w0, uint32_t w1, uint32_t& loadCount)
+{
+    std::vector<KcacheLine> lines;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        uint32_t mode = i == 0 ? G_SQ_CF_ALU_WORD0_KCACHE_MODE0(w0) : G_SQ_CF_ALU_WORD1_KCACHE_MODE1(w1);
+        uint32_t bank = i == 0 ? G_SQ_CF_ALU_WORD0_KCACHE_BANK0(w0) : G_SQ_CF_ALU_WORD0_KCACHE_BANK1(w0);
+        uint32_t addr = i == 0 ? G_SQ_CF_ALU_WORD1_KCACHE_ADDR0(w1) : G_SQ_CF_ALU_WORD1_KCACHE_ADDR1(w1);
+        if (mode == 0)
+            continue;
+        // lock_1 holds one line of 16 constants, lock_2 and lock_loop_index hold two
+        for (uint32_t l = 0; l < (mode == 1 ? 1u : 2u); l++)
+            lines.push_back({bank, addr + l});
+    }
+    loadCount = 0;
+    for (const auto& line : lines)
+    {
+        if (std::find(kcacheLines.begin(), kcacheLines.end(), line) == kcacheLines.end())
+            loadCount++;
+    }
+    kcacheLines = std::move(lines);
+}
+
+bool ProgramEstimator::EstimateAluClause(uint32_t addr, uint32_t slotCount, uint32_t& groupCount)
+{
+    uint32_t end = addr + slotCount * 2;
+    if (end > ndw)
+        return false;
+    groupCount = 0;
+    uint32_t i = addr;
+    while (i < end)
+    {
+        bool slotUsed[5]{};
+        uint32_t literalCount = 0;
+        std::string opNames;
+        bool last = false;
+        while (!last)
+        {
+            if (i + 2 > end)
+                return false;
+            uint32_t w0 = Dword(i);
+            uint32_t w1 = Dword(i + 1);
+            i += 2;
+            last = G_SQ_ALU_WORD0_LAST(w0);
+            bool isOp3 = G_SQ_ALU_WORD1_ENCODING(w1) != 0;
+            uint32_t op;
+            if (!LookupAluOp(isa, isOp3 ? G_SQ_ALU_WORD1_OP3_ALU_INST(w1) : G_SQ_ALU_WORD1_OP2_ALU_INST(w1), isOp3, op))
+                return false;
+            // same slot assignment as the hardware: vector slots by destination channel, the rest goes to the trans unit
+            uint32_t chan = G_SQ_ALU_WORD1_DST_CHAN(w1);
+            uint32_t slot = (!(r600_isa_alu_slots(isa->hw_class, op) & AF_V) || slotUsed[chan]) ? 4 : chan;
+            if (slotUsed[slot])
+                return false;
+            slotUsed[slot] = true;
+            est.aluSlotCount++;
+            if (slot == 4)
+                est.transCount++;
+            uint32_t srcSel[3] = {G_SQ_ALU_WORD0_SRC0_SEL(w0), G_SQ_ALU_WORD0_SRC1_SEL(w0), isOp3 ? G_SQ_ALU_WORD1_OP3_SRC2_SEL(w1) : 0};
+            uint32_t srcChan[3] = {G_SQ_ALU_WORD0_SRC0_CHAN(w0), G_SQ_ALU_WORD0_SRC1_CHAN(w0), G_SQ_ALU_WORD1_OP3_SRC2_CHAN(w1)};
+            for (uint32_t s = 0; s < (uint32_t)std::min(r600_isa_alu(op)->src_count, 3); s++)
+            {
+                if (srcSel[s] == kAluSrcLiteral)
+                    literalCount = std::max(literalCount, srcChan[s] + 1);
+            }
+            if (printListing)
+            {
+                opNames += " ";
+                opNames += "xyzwt"[slot];
+                opNames += ":";
+                opNames += r600_isa_alu(op)->name;
+            }
+        }
+        // literals follow the group, padded to a full slot
+        i += (literalCount + 1) & ~1u;
+        est.literalCount += literalCount;
+        if (printListing)
+        {
+            char slotMap[6];
+            for (uint32_t s = 0; s < 5; s++)
+                slotMap[s] = slotUsed[s] ? "xyzwt"[s] : '.';
+            slotMap[5] = '\0';
+            fprintf(stderr, "        %4u  %s  lit %u %s\n", groupCount, slotMap, literalCount, opNames.c_str());
+        }
+        groupCount++;
+    }
+    return i == end;
+}
+
+bool ProgramEstimator::EstimateFetchClause(uint32_t cfOp, uint32_t addr, uint32_t fetchCount)
+{
+    // fetch instructions are 128 bits wide
+    if (addr + fetchCount * 4 > ndw)
+        return false;
+    bool isVtx = cfOp == CF_OP_VTX || cfOp == CF_OP_VTX_TC;
+    if (isVtx)
+        est.vtxCount += fetchCount;
+    else
+        est.texCount += fetchCount;
+    if (printListing)
+    {
+        for (uint32_t f = 0; f < fetchCount; f++)
+        {
+            uint32_t w0 = Dword(addr + f * 4);
+            const char* name = "VFETCH";
+            if (!isVtx)
+            {
+                uint32_t opcode = G_SQ_TEX_WORD0_TEX_INST(w0);
+                name = isa->fetch_map[opcode] ? r600_isa_fetch(isa->fetch_map[opcode] - 1)->name : "???";
+            }
+            fprintf(stderr, "        %4u  %s R%u\n", f, name, isVtx ? G_SQ_VTX_WORD1_GPR_DST_GPR(Dword(addr + f * 4 + 1)) : G_SQ_TEX_WORD1_DST_GPR(Dword(addr + f * 4 + 1)));
+        }
+    }
+    return true;
+}
+
+bool ProgramEstimator::Run(uint32_t gprCount, GLSL_PROGRAM_ESTIMATE& estimate)
+{
+    est = {};
+    kcacheLines.clear();
+    est.gprCount = gprCount;
+    uint32_t fetchClauseCount = 0;
+    uint32_t kcacheLoadCount = 0;
+    int lastClauseType = -1; // 0 ALU, 1 fetch
+    bool endOfProgram = false;
+    // the CF program ends where the first clause starts
+    uint32_t cfEnd = ndw;
+    if (printListing)
+        fprintf(stderr, "Estimate per wavefront of 64 threads:\n");
+    for (uint32_t i = 0; i + 2 <= cfEnd && !endOfProgram; i += 2)
+    {
+        uint32_t w0 = Dword(i);
+        uint32_t w1 = Dword(i + 1);
+        uint32_t cfIndex = i / 2;
+        uint32_t op;
+        est.cfCycles += kClauseIssueCycles;
+        if ((w1 >> 29) & 1) // CF_ALU
+        {
+            if (!LookupCfOp(isa, G_SQ_CF_ALU_WORD1_CF_INST(w1), true, op))
+                return false;
+            uint32_t addr = G_SQ_CF_ALU_WORD0_ADDR(w0) * 2;
+            uint32_t slotCount = G_SQ_CF_ALU_WORD1_COUNT(w1) + 1;
+            cfEnd = std::min(cfEnd, addr);
+            if (op != CF_OP_ALU)
+                est.hasFlowControl = 1; // push/pop/else variants belong to branches and loops
+            uint32_t loads;
+            LockKcache(w0, w1, loads);
+            uint32_t switchLatency = lastClauseType == 1 ? kClauseSwitchLatency : 0;
+            est.clauseSwitchCount += lastClauseType == 1 ? 1 : 0;
+            lastClauseType = 0;
+            if (printListing)
+                fprintf(stderr, "CF %3u: %-16s addr %u\n", cfIndex, r600_isa_cf(op)->name, addr);
+            uint32_t groupCount;
+            uint32_t slotsBefore = est.aluSlotCount;
+            uint32_t transBefore = est.transCount;
+            uint32_t literalsBefore = est.literalCount;
+            if (!EstimateAluClause(addr, slotCount, groupCount))
+                return false;
+            uint32_t slotsUsed = est.aluSlotCount - slotsBefore;
+            est.aluGroupCount += groupCount;
+            est.aluCycles += groupCount * kAluGroupCycles;
+            est.latencyCycles += switchLatency + loads * kKcacheLoadLatency;
+            kcacheLoadCount += loads;
+            est.clauseCount++;
+            if (printListing)
+            {
+                fprintf(stderr, "        -> %u groups, %u/%u slots (%.0f%%), trans %u, literals %u, kcache lines loaded %u: %u cycles",
+                        groupCount, slotsUsed, groupCount * 5, groupCount ? slotsUsed * 100.0 / (groupCount * 5) : 0.0,
+                        est.transCount - transBefore, est.literalCount - literalsBefore, loads, groupCount * kAluGroupCycles);
+                fprintf(stderr, ", +%u latency\n", switchLatency + loads * kKcacheLoadLatency);
+            }
+            continue;
+        }
+        if (!LookupCfOp(isa, G_SQ_CF_WORD1_CF_INST(w1), false, op))
+            return false;
+        unsigned flags = r600_isa_cf(op)->flags;
+        if (flags & (CF_EXP | CF_MEM))
+        {
+            uint32_t burstCount = G_SQ_CF_ALLOC_EXPORT_WORD1_BURST_COUNT(w1) + 1;
+            endOfProgram = G_SQ_CF_ALLOC_EXPORT_WORD1_END_OF_PROGRAM(w1);
+            est.exportCount += burstCount;
+            est.cfCycles += burstCount * kExportCycles;
+            if (printListing)
+                fprintf(stderr, "CF %3u: %-16s R%u, %u registers: %u cycles\n", cfIndex, r600_isa_cf(op)->name, G_SQ_CF_ALLOC_EXPORT_WORD0_RW_GPR(w0),
+                        burstCount, kClauseIssueCycles + burstCount * kExportCycles);
+            continue;
+        }
+        endOfProgram = G_SQ_CF_WORD1_END_OF_PROGRAM(w1);
+        if (flags & (CF_BRANCH | CF_LOOP | CF_CALL))
+            est.hasFlowControl = 1;
+        if (!(flags & CF_FETCH))
+        {
+            if (printListing)
+                fprintf(stderr, "CF %3u: %-16s addr %u: %u cycles\n", cfIndex, r600_isa_cf(op)->name, G_SQ_CF_WORD0_ADDR(w0), kClauseIssueCycles);
+            continue;
+        }
+        uint32_t addr = G_SQ_CF_WORD0_ADDR(w0) * 2;
+        uint32_t fetchCount = G_SQ_CF_WORD1_COUNT(w1) + (G_SQ_CF_WORD1_COUNT_3(w1) << 3) + 1;
+        cfEnd = std::min(cfEnd, addr);
+        uint32_t switchLatency = lastClauseType == 0 ? kClauseSwitchLatency : 0;
+        est.clauseSwitchCount += lastClauseType == 0 ? 1 : 0;
+        lastClauseType = 1;
+        if (printListing)
+            fprintf(stderr, "CF %3u: %-16s addr %u\n", cfIndex, r600_isa_cf(op)->name, addr);
+        if (!EstimateFetchClause(op, addr, fetchCount))
+            return false;
+        est.fetchCycles += fetchCount * kFetchCycles;
+        est.latencyCycles += switchLatency + kFetchLatency;
+        est.clauseCount++;
+        fetchClauseCount++;
+        if (printListing)
+            fprintf(stderr, "        -> %u fetches: %u cycles, +%u latency\n", fetchCount, fetchCount * kFetchCycles, switchLatency + kFetchLatency);
+    }
+    if (!endOfProgram)
+        return false;
+    est.kcacheLoadCount = kcacheLoadCount;
+
+    // with enough resident wavefronts the ALU and the texture units work in parallel and latencies are hidden
+    // otherwise the wavefronts wait on each other
+    uint32_t availableGprs = kGprsPerSimd - kClauseTempGprs;
+    est.wavefronts = std::min(kMaxWavefronts, availableGprs / std::max(gprCount, 1u));
+    est.wavefronts = std::max(est.wavefronts, 1u);
+    est.serialCycles = est.aluCycles + est.fetchCycles + est.cfCycles + est.latencyCycles;
+    uint32_t throughputCycles = std::max(est.aluCycles, est.fetchCycles) + est.cfCycles;
+    uint32_t latencyBoundCycles = (est.serialCycles + est.wavefronts - 1) / est.wavefronts;
+    est.cycles = std::max(throughputCycles, latencyBoundCycles);
+    if (latencyBoundCycles > throughputCycles)
+        est.bottleneck = GLSL_ESTIMATE_BOTTLENECK_LATENCY;
+    else
+        est.bottleneck = est.aluCycles >= est.fetchCycles ? GLSL_ESTIMATE_BOTTLENECK_ALU : GLSL_ESTIMATE_BOTTLENECK_FETCH;
+
+    if (printListing)
+    {
+        static const char* bottleneckNames[] = {"ALU", "fetch", "latency"};
+        fprintf(stderr, "Summary:\n");
+        fprintf(stderr, "  ALU: %u groups, %u/%u slots used (%.1f%%), %u trans, %u literals\n", est.aluGroupCount, est.aluSlotCount, est.aluGroupCount * 5,
+                est.aluGroupCount ? est.aluSlotCount * 100.0 / (est.aluGroupCount * 5) : 0.0, est.transCount, est.literalCount);
+        fprintf(stderr, "  Fetch: %u tex, %u vtx in %u clauses\n", est.texCount, est.vtxCount, fetchClauseCount);
+        fprintf(stderr, "  Clauses: %u, %u ALU/fetch switches, %u kcache line loads, %u exported registers\n", est.clauseCount, est.clauseSwitchCount,
+                est.kcacheLoadCount, est.exportCount);
+        fprintf(stderr, "  Occupancy: %u GPRs, %u wavefronts per SIMD\n", gprCount, est.wavefronts);
+        fprintf(stderr, "  Cycles: ALU %u, fetch %u, CF %u, latency %u, single wavefront %u\n", est.aluCycles, est.fetchCycles, est.cfCycles,
+                est.latencyCycles, est.serialCycles);
+        fprintf(stderr, "  Estimated cycles per wavefront: %u (%s bound)%s\n", est.cycles, bottleneckNames[est.bottleneck],
+                est.hasFlowControl ? ", branches and loop bodies counted once" : "");
+    }
+    estimate = est;
+    return true;
+}
+
+static bool EstimateProgram(CafeGLSLCompiler* compiler, const void* program, uint32_t size, uint32_t sqPgmResources, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing)
+{
+    if (!program || size < 8 || !estimate)
+        return false;
+    ProgramEstimator estimator(compiler->r600Isa, program, size, printListing);
+    // NUM_GPRS is the low byte of SQ_PGM_RESOURCES_VS/PS
+    if (!estimator.Run(sqPgmResources & 0xFF, *estimate))
+    {
+        if (printListing)
+            fprintf(stderr, "Estimate failed: program could not be decoded\n");
+        return false;
+    }
+    return true;
+}
+
+bool _EstimateVertexShader(CafeGLSLCompiler* compiler, const GX2VertexShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing)
+{
+    return EstimateProgram(compiler, shader->program, shader->size, shader->regs.sq_pgm_resources_vs, estimate, printListing);
+}
+
+bool _EstimatePixelShader(CafeGLSLCompiler* compiler, const GX2PixelShader* shader, GLSL_PROGRAM_ESTIMATE* estimate, bool printListing)
+{
+    return EstimateProgram(compiler, shader->program, shader->size, shader->regs.sq_pgm_resources_ps, estimate, printListing);
+}
@@ -257,6 +257,41 @@ struct GX2GeometryShader
     GX2RBuffer gx2rBuffer;
 };
 
+// only the surface enums used by the texture baker
+typedef enum GX2SurfaceDim
+{
+    GX2_SURFACE_DIM_TEXTURE_2D             = 1,
+    GX2_SURFACE_DIM_TEXTURE_2D_ARRAY       = 5
+}GX2SurfaceDim;
+
+typedef enum GX2SurfaceFormat
+{
+    GX2_SURFACE_FORMAT_INVALID             = 0x000,
+    GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8   = 0x01a,
+    GX2_SURFACE_FORMAT_SRGB_R8_G8_B8_A8    = 0x41a,
+    GX2_SURFACE_FORMAT_UNORM_BC1           = 0x031,
+    GX2_SURFACE_FORMAT_UNORM_BC2           = 0x032,
+    GX2_SURFACE_FORMAT_UNORM_BC3           = 0x033,
+    GX2_SURFACE_FORMAT_UNORM_BC4           = 0x034,
+    GX2_SURFACE_FORMAT_UNORM_BC5           = 0x035,
+    GX2_SURFACE_FORMAT_SRGB_BC1            = 0x431,
+    GX2_SURFACE_FORMAT_SRGB_BC2            = 0x432,
+    GX2_SURFACE_FORMAT_SRGB_BC3            = 0x433
+}GX2SurfaceFormat;
+
+typedef enum GX2TileMode
+{
+    GX2_TILE_MODE_DEFAULT                  = 0,
+    GX2_TILE_MODE_LINEAR_ALIGNED           = 1,
+    GX2_TILE_MODE_TILED_1D_THIN1           = 2,
+    GX2_TILE_MODE_TILED_2D_THIN1           = 4
+}GX2TileMode;
+
+typedef enum GX2SurfaceUse
+{
+    GX2_SURFACE_USE_TEXTURE                = 1
+}GX2SurfaceUse;
+
 struct GX2Surface
 {
     uint32_t dim;
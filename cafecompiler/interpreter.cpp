@@ -0,0 +1,1389 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <cmath>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "cafe_glsl_compiler.h"
+
+#include "gallium/drivers/r600/r600_isa.h"
+#include "gallium/drivers/r600/r700_sq.h"
+
+// host execution of a final program. Like the estimator it decodes the shader binary, so the code that runs is exactly
+// what the GPU gets. One wavefront is executed in lockstep: every register holds one value per lane and each instruction
+// loops over all lanes, which the host compiler can vectorize. Inactive lanes are computed too but never written back
+
+static const uint32_t kLanes = GLSL_RUN_MAX_LANES;
+static const uint32_t kGprCount = 128;
+static const uint32_t kMaxStackDepth = 64;
+static const uint32_t kDefaultMaxLoopIterations = 65536;
+
+// ALU source selects
+static const uint32_t kAluSrcKcache0 = 128;
+static const uint32_t kAluSrcKcache1 = 160;
+static const uint32_t kAluSrcKcacheEnd = 192;
+static const uint32_t kAluSrc0 = 248;
+static const uint32_t kAluSrc1 = 249;
+static const uint32_t kAluSrc1Int = 250;
+static const uint32_t kAluSrcM1Int = 251;
+static const uint32_t kAluSrc0_5 = 252;
+static const uint32_t kAluSrcLiteral = 253;
+static const uint32_t kAluSrcPV = 254;
+static const uint32_t kAluSrcPS = 255;
+
+static const uint32_t kPredSelZero = 2;
+static const uint32_t kPredSelOne = 3;
+
+// export targets
+static const uint32_t kExportTypePixel = 0;
+static const uint32_t kExportTypePos = 1;
+static const uint32_t kExportTypeParam = 2;
+static const uint32_t kExportPixelDepth = 61;
+static const uint32_t kExportPosBase = 60;
+
+// GX2 uniform blocks are bound at buffer 0x80 + binding. Kcache banks only hold the low 4 bits
+static const uint32_t kUniformBufferBase = 0x80;
+
+static inline float AsFloat(uint32_t v)
+{
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline uint32_t AsUint(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+static const uint32_t kFloatOne = 0x3F800000;
+static const uint32_t kFloatHalf = 0x3F000000;
+
+// per lane helpers, the lambdas are inlined so the lane loops stay simple
+template<typename F>
+static inline void MapFloat1(uint32_t* dst, const uint32_t* a, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = AsUint(f(AsFloat(a[l])));
+}
+
+template<typename F>
+static inline void MapFloat2(uint32_t* dst, const uint32_t* a, const uint32_t* b, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = AsUint(f(AsFloat(a[l]), AsFloat(b[l])));
+}
+
+template<typename F>
+static inline void MapFloat3(uint32_t* dst, const uint32_t* a, const uint32_t* b, const uint32_t* c, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = AsUint(f(AsFloat(a[l]), AsFloat(b[l]), AsFloat(c[l])));
+}
+
+template<typename F>
+static inline void MapUint1(uint32_t* dst, const uint32_t* a, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = f(a[l]);
+}
+
+template<typename F>
+static inline void MapUint2(uint32_t* dst, const uint32_t* a, const uint32_t* b, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = f(a[l], b[l]);
+}
+
+template<typename F>
+static inline void MapUint3(uint32_t* dst, const uint32_t* a, const uint32_t* b, const uint32_t* c, F f)
+{
+    for (uint32_t l = 0; l < kLanes; l++)
+        dst[l] = f(a[l], b[l], c[l]);
+}
+
+// DX9 style multiplication used by MUL, MULADD and DOT4: zero times anything is zero
+static inline float MulLegacy(float a, float b)
+{
+    return (a == 0.0f || b == 0.0f) ? 0.0f : a * b;
+}
+
+static inline float ClampInfinity(float f)
+{
+    if (std::isinf(f))
+        return f > 0.0f ? FLT_MAX : -FLT_MAX;
+    return f;
+}
+
+static inline float FlushInfinity(float f)
+{
+    if (std::isinf(f))
+        return f > 0.0f ? 0.0f : -0.0f;
+    return f;
+}
+
+static inline uint32_t FloatToInt(float f)
+{
+    if (std::isnan(f))
+        return 0;
+    if (f >= 2147483647.0f)
+        return 0x7FFFFFFF;
+    if (f <= -2147483648.0f)
+        return 0x80000000;
+    return (uint32_t)(int32_t)f;
+}
+
+static inline uint32_t FloatToUint(float f)
+{
+    if (std::isnan(f) || f <= 0.0f)
+        return 0;
+    if (f >= 4294967295.0f)
+        return 0xFFFFFFFF;
+    return (uint32_t)f;
+}
+
+// condition of SETcc, PRED_SETcc, KILLcc and CNDcc as described by the op flags
+static inline bool Compare(unsigned flags, uint32_t a, uint32_t b)
+{
+    unsigned cc = flags & AF_CC_MASK;
+    switch (flags & AF_CMP_TYPE_MASK)
+    {
+    case AF_INT_CMP:
+        return cc == AF_CC_E ? (int32_t)a == (int32_t)b : cc == AF_CC_GT ? (int32_t)a > (int32_t)b : cc == AF_CC_GE ? (int32_t)a >= (int32_t)b : (int32_t)a != (int32_t)b;
+    case AF_UINT_CMP:
+        return cc == AF_CC_E ? a == b : cc == AF_CC_GT ? a > b : cc == AF_CC_GE ? a >= b : a != b;
+    default:
+    {
+        float fa = AsFloat(a);
+        float fb = AsFloat(b);
+        return cc == AF_CC_E ? fa == fb : cc == AF_CC_GT ? fa > fb : cc == AF_CC_GE ? fa >= fb : !(fa == fb);
+    }
+    }
+}
+
+static inline uint64_t LaneBit(uint32_t lane)
+{
+    return 1ull << lane;
+}
+
+struct AluInstruction
+{
+    uint32_t op;
+    uint32_t slot;
+    bool isOp3;
+    uint32_t srcSel[3];
+    uint32_t srcChan[3];
+    bool srcRel[3];
+    bool srcNeg[3];
+    bool srcAbs[3];
+    uint32_t indexMode;
+    uint32_t predSel;
+    uint32_t dstGpr;
+    uint32_t dstChan;
+    bool dstRel;
+    bool writeMask;
+    bool clamp;
+    uint32_t omod;
+    bool updateExecMask;
+    bool updatePred;
+};
+
+struct KcacheSet
+{
+    uint32_t bank;
+    uint32_t mode; // number of locked lines
+    uint32_t addr; // first line, in units of 16 constants
+};
+
+struct ExecFrame
+{
+    uint64_t mask; // active lanes when the frame was pushed
+    bool isLoop;
+    uint64_t brokenLanes; // loops only
+    uint64_t continuedLanes;
+    uint32_t iterations;
+};
+
+class ProgramInterpreter
+{
+public:
+    ProgramInterpreter(struct r600_isa* isa, const void* program, uint32_t size, const GLSL_RUN_INPUT& input, GLSL_RUN_RESULT& result)
+        : isa(isa), program((const uint8_t*)program), ndw(size / 4), input(input), result(result) {}
+
+    bool Run();
+
+private:
+    uint32_t Dword(uint32_t i) const // programs are stored little-endian
+    {
+        const uint8_t* p = program + i * 4;
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    uint32_t& Gpr(uint32_t index, uint32_t chan, uint32_t lane) { return gprs[(index * 4 + chan) * kLanes + lane]; }
+
+    bool Fail(const char* format, ...);
+
+    bool RunAluClause(uint32_t w0, uint32_t w1, GLSL_RUN_CF_STATS& stats);
+    bool DecodeAluInstruction(uint32_t w0, uint32_t w1, bool* slotUsed, AluInstruction& alu, uint32_t& literalCount);
+    bool ExecuteAluGroup(const AluInstruction* group, uint32_t count, const uint32_t* literals);
+    bool ReadAluSource(const AluInstruction& alu, uint32_t s, const uint32_t* literals, uint32_t* values);
+    bool ExecuteAluOp(const AluInstruction& alu, uint32_t (*src)[kLanes], uint64_t lanes, uint32_t* dst, uint64_t& condLanes);
+    bool ReadUniform(uint32_t bank, uint32_t constIndex, uint32_t chan, uint32_t& value);
+
+    bool RunTexClause(uint32_t addr, uint32_t count, GLSL_RUN_CF_STATS& stats);
+    bool RunVtxClause(uint32_t addr, uint32_t count, GLSL_RUN_CF_STATS& stats);
+    bool Export(uint32_t w0, uint32_t w1);
+
+    void PushFrame(bool isLoop);
+    bool PopFrames(uint32_t count);
+    ExecFrame* InnermostLoop();
+    uint64_t ExcludedLanes(); // lanes which have to stay inactive until their loop or the program ends
+
+    struct r600_isa* isa;
+    const uint8_t* program;
+    uint32_t ndw;
+    const GLSL_RUN_INPUT& input;
+    GLSL_RUN_RESULT& result;
+
+    std::vector<uint32_t> gprs; // [gpr][chan][lane]
+    int32_t ar[4][kLanes]{};
+    uint32_t pv[5][kLanes]{}; // results of the previous group, PS is pv[4]
+    KcacheSet kcache[2]{};
+    uint64_t laneMask{};
+    uint64_t active{};
+    uint64_t killed{};
+    uint64_t predicate{};
+    std::vector<ExecFrame> stack;
+};
+
+static bool LookupCfOp(struct r600_isa* isa, uint32_t opcode, bool isAlu, uint32_t& op)
+{
+    uint32_t index = isAlu ? opcode + 0x80 : opcode;
+    if (index >= 256 || isa->cf_map[index] == 0)
+        return false;
+    op = isa->cf_map[index] - 1;
+    return true;
+}
+
+static bool LookupAluOp(struct r600_isa* isa, uint32_t opcode, bool isOp3, uint32_t& op)
+{
+    const unsigned* map = isOp3 ? isa->alu_op3_map : isa->alu_op2_map;
+    if (opcode >= 256 || map[opcode] == 0)
+        return false;
+    op = map[opcode] - 1;
+    return true;
+}
+
+bool ProgramInterpreter::Fail(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(result.error, sizeof(result.error), format, args);
+    va_end(args);
+    return false;
+}
+
+void ProgramInterpreter::PushFrame(bool isLoop)
+{
+    stack.push_back({active, isLoop, 0, 0, 0});
+}
+
+ExecFrame* ProgramInterpreter::InnermostLoop()
+{
+    for (size_t i = stack.size(); i > 0; i--)
+    {
+        if (stack[i - 1].isLoop)
+            return &stack[i - 1];
+    }
+    return nullptr;
+}
+
+uint64_t ProgramInterpreter::ExcludedLanes()
+{
+    ExecFrame* loop = InnermostLoop();
+    return killed | (loop ? loop->brokenLanes | loop->continuedLanes : 0);
+}
+
+bool ProgramInterpreter::PopFrames(uint32_t count)
+{
+    if (count == 0)
+        return true;
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (stack.empty() || stack.back().isLoop)
+            return Fail("Stack underflow");
+        mask = stack.back().mask;
+        stack.pop_back();
+    }
+    active = mask & ~ExcludedLanes();
+    return true;
+}
+
+bool ProgramInterpreter::ReadUniform(uint32_t bank, uint32_t constIndex, uint32_t chan, uint32_t& value)
+{
+    if (bank >= input.uniformBlockCount || !input.uniformBlocks[bank].data)
+        return Fail("Uniform block %u is not set", bank);
+    const GLSL_RUN_BUFFER& buffer = input.uniformBlocks[bank];
+    uint32_t word = constIndex * 4 + chan;
+    // reads past the end of the block return 0
+    value = (word + 1) * 4 <= buffer.size ? buffer.data[word] : 0;
+    return true;
+}
+
+bool ProgramInterpreter::ReadAluSource(const AluInstruction& alu, uint32_t s, const uint32_t* literals, uint32_t* values)
+{
+    uint32_t sel = alu.srcSel[s];
+    uint32_t chan = alu.srcChan[s];
+    if (sel < kGprCount)
+    {
+        if (alu.srcRel[s] && alu.indexMode > 3)
+            return Fail("Loop index relative addressing is not supported");
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            int32_t index = (int32_t)sel + (alu.srcRel[s] ? ar[alu.indexMode][l] : 0);
+            if (index < 0 || index >= (int32_t)kGprCount)
+            {
+                if (active & LaneBit(l))
+                    return Fail("Relative GPR index %d is out of range", index);
+                index = 0;
+            }
+            values[l] = Gpr(index, chan, l);
+        }
+    }
+    else if (sel >= kAluSrcKcache0 && sel < kAluSrcKcacheEnd)
+    {
+        const KcacheSet& set = kcache[sel >= kAluSrcKcache1 ? 1 : 0];
+        uint32_t index = sel - (sel >= kAluSrcKcache1 ? kAluSrcKcache1 : kAluSrcKcache0);
+        if (index >= set.mode * 16)
+            return Fail("Constant %u is not in a locked kcache line", sel);
+        uint32_t value;
+        if (!ReadUniform(set.bank, set.addr * 16 + index, chan, value))
+            return false;
+        std::fill(values, values + kLanes, value);
+    }
+    else if (sel == kAluSrcPV || sel == kAluSrcPS)
+        memcpy(values, pv[sel == kAluSrcPS ? 4 : chan], sizeof(pv[0]));
+    else
+    {
+        uint32_t value;
+        switch (sel)
+        {
+        case kAluSrc0: value = 0; break;
+        case kAluSrc1: value = kFloatOne; break;
+        case kAluSrc1Int: value = 1; break;
+        case kAluSrcM1Int: value = 0xFFFFFFFF; break;
+        case kAluSrc0_5: value = kFloatHalf; break;
+        case kAluSrcLiteral: value = literals[chan]; break;
+        default:
+            return Fail("ALU source %u is not supported", sel);
+        }
+        std::fill(values, values + kLanes, value);
+    }
+    // modifiers work on the sign bit, abs is applied first
+    if (alu.srcAbs[s])
+    {
+        for (uint32_t l = 0; l < kLanes; l++)
+            values[l] &= 0x7FFFFFFF;
+    }
+    if (alu.srcNeg[s])
+    {
+        for (uint32_t l = 0; l < kLanes; l++)
+            values[l] ^= 0x80000000;
+    }
+    return true;
+}
+
+bool ProgramInterpreter::ExecuteAluOp(const AluInstruction& alu, uint32_t (*src)[kLanes], uint64_t lanes, uint32_t* dst, uint64_t& condLanes)
+{
+    const uint32_t* a = src[0];
+    const uint32_t* b = src[1];
+    const uint32_t* c = src[2];
+    unsigned flags = r600_isa_alu(alu.op)->flags;
+    if (flags & (AF_SET | AF_PRED | AF_KILL | AF_CMOV))
+    {
+        if ((flags & AF_PRED_PUSH) || alu.op == ALU_OP1_PRED_SET_INV || alu.op == ALU_OP2_PRED_SET_POP || alu.op == ALU_OP0_PRED_SET_CLR ||
+            alu.op == ALU_OP1_PRED_SET_RESTORE)
+            return Fail("%s is not supported", r600_isa_alu(alu.op)->name);
+        uint32_t trueValue = (flags & (AF_DX10 | AF_INT_DST)) ? 0xFFFFFFFF : kFloatOne;
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            // CNDcc compares against 0, PRED_SETcc results in 0.0 when the condition holds
+            bool cond = Compare(flags, a[l], (flags & AF_CMOV) ? 0 : b[l]);
+            if (cond)
+                condLanes |= LaneBit(l);
+            if (flags & AF_CMOV)
+                dst[l] = cond ? b[l] : c[l];
+            else if (flags & AF_SET)
+                dst[l] = cond ? trueValue : 0;
+            else if (flags & AF_PRED)
+                dst[l] = cond ? 0 : kFloatOne;
+            else
+                dst[l] = cond ? kFloatOne : 0;
+        }
+        condLanes &= lanes;
+        return true;
+    }
+    switch (alu.op)
+    {
+    case ALU_OP0_NOP:
+        break;
+    case ALU_OP1_MOV:
+        memcpy(dst, a, sizeof(uint32_t) * kLanes);
+        break;
+    case ALU_OP2_ADD:
+        MapFloat2(dst, a, b, [](float x, float y) { return x + y; });
+        break;
+    case ALU_OP2_MUL:
+        MapFloat2(dst, a, b, MulLegacy);
+        break;
+    case ALU_OP2_MUL_IEEE:
+        MapFloat2(dst, a, b, [](float x, float y) { return x * y; });
+        break;
+    case ALU_OP2_DOT4:
+        MapFloat2(dst, a, b, MulLegacy); // the products are summed up after the group
+        break;
+    case ALU_OP2_DOT4_IEEE:
+        MapFloat2(dst, a, b, [](float x, float y) { return x * y; });
+        break;
+    case ALU_OP1_MAX4:
+        memcpy(dst, a, sizeof(uint32_t) * kLanes);
+        break;
+    case ALU_OP2_MAX:
+        MapFloat2(dst, a, b, [](float x, float y) { return x >= y ? x : y; });
+        break;
+    case ALU_OP2_MIN:
+        MapFloat2(dst, a, b, [](float x, float y) { return x < y ? x : y; });
+        break;
+    case ALU_OP2_MAX_DX10:
+        MapFloat2(dst, a, b, [](float x, float y) { return fmaxf(x, y); });
+        break;
+    case ALU_OP2_MIN_DX10:
+        MapFloat2(dst, a, b, [](float x, float y) { return fminf(x, y); });
+        break;
+    case ALU_OP1_FRACT:
+        MapFloat1(dst, a, [](float x) { return x - floorf(x); });
+        break;
+    case ALU_OP1_TRUNC:
+        MapFloat1(dst, a, [](float x) { return truncf(x); });
+        break;
+    case ALU_OP1_CEIL:
+        MapFloat1(dst, a, [](float x) { return ceilf(x); });
+        break;
+    case ALU_OP1_FLOOR:
+        MapFloat1(dst, a, [](float x) { return floorf(x); });
+        break;
+    case ALU_OP1_RNDNE:
+        MapFloat1(dst, a, [](float x) { return nearbyintf(x); });
+        break;
+    case ALU_OP1_EXP_IEEE:
+        MapFloat1(dst, a, [](float x) { return exp2f(x); });
+        break;
+    case ALU_OP1_LOG_IEEE:
+        MapFloat1(dst, a, [](float x) { return log2f(x); });
+        break;
+    case ALU_OP1_LOG_CLAMPED:
+        MapFloat1(dst, a, [](float x) { return ClampInfinity(log2f(x)); });
+        break;
+    case ALU_OP1_RECIP_IEEE:
+        MapFloat1(dst, a, [](float x) { return 1.0f / x; });
+        break;
+    case ALU_OP1_RECIP_CLAMPED:
+        MapFloat1(dst, a, [](float x) { return ClampInfinity(1.0f / x); });
+        break;
+    case ALU_OP1_RECIP_FF:
+        MapFloat1(dst, a, [](float x) { return FlushInfinity(1.0f / x); });
+        break;
+    case ALU_OP1_RECIPSQRT_IEEE:
+        MapFloat1(dst, a, [](float x) { return 1.0f / sqrtf(x); });
+        break;
+    case ALU_OP1_RECIPSQRT_CLAMPED:
+        MapFloat1(dst, a, [](float x) { return ClampInfinity(1.0f / sqrtf(x)); });
+        break;
+    case ALU_OP1_RECIPSQRT_FF:
+        MapFloat1(dst, a, [](float x) { return FlushInfinity(1.0f / sqrtf(x)); });
+        break;
+    case ALU_OP1_SQRT_IEEE:
+        MapFloat1(dst, a, [](float x) { return sqrtf(x); });
+        break;
+    // the input is in periods, the backend normalizes it to [-0.5, 0.5)
+    case ALU_OP1_SIN:
+        MapFloat1(dst, a, [](float x) { return sinf(x * (float)(2.0 * M_PI)); });
+        break;
+    case ALU_OP1_COS:
+        MapFloat1(dst, a, [](float x) { return cosf(x * (float)(2.0 * M_PI)); });
+        break;
+    case ALU_OP3_MULADD:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return MulLegacy(x, y) + z; });
+        break;
+    case ALU_OP3_MULADD_M2:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (MulLegacy(x, y) + z) * 2.0f; });
+        break;
+    case ALU_OP3_MULADD_M4:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (MulLegacy(x, y) + z) * 4.0f; });
+        break;
+    case ALU_OP3_MULADD_D2:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (MulLegacy(x, y) + z) * 0.5f; });
+        break;
+    case ALU_OP3_MULADD_IEEE:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return x * y + z; });
+        break;
+    case ALU_OP3_MULADD_IEEE_M2:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (x * y + z) * 2.0f; });
+        break;
+    case ALU_OP3_MULADD_IEEE_M4:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (x * y + z) * 4.0f; });
+        break;
+    case ALU_OP3_MULADD_IEEE_D2:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return (x * y + z) * 0.5f; });
+        break;
+    case ALU_OP3_FMA:
+        MapFloat3(dst, a, b, c, [](float x, float y, float z) { return fmaf(x, y, z); });
+        break;
+    // conversions
+    case ALU_OP1_FLT_TO_INT:
+        MapUint1(dst, a, [](uint32_t x) { return FloatToInt(AsFloat(x)); });
+        break;
+    case ALU_OP1_FLT_TO_UINT:
+        MapUint1(dst, a, [](uint32_t x) { return FloatToUint(AsFloat(x)); });
+        break;
+    case ALU_OP1_INT_TO_FLT:
+        MapUint1(dst, a, [](uint32_t x) { return AsUint((float)(int32_t)x); });
+        break;
+    case ALU_OP1_UINT_TO_FLT:
+        MapUint1(dst, a, [](uint32_t x) { return AsUint((float)x); });
+        break;
+    // integer
+    case ALU_OP2_ADD_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x + y; });
+        break;
+    case ALU_OP2_SUB_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x - y; });
+        break;
+    case ALU_OP2_AND_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x & y; });
+        break;
+    case ALU_OP2_OR_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x | y; });
+        break;
+    case ALU_OP2_XOR_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x ^ y; });
+        break;
+    case ALU_OP1_NOT_INT:
+        MapUint1(dst, a, [](uint32_t x) { return ~x; });
+        break;
+    case ALU_OP2_LSHL_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x << (y & 31); });
+        break;
+    case ALU_OP2_LSHR_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x >> (y & 31); });
+        break;
+    case ALU_OP2_ASHR_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (uint32_t)((int32_t)x >> (y & 31)); });
+        break;
+    case ALU_OP2_MAX_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (int32_t)x >= (int32_t)y ? x : y; });
+        break;
+    case ALU_OP2_MIN_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (int32_t)x < (int32_t)y ? x : y; });
+        break;
+    case ALU_OP2_MAX_UINT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return std::max(x, y); });
+        break;
+    case ALU_OP2_MIN_UINT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return std::min(x, y); });
+        break;
+    case ALU_OP2_MULLO_INT:
+    case ALU_OP2_MULLO_UINT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return x * y; });
+        break;
+    case ALU_OP2_MULHI_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (uint32_t)(((int64_t)(int32_t)x * (int32_t)y) >> 32); });
+        break;
+    case ALU_OP2_MULHI_UINT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (uint32_t)(((uint64_t)x * y) >> 32); });
+        break;
+    case ALU_OP2_MUL_UINT24:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (x & 0xFFFFFF) * (y & 0xFFFFFF); });
+        break;
+    case ALU_OP3_MULADD_UINT24:
+        MapUint3(dst, a, b, c, [](uint32_t x, uint32_t y, uint32_t z) { return (x & 0xFFFFFF) * (y & 0xFFFFFF) + z; });
+        break;
+    case ALU_OP1_RECIP_UINT:
+        MapUint1(dst, a, [](uint32_t x) { return x ? (uint32_t)std::min<uint64_t>(0x100000000ull / x, 0xFFFFFFFF) : 0xFFFFFFFF; });
+        break;
+    case ALU_OP2_BFM_INT:
+        MapUint2(dst, a, b, [](uint32_t x, uint32_t y) { return (uint32_t)(((1ull << (x & 31)) - 1) << (y & 31)); });
+        break;
+    case ALU_OP3_BFE_UINT:
+        MapUint3(dst, a, b, c, [](uint32_t x, uint32_t y, uint32_t z) {
+            uint32_t width = z & 31;
+            return width ? (x >> (y & 31)) & (uint32_t)((1ull << width) - 1) : 0;
+        });
+        break;
+    case ALU_OP3_BFE_INT:
+        MapUint3(dst, a, b, c, [](uint32_t x, uint32_t y, uint32_t z) {
+            uint32_t width = z & 31;
+            uint32_t offset = y & 31;
+            if (width == 0)
+                return 0u;
+            if (width + offset < 32)
+                return (uint32_t)((int32_t)(x << (32 - width - offset)) >> (32 - width));
+            return (uint32_t)((int32_t)x >> offset);
+        });
+        break;
+    case ALU_OP3_BFI_INT:
+        MapUint3(dst, a, b, c, [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (~x & z); });
+        break;
+    case ALU_OP3_BIT_ALIGN_INT:
+        MapUint3(dst, a, b, c, [](uint32_t x, uint32_t y, uint32_t z) { return (uint32_t)((((uint64_t)x << 32) | y) >> (z & 31)); });
+        break;
+    case ALU_OP1_BFREV_INT:
+        MapUint1(dst, a, [](uint32_t x) {
+            uint32_t r = 0;
+            for (uint32_t i = 0; i < 32; i++)
+                r |= ((x >> i) & 1) << (31 - i);
+            return r;
+        });
+        break;
+    case ALU_OP1_BCNT_INT:
+        MapUint1(dst, a, [](uint32_t x) { return (uint32_t)__builtin_popcount(x); });
+        break;
+    case ALU_OP1_FFBL_INT:
+        MapUint1(dst, a, [](uint32_t x) { return x ? (uint32_t)__builtin_ctz(x) : 0xFFFFFFFF; });
+        break;
+    case ALU_OP1_FFBH_UINT:
+        MapUint1(dst, a, [](uint32_t x) { return x ? (uint32_t)__builtin_clz(x) : 0xFFFFFFFF; });
+        break;
+    case ALU_OP1_FFBH_INT:
+        MapUint1(dst, a, [](uint32_t x) {
+            uint32_t v = (int32_t)x < 0 ? ~x : x;
+            return v ? (uint32_t)__builtin_clz(v) : 0xFFFFFFFF;
+        });
+        break;
+    // AR is written after the group
+    case ALU_OP1_MOVA_INT:
+        memcpy(dst, a, sizeof(uint32_t) * kLanes);
+        break;
+    case ALU_OP1_MOVA_FLOOR:
+        MapUint1(dst, a, [](uint32_t x) { return (uint32_t)std::min(std::max((int32_t)FloatToInt(floorf(AsFloat(x))), -256), 255); });
+        break;
+    default:
+        return Fail("%s is not supported", r600_isa_alu(alu.op)->name);
+    }
+    return true;
+}
+
+bool ProgramInterpreter::ExecuteAluGroup(const AluInstruction* group, uint32_t count, const uint32_t* literals)
+{
+    uint32_t results[5][kLanes];
+    uint32_t src[3][kLanes];
+    uint64_t newActive = active;
+    uint64_t newPredicate = predicate;
+    uint64_t killedLanes = 0;
+    bool hasReduction = false;
+    // every instruction reads its sources before any instruction of the group writes
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const AluInstruction& alu = group[i];
+        uint32_t srcCount = (uint32_t)std::min(r600_isa_alu(alu.op)->src_count, 3);
+        for (uint32_t s = 0; s < srcCount; s++)
+        {
+            if (!ReadAluSource(alu, s, literals, src[s]))
+                return false;
+        }
+        uint64_t lanes = active;
+        if (alu.predSel == kPredSelZero)
+            lanes &= ~predicate;
+        else if (alu.predSel == kPredSelOne)
+            lanes &= predicate;
+        uint64_t condLanes = 0;
+        if (!ExecuteAluOp(alu, src, lanes, results[alu.slot], condLanes))
+            return false;
+        unsigned flags = r600_isa_alu(alu.op)->flags;
+        hasReduction |= (flags & AF_4SLOT) != 0;
+        if (flags & AF_PRED)
+        {
+            if (alu.updatePred)
+                newPredicate = (newPredicate & ~lanes) | condLanes;
+            if (alu.updateExecMask)
+                newActive = (newActive & ~lanes) | condLanes;
+        }
+        else if (flags & AF_KILL)
+            killedLanes |= condLanes;
+    }
+    // DOT4 and MAX4 combine the four vector slots
+    if (hasReduction)
+    {
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            float dot = 0.0f;
+            float max = -INFINITY;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (group[i].slot < 4 && (r600_isa_alu(group[i].op)->flags & AF_4SLOT))
+                {
+                    dot += AsFloat(results[group[i].slot][l]);
+                    max = fmaxf(max, AsFloat(results[group[i].slot][l]));
+                }
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (group[i].slot < 4 && (r600_isa_alu(group[i].op)->flags & AF_4SLOT))
+                    results[group[i].slot][l] = AsUint(group[i].op == ALU_OP1_MAX4 ? max : dot);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const AluInstruction& alu = group[i];
+        uint32_t* values = results[alu.slot];
+        unsigned flags = r600_isa_alu(alu.op)->flags;
+        if ((flags & AF_DST_TYPE_MASK) == AF_FLOAT_DST && !(flags & (AF_MOVA | AF_SET | AF_PRED | AF_KILL)))
+        {
+            static const float omodScale[4] = {1.0f, 2.0f, 4.0f, 0.5f};
+            for (uint32_t l = 0; l < kLanes; l++)
+            {
+                float f = AsFloat(values[l]) * omodScale[alu.omod];
+                if (alu.clamp)
+                    f = std::min(std::max(f, 0.0f), 1.0f);
+                values[l] = AsUint(f);
+            }
+        }
+        uint64_t lanes = active;
+        if (alu.predSel == kPredSelZero)
+            lanes &= ~predicate;
+        else if (alu.predSel == kPredSelOne)
+            lanes &= predicate;
+        if (flags & AF_MOVA)
+        {
+            for (uint32_t l = 0; l < kLanes; l++)
+            {
+                if (lanes & LaneBit(l))
+                    ar[alu.dstChan][l] = (int32_t)values[l];
+            }
+        }
+        if (alu.isOp3 || alu.writeMask)
+        {
+            if (alu.dstRel && alu.indexMode > 3)
+                return Fail("Loop index relative addressing is not supported");
+            for (uint32_t l = 0; l < kLanes; l++)
+            {
+                if (!(lanes & LaneBit(l)))
+                    continue;
+                int32_t index = (int32_t)alu.dstGpr + (alu.dstRel ? ar[alu.indexMode][l] : 0);
+                if (index < 0 || index >= (int32_t)kGprCount)
+                    return Fail("Relative GPR index %d is out of range", index);
+                Gpr(index, alu.dstChan, l) = values[l];
+            }
+        }
+    }
+    for (uint32_t i = 0; i < count; i++)
+        memcpy(pv[group[i].slot], results[group[i].slot], sizeof(pv[0]));
+    killed |= killedLanes;
+    active = newActive & ~killed;
+    predicate = newPredicate;
+    return true;
+}
+
+bool ProgramInterpreter::DecodeAluInstruction(uint32_t w0, uint32_t w1, bool* slotUsed, AluInstruction& alu, uint32_t& literalCount)
+{
+    alu.isOp3 = G_SQ_ALU_WORD1_ENCODING(w1) != 0;
+    if (!LookupAluOp(isa, alu.isOp3 ? G_SQ_ALU_WORD1_OP3_ALU_INST(w1) : G_SQ_ALU_WORD1_OP2_ALU_INST(w1), alu.isOp3, alu.op))
+        return Fail("Unknown ALU opcode");
+    alu.dstChan = G_SQ_ALU_WORD1_DST_CHAN(w1);
+    // same slot assignment as the hardware: vector slots by destination channel, the rest goes to the trans unit
+    alu.slot = (!(r600_isa_alu_slots(isa->hw_class, alu.op) & AF_V) || slotUsed[alu.dstChan]) ? 4 : alu.dstChan;
+    if (slotUsed[alu.slot])
+        return Fail("ALU group uses slot %c twice", "xyzwt"[alu.slot]);
+    slotUsed[alu.slot] = true;
+    alu.srcSel[0] = G_SQ_ALU_WORD0_SRC0_SEL(w0);
+    alu.srcChan[0] = G_SQ_ALU_WORD0_SRC0_CHAN(w0);
+    alu.srcRel[0] = G_SQ_ALU_WORD0_SRC0_REL(w0);
+    alu.srcNeg[0] = G_SQ_ALU_WORD0_SRC0_NEG(w0);
+    alu.srcSel[1] = G_SQ_ALU_WORD0_SRC1_SEL(w0);
+    alu.srcChan[1] = G_SQ_ALU_WORD0_SRC1_CHAN(w0);
+    alu.srcRel[1] = G_SQ_ALU_WORD0_SRC1_REL(w0);
+    alu.srcNeg[1] = G_SQ_ALU_WORD0_SRC1_NEG(w0);
+    alu.srcSel[2] = alu.isOp3 ? G_SQ_ALU_WORD1_OP3_SRC2_SEL(w1) : 0;
+    alu.srcChan[2] = alu.isOp3 ? G_SQ_ALU_WORD1_OP3_SRC2_CHAN(w1) : 0;
+    alu.srcRel[2] = alu.isOp3 && G_SQ_ALU_WORD1_OP3_SRC2_REL(w1);
+    alu.srcNeg[2] = alu.isOp3 && G_SQ_ALU_WORD1_OP3_SRC2_NEG(w1);
+    alu.srcAbs[0] = !alu.isOp3 && G_SQ_ALU_WORD1_OP2_SRC0_ABS(w1);
+    alu.srcAbs[1] = !alu.isOp3 && G_SQ_ALU_WORD1_OP2_SRC1_ABS(w1);
+    alu.srcAbs[2] = false;
+    alu.indexMode = G_SQ_ALU_WORD0_INDEX_MODE(w0);
+    alu.predSel = G_SQ_ALU_WORD0_PRED_SEL(w0);
+    alu.dstGpr = G_SQ_ALU_WORD1_DST_GPR(w1);
+    alu.dstRel = G_SQ_ALU_WORD1_DST_REL(w1);
+    alu.clamp = G_SQ_ALU_WORD1_CLAMP(w1);
+    alu.writeMask = !alu.isOp3 && G_SQ_ALU_WORD1_OP2_WRITE_MASK(w1);
+    alu.omod = alu.isOp3 ? 0 : G_SQ_ALU_WORD1_OP2_OMOD(w1);
+    alu.updateExecMask = !alu.isOp3 && G_SQ_ALU_WORD1_OP2_UPDATE_EXECUTE_MASK(w1);
+    alu.updatePred = !alu.isOp3 && G_SQ_ALU_WORD1_OP2_UPDATE_PRED(w1);
+    for (uint32_t s = 0; s < (uint32_t)std::min(r600_isa_alu(alu.op)->src_count, 3); s++)
+    {
+        if (alu.srcSel[s] == kAluSrcLiteral)
+            literalCount = std::max(literalCount, alu.srcChan[s] + 1);
+    }
+    return true;
+}
+
+bool ProgramInterpreter::RunAluClause(uint32_t w0, uint32_t w1, GLSL_RUN_CF_STATS& stats)
+{
+    uint32_t addr = G_SQ_CF_ALU_WORD0_ADDR(w0) * 2;
+    uint32_t end = addr + (G_SQ_CF_ALU_WORD1_COUNT(w1) + 1) * 2;
+    if (end > ndw)
+        return Fail("ALU clause at %u is out of bounds", addr);
+    kcache[0] = {G_SQ_CF_ALU_WORD0_KCACHE_BANK0(w0), G_SQ_CF_ALU_WORD0_KCACHE_MODE0(w0), G_SQ_CF_ALU_WORD1_KCACHE_ADDR0(w1)};
+    kcache[1] = {G_SQ_CF_ALU_WORD0_KCACHE_BANK1(w0), G_SQ_CF_ALU_WORD1_KCACHE_MODE1(w1), G_SQ_CF_ALU_WORD1_KCACHE_ADDR1(w1)};
+    for (auto& set : kcache)
+    {
+        // lock_loop_index locks two lines like lock_2
+        set.mode = std::min(set.mode, 2u);
+    }
+    uint32_t i = addr;
+    while (i < end)
+    {
+        AluInstruction group[5];
+        bool slotUsed[5]{};
+        uint32_t count = 0;
+        uint32_t literalCount = 0;
+        bool last = false;
+        while (!last)
+        {
+            if (count == 5 || i + 2 > end)
+                return Fail("Malformed ALU group at %u", i);
+            uint32_t aluW0 = Dword(i);
+            uint32_t aluW1 = Dword(i + 1);
+            i += 2;
+            last = G_SQ_ALU_WORD0_LAST(aluW0);
+            if (!DecodeAluInstruction(aluW0, aluW1, slotUsed, group[count++], literalCount))
+                return false;
+        }
+        // literals follow the group, padded to a full slot
+        uint32_t literals[4]{};
+        if (i + literalCount > end)
+            return Fail("Malformed ALU group at %u", i);
+        for (uint32_t l = 0; l < literalCount; l++)
+            literals[l] = Dword(i + l);
+        i += (literalCount + 1) & ~1u;
+        if (!ExecuteAluGroup(group, count, literals))
+            return false;
+        stats.aluGroupCount++;
+        stats.aluCount += count;
+    }
+    return true;
+}
+
+static void FetchTexel(const GLSL_RUN_TEXTURE& texture, int32_t x, int32_t y, float* texel)
+{
+    // repeat wrapping
+    int32_t width = (int32_t)texture.width;
+    int32_t height = (int32_t)texture.height;
+    x = ((x % width) + width) % width;
+    y = ((y % height) + height) % height;
+    memcpy(texel, texture.texels + ((size_t)y * texture.width + x) * 4, sizeof(float) * 4);
+}
+
+static int32_t TexelCoord(float f)
+{
+    if (!std::isfinite(f))
+        return 0;
+    return (int32_t)std::min(std::max(floorf(f), -16777216.0f), 16777216.0f);
+}
+
+static void SampleTexture(const GLSL_RUN_TEXTURE& texture, float x, float y, float* texel)
+{
+    if (!texture.bilinear)
+    {
+        FetchTexel(texture, TexelCoord(x), TexelCoord(y), texel);
+        return;
+    }
+    x -= 0.5f;
+    y -= 0.5f;
+    int32_t x0 = TexelCoord(x);
+    int32_t y0 = TexelCoord(y);
+    float fx = std::isfinite(x) ? x - floorf(x) : 0.0f;
+    float fy = std::isfinite(y) ? y - floorf(y) : 0.0f;
+    float t00[4], t10[4], t01[4], t11[4];
+    FetchTexel(texture, x0, y0, t00);
+    FetchTexel(texture, x0 + 1, y0, t10);
+    FetchTexel(texture, x0, y0 + 1, t01);
+    FetchTexel(texture, x0 + 1, y0 + 1, t11);
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        float top = t00[c] + (t10[c] - t00[c]) * fx;
+        float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+        texel[c] = top + (bottom - top) * fy;
+    }
+}
+
+bool ProgramInterpreter::RunTexClause(uint32_t addr, uint32_t count, GLSL_RUN_CF_STATS& stats)
+{
+    // fetch instructions are 128 bits wide
+    if (addr + count * 4 > ndw)
+        return Fail("Fetch clause at %u is out of bounds", addr);
+    for (uint32_t f = 0; f < count; f++)
+    {
+        uint32_t w0 = Dword(addr + f * 4);
+        uint32_t w1 = Dword(addr + f * 4 + 1);
+        uint32_t w2 = Dword(addr + f * 4 + 2);
+        uint32_t opcode = G_SQ_TEX_WORD0_TEX_INST(w0);
+        if (isa->fetch_map[opcode] == 0)
+            return Fail("Unknown fetch opcode %u", opcode);
+        uint32_t op = isa->fetch_map[opcode] - 1;
+        uint32_t srcGpr = G_SQ_TEX_WORD0_SRC_GPR(w0);
+        uint32_t dstGpr = G_SQ_TEX_WORD1_DST_GPR(w1);
+        if (G_SQ_TEX_WORD0_SRC_REL(w0) || G_SQ_TEX_WORD1_DST_REL(w1))
+            return Fail("Relative fetch registers are not supported");
+        if (srcGpr >= kGprCount || dstGpr >= kGprCount)
+            return Fail("Fetch register out of range");
+        if (G_SQ_TEX_WORD2_OFFSET_X(w2) || G_SQ_TEX_WORD2_OFFSET_Y(w2) || G_SQ_TEX_WORD2_OFFSET_Z(w2))
+            return Fail("Texture offsets are not supported");
+        uint32_t srcSel[4] = {G_SQ_TEX_WORD2_SRC_SEL_X(w2), G_SQ_TEX_WORD2_SRC_SEL_Y(w2), G_SQ_TEX_WORD2_SRC_SEL_Z(w2), G_SQ_TEX_WORD2_SRC_SEL_W(w2)};
+        uint32_t dstSel[4] = {G_SQ_TEX_WORD1_DST_SEL_X(w1), G_SQ_TEX_WORD1_DST_SEL_Y(w1), G_SQ_TEX_WORD1_DST_SEL_Z(w1), G_SQ_TEX_WORD1_DST_SEL_W(w1)};
+        bool normalized[2] = {G_SQ_TEX_WORD1_COORD_TYPE_X(w1) != 0, G_SQ_TEX_WORD1_COORD_TYPE_Y(w1) != 0};
+        uint32_t resourceId = G_SQ_TEX_WORD0_RESOURCE_ID(w0);
+
+        uint32_t coords[4][kLanes];
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            for (uint32_t l = 0; l < kLanes; l++)
+                coords[c][l] = srcSel[c] < 4 ? Gpr(srcGpr, srcSel[c], l) : (srcSel[c] == 5 ? kFloatOne : 0);
+        }
+        unsigned flags = r600_isa_fetch(op)->flags;
+        if (flags & FF_SETGRAD)
+        {
+            // explicit gradients only select the mip level and textures have a single level
+            stats.fetchCount++;
+            continue;
+        }
+        const GLSL_RUN_TEXTURE* texture = nullptr;
+        if (!(flags & FF_GETGRAD))
+        {
+            if (resourceId >= input.textureCount || !input.textures[resourceId].texels || input.textures[resourceId].width == 0 ||
+                input.textures[resourceId].height == 0)
+                return Fail("Texture %u is not set", resourceId);
+            texture = input.textures + resourceId;
+        }
+        uint32_t values[4][kLanes];
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            float texel[4];
+            switch (op)
+            {
+            case FETCH_OP_SAMPLE:
+            case FETCH_OP_SAMPLE_L:
+            case FETCH_OP_SAMPLE_LB:
+            case FETCH_OP_SAMPLE_LZ:
+            case FETCH_OP_SAMPLE_G:
+            {
+                float x = AsFloat(coords[0][l]) * (normalized[0] ? texture->width : 1.0f);
+                float y = AsFloat(coords[1][l]) * (normalized[1] ? texture->height : 1.0f);
+                SampleTexture(*texture, x, y, texel);
+                for (uint32_t c = 0; c < 4; c++)
+                    values[c][l] = AsUint(texel[c]);
+                break;
+            }
+            case FETCH_OP_LD:
+            {
+                int32_t x = (int32_t)coords[0][l];
+                int32_t y = (int32_t)coords[1][l];
+                bool inside = x >= 0 && y >= 0 && x < (int32_t)texture->width && y < (int32_t)texture->height;
+                if (inside)
+                    FetchTexel(*texture, x, y, texel);
+                for (uint32_t c = 0; c < 4; c++)
+                    values[c][l] = inside ? AsUint(texel[c]) : 0;
+                break;
+            }
+            case FETCH_OP_GET_TEXTURE_RESINFO:
+                values[0][l] = texture->width;
+                values[1][l] = texture->height;
+                values[2][l] = 1;
+                values[3][l] = 1; // mip levels
+                break;
+            case FETCH_OP_GET_GRADIENTS_H:
+            case FETCH_OP_GET_GRADIENTS_V:
+            {
+                // lanes form 2x2 quads: top left, top right, bottom left, bottom right
+                uint32_t quad = l & ~3u;
+                uint32_t first = op == FETCH_OP_GET_GRADIENTS_H ? quad + (l & 2) : quad + (l & 1);
+                uint32_t second = first + (op == FETCH_OP_GET_GRADIENTS_H ? 1 : 2);
+                for (uint32_t c = 0; c < 4; c++)
+                    values[c][l] = second < kLanes ? AsUint(AsFloat(coords[c][second]) - AsFloat(coords[c][first])) : 0;
+                break;
+            }
+            default:
+                return Fail("%s is not supported", r600_isa_fetch(op)->name);
+            }
+        }
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            if (dstSel[c] == 7)
+                continue;
+            for (uint32_t l = 0; l < kLanes; l++)
+            {
+                if (active & LaneBit(l))
+                    Gpr(dstGpr, c, l) = dstSel[c] < 4 ? values[dstSel[c]][l] : (dstSel[c] == 5 ? kFloatOne : 0);
+            }
+        }
+        stats.fetchCount++;
+        result.texCount++;
+    }
+    return true;
+}
+
+// number of 32 bit components of the buffer formats the backend uses for uniform blocks
+static uint32_t GetVtxFormatComponentCount(uint32_t format)
+{
+    switch (format)
+    {
+    case 13: // fmt_32
+    case 14: // fmt_32_float
+        return 1;
+    case 29: // fmt_32_32
+    case 30: // fmt_32_32_float
+        return 2;
+    case 47: // fmt_32_32_32
+    case 48: // fmt_32_32_32_float
+        return 3;
+    case 34: // fmt_32_32_32_32
+    case 35: // fmt_32_32_32_32_float
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+bool ProgramInterpreter::RunVtxClause(uint32_t addr, uint32_t count, GLSL_RUN_CF_STATS& stats)
+{
+    if (addr + count * 4 > ndw)
+        return Fail("Fetch clause at %u is out of bounds", addr);
+    for (uint32_t f = 0; f < count; f++)
+    {
+        uint32_t w0 = Dword(addr + f * 4);
+        uint32_t w1 = Dword(addr + f * 4 + 1);
+        uint32_t w2 = Dword(addr + f * 4 + 2);
+        if (G_SQ_VTX_WORD0_VTX_INST(w0) != 0) // VFETCH
+            return Fail("Vertex fetch opcode %u is not supported", G_SQ_VTX_WORD0_VTX_INST(w0));
+        uint32_t bufferId = G_SQ_VTX_WORD0_BUFFER_ID(w0);
+        uint32_t srcGpr = G_SQ_VTX_WORD0_SRC_GPR(w0);
+        uint32_t srcChan = G_SQ_VTX_WORD0_SRC_SEL_X(w0);
+        uint32_t dstGpr = G_SQ_VTX_WORD1_GPR_DST_GPR(w1);
+        if (G_SQ_VTX_WORD0_SRC_REL(w0) || G_SQ_VTX_WORD1_GPR_DST_REL(w1))
+            return Fail("Relative fetch registers are not supported");
+        if (srcGpr >= kGprCount || dstGpr >= kGprCount || srcChan > 3)
+            return Fail("Fetch register out of range");
+        if (bufferId < kUniformBufferBase)
+            return Fail("Fetch from buffer %u is not supported, only uniform blocks are", bufferId);
+        // with use_const_fields the format comes from the buffer resource, which is four dwords per element for uniform blocks
+        uint32_t componentCount = G_SQ_VTX_WORD1_USE_CONST_FIELDS(w1) ? 4 : GetVtxFormatComponentCount(G_SQ_VTX_WORD1_DATA_FORMAT(w1));
+        if (componentCount == 0)
+            return Fail("Vertex fetch format %u is not supported", G_SQ_VTX_WORD1_DATA_FORMAT(w1));
+        uint32_t dstSel[4] = {G_SQ_VTX_WORD1_DST_SEL_X(w1), G_SQ_VTX_WORD1_DST_SEL_Y(w1), G_SQ_VTX_WORD1_DST_SEL_Z(w1), G_SQ_VTX_WORD1_DST_SEL_W(w1)};
+        uint32_t offset = G_SQ_VTX_WORD2_OFFSET(w2);
+        uint32_t bank = bufferId - kUniformBufferBase;
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            if (!(active & LaneBit(l)))
+                continue;
+            // the index addresses 16 byte elements
+            uint32_t byteAddr = Gpr(srcGpr, srcChan, l) * 16 + offset;
+            uint32_t values[4] = {0, 0, 0, kFloatOne};
+            for (uint32_t c = 0; c < componentCount; c++)
+            {
+                uint32_t byte = byteAddr + c * 4;
+                if (!ReadUniform(bank, byte / 16, (byte / 4) & 3, values[c]))
+                    return false;
+            }
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                if (dstSel[c] != 7)
+                    Gpr(dstGpr, c, l) = dstSel[c] < 4 ? values[dstSel[c]] : (dstSel[c] == 5 ? kFloatOne : 0);
+            }
+        }
+        stats.fetchCount++;
+        result.vtxCount++;
+    }
+    return true;
+}
+
+bool ProgramInterpreter::Export(uint32_t w0, uint32_t w1)
+{
+    uint32_t type = G_SQ_CF_ALLOC_EXPORT_WORD0_TYPE(w0);
+    uint32_t arrayBase = G_SQ_CF_ALLOC_EXPORT_WORD0_ARRAY_BASE(w0);
+    uint32_t gpr = G_SQ_CF_ALLOC_EXPORT_WORD0_RW_GPR(w0);
+    uint32_t burstCount = G_SQ_CF_ALLOC_EXPORT_WORD1_BURST_COUNT(w1) + 1;
+    uint32_t swizzle[4] = {G_SQ_CF_ALLOC_EXPORT_WORD1_SWIZ_SEL_X(w1), G_SQ_CF_ALLOC_EXPORT_WORD1_SWIZ_SEL_Y(w1), G_SQ_CF_ALLOC_EXPORT_WORD1_SWIZ_SEL_Z(w1),
+                           G_SQ_CF_ALLOC_EXPORT_WORD1_SWIZ_SEL_W(w1)};
+    if (G_SQ_CF_ALLOC_EXPORT_WORD0_RW_REL(w0))
+        return Fail("Relative export registers are not supported");
+    for (uint32_t b = 0; b < burstCount; b++, gpr++)
+    {
+        uint32_t target = arrayBase + b;
+        if (gpr >= kGprCount)
+            return Fail("Export register out of range");
+        uint32_t (*dst)[4] = nullptr;
+        if (type == kExportTypePixel && target < 8)
+        {
+            dst = result.colors[target];
+            result.colorMask |= 1u << target;
+        }
+        else if (type == kExportTypePos && target >= kExportPosBase && target < kExportPosBase + 4)
+        {
+            dst = result.positions[target - kExportPosBase];
+            result.positionMask |= 1u << (target - kExportPosBase);
+        }
+        else if (type == kExportTypeParam && target < 32)
+        {
+            dst = result.params[target];
+            result.paramMask |= 1u << target;
+        }
+        else if (type != kExportTypePixel || target != kExportPixelDepth)
+            return Fail("Export type %u target %u is not supported", type, target);
+        for (uint32_t l = 0; l < kLanes; l++)
+        {
+            if (!(active & LaneBit(l)))
+                continue;
+            uint32_t values[4];
+            for (uint32_t c = 0; c < 4; c++)
+                values[c] = swizzle[c] < 4 ? Gpr(gpr, swizzle[c], l) : (swizzle[c] == 5 ? kFloatOne : 0);
+            if (dst)
+            {
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    if (swizzle[c] != 7)
+                        dst[l][c] = values[c];
+                }
+            }
+            else
+                result.depth[l] = values[0];
+        }
+        result.depthExported |= dst ? 0 : 1;
+    }
+    return true;
+}
+
+bool ProgramInterpreter::Run()
+{
+    laneMask = input.laneCount >= 64 ? ~0ull : LaneBit(input.laneCount) - 1;
+    active = laneMask;
+    gprs.assign(kGprCount * 4 * kLanes, 0);
+    for (uint32_t l = 0; l < input.laneCount; l++)
+    {
+        for (uint32_t r = 0; r < input.inputGprCount; r++)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+                Gpr(r, c, l) = input.inputGprs[(l * input.inputGprCount + r) * 4 + c];
+        }
+    }
+    uint32_t maxLoopIterations = input.maxLoopIterations ? input.maxLoopIterations : kDefaultMaxLoopIterations;
+
+    // the CF program ends where the first clause starts
+    uint32_t cfEnd = ndw;
+    for (uint32_t i = 0; i + 2 <= cfEnd; i += 2)
+    {
+        uint32_t w0 = Dword(i);
+        uint32_t w1 = Dword(i + 1);
+        uint32_t op;
+        bool isAlu = (w1 >> 29) & 1;
+        if (!LookupCfOp(isa, isAlu ? G_SQ_CF_ALU_WORD1_CF_INST(w1) : G_SQ_CF_WORD1_CF_INST(w1), isAlu, op))
+            return Fail("Unknown CF opcode at %u", i / 2);
+        if (isAlu)
+            cfEnd = std::min(cfEnd, G_SQ_CF_ALU_WORD0_ADDR(w0) * 2);
+        else if (r600_isa_cf(op)->flags & CF_FETCH)
+            cfEnd = std::min(cfEnd, G_SQ_CF_WORD0_ADDR(w0) * 2);
+    }
+    result.cfCount = cfEnd / 2;
+    result.cfStats = (GLSL_RUN_CF_STATS*)calloc(result.cfCount ? result.cfCount : 1, sizeof(GLSL_RUN_CF_STATS));
+
+    uint32_t pc = 0;
+    bool endOfProgram = false;
+    while (!endOfProgram)
+    {
+        if (pc >= result.cfCount)
+            return Fail("Program ran past the last CF instruction");
+        uint32_t w0 = Dword(pc * 2);
+        uint32_t w1 = Dword(pc * 2 + 1);
+        GLSL_RUN_CF_STATS& stats = result.cfStats[pc];
+        stats.executeCount++;
+        stats.activeLaneCount += (uint32_t)__builtin_popcountll(active);
+        result.cfExecuteCount++;
+        uint32_t nextPc = pc + 1;
+        uint32_t op;
+        bool isAlu = (w1 >> 29) & 1;
+        LookupCfOp(isa, isAlu ? G_SQ_CF_ALU_WORD1_CF_INST(w1) : G_SQ_CF_WORD1_CF_INST(w1), isAlu, op);
+        if (isAlu)
+        {
+            if (op == CF_OP_ALU_PUSH_BEFORE)
+                PushFrame(false);
+            else if (op != CF_OP_ALU && op != CF_OP_ALU_POP_AFTER && op != CF_OP_ALU_POP2_AFTER)
+                return Fail("%s is not supported", r600_isa_cf(op)->name);
+            // clauses without active lanes are skipped
+            if (active && !RunAluClause(w0, w1, stats))
+                return false;
+            if (op == CF_OP_ALU_POP_AFTER && !PopFrames(1))
+                return false;
+            if (op == CF_OP_ALU_POP2_AFTER && !PopFrames(2))
+                return false;
+            pc = nextPc;
+            continue;
+        }
+        unsigned flags = r600_isa_cf(op)->flags;
+        if (flags & CF_EXP)
+        {
+            if (!Export(w0, w1))
+                return false;
+            endOfProgram = G_SQ_CF_ALLOC_EXPORT_WORD1_END_OF_PROGRAM(w1);
+            pc = nextPc;
+            continue;
+        }
+        if (flags & CF_MEM)
+            return Fail("%s is not supported", r600_isa_cf(op)->name);
+        endOfProgram = G_SQ_CF_WORD1_END_OF_PROGRAM(w1);
+        uint32_t addr = G_SQ_CF_WORD0_ADDR(w0);
+        uint32_t popCount = G_SQ_CF_WORD1_POP_COUNT(w1);
+        switch (op)
+        {
+        case CF_OP_TEX:
+        case CF_OP_VTX:
+        case CF_OP_VTX_TC:
+        {
+            uint32_t fetchCount = G_SQ_CF_WORD1_COUNT(w1) + (G_SQ_CF_WORD1_COUNT_3(w1) << 3) + 1;
+            bool isVtx = op != CF_OP_TEX;
+            if (active && !(isVtx ? RunVtxClause(addr * 2, fetchCount, stats) : RunTexClause(addr * 2, fetchCount, stats)))
+                return false;
+            break;
+        }
+        case CF_OP_NOP:
+        case CF_OP_CALL_FS: // the fetch shader is not run, inputGprs holds what it would load
+            break;
+        case CF_OP_PUSH:
+            PushFrame(false);
+            if (!active)
+            {
+                if (!PopFrames(popCount))
+                    return false;
+                nextPc = addr;
+            }
+            break;
+        case CF_OP_POP:
+            if (!PopFrames(popCount))
+                return false;
+            break;
+        case CF_OP_JUMP:
+            if (!active)
+            {
+                if (!PopFrames(popCount))
+                    return false;
+                nextPc = addr;
+            }
+            break;
+        case CF_OP_ELSE:
+        {
+            if (stack.empty() || stack.back().isLoop)
+                return Fail("ELSE without a branch");
+            active = stack.back().mask & ~active & ~ExcludedLanes();
+            if (!active)
+            {
+                if (!PopFrames(popCount))
+                    return false;
+                nextPc = addr;
+            }
+            break;
+        }
+        case CF_OP_LOOP_START_DX10:
+            if (!active)
+                nextPc = addr;
+            else
+                PushFrame(true);
+            break;
+        case CF_OP_LOOP_END:
+        {
+            ExecFrame* loop = InnermostLoop();
+            if (!loop)
+                return Fail("LOOP_END without a loop");
+            // a break or continue may have jumped here from inside a branch
+            stack.resize(loop - stack.data() + 1);
+            loop = &stack.back();
+            active = (active | loop->continuedLanes) & ~loop->brokenLanes & ~killed;
+            loop->continuedLanes = 0;
+            loop->iterations++;
+            if (active)
+            {
+                if (loop->iterations >= maxLoopIterations)
+                    return Fail("Loop ended at CF %u exceeded %u iterations", pc, maxLoopIterations);
+                nextPc = addr;
+            }
+            else
+            {
+                uint64_t mask = loop->mask;
+                stack.pop_back();
+                active = mask & ~ExcludedLanes();
+            }
+            break;
+        }
+        case CF_OP_LOOP_BREAK:
+        case CF_OP_LOOP_CONTINUE:
+        {
+            ExecFrame* loop = InnermostLoop();
+            if (!loop)
+                return Fail("%s outside of a loop", r600_isa_cf(op)->name);
+            (op == CF_OP_LOOP_BREAK ? loop->brokenLanes : loop->continuedLanes) |= active;
+            active = 0;
+            // once no lane of the loop is left in the current iteration the rest of the body is skipped
+            if (!(loop->mask & ~loop->brokenLanes & ~loop->continuedLanes & ~killed))
+                nextPc = addr;
+            break;
+        }
+        default:
+            return Fail("%s is not supported", r600_isa_cf(op)->name);
+        }
+        if (stack.size() > kMaxStackDepth)
+            return Fail("Stack overflow");
+        pc = nextPc;
+    }
+    result.killedLanes = killed & laneMask;
+    for (uint32_t i = 0; i < result.cfCount; i++)
+    {
+        result.aluGroupCount += result.cfStats[i].aluGroupCount;
+        result.aluCount += result.cfStats[i].aluCount;
+    }
+    return true;
+}
+
+static GLSL_RUN_RESULT* RunProgram(CafeGLSLCompiler* compiler, const void* program, uint32_t size, const GLSL_RUN_INPUT* input)
+{
+    if (!program || size < 8 || !input || input->laneCount == 0 || input->laneCount > GLSL_RUN_MAX_LANES ||
+        (input->inputGprCount && !input->inputGprs) || input->inputGprCount > kGprCount)
+        return nullptr;
+    GLSL_RUN_RESULT* result = (GLSL_RUN_RESULT*)calloc(1, sizeof(GLSL_RUN_RESULT));
+    ProgramInterpreter interpreter(compiler->r600Isa, program, size, *input, *result);
+    result->success = interpreter.Run() ? 1 : 0;
+    return result;
+}
+
+GLSL_RUN_RESULT* _RunVertexShader(CafeGLSLCompiler* compiler, const GX2VertexShader* shader, const GLSL_RUN_INPUT* input)
+{
+    return RunProgram(compiler, shader->program, shader->size, input);
+}
+
+GLSL_RUN_RESULT* _RunPixelShader(CafeGLSLCompiler* compiler, const GX2PixelShader* shader, const GLSL_RUN_INPUT* input)
+{
+    return RunProgram(compiler, shader->program, shader->size, input);
+}
+
+void _FreeRunResult(GLSL_RUN_RESULT* result)
+{
+    if (!result)
+        return;
+    free(result->cfStats);
+    free(result);
+}
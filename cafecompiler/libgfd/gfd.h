@@ -5,6 +5,8 @@
 #include <stdexcept>
 #include <vector>
 
+struct GLSL_LOOKUP_TABLE;
+
 enum GFDBlockType : uint32_t {
     EndOfFile = 1,
     Padding = 2,
@@ -19,7 +21,10 @@ enum GFDBlockType : uint32_t {
     TextureImage = 12,
     TextureMipmap = 13,
     ComputeShaderHeader = 14,
-    ComputeShaderProgram = 15
+    ComputeShaderProgram = 15,
+    // CafeGLSL name lookup tables (see GLSL_LOOKUP_TABLE). Other loaders skip unknown block types
+    VertexShaderLookupTable = 0x100,
+    PixelShaderLookupTable = 0x101,
 };
 
 struct GFDFileHeader
@@ -84,6 +89,9 @@ struct GFDFile
     std::vector<GX2PixelShader> pixelShaders;
     std::vector<GX2GeometryShader> geometryShaders;
     std::vector<GX2Texture> textures;
+    // optional, either empty or one table per shader
+    std::vector<const GLSL_LOOKUP_TABLE*> vertexShaderLookupTables;
+    std::vector<const GLSL_LOOKUP_TABLE*> pixelShaderLookupTables;
 };
 
 static constexpr uint32_t GFDFileMajorVersion = 7u;
@@ -105,3 +113,68 @@ public:
 bool readFile(GFDFile &file, const std::string &path);
 
 bool writeFile(const GFDFile &file, const std::string &path, bool align = false);
+// serializes the file to memory instead of writing it to disk
+bool writeFile(const GFDFile &file, std::vector<uint8_t> &data, bool align = false);
+
+// compressed container (.gsz). The GFD blocks are split into entries, one per shader or texture starting at its header block,
+// which are compressed individually with the codec of util/compress (zstd or zlib, whichever the build has) so any shader
+// can be read without decompressing the others. Decompressing all entries gives back the exact bytes writeFile produces
+// layout: GFDCompressedHeader, the plain GFDFileHeader, entryCount times GFDCompressedEntry, compressed entry data
+struct GFDCompressedHeader
+{
+    static constexpr uint32_t Magic = 0x4347535A; // 'CGSZ'
+    static constexpr uint32_t HeaderSize = 6 * 4;
+    static constexpr uint32_t Version = 1;
+    uint32_t magic;
+    uint32_t headerSize;
+    uint32_t version;
+    uint32_t codec; // util_compress_codec
+    uint32_t plainSize; // size of the plain GFD file
+    uint32_t entryCount;
+};
+
+struct GFDCompressedEntry
+{
+    static constexpr uint32_t EntrySize = 8 * 4;
+    uint32_t type; // GFDBlockType of the first block, a shader or texture header unless the file has none
+    uint32_t index;
+    uint32_t plainOffset; // position of the entry's blocks in the plain file
+    uint32_t plainSize;
+    uint32_t dataOffset; // position of the compressed data in the container
+    uint32_t dataSize;
+    uint32_t programOffset; // position of the program data (the image for textures) within the entry, 0 if there is none
+    uint32_t programSize;
+};
+
+// GX2 shader programs have to be 256 byte aligned
+static constexpr uint32_t GFDProgramAlignment = 0x100;
+
+// all of these fail if the build has no compression support
+bool compressFile(const std::vector<uint8_t> &plain, std::vector<uint8_t> &data);
+bool writeCompressedFile(const GFDFile &file, const std::string &path, bool align = false);
+bool writeCompressedFile(const GFDFile &file, std::vector<uint8_t> &data, bool align = false);
+
+// random access to the entries of a container. The container data is not copied and has to stay valid while the reader is used
+class GFDCompressedReader
+{
+public:
+    bool open(const uint8_t *data, size_t size);
+
+    const std::vector<GFDCompressedEntry> &entries() const { return m_entries; }
+    // type is the header block type of the shader or texture, returns nullptr if the container has no such entry
+    const GFDCompressedEntry *findEntry(GFDBlockType type, uint32_t index) const;
+
+    // decompresses one entry in a single pass. The program data goes straight to program, which must hold programSize bytes
+    // and be aligned to GFDProgramAlignment. blocks receives the other bytes of the entry, the blocks in their plain layout with
+    // the program data left out
+    bool readEntry(const GFDCompressedEntry &entry, std::vector<uint8_t> &blocks, void *program) const;
+
+    // decompresses the whole container to the plain GFD file
+    bool readPlain(std::vector<uint8_t> &plain) const;
+
+private:
+    const uint8_t *m_data{nullptr};
+    size_t m_size{0};
+    uint32_t m_plainSize{0};
+    std::vector<GFDCompressedEntry> m_entries;
+};
@@ -0,0 +1,232 @@
+#include "gfd.h"
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+#ifdef HAVE_COMPRESSION
+extern "C" {
+#include "util/compress.h"
+}
+#endif
+
+// all integers of the container are big endian like the GFD data itself
+static uint32_t readU32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+static void writeU32(std::vector<uint8_t> &fh, uint32_t value)
+{
+    fh.push_back((uint8_t)(value >> 24));
+    fh.push_back((uint8_t)(value >> 16));
+    fh.push_back((uint8_t)(value >> 8));
+    fh.push_back((uint8_t)value);
+}
+
+static void writeU32At(std::vector<uint8_t> &fh, size_t pos, uint32_t value)
+{
+    fh[pos + 0] = (uint8_t)(value >> 24);
+    fh[pos + 1] = (uint8_t)(value >> 16);
+    fh[pos + 2] = (uint8_t)(value >> 8);
+    fh[pos + 3] = (uint8_t)value;
+}
+
+static bool isEntryHeaderBlock(uint32_t type)
+{
+    return type == GFDBlockType::VertexShaderHeader || type == GFDBlockType::PixelShaderHeader ||
+           type == GFDBlockType::GeometryShaderHeader || type == GFDBlockType::TextureHeader;
+}
+
+static bool isEntryProgramBlock(uint32_t type)
+{
+    return type == GFDBlockType::VertexShaderProgram || type == GFDBlockType::PixelShaderProgram ||
+           type == GFDBlockType::GeometryShaderProgram || type == GFDBlockType::TextureImage;
+}
+
+bool compressFile(const std::vector<uint8_t> &plain, std::vector<uint8_t> &fh)
+{
+#ifdef HAVE_COMPRESSION
+    fh.clear();
+    if (plain.size() < GFDFileHeader::HeaderSize || readU32(plain.data()) != GFDFileHeader::Magic)
+        return false;
+
+    // split the blocks into entries, each one starts at a shader or texture header block
+    std::vector<GFDCompressedEntry> entries;
+    size_t pos = GFDFileHeader::HeaderSize;
+    while (pos < plain.size())
+    {
+        if (plain.size() - pos < GFDBlockHeader::HeaderSize || readU32(plain.data() + pos) != GFDBlockHeader::Magic)
+            return false;
+        const uint32_t type = readU32(plain.data() + pos + 4 * 4);
+        const uint32_t dataSize = readU32(plain.data() + pos + 5 * 4);
+        const uint32_t index = readU32(plain.data() + pos + 7 * 4);
+        if (plain.size() - pos - GFDBlockHeader::HeaderSize < dataSize)
+            return false;
+        if (entries.empty() || isEntryHeaderBlock(type))
+        {
+            GFDCompressedEntry entry{};
+            entry.type = type;
+            entry.index = index;
+            entry.plainOffset = (uint32_t)pos;
+            entries.push_back(entry);
+        }
+        GFDCompressedEntry &entry = entries.back();
+        if (isEntryProgramBlock(type) && entry.programSize == 0)
+        {
+            entry.programOffset = (uint32_t)(pos + GFDBlockHeader::HeaderSize - entry.plainOffset);
+            entry.programSize = dataSize;
+        }
+        pos += GFDBlockHeader::HeaderSize + dataSize;
+        entry.plainSize = (uint32_t)(pos - entry.plainOffset);
+    }
+
+    writeU32(fh, GFDCompressedHeader::Magic);
+    writeU32(fh, GFDCompressedHeader::HeaderSize);
+    writeU32(fh, GFDCompressedHeader::Version);
+    writeU32(fh, (uint32_t)util_compress_get_codec());
+    writeU32(fh, (uint32_t)plain.size());
+    writeU32(fh, (uint32_t)entries.size());
+    fh.insert(fh.end(), plain.begin(), plain.begin() + GFDFileHeader::HeaderSize);
+    const size_t indexPos = fh.size();
+    fh.resize(indexPos + entries.size() * GFDCompressedEntry::EntrySize);
+
+    std::vector<uint8_t> compressed;
+    for (auto &entry : entries)
+    {
+        compressed.resize(util_compress_max_compressed_len(entry.plainSize));
+        size_t compressedSize = util_compress_deflate(plain.data() + entry.plainOffset, entry.plainSize, compressed.data(), compressed.size());
+        if (compressedSize == 0)
+            return false;
+        entry.dataOffset = (uint32_t)fh.size();
+        entry.dataSize = (uint32_t)compressedSize;
+        fh.insert(fh.end(), compressed.begin(), compressed.begin() + compressedSize);
+    }
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const GFDCompressedEntry &entry = entries[i];
+        const size_t entryPos = indexPos + i * GFDCompressedEntry::EntrySize;
+        writeU32At(fh, entryPos + 0 * 4, entry.type);
+        writeU32At(fh, entryPos + 1 * 4, entry.index);
+        writeU32At(fh, entryPos + 2 * 4, entry.plainOffset);
+        writeU32At(fh, entryPos + 3 * 4, entry.plainSize);
+        writeU32At(fh, entryPos + 4 * 4, entry.dataOffset);
+        writeU32At(fh, entryPos + 5 * 4, entry.dataSize);
+        writeU32At(fh, entryPos + 6 * 4, entry.programOffset);
+        writeU32At(fh, entryPos + 7 * 4, entry.programSize);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool writeCompressedFile(const GFDFile &file, std::vector<uint8_t> &data, bool align)
+{
+    std::vector<uint8_t> plain;
+    if (!writeFile(file, plain, align))
+        return false;
+    return compressFile(plain, data);
+}
+
+bool writeCompressedFile(const GFDFile &file, const std::string &path, bool align)
+{
+    std::vector<uint8_t> fh;
+    if (!writeCompressedFile(file, fh, align))
+        return false;
+    std::ofstream out{path, std::ofstream::binary};
+    out.write(reinterpret_cast<const char *>(fh.data()), fh.size());
+    return out.good();
+}
+
+bool GFDCompressedReader::open(const uint8_t *data, size_t size)
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_entries.clear();
+#ifdef HAVE_COMPRESSION
+    if (size < GFDCompressedHeader::HeaderSize + GFDFileHeader::HeaderSize || readU32(data) != GFDCompressedHeader::Magic ||
+        readU32(data + 1 * 4) != GFDCompressedHeader::HeaderSize || readU32(data + 2 * 4) != GFDCompressedHeader::Version)
+        return false;
+    // the codec is fixed at build time
+    if (readU32(data + 3 * 4) != (uint32_t)util_compress_get_codec())
+        return false;
+    m_plainSize = readU32(data + 4 * 4);
+    const uint32_t entryCount = readU32(data + 5 * 4);
+    const size_t indexPos = GFDCompressedHeader::HeaderSize + GFDFileHeader::HeaderSize;
+    if ((size - indexPos) / GFDCompressedEntry::EntrySize < entryCount)
+        return false;
+    m_entries.resize(entryCount);
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        const uint8_t *entryData = data + indexPos + i * GFDCompressedEntry::EntrySize;
+        GFDCompressedEntry &entry = m_entries[i];
+        entry.type = readU32(entryData + 0 * 4);
+        entry.index = readU32(entryData + 1 * 4);
+        entry.plainOffset = readU32(entryData + 2 * 4);
+        entry.plainSize = readU32(entryData + 3 * 4);
+        entry.dataOffset = readU32(entryData + 4 * 4);
+        entry.dataSize = readU32(entryData + 5 * 4);
+        entry.programOffset = readU32(entryData + 6 * 4);
+        entry.programSize = readU32(entryData + 7 * 4);
+        if (entry.dataOffset > size || size - entry.dataOffset < entry.dataSize ||
+            entry.plainOffset > m_plainSize || m_plainSize - entry.plainOffset < entry.plainSize ||
+            entry.programOffset > entry.plainSize || entry.plainSize - entry.programOffset < entry.programSize)
+        {
+            m_entries.clear();
+            return false;
+        }
+    }
+    m_data = data;
+    m_size = size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+const GFDCompressedEntry *GFDCompressedReader::findEntry(GFDBlockType headerType, uint32_t index) const
+{
+    for (const auto &entry : m_entries)
+    {
+        if (entry.type == (uint32_t)headerType && entry.index == index)
+            return &entry;
+    }
+    return nullptr;
+}
+
+bool GFDCompressedReader::readEntry(const GFDCompressedEntry &entry, std::vector<uint8_t> &blocks, void *program) const
+{
+#ifdef HAVE_COMPRESSION
+    if (!m_data || (entry.programSize != 0 && (reinterpret_cast<uintptr_t>(program) & (GFDProgramAlignment - 1)) != 0))
+        return false;
+    util_inflate_stream *stream = util_compress_inflate_begin(m_data + entry.dataOffset, entry.dataSize);
+    if (!stream)
+        return false;
+    blocks.resize(entry.plainSize - entry.programSize);
+    const uint32_t tailSize = entry.plainSize - entry.programOffset - entry.programSize;
+    bool success = util_compress_inflate_next(stream, blocks.data(), entry.programOffset) &&
+                   util_compress_inflate_next(stream, (uint8_t *)program, entry.programSize) &&
+                   util_compress_inflate_next(stream, blocks.data() + entry.programOffset, tailSize);
+    return util_compress_inflate_end(stream) && success;
+#else
+    return false;
+#endif
+}
+
+bool GFDCompressedReader::readPlain(std::vector<uint8_t> &plain) const
+{
+#ifdef HAVE_COMPRESSION
+    if (!m_data)
+        return false;
+    plain.assign(m_data + GFDCompressedHeader::HeaderSize, m_data + GFDCompressedHeader::HeaderSize + GFDFileHeader::HeaderSize);
+    plain.resize(m_plainSize);
+    for (const auto &entry : m_entries)
+    {
+        if (!util_compress_inflate(m_data + entry.dataOffset, entry.dataSize, plain.data() + entry.plainOffset, entry.plainSize))
+            return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -1,4 +1,5 @@
 #include "gfd.h"
+#include "./../CafeGLSLCompiler.h"
 #include <fstream>
 #include <cstring>
 #include <string.h>
@@ -508,6 +509,31 @@ static bool writeGeometryShader(std::vector<uint8_t> &fh, const GX2GeometryShade
     return true;
 }
 
+static bool writeLookupTable(std::vector<uint8_t> &fh, const GLSL_LOOKUP_TABLE *table)
+{
+    write<uint32_t>(fh, table->magic);
+    write<uint32_t>(fh, table->bucketCount);
+    write<uint32_t>(fh, table->slotCount);
+    write<uint32_t>(fh, table->entryCount);
+
+    auto displacements = reinterpret_cast<const uint32_t *>(table + 1);
+    for (auto i = 0u; i < table->bucketCount; ++i)
+    {
+        write<uint32_t>(fh, displacements[i]);
+    }
+
+    auto slots = reinterpret_cast<const GLSL_LOOKUP_ENTRY *>(displacements + table->bucketCount);
+    for (auto i = 0u; i < table->slotCount; ++i)
+    {
+        write<uint32_t>(fh, slots[i].nameHashHigh);
+        write<uint32_t>(fh, slots[i].nameHashLow);
+        write<uint16_t>(fh, slots[i].kind);
+        write<uint16_t>(fh, slots[i].index);
+        write<int32_t>(fh, slots[i].location);
+    }
+    return true;
+}
+
 static bool writeTexture(MemoryFile &fh, const GX2Texture &texture)
 {
     write<uint32_t>(fh, static_cast<uint32_t>(texture.surface.dim));
@@ -589,9 +615,9 @@ static bool alignNextBlock(MemoryFile &fh, uint32_t &blockID)
     return true;
 }
 
-bool writeFile(const GFDFile &file, const std::string &path, bool align)
+bool writeFile(const GFDFile &file, std::vector<uint8_t> &fh, bool align)
 {
-    MemoryFile fh;
+    fh.clear();
     auto blockID = uint32_t{0};
 
     // Write File Header
@@ -635,6 +661,20 @@ bool writeFile(const GFDFile &file, const std::string &path, bool align)
         uint8_t* program = (uint8_t*)file.vertexShaders[i].program;
         const std::vector<uint8_t> shaderData(program, program + size);
         writeBlock(fh, dataHeader, shaderData);
+
+        if (i < file.vertexShaderLookupTables.size())
+        {
+            std::vector<uint8_t> lookupTable;
+            writeLookupTable(lookupTable, file.vertexShaderLookupTables[i]);
+
+            GFDBlockHeader lookupHeader;
+            lookupHeader.majorVersion = GFDBlockMajorVersion;
+            lookupHeader.minorVersion = 0;
+            lookupHeader.type = GFDBlockType::VertexShaderLookupTable;
+            lookupHeader.id = blockID++;
+            lookupHeader.index = i;
+            writeBlock(fh, lookupHeader, lookupTable);
+        }
     }
 
     // Write pixel shaders
@@ -667,6 +707,20 @@ bool writeFile(const GFDFile &file, const std::string &path, bool align)
         uint8_t* program = (uint8_t*)file.pixelShaders[i].program;
         const std::vector<uint8_t> shaderData(program, program + size);
         writeBlock(fh, dataHeader, shaderData);
+
+        if (i < file.pixelShaderLookupTables.size())
+        {
+            std::vector<uint8_t> lookupTable;
+            writeLookupTable(lookupTable, file.pixelShaderLookupTables[i]);
+
+            GFDBlockHeader lookupHeader;
+            lookupHeader.majorVersion = GFDBlockMajorVersion;
+            lookupHeader.minorVersion = 0;
+            lookupHeader.type = GFDBlockType::PixelShaderLookupTable;
+            lookupHeader.id = blockID++;
+            lookupHeader.index = i;
+            writeBlock(fh, lookupHeader, lookupTable);
+        }
     }
 
     // Write geometry shaders
@@ -761,7 +815,7 @@ bool writeFile(const GFDFile &file, const std::string &path, bool align)
             GFDBlockHeader mipmapHeader;
             mipmapHeader.majorVersion = GFDBlockMajorVersion;
             mipmapHeader.minorVersion = 0;
-            mipmapHeader.type = GFDBlockType::TextureImage;
+            mipmapHeader.type = GFDBlockType::TextureMipmap;
             mipmapHeader.id = blockID++;
             mipmapHeader.index = i;
 
@@ -780,7 +834,14 @@ bool writeFile(const GFDFile &file, const std::string &path, bool align)
     eofHeader.id = blockID++;
     eofHeader.index = 0;
     writeBlock(fh, eofHeader, {});
+    return true;
+}
 
+bool writeFile(const GFDFile &file, const std::string &path, bool align)
+{
+    MemoryFile fh;
+    if (!writeFile(file, fh, align))
+        return false;
     std::ofstream out{path, std::ofstream::binary};
     out.write(reinterpret_cast<const char *>(fh.data()), fh.size());
     return true;
@@ -0,0 +1,162 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "cafe_glsl_compiler.h"
+
+// builds the name lookup tables described in CafeGLSLCompiler.h
+// the tables use hash and displace: a key's bucket is selected by its name hash and every bucket stores
+// a displacement which moves all of its keys into free slots. Buckets are placed largest first
+
+struct LookupKey
+{
+    uint64_t hash;
+    uint16_t kind;
+    uint16_t index;
+    int32_t location;
+};
+
+static uint32_t NextPowerOfTwo(uint32_t v)
+{
+    uint32_t r = 1;
+    while (r < v)
+        r <<= 1;
+    return r;
+}
+
+// assign every bucket a displacement. Returns false if a bucket could not be placed
+static bool PlaceBuckets(const std::vector<LookupKey>& keys, const std::vector<std::vector<uint32_t>>& buckets, uint32_t slotCount, std::vector<uint32_t>& displacements, std::vector<int32_t>& slotToKey)
+{
+    std::vector<uint32_t> bucketOrder(buckets.size());
+    for (uint32_t i = 0; i < bucketOrder.size(); i++)
+        bucketOrder[i] = i;
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    slotToKey.assign(slotCount, -1);
+    displacements.assign(buckets.size(), 0);
+    std::vector<uint32_t> bucketSlots;
+    for (uint32_t bucketIndex : bucketOrder)
+    {
+        const std::vector<uint32_t>& bucket = buckets[bucketIndex];
+        if (bucket.empty())
+            break;
+        bool placed = false;
+        for (uint32_t displacement = 0; displacement < 0x10000 && !placed; displacement++)
+        {
+            bucketSlots.clear();
+            placed = true;
+            for (uint32_t keyIndex : bucket)
+            {
+                uint32_t slot = GLSL_GetLookupTableSlot(keys[keyIndex].hash, displacement, slotCount);
+                if (slotToKey[slot] >= 0 || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+                {
+                    placed = false;
+                    break;
+                }
+                bucketSlots.emplace_back(slot);
+            }
+            if (!placed)
+                continue;
+            for (size_t i = 0; i < bucket.size(); i++)
+                slotToKey[bucketSlots[i]] = (int32_t)bucket[i];
+            displacements[bucketIndex] = displacement;
+        }
+        if (!placed)
+            return false;
+    }
+    return true;
+}
+
+static GLSL_LOOKUP_TABLE* BuildLookupTable(std::vector<LookupKey>& keys)
+{
+    // a name can only be stored once per kind
+    std::stable_sort(keys.begin(), keys.end(), [](const LookupKey& a, const LookupKey& b) { return a.hash < b.hash; });
+    keys.erase(std::unique(keys.begin(), keys.end(), [](const LookupKey& a, const LookupKey& b) { return a.hash == b.hash; }), keys.end());
+
+    uint32_t keyCount = (uint32_t)keys.size();
+    uint32_t bucketCount = NextPowerOfTwo(std::max(1u, keyCount / 2));
+    uint32_t slotCount = NextPowerOfTwo(std::max(1u, keyCount + keyCount / 4));
+    std::vector<std::vector<uint32_t>> buckets(bucketCount);
+    for (uint32_t i = 0; i < keyCount; i++)
+        buckets[GLSL_GetLookupTableBucket(keys[i].hash, bucketCount)].emplace_back(i);
+
+    std::vector<uint32_t> displacements;
+    std::vector<int32_t> slotToKey;
+    while (!PlaceBuckets(keys, buckets, slotCount, displacements, slotToKey))
+        slotCount <<= 1;
+
+    GLSL_LOOKUP_TABLE tableHeader{};
+    tableHeader.magic = GLSL_LOOKUP_TABLE_MAGIC;
+    tableHeader.bucketCount = bucketCount;
+    tableHeader.slotCount = slotCount;
+    tableHeader.entryCount = keyCount;
+    uint32_t tableSize = GLSL_GetLookupTableSize(&tableHeader);
+    GLSL_LOOKUP_TABLE* table = (GLSL_LOOKUP_TABLE*)calloc(1, tableSize);
+    *table = tableHeader;
+    uint32_t* tableDisplacements = (uint32_t*)(table + 1);
+    GLSL_LOOKUP_ENTRY* tableSlots = (GLSL_LOOKUP_ENTRY*)(tableDisplacements + bucketCount);
+    memcpy(tableDisplacements, displacements.data(), bucketCount * sizeof(uint32_t));
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        if (slotToKey[i] < 0)
+            continue;
+        const LookupKey& key = keys[slotToKey[i]];
+        tableSlots[i].nameHashHigh = (uint32_t)(key.hash >> 32);
+        tableSlots[i].nameHashLow = (uint32_t)key.hash;
+        tableSlots[i].kind = key.kind;
+        tableSlots[i].index = key.index;
+        tableSlots[i].location = key.location;
+    }
+    return table;
+}
+
+static void AddLookupKey(std::vector<LookupKey>& keys, GLSL_SHADER_VAR_KIND kind, const char* name, uint32_t index, int32_t location)
+{
+    LookupKey key;
+    key.hash = GLSL_HashShaderVarName(kind, name);
+    key.kind = (uint16_t)kind;
+    key.index = (uint16_t)index;
+    key.location = location;
+    keys.emplace_back(key);
+}
+
+template<typename T>
+static void AddShaderVarKeys(std::vector<LookupKey>& keys, const T* shader)
+{
+    for (uint32_t i = 0; i < shader->uniformBlockCount; i++)
+        AddLookupKey(keys, GLSL_SHADER_VAR_KIND_UNIFORM_BLOCK, shader->uniformBlocks[i].name, i, (int32_t)shader->uniformBlocks[i].offset);
+    for (uint32_t i = 0; i < shader->uniformVarCount; i++)
+        AddLookupKey(keys, GLSL_SHADER_VAR_KIND_UNIFORM_VAR, shader->uniformVars[i].name, i, (int32_t)shader->uniformVars[i].offset);
+    for (uint32_t i = 0; i < shader->samplerVarCount; i++)
+        AddLookupKey(keys, GLSL_SHADER_VAR_KIND_SAMPLER, shader->samplerVars[i].name, i, (int32_t)shader->samplerVars[i].location);
+}
+
+GLSL_LOOKUP_TABLE* _CreateVertexShaderLookupTable(const GX2VertexShader* shader)
+{
+    std::vector<LookupKey> keys;
+    AddShaderVarKeys(keys, shader);
+    for (uint32_t i = 0; i < shader->attribVarCount; i++)
+        AddLookupKey(keys, GLSL_SHADER_VAR_KIND_ATTRIB, shader->attribVars[i].name, i, (int32_t)shader->attribVars[i].location);
+    return BuildLookupTable(keys);
+}
+
+GLSL_LOOKUP_TABLE* _CreatePixelShaderLookupTable(const GX2PixelShader* shader)
+{
+    std::vector<LookupKey> keys;
+    AddShaderVarKeys(keys, shader);
+    return BuildLookupTable(keys);
+}
+
+void _FreeLookupTable(GLSL_LOOKUP_TABLE* table)
+{
+    free(table);
+}
+
+const GLSL_LOOKUP_ENTRY* _LookupShaderVar(const GLSL_LOOKUP_TABLE* table, GLSL_SHADER_VAR_KIND kind, const char* name)
+{
+    assert(table->magic == GLSL_LOOKUP_TABLE_MAGIC);
+    return GLSL_LookupShaderVarByHash(table, GLSL_HashShaderVarName(kind, name));
+}
@@ -1,14 +1,22 @@
 #include "gx2_definitions.h"
 #include "CafeGLSLCompiler.h" // the public header
+#include "cafe_glsl_compiler.h" // internal, for BenchmarkTypeLookups
 
 #include "tests.h"
+#include "texture.h"
+#include "corpus.h"
+#include "server.h"
 #include "./libgfd/gfd.h"
 
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <map>
 #include <cstring>
+#include <cstdlib>
+#include <chrono>
 #include <unistd.h>
 
 void PrintUsage()
@@ -17,7 +25,38 @@ void PrintUsage()
     std::cout << "Options:\n";
     std::cout << "  -ps <file>        : Pixel shader file (can be used multiple times to pack multiple shaders into .gsh file)\n";
     std::cout << "  -vs <file>        : Vertex shader file (can be used multiple times to pack multiple shaders into .gsh file)\n";
-    std::cout << "  -o <file>         : Output path for .gsh file (default: no file is written)\n";
+    std::cout << "  -o <file>         : Output path for .gsh or .gtx file (default: no file is written)\n";
+    std::cout << "  -perm <file>      : Permutation file. Each line is a set of defines (NAME or NAME=VALUE, separated by spaces). Every shader is compiled once per line and identical results are only stored once\n";
+    std::cout << "  -spec <name=values>: Bake a uniform value into the shaders. Values are separated by commas, values containing a '.' or an exponent are floats, others are integers. E.g. -spec uKernelSize=5 or -spec uTint=1.0,0.5,0.5\n";
+    std::cout << "  -include <path=file>: Make the file available to #include under the absolute path, e.g. -include /lib/lighting.glsl=lighting.glsl\n";
+    std::cout << "  -lookup           : Store a name lookup table (GLSL_LOOKUP_TABLE) for every shader in the .gsh file\n";
+    std::cout << "  -arena            : Allocate the AST and IR of each compile from a single arena\n";
+    std::cout << "  -allocstats       : Print allocation counts and peak heap usage of each compile\n";
+    std::cout << "  -packalu          : Schedule ALU instructions with a lookahead that fills more slots of each ALU group\n";
+    std::cout << "  -kcachesched      : Schedule ALU instructions which read the same uniform cache lines together to avoid ALU clause splits\n";
+    std::cout << "  -hoistfetch       : Compute fetch addresses first and batch texture and vertex fetches into few large clauses\n";
+    std::cout << "  -size             : Optimize for program size: limited loop unrolling, shared literals and branches instead of predication. Prints the size against the regular compile\n";
+    std::cout << "  -arraygprs        : Keep indexed temporary arrays in GPRs while they fit into the GPR budget instead of using scratch memory\n";
+    std::cout << "  -gprbudget <n>    : Recompile shaders which need more than n GPRs with register pressure scheduling and without sb. Prints the achieved GPR count\n";
+    std::cout << "  -cbufs <n>        : Number of color buffers bound to the pixel shaders. Color outputs above are not exported (default: one per color output)\n";
+    std::cout << "  -direct           : Translate the linked shaders directly with an explicit shader key, skipping the state tracker variants and gallium CSOs\n";
+    std::cout << "  -benchpipeline <n>: Compile every shader n times with the regular and the direct pipeline and print the average compile times\n";
+    std::cout << "  -tex <files>      : Bake a texture into the output file. Accepts PAM, binary PPM and DDS images, multiple comma separated files become the slices of a 2D array (can be used multiple times)\n";
+    std::cout << "  -texformat <name> : Texture format: rgba8, rgba8_srgb, bc1, bc1_srgb, bc2, bc2_srgb, bc3, bc3_srgb, bc4, bc5 (default: rgba8 or the format of a DDS file)\n";
+    std::cout << "  -texmips <count>  : Number of mip levels to generate, 0 for the full chain (default: 0)\n";
+    std::cout << "  -textile <mode>   : Texture tile mode: linear, 1d or 2d (default: 2d)\n";
+    std::cout << "  -estimate         : Print a static cycle estimate with an annotated clause listing for every compiled shader\n";
+    std::cout << "  -corpus <dir>     : Compile every .vs/.vert and .ps/.fs/.frag file in the directory and its subdirectories and collect codegen stats\n";
+    std::cout << "  -stats <file>     : Write the corpus stats to this file. Without -corpus the file is read and compared against -baseline\n";
+    std::cout << "  -baseline <file>  : Stats file of a previous run. Prints per shader and total deltas of the corpus stats\n";
+    std::cout << "  -compress         : Write the -o file as a compressed container with per shader random access (.gsz) instead of a plain .gsh file\n";
+    std::cout << "  -benchgsz <file>  : Compare the read throughput of a .gsh file against a compressed copy of it\n";
+    std::cout << "  -benchtypes <n>   : Measure the glsl type lookup throughput with 1 to n threads\n";
+    std::cout << "  -server <socket>  : Run a compile server on the unix domain socket. Options such as -spec, -include, -cbufs and -gprbudget apply to all requests\n";
+    std::cout << "  -workers <n>      : Number of compiler instances of the compile server (default: one per hardware thread)\n";
+    std::cout << "  -connect <socket> : Compile the -vs/-ps shaders with a running compile server instead of in this process. Compile flags are sent along\n";
+    std::cout << "  -raw              : With -connect, write the program of a single shader to the -o file instead of a .gsh file\n";
+    std::cout << "  -stopserver <socket>: Shut down a running compile server\n";
     std::cout << "  -t                : Run tests\n";
     std::cout << "  -v                : Verbose output (prints assembly and debug information)\n";
 }
@@ -77,12 +116,31 @@ const void RestoreStdErrHook(uint64_t stderrBackup) {
 }
 
 
-GX2PixelShader *CompilePixelShader(const std::string &shaderSource, const std::string &shaderFile, bool printAssembly)
+// prints the achieved GPR count of the last compiled shader if a budget was set
+void PrintGprBudgetResult()
 {
+    GLSL_SHADER_STATS stats;
+    if (!GLSL_GetLastShaderStats(&stats) || stats.gprBudget == 0)
+        return;
+    std::cout << "  GPRs: " << stats.optimized.gprCount << " (budget " << stats.gprBudget << (stats.optimized.gprCount > stats.gprBudget ? ", not met)\n" : ")\n");
+}
+
+// prints the program size of the last compiled shader against the regular compile if it was compiled for size
+void PrintSizeResult()
+{
+    GLSL_SHADER_STATS stats;
+    if (!GLSL_GetLastShaderStats(&stats) || stats.sizeBaselineNdw == 0)
+        return;
+    std::cout << "  Size: " << stats.optimized.ndw << " dwords (" << stats.sizeBaselineNdw << " without size optimization)\n";
+}
+
+GX2PixelShader *CompilePixelShader(const std::string &shaderSource, const std::string &shaderFile, GLSL_COMPILER_FLAG flags)
+{
+    bool printAssembly = (flags & GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY) != 0;
     char infoLogBuffer[1024];
     std::cout << "Compiling pixel shader: " << shaderFile << "\n";
     uint64_t storedStdErr = printAssembly ? HookStdErrToStdOut() : 0;
-    GX2PixelShader *ps = GLSL_CompilePixelShader(shaderSource.c_str(), infoLogBuffer, 1024, printAssembly ? GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY : GLSL_COMPILER_FLAG_NONE);
+    GX2PixelShader *ps = GLSL_CompilePixelShader(shaderSource.c_str(), infoLogBuffer, 1024, flags);
     if (printAssembly)
         RestoreStdErrHook(storedStdErr);
 
@@ -92,15 +150,18 @@ GX2PixelShader *CompilePixelShader(const std::string &shaderSource, const std::s
         std::cerr << infoLogBuffer << "\n";
         exit(-2);
     }
+    PrintGprBudgetResult();
+    PrintSizeResult();
     return ps;
 }
 
-GX2VertexShader *CompileVertexShader(const std::string &shaderSource, const std::string &shaderFile, bool printAssembly)
+GX2VertexShader *CompileVertexShader(const std::string &shaderSource, const std::string &shaderFile, GLSL_COMPILER_FLAG flags)
 {
+    bool printAssembly = (flags & GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY) != 0;
     char infoLogBuffer[1024];
     std::cout << "Compiling vertex shader: " << shaderFile << "\n";
     uint64_t storedStdErr = printAssembly ? HookStdErrToStdOut() : 0;
-    GX2VertexShader *vs = GLSL_CompileVertexShader(shaderSource.c_str(), infoLogBuffer, 1024, printAssembly ? GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY : GLSL_COMPILER_FLAG_NONE);
+    GX2VertexShader *vs = GLSL_CompileVertexShader(shaderSource.c_str(), infoLogBuffer, 1024, flags);
     if (printAssembly)
         RestoreStdErrHook(storedStdErr);
 
@@ -111,9 +172,341 @@ GX2VertexShader *CompileVertexShader(const std::string &shaderSource, const std:
                   << infoLogBuffer << "\n";
         exit(-2);
     }
+    PrintGprBudgetResult();
+    PrintSizeResult();
     return vs;
 }
 
+template<typename T>
+double TimeCompiles(T *(*compileFunc)(const char*, char*, int, GLSL_COMPILER_FLAG), void (*freeFunc)(T*), const std::string &shaderSource, uint32_t iterations, GLSL_COMPILER_FLAG flags, std::vector<uint8_t> &program)
+{
+    char infoLogBuffer[1024];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        T *shader = compileFunc(shaderSource.c_str(), infoLogBuffer, 1024, flags);
+        if (!shader)
+        {
+            std::cerr << infoLogBuffer << "\n";
+            exit(-2);
+        }
+        if (i + 1 == iterations)
+            program.assign((const uint8_t*)shader->program, (const uint8_t*)shader->program + shader->size);
+        freeFunc(shader);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// compares the regular pipeline (st variant + gallium CSO + r600_shader_select) against GLSL_COMPILER_FLAG_DIRECT_PIPELINE
+template<typename T>
+void BenchmarkCompilePipelines(T *(*compileFunc)(const char*, char*, int, GLSL_COMPILER_FLAG), void (*freeFunc)(T*), const std::string &shaderSource, const std::string &shaderFile, uint32_t iterations, GLSL_COMPILER_FLAG flags)
+{
+    std::vector<uint8_t> regularProgram, directProgram;
+    // warm up the builtin function and type caches
+    TimeCompiles(compileFunc, freeFunc, shaderSource, 1, flags, regularProgram);
+    double regularMs = TimeCompiles(compileFunc, freeFunc, shaderSource, iterations, (GLSL_COMPILER_FLAG)(flags & ~GLSL_COMPILER_FLAG_DIRECT_PIPELINE), regularProgram);
+    double directMs = TimeCompiles(compileFunc, freeFunc, shaderSource, iterations, (GLSL_COMPILER_FLAG)(flags | GLSL_COMPILER_FLAG_DIRECT_PIPELINE), directProgram);
+    std::cout << shaderFile << ": regular " << regularMs << " ms, direct " << directMs << " ms per compile (" << iterations << " compiles, " << (regularMs / directMs) << "x)";
+    std::cout << (regularProgram == directProgram ? "\n" : ", programs differ!\n");
+}
+
+std::vector<std::vector<std::string>> ReadPermutationFile(const std::string &filePath)
+{
+    std::vector<std::vector<std::string>> permutations;
+    std::istringstream fileStream(ReadFile(filePath));
+    std::string line;
+    while (std::getline(fileStream, line))
+    {
+        std::istringstream lineStream(line);
+        std::vector<std::string> defines;
+        std::string define;
+        while (lineStream >> define)
+            defines.emplace_back(define);
+        if (!defines.empty())
+            permutations.emplace_back(defines);
+    }
+    return permutations;
+}
+
+// parses name=v0,v1,... into a name and raw 32bit values
+bool ParseUniformSpecialization(const std::string &arg, std::string &name, std::vector<uint32_t> &values)
+{
+    size_t separator = arg.find('=');
+    if (separator == std::string::npos || separator == 0)
+        return false;
+    name = arg.substr(0, separator);
+    std::istringstream valueStream(arg.substr(separator + 1));
+    std::string valueStr;
+    while (std::getline(valueStream, valueStr, ','))
+    {
+        if (valueStr.empty())
+            return false;
+        uint32_t value;
+        if (valueStr.find_first_of(".eE") != std::string::npos && valueStr.find_first_of("xX") == std::string::npos)
+        {
+            float f = std::stof(valueStr);
+            memcpy(&value, &f, sizeof(uint32_t));
+        }
+        else
+        {
+            value = (uint32_t)std::stoll(valueStr, nullptr, 0);
+        }
+        values.emplace_back(value);
+    }
+    return !values.empty();
+}
+
+template<typename T>
+void AddPermutationsToFile(std::vector<T> &fileShaders, T **shaderTable, uint32_t count, const std::string &shaderFile)
+{
+    std::map<T*, size_t> shaderIndices;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto it = shaderIndices.find(shaderTable[i]);
+        if (it == shaderIndices.end())
+        {
+            it = shaderIndices.emplace(shaderTable[i], fileShaders.size()).first;
+            fileShaders.push_back(*shaderTable[i]);
+        }
+        std::cout << shaderFile << " permutation " << i << " -> shader index " << it->second << "\n";
+    }
+}
+
+template<typename T>
+T **CompileShaderPermutations(T **(*compileFunc)(const char*, const GLSL_DEFINE_SET*, uint32_t, char*, int, GLSL_COMPILER_FLAG), const std::string &shaderSource, const std::string &shaderFile, const std::vector<std::vector<std::string>> &permutations, GLSL_COMPILER_FLAG flags)
+{
+    bool printAssembly = (flags & GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY) != 0;
+    char infoLogBuffer[1024];
+    std::cout << "Compiling " << permutations.size() << " permutations of shader: " << shaderFile << "\n";
+    std::vector<std::vector<const char*>> defineStrings(permutations.size());
+    std::vector<GLSL_DEFINE_SET> defineSets(permutations.size());
+    for (size_t i = 0; i < permutations.size(); i++)
+    {
+        for (const auto &define : permutations[i])
+            defineStrings[i].emplace_back(define.c_str());
+        defineSets[i].defines = defineStrings[i].data();
+        defineSets[i].defineCount = (uint32_t)defineStrings[i].size();
+    }
+    uint64_t storedStdErr = printAssembly ? HookStdErrToStdOut() : 0;
+    T **shaderTable = compileFunc(shaderSource.c_str(), defineSets.data(), (uint32_t)defineSets.size(), infoLogBuffer, 1024, flags);
+    if (printAssembly)
+        RestoreStdErrHook(storedStdErr);
+
+    if (!shaderTable)
+    {
+        std::cerr << "Shader " << shaderFile << " failed to compile:\n";
+        std::cerr << infoLogBuffer << "\n";
+        exit(-2);
+    }
+    return shaderTable;
+}
+
+template<typename T>
+void PrintShaderEstimates(const std::vector<T> &shaders, bool (*estimateFunc)(const T*, GLSL_PROGRAM_ESTIMATE*, bool), const char *shaderKind)
+{
+    for (size_t i = 0; i < shaders.size(); i++)
+    {
+        std::cout << "Estimate of " << shaderKind << " shader " << i << ":\n";
+        GLSL_PROGRAM_ESTIMATE estimate;
+        uint64_t storedStdErr = HookStdErrToStdOut();
+        bool success = estimateFunc(&shaders[i], &estimate, true);
+        RestoreStdErrHook(storedStdErr);
+        if (!success)
+            std::cerr << "Failed to estimate " << shaderKind << " shader " << i << "\n";
+    }
+}
+
+// compiles all shaders with a compile server in a single request and writes the returned .gsh or program to outputPath
+int RunCompileClient(const std::string &socketPath, const std::vector<std::pair<std::string, std::string>> &shaders, const std::string &outputPath, GLSL_COMPILER_FLAG flags, bool rawProgram)
+{
+    CompileServerRequest request;
+    request.flags = flags;
+    request.output = rawProgram ? CompileServerOutput::GX2_PROGRAM : CompileServerOutput::GSH;
+    for (const auto &shader : shaders)
+        request.shaders.push_back({shader.first == "-ps", ReadFile(shader.second)});
+
+    CompileServerResponse response;
+    std::string error;
+    if (!SendCompileServerRequest(socketPath, request, response, error))
+    {
+        std::cerr << error << "\n";
+        return -1;
+    }
+    if (response.status == CompileServerStatus::COMPILE_ERROR)
+    {
+        // the info log starts with the index of the failing shader
+        std::string infoLog(response.payload.begin(), response.payload.end());
+        size_t index = infoLog.compare(0, 7, "Shader ") == 0 ? strtoul(infoLog.c_str() + 7, nullptr, 10) : shaders.size();
+        std::cerr << "Shader " << (index < shaders.size() ? shaders[index].second : socketPath) << " failed to compile:\n";
+        std::cerr << infoLog << "\n";
+        return -2;
+    }
+    if (response.status != CompileServerStatus::OK)
+    {
+        std::cerr << "The compile server rejected the request\n";
+        return -1;
+    }
+    if (outputPath.empty())
+        return 0;
+    size_t offset = 0;
+    if (rawProgram)
+        offset = sizeof(uint32_t); // skip the program size of the only shader
+    std::ofstream out(outputPath, std::ofstream::binary);
+    out.write((const char*)response.payload.data() + offset, response.payload.size() - offset);
+    if (!out)
+    {
+        std::cerr << "Failed to write output file: " << outputPath << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+// reads the .gsh file and a compressed copy of it from disk and compares the throughput. The compressed container is read
+// and every program decompressed into 256 byte aligned memory, as a loader would do it. On the host the files come from the
+// page cache, so the break-even read speed of the medium (below which the compressed container loads faster) is printed as well
+int BenchmarkCompressedGsh(const std::string &gshPath, uint32_t iterations)
+{
+    auto readAll = [](const std::string &path, std::vector<uint8_t> &data) {
+        std::ifstream file(path, std::ifstream::binary | std::ifstream::ate);
+        if (!file.is_open())
+            return false;
+        data.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read((char *)data.data(), data.size());
+        return file.good();
+    };
+    std::vector<uint8_t> plain, compressed;
+    if (!readAll(gshPath, plain) || !compressFile(plain, compressed))
+    {
+        std::cerr << "Failed to read or compress " << gshPath << "\n";
+        return -1;
+    }
+    const std::string gszPath = gshPath + ".gsz";
+    std::ofstream out{gszPath, std::ofstream::binary};
+    out.write((const char *)compressed.data(), compressed.size());
+    out.close();
+
+    std::vector<uint8_t> data;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        readAll(gshPath, data);
+    std::chrono::duration<double> rawTime = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> blocks;
+    double decompressSeconds = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        readAll(gszPath, data);
+        auto decompressStart = std::chrono::steady_clock::now();
+        GFDCompressedReader reader;
+        if (!reader.open(data.data(), data.size()))
+        {
+            std::cerr << "Failed to open " << gszPath << "\n";
+            return -1;
+        }
+        for (const auto &entry : reader.entries())
+        {
+            void *program = aligned_alloc(GFDProgramAlignment, (entry.programSize + GFDProgramAlignment - 1) & ~(GFDProgramAlignment - 1));
+            bool success = reader.readEntry(entry, blocks, program);
+            free(program);
+            if (!success)
+            {
+                std::cerr << "Failed to decompress " << gszPath << "\n";
+                return -1;
+            }
+        }
+        decompressSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - decompressStart).count();
+    }
+    std::chrono::duration<double> compressedTime = std::chrono::steady_clock::now() - start;
+
+    const double megabytes = plain.size() / (1024.0 * 1024.0);
+    std::cout << gshPath << ": " << plain.size() << " bytes, compressed " << compressed.size() << " bytes (" << (compressed.size() * 100.0 / plain.size()) << "%)\n";
+    std::cout << "  raw .gsh:   " << megabytes * iterations / rawTime.count() << " MB/s\n";
+    std::cout << "  compressed: " << megabytes * iterations / compressedTime.count() << " MB/s, decompression alone " << megabytes * iterations / decompressSeconds << " MB/s\n";
+    const double savedMegabytes = (plain.size() - (double)compressed.size()) / (1024.0 * 1024.0);
+    if (savedMegabytes > 0.0)
+        std::cout << "  the compressed container loads faster from media slower than " << savedMegabytes * iterations / decompressSeconds << " MB/s\n";
+    return 0;
+}
+
+int RunShaderCorpus(const std::string &corpusPath, const std::string &statsPath, const std::string &baselinePath, GLSL_COMPILER_FLAG flags, uint32_t gprBudget)
+{
+    std::vector<CorpusShaderStats> results;
+    std::vector<std::string> failedShaders;
+    std::string error;
+    if (!corpusPath.empty())
+    {
+        if (!GLSL_Init())
+        {
+            std::cerr << "Failed to initialize GLSL compiler.\n";
+            return -1;
+        }
+        GLSL_SetGprBudget(gprBudget);
+        bool success = CompileShaderCorpus(corpusPath, flags, results, failedShaders, error);
+        GLSL_Shutdown();
+        if (!success)
+        {
+            std::cerr << error << "\n";
+            return -1;
+        }
+        std::cout << "Compiled " << results.size() << " shaders from " << corpusPath << "\n";
+        PrintCorpusAluPacking(results);
+        PrintCorpusCompileTime(results);
+        PrintCorpusSizeReduction(results);
+        for (const auto &name : failedShaders)
+            std::cerr << "Shader " << name << " failed to compile\n";
+        if (!statsPath.empty() && !WriteCorpusStats(statsPath, results))
+        {
+            std::cerr << "Failed to write stats file: " << statsPath << "\n";
+            return -1;
+        }
+    }
+    else if (!ReadCorpusStats(statsPath, results, error))
+    {
+        std::cerr << error << "\n";
+        return -1;
+    }
+
+    if (!baselinePath.empty())
+    {
+        std::vector<CorpusShaderStats> baseline;
+        if (!ReadCorpusStats(baselinePath, baseline, error))
+        {
+            std::cerr << error << "\n";
+            return -1;
+        }
+        PrintCorpusStatsDiff(baseline, results);
+    }
+    return failedShaders.empty() ? 0 : -2;
+}
+
+GX2Texture BakeTextureFromFiles(const std::string &fileList, const TextureBakeOptions &options)
+{
+    std::cout << "Baking texture: " << fileList << "\n";
+    std::vector<TextureSourceImage> slices;
+    std::istringstream fileStream(fileList);
+    std::string file;
+    std::string error;
+    while (std::getline(fileStream, file, ','))
+    {
+        slices.emplace_back();
+        if (!LoadTextureImage(file, slices.back(), error))
+        {
+            std::cerr << error << "\n";
+            exit(-2);
+        }
+    }
+    GX2Texture texture;
+    if (!BakeTexture(slices, options, texture, error))
+    {
+        std::cerr << "Texture " << fileList << " failed to bake: " << error << "\n";
+        exit(-2);
+    }
+    return texture;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2)
@@ -123,20 +516,188 @@ int main(int argc, char *argv[])
     }
 
     bool runTests = false;
-    bool printAssembly = false;
+    bool writeLookupTables = false;
+    bool printEstimates = false;
+    uint32_t compileFlags = GLSL_COMPILER_FLAG_NONE;
+    uint32_t gprBudget = 0;
+    uint32_t benchIterations = 0;
+    uint32_t benchTypeThreads = 0;
+    uint32_t serverWorkers = 0;
+    bool rawProgram = false;
+    bool compressOutput = false;
+    GLSL_PIXEL_SHADER_KEY pixelShaderKey = {};
     std::string outputPath = "";
+    std::string permutationPath = "";
+    std::string corpusPath = "";
+    std::string statsPath = "";
+    std::string baselinePath = "";
+    std::string serverPath = "";
+    std::string connectPath = "";
+    std::string stopServerPath = "";
+    std::string benchGszPath = "";
     std::vector<std::pair<std::string, std::string>> shaders;
+    std::vector<std::pair<std::string, std::vector<uint32_t>>> uniformSpecializations;
+    std::vector<std::string> textures;
+    std::vector<std::pair<std::string, std::string>> includeFiles;
+    TextureBakeOptions textureOptions;
 
     for (int i = 1; i < argc; ++i)
     {
         if (strcmp(argv[i], "-v") == 0)
         {
-            printAssembly = true;
+            compileFlags |= GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY;
         }
         else if (strcmp(argv[i], "-t") == 0)
         {
             runTests = true;
         }
+        else if (strcmp(argv[i], "-lookup") == 0)
+        {
+            writeLookupTables = true;
+        }
+        else if (strcmp(argv[i], "-estimate") == 0)
+        {
+            printEstimates = true;
+        }
+        else if (strcmp(argv[i], "-raw") == 0)
+        {
+            rawProgram = true;
+        }
+        else if (strcmp(argv[i], "-arena") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_USE_COMPILE_ARENA;
+        }
+        else if (strcmp(argv[i], "-allocstats") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS;
+        }
+        else if (strcmp(argv[i], "-packalu") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_PACK_ALU_GROUPS;
+        }
+        else if (strcmp(argv[i], "-kcachesched") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_GROUP_KCACHE_LINES;
+        }
+        else if (strcmp(argv[i], "-hoistfetch") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_HOIST_FETCHES;
+        }
+        else if (strcmp(argv[i], "-size") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_OPTIMIZE_SIZE;
+        }
+        else if (strcmp(argv[i], "-arraygprs") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS;
+        }
+        else if (strcmp(argv[i], "-cbufs") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                pixelShaderKey.colorBufferCount = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -cbufs\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-compress") == 0)
+        {
+            compressOutput = true;
+        }
+        else if (strcmp(argv[i], "-benchgsz") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                benchGszPath = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -benchgsz\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-benchtypes") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                benchTypeThreads = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -benchtypes\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-direct") == 0)
+        {
+            compileFlags |= GLSL_COMPILER_FLAG_DIRECT_PIPELINE;
+        }
+        else if (strcmp(argv[i], "-benchpipeline") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                benchIterations = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -benchpipeline\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-workers") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                serverWorkers = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -workers\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-server") == 0 || strcmp(argv[i], "-connect") == 0 || strcmp(argv[i], "-stopserver") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                std::string &path = strcmp(argv[i], "-server") == 0 ? serverPath : (strcmp(argv[i], "-connect") == 0 ? connectPath : stopServerPath);
+                path = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing socket argument for " << argv[i] << "\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-gprbudget") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                gprBudget = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -gprbudget\n";
+                PrintUsage();
+                return -1;
+            }
+        }
         else if (strcmp(argv[i], "-o") == 0)
         {
             if (i + 1 < argc)
@@ -151,6 +712,124 @@ int main(int argc, char *argv[])
                 return -1;
             }
         }
+        else if (strcmp(argv[i], "-perm") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                permutationPath = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing file argument for -perm\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-corpus") == 0 || strcmp(argv[i], "-stats") == 0 || strcmp(argv[i], "-baseline") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                std::string &path = argv[i][1] == 'c' ? corpusPath : (argv[i][1] == 's' ? statsPath : baselinePath);
+                path = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing file argument for " << argv[i] << "\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-spec") == 0)
+        {
+            std::string name;
+            std::vector<uint32_t> values;
+            if (i + 1 < argc && ParseUniformSpecialization(argv[i + 1], name, values))
+            {
+                uniformSpecializations.emplace_back(name, values);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing or invalid argument for -spec\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-include") == 0)
+        {
+            const char* separator = i + 1 < argc ? strchr(argv[i + 1], '=') : nullptr;
+            if (separator && separator != argv[i + 1] && separator[1])
+            {
+                includeFiles.emplace_back(std::string(argv[i + 1], separator - argv[i + 1]), separator + 1);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing or invalid argument for -include\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-tex") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                textures.emplace_back(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing file argument for -tex\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-texformat") == 0)
+        {
+            if (i + 1 < argc && ParseTextureFormat(argv[i + 1], textureOptions.format))
+            {
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing or invalid argument for -texformat\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-texmips") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                textureOptions.mipLevels = (uint32_t)atoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "Missing argument for -texmips\n";
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-textile") == 0)
+        {
+            std::string mode = i + 1 < argc ? argv[i + 1] : "";
+            if (mode == "linear")
+                textureOptions.tileMode = GX2_TILE_MODE_LINEAR_ALIGNED;
+            else if (mode == "1d")
+                textureOptions.tileMode = GX2_TILE_MODE_TILED_1D_THIN1;
+            else if (mode == "2d")
+                textureOptions.tileMode = GX2_TILE_MODE_TILED_2D_THIN1;
+            else
+            {
+                std::cerr << "Missing or invalid argument for -textile\n";
+                PrintUsage();
+                return -1;
+            }
+            ++i;
+        }
         else if (strcmp(argv[i], "-ps") == 0 || strcmp(argv[i], "-vs") == 0)
         {
             if (i + 1 < argc)
@@ -178,15 +857,68 @@ int main(int argc, char *argv[])
         return RunTests();        
     }
 
+    if (!benchGszPath.empty())
+        return BenchmarkCompressedGsh(benchGszPath, 64);
 
-    if (shaders.empty())
+    if (benchTypeThreads > 0)
     {
-        std::cerr << "No shaders specified.\n";
+        const uint32_t lookupsPerThread = 1 << 20;
+        double singleThreaded = 0.0;
+        for (uint32_t threadCount = 1; threadCount <= benchTypeThreads; threadCount *= 2)
+        {
+            double lookupsPerSecond = BenchmarkTypeLookups(threadCount, lookupsPerThread);
+            if (threadCount == 1)
+                singleThreaded = lookupsPerSecond;
+            std::cout << threadCount << " threads: " << lookupsPerSecond / 1e6 << "M type lookups/s (" << lookupsPerSecond / singleThreaded << "x)\n";
+        }
+        return 0;
+    }
+
+    if (!corpusPath.empty() || !baselinePath.empty())
+    {
+        if (corpusPath.empty() && statsPath.empty())
+        {
+            std::cerr << "-baseline requires -corpus or -stats\n";
+            PrintUsage();
+            return -1;
+        }
+        return RunShaderCorpus(corpusPath, statsPath, baselinePath, (GLSL_COMPILER_FLAG)compileFlags, gprBudget);
+    }
+
+    if (!stopServerPath.empty())
+    {
+        CompileServerRequest request;
+        request.command = CompileServerCommand::SHUTDOWN;
+        CompileServerResponse response;
+        std::string error;
+        if (!SendCompileServerRequest(stopServerPath, request, response, error))
+        {
+            std::cerr << error << "\n";
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!connectPath.empty())
+    {
+        if (shaders.empty() || (rawProgram && shaders.size() != 1))
+        {
+            std::cerr << "-connect requires shaders, -raw requires exactly one\n";
+            PrintUsage();
+            return -1;
+        }
+        return RunCompileClient(connectPath, shaders, outputPath, (GLSL_COMPILER_FLAG)compileFlags, rawProgram);
+    }
+
+    bool runServer = !serverPath.empty();
+    if (shaders.empty() && textures.empty() && !runServer)
+    {
+        std::cerr << "No shaders or textures specified.\n";
         PrintUsage();
         return -1;
     }
 
-    if (!GLSL_Init())
+    if ((!shaders.empty() || runServer) && !GLSL_Init())
     {
         std::cerr << "Failed to initialize GLSL compiler.\n";
         return -1;
@@ -194,6 +926,57 @@ int main(int argc, char *argv[])
 
     bool serialize = !outputPath.empty();
 
+    if (!uniformSpecializations.empty())
+    {
+        std::vector<GLSL_UNIFORM_SPECIALIZATION> specs(uniformSpecializations.size());
+        for (size_t i = 0; i < uniformSpecializations.size(); i++)
+        {
+            specs[i].name = uniformSpecializations[i].first.c_str();
+            specs[i].values = uniformSpecializations[i].second.data();
+            specs[i].valueCount = (uint32_t)uniformSpecializations[i].second.size();
+        }
+        GLSL_SetUniformSpecializations(specs.data(), (uint32_t)specs.size());
+    }
+
+    if (!shaders.empty() || runServer)
+    {
+        GLSL_SetGprBudget(gprBudget);
+        GLSL_SetPixelShaderKey(&pixelShaderKey);
+        for (const auto &include : includeFiles)
+        {
+            if (!GLSL_SetInclude(include.first.c_str(), ReadFile(include.second).c_str()))
+            {
+                std::cerr << "Invalid include path: " << include.first << "\n";
+                return -1;
+            }
+        }
+    }
+
+    if (runServer)
+    {
+        int result = RunCompileServer(serverPath, serverWorkers);
+        GLSL_Shutdown();
+        return result;
+    }
+
+    if (benchIterations > 0)
+    {
+        for (const auto &shader : shaders)
+        {
+            std::string shaderSource = ReadFile(shader.second);
+            if (shader.first == "-ps")
+                BenchmarkCompilePipelines(GLSL_CompilePixelShader, GLSL_FreePixelShader, shaderSource, shader.second, benchIterations, (GLSL_COMPILER_FLAG)compileFlags);
+            else
+                BenchmarkCompilePipelines(GLSL_CompileVertexShader, GLSL_FreeVertexShader, shaderSource, shader.second, benchIterations, (GLSL_COMPILER_FLAG)compileFlags);
+        }
+        GLSL_Shutdown();
+        return 0;
+    }
+
+    std::vector<std::vector<std::string>> permutations;
+    if (!permutationPath.empty())
+        permutations = ReadPermutationFile(permutationPath);
+
     GFDFile gshFile = {};
     for (const auto &shader : shaders)
     {
@@ -201,14 +984,24 @@ int main(int argc, char *argv[])
         std::string shaderFile = shader.second;
         std::string shaderSource = ReadFile(shaderFile);
 
-        if (shaderType == "-ps")
+        if (!permutations.empty() && shaderType == "-ps")
         {
-            GX2PixelShader *ps = CompilePixelShader(shaderSource, shaderFile, printAssembly);
+            GX2PixelShader **shaderTable = CompileShaderPermutations(GLSL_CompilePixelShaderPermutations, shaderSource, shaderFile, permutations, (GLSL_COMPILER_FLAG)compileFlags);
+            AddPermutationsToFile(gshFile.pixelShaders, shaderTable, (uint32_t)permutations.size(), shaderFile);
+        }
+        else if (!permutations.empty() && shaderType == "-vs")
+        {
+            GX2VertexShader **shaderTable = CompileShaderPermutations(GLSL_CompileVertexShaderPermutations, shaderSource, shaderFile, permutations, (GLSL_COMPILER_FLAG)compileFlags);
+            AddPermutationsToFile(gshFile.vertexShaders, shaderTable, (uint32_t)permutations.size(), shaderFile);
+        }
+        else if (shaderType == "-ps")
+        {
+            GX2PixelShader *ps = CompilePixelShader(shaderSource, shaderFile, (GLSL_COMPILER_FLAG)compileFlags);
             gshFile.pixelShaders.push_back(*ps);
         }
         else if (shaderType == "-vs")
         {
-            GX2VertexShader *vs = CompileVertexShader(shaderSource, shaderFile, printAssembly);
+            GX2VertexShader *vs = CompileVertexShader(shaderSource, shaderFile, (GLSL_COMPILER_FLAG)compileFlags);
             gshFile.vertexShaders.push_back(*vs);
         }
         else
@@ -219,12 +1012,38 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (serialize && !writeFile(gshFile, outputPath))
+    if (printEstimates)
+    {
+        PrintShaderEstimates(gshFile.vertexShaders, GLSL_EstimateVertexShader, "vertex");
+        PrintShaderEstimates(gshFile.pixelShaders, GLSL_EstimatePixelShader, "pixel");
+    }
+
+    for (const auto &texture : textures)
+        gshFile.textures.push_back(BakeTextureFromFiles(texture, textureOptions));
+
+    if (writeLookupTables)
+    {
+        for (const auto &vs : gshFile.vertexShaders)
+            gshFile.vertexShaderLookupTables.emplace_back(GLSL_CreateVertexShaderLookupTable(&vs));
+        for (const auto &ps : gshFile.pixelShaders)
+            gshFile.pixelShaderLookupTables.emplace_back(GLSL_CreatePixelShaderLookupTable(&ps));
+    }
+
+    // texture data is aligned within the file
+    if (serialize && !(compressOutput ? writeCompressedFile(gshFile, outputPath, !gshFile.textures.empty()) : writeFile(gshFile, outputPath, !gshFile.textures.empty())))
     {
         std::cerr << "Failed to write output file: " << outputPath << "\n";
         return -1;
     }
 
-    GLSL_Shutdown();
+    for (const auto &table : gshFile.vertexShaderLookupTables)
+        GLSL_FreeLookupTable((GLSL_LOOKUP_TABLE*)table);
+    for (const auto &table : gshFile.pixelShaderLookupTables)
+        GLSL_FreeLookupTable((GLSL_LOOKUP_TABLE*)table);
+    for (auto &texture : gshFile.textures)
+        FreeBakedTexture(texture);
+
+    if (!shaders.empty())
+        GLSL_Shutdown();
     return 0;
 }
@@ -0,0 +1,294 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#if !defined(__WUT__)
+#include <thread>
+#include <atomic>
+#endif
+
+#include "cafe_glsl_compiler.h"
+
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
+
+void DebugLog(const char *format, ...);
+size_t _strlcpy(char *dst, const char *src, size_t size);
+
+GX2VertexShader* _CompileVertexShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+GX2PixelShader* _CompilePixelShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+void _FreeVertexShader(GX2VertexShader* shader);
+void _FreePixelShader(GX2PixelShader* shader);
+
+extern CafeGLSLCompiler *s_compiler;
+
+// additional compiler instances used to build permutations in parallel. s_compiler always acts as the first worker
+static std::vector<CafeGLSLCompiler*> s_permutationWorkers;
+
+void _DestroyPermutationWorkers()
+{
+    for (auto& worker : s_permutationWorkers)
+        delete worker;
+    s_permutationWorkers.clear();
+}
+
+// workers compile with the same options as s_compiler
+void _SetPermutationWorkerOptions(const CafeGLSLCompiler::CompileOptions& options)
+{
+    for (auto& worker : s_permutationWorkers)
+        worker->options = options;
+}
+
+// returns true if the line at linePtr is a #version directive. Whitespace is allowed around the hash
+static bool IsVersionDirective(const char* linePtr, const char*& versionArgs)
+{
+    while (*linePtr == ' ' || *linePtr == '\t')
+        linePtr++;
+    if (*linePtr != '#')
+        return false;
+    linePtr++;
+    while (*linePtr == ' ' || *linePtr == '\t')
+        linePtr++;
+    if (strncmp(linePtr, "version", 7) != 0)
+        return false;
+    versionArgs = linePtr + 7;
+    return true;
+}
+
+// inject the defines of a permutation right after the #version directive (which must stay the first directive)
+// a #line directive follows the defines so that line numbers in the info log still match the original source
+static std::string BuildPermutationSource(const char* shaderSource, const GLSL_DEFINE_SET& defineSet)
+{
+    size_t insertOffset = 0;
+    uint32_t nextLineNumber = 1;
+    bool lineDirectiveIsNextLine = false; // from GLSL 3.30 and GLSL ES on #line N refers to the next line, before it was N+1
+    const char* linePtr = shaderSource;
+    uint32_t lineNumber = 1;
+    while (*linePtr)
+    {
+        const char* lineEnd = strchr(linePtr, '\n');
+        const char* versionArgs;
+        if (IsVersionDirective(linePtr, versionArgs))
+        {
+            long version = strtol(versionArgs, nullptr, 10);
+            bool isES = version == 100 || (lineEnd ? std::string(versionArgs, lineEnd) : std::string(versionArgs)).find("es") != std::string::npos;
+            lineDirectiveIsNextLine = version >= 330 || isES;
+            insertOffset = lineEnd ? (lineEnd + 1 - shaderSource) : strlen(shaderSource);
+            nextLineNumber = lineNumber + 1;
+            break;
+        }
+        if (!lineEnd)
+            break;
+        linePtr = lineEnd + 1;
+        lineNumber++;
+    }
+
+    std::string source(shaderSource, insertOffset);
+    if (insertOffset > 0 && source.back() != '\n')
+        source.push_back('\n');
+    for (uint32_t i = 0; i < defineSet.defineCount; i++)
+    {
+        std::string define = defineSet.defines[i];
+        size_t separator = define.find('=');
+        if (separator != std::string::npos)
+            define[separator] = ' ';
+        source.append("#define ");
+        source.append(define);
+        source.push_back('\n');
+    }
+    source.append("#line ");
+    source.append(std::to_string(lineDirectiveIsNextLine ? nextLineNumber : nextLineNumber - 1));
+    source.push_back('\n');
+    source.append(shaderSource + insertOffset);
+    return source;
+}
+
+template<typename T>
+static bool IsSameShaderVars(const T* a, const T* b)
+{
+    if (a->uniformBlockCount != b->uniformBlockCount || a->uniformVarCount != b->uniformVarCount || a->samplerVarCount != b->samplerVarCount)
+        return false;
+    for (uint32_t i = 0; i < a->uniformBlockCount; i++)
+    {
+        if (strcmp(a->uniformBlocks[i].name, b->uniformBlocks[i].name) != 0 || a->uniformBlocks[i].offset != b->uniformBlocks[i].offset || a->uniformBlocks[i].size != b->uniformBlocks[i].size)
+            return false;
+    }
+    for (uint32_t i = 0; i < a->uniformVarCount; i++)
+    {
+        if (strcmp(a->uniformVars[i].name, b->uniformVars[i].name) != 0 || a->uniformVars[i].offset != b->uniformVars[i].offset ||
+            a->uniformVars[i].count != b->uniformVars[i].count || a->uniformVars[i].block != b->uniformVars[i].block || a->uniformVars[i].type != b->uniformVars[i].type)
+            return false;
+    }
+    for (uint32_t i = 0; i < a->samplerVarCount; i++)
+    {
+        if (strcmp(a->samplerVars[i].name, b->samplerVars[i].name) != 0 || a->samplerVars[i].location != b->samplerVars[i].location || a->samplerVars[i].type != b->samplerVars[i].type)
+            return false;
+    }
+    return true;
+}
+
+static bool IsSameShader(const GX2VertexShader* a, const GX2VertexShader* b)
+{
+    if (a->size != b->size || memcmp(a->program, b->program, a->size) != 0 || memcmp(&a->regs, &b->regs, sizeof(a->regs)) != 0)
+        return false;
+    if (a->attribVarCount != b->attribVarCount)
+        return false;
+    for (uint32_t i = 0; i < a->attribVarCount; i++)
+    {
+        if (strcmp(a->attribVars[i].name, b->attribVars[i].name) != 0 || a->attribVars[i].location != b->attribVars[i].location || a->attribVars[i].type != b->attribVars[i].type)
+            return false;
+    }
+    return IsSameShaderVars(a, b);
+}
+
+static bool IsSameShader(const GX2PixelShader* a, const GX2PixelShader* b)
+{
+    if (a->size != b->size || memcmp(a->program, b->program, a->size) != 0 || memcmp(&a->regs, &b->regs, sizeof(a->regs)) != 0)
+        return false;
+    return IsSameShaderVars(a, b);
+}
+
+template<typename T>
+static uint64_t HashShader(const T* shader)
+{
+    uint64_t regsHash = XXH64(&shader->regs, sizeof(shader->regs), 0);
+    return XXH64(shader->program, shader->size, regsHash);
+}
+
+template<typename T>
+static T** _CompileShaderPermutations(T* (*compileFunc)(CafeGLSLCompiler*, const char*, char*, int, GLSL_COMPILER_FLAG), void (*freeFunc)(T*),
+                                      const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+{
+    if (defineSetCount == 0)
+        return nullptr;
+    std::vector<std::string> sources(defineSetCount);
+    for (uint32_t i = 0; i < defineSetCount; i++)
+        sources[i] = BuildPermutationSource(shaderSource, defineSets[i]);
+
+    std::vector<T*> shaders(defineSetCount, nullptr);
+    std::vector<std::string> infoLogs(defineSetCount);
+    auto compilePermutation = [&](CafeGLSLCompiler* compiler, uint32_t index)
+    {
+        char infoLog[1024];
+        infoLog[0] = '\0';
+        shaders[index] = compileFunc(compiler, sources[index].c_str(), infoLog, sizeof(infoLog), flags);
+        if (!shaders[index])
+            infoLogs[index] = infoLog;
+    };
+
+#if defined(__WUT__)
+    for (uint32_t i = 0; i < defineSetCount; i++)
+        compilePermutation(s_compiler, i);
+#else
+    uint32_t numWorkers = std::max(1u, std::min(std::thread::hardware_concurrency(), defineSetCount));
+    while (s_permutationWorkers.size() < numWorkers - 1)
+    {
+        s_permutationWorkers.emplace_back(new CafeGLSLCompiler());
+        s_permutationWorkers.back()->options = s_compiler->options;
+    }
+    std::atomic<uint32_t> nextIndex{0};
+    auto workerFunc = [&](CafeGLSLCompiler* compiler)
+    {
+        uint32_t index;
+        while ((index = nextIndex.fetch_add(1)) < defineSetCount)
+            compilePermutation(compiler, index);
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < numWorkers - 1; i++)
+        threads.emplace_back(workerFunc, s_permutationWorkers[i]);
+    workerFunc(s_compiler);
+    for (auto& thread : threads)
+        thread.join();
+#endif
+
+    // report the first failing permutation
+    for (uint32_t i = 0; i < defineSetCount; i++)
+    {
+        if (shaders[i])
+            continue;
+        std::string infoLog = "Permutation " + std::to_string(i) + ": " + infoLogs[i];
+        _strlcpy(infoLogOut, infoLog.c_str(), infoLogMaxLength);
+        for (auto& shader : shaders)
+        {
+            if (shader)
+                freeFunc(shader);
+        }
+        return nullptr;
+    }
+
+    // deduplicate permutations which compiled to the same program
+    T** shaderTable = (T**)malloc(sizeof(T*) * defineSetCount);
+    std::unordered_multimap<uint64_t, T*> uniqueShaders;
+    uint32_t numUnique = 0;
+    for (uint32_t i = 0; i < defineSetCount; i++)
+    {
+        uint64_t hash = HashShader(shaders[i]);
+        T* match = nullptr;
+        auto range = uniqueShaders.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (IsSameShader(it->second, shaders[i]))
+            {
+                match = it->second;
+                break;
+            }
+        }
+        if (match)
+        {
+            freeFunc(shaders[i]);
+            shaderTable[i] = match;
+            continue;
+        }
+        uniqueShaders.emplace(hash, shaders[i]);
+        shaderTable[i] = shaders[i];
+        numUnique++;
+    }
+    DebugLog("Compiled %u permutations into %u unique shaders", defineSetCount, numUnique);
+    return shaderTable;
+}
+
+template<typename T>
+static void _FreeShaderPermutations(void (*freeFunc)(T*), T** shaderTable, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // shared entries are only freed once
+        bool isDuplicate = false;
+        for (uint32_t f = 0; f < i; f++)
+        {
+            if (shaderTable[f] == shaderTable[i])
+            {
+                isDuplicate = true;
+                break;
+            }
+        }
+        if (!isDuplicate)
+            freeFunc(shaderTable[i]);
+    }
+    free(shaderTable);
+}
+
+GX2VertexShader** _CompileVertexShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+{
+    return _CompileShaderPermutations<GX2VertexShader>(_CompileVertexShader, _FreeVertexShader, shaderSource, defineSets, defineSetCount, infoLogOut, infoLogMaxLength, flags);
+}
+
+GX2PixelShader** _CompilePixelShaderPermutations(const char* shaderSource, const GLSL_DEFINE_SET* defineSets, uint32_t defineSetCount, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags)
+{
+    return _CompileShaderPermutations<GX2PixelShader>(_CompilePixelShader, _FreePixelShader, shaderSource, defineSets, defineSetCount, infoLogOut, infoLogMaxLength, flags);
+}
+
+void _FreeVertexShaderPermutations(GX2VertexShader** shaderTable, uint32_t count)
+{
+    _FreeShaderPermutations<GX2VertexShader>(_FreeVertexShader, shaderTable, count);
+}
+
+void _FreePixelShaderPermutations(GX2PixelShader** shaderTable, uint32_t count)
+{
+    _FreeShaderPermutations<GX2PixelShader>(_FreePixelShader, shaderTable, count);
+}
@@ -0,0 +1,406 @@
+#include "server.h"
+#include "cafe_glsl_compiler.h"
+#include "./libgfd/gfd.h"
+
+#include <iostream>
+#include <cstring>
+
+#if !defined(__WUT__)
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <set>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+GX2VertexShader* _CompileVertexShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+GX2PixelShader* _CompilePixelShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+void _FreeVertexShader(GX2VertexShader* shader);
+void _FreePixelShader(GX2PixelShader* shader);
+
+extern CafeGLSLCompiler *s_compiler;
+
+static constexpr uint32_t kServerMagic = 0x43475352; // 'CGSR'
+static constexpr uint32_t kServerProtocolVersion = 1;
+// limits for untrusted requests, well above any real shader
+static constexpr uint32_t kMaxShadersPerRequest = 4096;
+static constexpr uint32_t kMaxSourceLength = 64 * 1024 * 1024;
+
+#if defined(__WUT__)
+
+int RunCompileServer(const std::string& socketPath, uint32_t workerCount)
+{
+    std::cerr << "The compile server is not supported on this platform\n";
+    return -1;
+}
+
+bool SendCompileServerRequest(const std::string& socketPath, const CompileServerRequest& request, CompileServerResponse& response, std::string& error)
+{
+    error = "The compile server is not supported on this platform";
+    return false;
+}
+
+#else
+
+static bool ReadAll(int fd, void* data, size_t size)
+{
+    uint8_t* ptr = (uint8_t*)data;
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, ptr, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const void* data, size_t size)
+{
+    const uint8_t* ptr = (const uint8_t*)data;
+    while (size > 0)
+    {
+        // MSG_NOSIGNAL, a client which disconnects early must not kill the server with SIGPIPE
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        ptr += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool ReadU32(int fd, uint32_t& value)
+{
+    return ReadAll(fd, &value, sizeof(value));
+}
+
+static void AppendU32(std::vector<uint8_t>& buffer, uint32_t value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static bool MakeSocketAddress(const std::string& socketPath, sockaddr_un& addr, std::string& error)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path))
+    {
+        error = "Invalid socket path: " + socketPath;
+        return false;
+    }
+    memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+
+// returns false if the connection was closed or the request is malformed. In the latter case response is set
+static bool ReadRequest(int fd, CompileServerRequest& request, CompileServerResponse& response)
+{
+    uint32_t header[6];
+    if (!ReadAll(fd, header, sizeof(header)))
+        return false;
+    // the response object is reused across requests, a malformed one must not resend the previous payload
+    response.status = CompileServerStatus::BAD_REQUEST;
+    response.payload.clear();
+    if (header[0] != kServerMagic || header[1] != kServerProtocolVersion || header[2] > (uint32_t)CompileServerCommand::SHUTDOWN ||
+        header[4] > (uint32_t)CompileServerOutput::GSH || header[5] > kMaxShadersPerRequest)
+        return false;
+    request.command = (CompileServerCommand)header[2];
+    request.flags = (GLSL_COMPILER_FLAG)header[3];
+    request.output = (CompileServerOutput)header[4];
+    request.shaders.resize(header[5]);
+    for (auto& shader : request.shaders)
+    {
+        uint32_t shaderType, sourceLength;
+        if (!ReadU32(fd, shaderType) || !ReadU32(fd, sourceLength) || shaderType > 1 || sourceLength > kMaxSourceLength)
+            return false;
+        shader.isPixelShader = shaderType == 1;
+        shader.source.resize(sourceLength);
+        if (sourceLength > 0 && !ReadAll(fd, &shader.source[0], sourceLength))
+            return false;
+    }
+    return true;
+}
+
+static bool WriteResponse(int fd, const CompileServerResponse& response)
+{
+    uint32_t header[2] = { (uint32_t)response.status, (uint32_t)response.payload.size() };
+    return WriteAll(fd, header, sizeof(header)) && WriteAll(fd, response.payload.data(), response.payload.size());
+}
+
+static void CompileRequest(CafeGLSLCompiler* compiler, const CompileServerRequest& request, CompileServerResponse& response)
+{
+    // disassembly is printed to stderr of the server, nobody would see it
+    GLSL_COMPILER_FLAG flags = (GLSL_COMPILER_FLAG)(request.flags & ~GLSL_COMPILER_FLAG_GENERATE_DISASSEMBLY);
+    char infoLogBuffer[4096];
+    std::vector<GX2VertexShader*> vertexShaders;
+    std::vector<GX2PixelShader*> pixelShaders;
+    std::vector<std::pair<const uint8_t*, uint32_t>> programs;
+    bool success = true;
+    for (const auto& shader : request.shaders)
+    {
+        infoLogBuffer[0] = '\0';
+        if (shader.isPixelShader)
+        {
+            GX2PixelShader* ps = _CompilePixelShader(compiler, shader.source.c_str(), infoLogBuffer, sizeof(infoLogBuffer), flags);
+            if (ps)
+            {
+                pixelShaders.push_back(ps);
+                programs.emplace_back((const uint8_t*)ps->program, ps->size);
+            }
+            success = ps != nullptr;
+        }
+        else
+        {
+            GX2VertexShader* vs = _CompileVertexShader(compiler, shader.source.c_str(), infoLogBuffer, sizeof(infoLogBuffer), flags);
+            if (vs)
+            {
+                vertexShaders.push_back(vs);
+                programs.emplace_back((const uint8_t*)vs->program, vs->size);
+            }
+            success = vs != nullptr;
+        }
+        if (!success)
+            break;
+    }
+
+    response.payload.clear();
+    if (!success)
+    {
+        // programs holds one entry per shader before the failing one
+        std::string infoLog = "Shader " + std::to_string(programs.size()) + ": " + infoLogBuffer;
+        response.status = CompileServerStatus::COMPILE_ERROR;
+        response.payload.assign(infoLog.begin(), infoLog.end());
+    }
+    else if (request.output == CompileServerOutput::GSH)
+    {
+        GFDFile gshFile = {};
+        for (auto& vs : vertexShaders)
+            gshFile.vertexShaders.push_back(*vs);
+        for (auto& ps : pixelShaders)
+            gshFile.pixelShaders.push_back(*ps);
+        response.status = CompileServerStatus::OK;
+        writeFile(gshFile, response.payload);
+    }
+    else
+    {
+        response.status = CompileServerStatus::OK;
+        for (const auto& program : programs)
+        {
+            AppendU32(response.payload, program.second);
+            response.payload.insert(response.payload.end(), program.first, program.first + program.second);
+        }
+    }
+
+    for (auto& vs : vertexShaders)
+        _FreeVertexShader(vs);
+    for (auto& ps : pixelShaders)
+        _FreePixelShader(ps);
+}
+
+struct CompileServerState
+{
+    std::mutex mutex;
+    std::condition_variable connectionAvailable;
+    std::deque<int> pendingConnections;
+    // connections currently owned by a worker, shut down on SHUTDOWN so idle clients can't block the workers
+    std::set<int> activeConnections;
+    std::atomic<bool> shutdown{false};
+    std::atomic<uint32_t> requestCount{0};
+    int listenSocket{-1};
+};
+
+// stops accepting and wakes up every worker waiting for the next request. Caller holds state.mutex
+static void BeginShutdown(CompileServerState& state)
+{
+    state.shutdown = true;
+    // wakes up the accept loop
+    ::shutdown(state.listenSocket, SHUT_RDWR);
+    // only the read side, a worker blocked in recv sees EOF while a request in flight can still send its response
+    for (int fd : state.activeConnections)
+        ::shutdown(fd, SHUT_RD);
+    state.connectionAvailable.notify_all();
+}
+
+// serves one connection until the client disconnects
+static void ServeConnection(CompileServerState& state, CafeGLSLCompiler* compiler, int fd)
+{
+    CompileServerRequest request;
+    CompileServerResponse response;
+    while (!state.shutdown)
+    {
+        if (!ReadRequest(fd, request, response))
+        {
+            if (response.status == CompileServerStatus::BAD_REQUEST)
+                WriteResponse(fd, response);
+            break;
+        }
+        if (request.command == CompileServerCommand::SHUTDOWN)
+        {
+            response.status = CompileServerStatus::OK;
+            response.payload.clear();
+            WriteResponse(fd, response);
+            std::lock_guard<std::mutex> lock(state.mutex);
+            BeginShutdown(state);
+            break;
+        }
+        CompileRequest(compiler, request, response);
+        state.requestCount++;
+        if (!WriteResponse(fd, response))
+            break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.activeConnections.erase(fd);
+    }
+    close(fd);
+}
+
+static void CompileServerWorker(CompileServerState& state, CafeGLSLCompiler* compiler)
+{
+    while (true)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.connectionAvailable.wait(lock, [&] { return state.shutdown || !state.pendingConnections.empty(); });
+            if (state.pendingConnections.empty())
+                return;
+            fd = state.pendingConnections.front();
+            state.pendingConnections.pop_front();
+            state.activeConnections.insert(fd);
+        }
+        ServeConnection(state, compiler, fd);
+    }
+}
+
+int RunCompileServer(const std::string& socketPath, uint32_t workerCount)
+{
+    sockaddr_un addr;
+    std::string error;
+    if (!MakeSocketAddress(socketPath, addr, error))
+    {
+        std::cerr << error << "\n";
+        return -1;
+    }
+    CompileServerState state;
+    state.listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (state.listenSocket < 0)
+    {
+        std::cerr << "Failed to create socket: " << strerror(errno) << "\n";
+        return -1;
+    }
+    // a stale socket file of a previous server would make bind fail
+    unlink(socketPath.c_str());
+    if (bind(state.listenSocket, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(state.listenSocket, 64) != 0)
+    {
+        std::cerr << "Failed to listen on " << socketPath << ": " << strerror(errno) << "\n";
+        close(state.listenSocket);
+        return -1;
+    }
+
+    if (workerCount == 0)
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    // s_compiler is the first worker, the others are initialized once up front so every request hits a warm instance
+    std::vector<CafeGLSLCompiler*> compilers{s_compiler};
+    while (compilers.size() < workerCount)
+    {
+        compilers.emplace_back(new CafeGLSLCompiler());
+        compilers.back()->options = s_compiler->options;
+    }
+    std::vector<std::thread> workers;
+    for (auto& compiler : compilers)
+        workers.emplace_back(CompileServerWorker, std::ref(state), compiler);
+    std::cout << "Compile server listening on " << socketPath << " with " << workerCount << " workers\n" << std::flush;
+
+    while (!state.shutdown)
+    {
+        int fd = accept(state.listenSocket, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.pendingConnections.push_back(fd);
+        state.connectionAvailable.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        BeginShutdown(state);
+        // connections which were accepted but not served yet are dropped
+        for (int fd : state.pendingConnections)
+            close(fd);
+        state.pendingConnections.clear();
+    }
+    for (auto& worker : workers)
+        worker.join();
+    for (size_t i = 1; i < compilers.size(); i++)
+        delete compilers[i];
+    close(state.listenSocket);
+    unlink(socketPath.c_str());
+    std::cout << "Compile server served " << state.requestCount << " requests\n";
+    return 0;
+}
+
+bool SendCompileServerRequest(const std::string& socketPath, const CompileServerRequest& request, CompileServerResponse& response, std::string& error)
+{
+    sockaddr_un addr;
+    if (!MakeSocketAddress(socketPath, addr, error))
+        return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        error = std::string("Failed to create socket: ") + strerror(errno);
+        return false;
+    }
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        error = "Failed to connect to " + socketPath + ": " + strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    std::vector<uint8_t> message;
+    AppendU32(message, kServerMagic);
+    AppendU32(message, kServerProtocolVersion);
+    AppendU32(message, (uint32_t)request.command);
+    AppendU32(message, (uint32_t)request.flags);
+    AppendU32(message, (uint32_t)request.output);
+    AppendU32(message, (uint32_t)request.shaders.size());
+    for (const auto& shader : request.shaders)
+    {
+        AppendU32(message, shader.isPixelShader ? 1 : 0);
+        AppendU32(message, (uint32_t)shader.source.size());
+        message.insert(message.end(), shader.source.begin(), shader.source.end());
+    }
+
+    uint32_t header[2];
+    bool success = WriteAll(fd, message.data(), message.size()) && ReadAll(fd, header, sizeof(header));
+    if (success)
+    {
+        response.status = (CompileServerStatus)header[0];
+        response.payload.resize(header[1]);
+        success = ReadAll(fd, response.payload.data(), response.payload.size());
+    }
+    close(fd);
+    if (!success)
+        error = "Connection to " + socketPath + " was closed";
+    return success;
+}
+
+#endif
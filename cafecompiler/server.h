@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gx2_definitions.h"
+#include "CafeGLSLCompiler.h"
+
+// compile server. A long running glslcompiler.elf keeps initialized compiler instances and serves compile requests over a
+// local unix domain socket, so build systems which invoke the compiler per shader don't pay for process startup and GLSL_Init
+//
+// all integers are uint32 in host byte order, the socket is local only
+// request:  magic 'CGSR', version, command, flags (GLSL_COMPILER_FLAG), output format, shader count
+//           followed by shader count times: shader type (0 = vertex, 1 = pixel), source length, source bytes
+// response: status, payload length, payload. The payload of a failed compile is the info log
+// a connection can send any number of requests, each one is answered before the next one is read
+
+enum class CompileServerCommand : uint32_t
+{
+    COMPILE = 0,
+    SHUTDOWN = 1, // the server finishes the requests in flight and exits
+};
+
+enum class CompileServerOutput : uint32_t
+{
+    GX2_PROGRAM = 0, // per shader: program size, program bytes
+    GSH = 1, // a .gsh file containing all shaders of the request, vertex shaders first
+};
+
+enum class CompileServerStatus : uint32_t
+{
+    OK = 0,
+    COMPILE_ERROR = 1,
+    BAD_REQUEST = 2,
+};
+
+struct CompileServerShader
+{
+    bool isPixelShader;
+    std::string source;
+};
+
+struct CompileServerRequest
+{
+    CompileServerCommand command{CompileServerCommand::COMPILE};
+    GLSL_COMPILER_FLAG flags{GLSL_COMPILER_FLAG_NONE};
+    CompileServerOutput output{CompileServerOutput::GSH};
+    std::vector<CompileServerShader> shaders;
+};
+
+struct CompileServerResponse
+{
+    CompileServerStatus status{CompileServerStatus::OK};
+    std::vector<uint8_t> payload;
+};
+
+// serves requests until a shutdown request arrives. GLSL_Init must have been called, the options set through the API
+// (GPR budget, pixel shader key, uniform specializations, includes) are applied to all requests
+// workerCount compiler instances compile requests of different connections in parallel, 0 uses one per hardware thread
+int RunCompileServer(const std::string& socketPath, uint32_t workerCount);
+
+// connects to a running server and sends a single request. Returns false if the server could not be reached
+bool SendCompileServerRequest(const std::string& socketPath, const CompileServerRequest& request, CompileServerResponse& response, std::string& error);
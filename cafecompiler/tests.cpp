@@ -2,13 +2,30 @@
 #include "cafe_glsl_compiler.h" // internal
 
 #include "CafeGLSLCompiler.h" // the public header
+#include "texture.h"
+#include "server.h"
+#include "./libgfd/gfd.h"
 
+#include <cmath>
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
 
+#if !defined(__WUT__)
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#if !defined(__WUT__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#endif
+
 void DebugLog(const char *format, ...);
 
+extern CafeGLSLCompiler *s_compiler; // the instance behind the public API
+GX2PixelShader* _CompilePixelShader(CafeGLSLCompiler* compiler, const char* shaderSource, char* infoLogOut, int infoLogMaxLength, GLSL_COMPILER_FLAG flags);
+
 GX2PixelShader* TestCompilePS(const char* shaderSource)
 {
     char infoLogBuffer[1024];
@@ -106,6 +123,16 @@ void main()
     assert(GX2Shader_GetUniformBlockLocation(ps, "uf_data11") == 11);
     assert(GX2Shader_GetTextureSamplerLocation(ps, "textureSampler") == 2);
     assert(GX2Shader_GetTextureSamplerLocation(ps, "textureSampler2") == 4);
+
+    // the lookup table resolves the same locations
+    GLSL_LOOKUP_TABLE* lookupTable = GLSL_CreatePixelShaderLookupTable(ps);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_UNIFORM_BLOCK, "uf_data9")->location == 9);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_UNIFORM_BLOCK, "uf_data11")->location == 11);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_SAMPLER, "textureSampler")->location == 2);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_SAMPLER, "textureSampler2")->location == 4);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_UNIFORM_BLOCK, "textureSampler") == nullptr);
+    assert(GLSL_LookupShaderVar(lookupTable, GLSL_SHADER_VAR_KIND_SAMPLER, "unknownSampler") == nullptr);
+    GLSL_FreeLookupTable(lookupTable);
 }
 
 void TestShader2()
@@ -149,6 +176,1286 @@ void main()
 
 }
 
+void TestShaderPermutations()
+{
+    const char* psSrc = R"(
+#version 450
+layout(binding = 1) uniform sampler2D textureSampler;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+#ifdef USE_TEXTURE
+  outputColor = texture(textureSampler, textureCoord) * SCALE;
+#else
+  outputColor = vec4(textureCoord, 0.0, SCALE);
+#endif
+}
+)";
+    const char* definesA[] = { "SCALE=2.0" };
+    const char* definesB[] = { "USE_TEXTURE", "SCALE=2.0" };
+    const char* definesC[] = { "SCALE=(1.0 + 1.0)" }; // folds to the same program as A
+    GLSL_DEFINE_SET defineSets[3] = { { definesA, 1 }, { definesB, 2 }, { definesC, 1 } };
+    char infoLogBuffer[1024];
+    GX2PixelShader** shaderTable = GLSL_CompilePixelShaderPermutations(psSrc, defineSets, 3, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    if(!shaderTable)
+    {
+        DebugLog("Shader permutations failed to compile. Info log:\n");
+        DebugLog("%s", infoLogBuffer);
+        exit(-2);
+    }
+    assert(shaderTable[0] != shaderTable[1]);
+    assert(shaderTable[0] == shaderTable[2]);
+    assert(GX2Shader_GetTextureSamplerLocation(shaderTable[1], "textureSampler") == 1);
+    GLSL_FreePixelShaderPermutations(shaderTable, 3);
+}
+
+void TestUniformSpecialization()
+{
+    const char* psSrc = R"(
+#version 450
+uniform int uf_count;
+uniform vec4 uf_tint;
+uniform vec4 uf_bias;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 color = vec4(textureCoord, 0.0, 1.0);
+  for (int i = 0; i < uf_count; i++)
+    color *= uf_tint;
+  outputColor = color + uf_bias;
+}
+)";
+    float tint[4] = { 1.0f, 0.5f, 0.5f, 1.0f };
+    uint32_t tintValues[4];
+    memcpy(tintValues, tint, sizeof(tintValues));
+    uint32_t countValue = 3;
+    GLSL_UNIFORM_SPECIALIZATION specs[2] = { { "uf_count", &countValue, 1 }, { "uf_tint", tintValues, 4 } };
+    GLSL_SetUniformSpecializations(specs, 2);
+    GX2PixelShader* ps = TestCompilePS(psSrc);
+    GLSL_SetUniformSpecializations(nullptr, 0);
+    // only the uniform which was not specialized remains
+    assert(ps->uniformVarCount == 1);
+    assert(strcmp(ps->uniformVars[0].name, "uf_bias") == 0);
+    GLSL_FreePixelShader(ps);
+}
+
+void TestCompileArena()
+{
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+vec4 blur(vec2 uv)
+{
+  vec4 sum = vec4(0.0);
+  for (int i = -2; i <= 2; i++)
+    sum += texture(textureSampler, uv + vec2(float(i) * 0.01, 0.0));
+  return sum / 5.0;
+}
+void main()
+{
+  outputColor = blur(textureCoord) * uf_tint;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS);
+    GX2PixelShader* psArena = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, (GLSL_COMPILER_FLAG)(GLSL_COMPILER_FLAG_USE_COMPILE_ARENA | GLSL_COMPILER_FLAG_PRINT_ALLOC_STATS));
+    assert(ps && psArena);
+    // the allocation strategy must not change the result
+    assert(ps->size == psArena->size && memcmp(ps->program, psArena->program, ps->size) == 0);
+    assert(memcmp(&ps->regs, &psArena->regs, sizeof(ps->regs)) == 0);
+    GLSL_FreePixelShader(ps);
+    GLSL_FreePixelShader(psArena);
+}
+
+void TestShaderStats()
+{
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  outputColor = (texture(textureSampler, textureCoord) + texture(textureSampler, textureCoord * 2.0)) * uf_tint * 0.37;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps);
+    GLSL_SHADER_STATS stats;
+    bool hasStats = GLSL_GetLastShaderStats(&stats);
+    assert(hasStats);
+    // the stats describe the program that is handed out
+    assert(stats.optimized.ndw * 4 == ps->size);
+    assert(stats.optimized.gprCount > 0 && stats.optimized.texCount == 2 && stats.optimized.fetchClauseCount > 0);
+    assert(stats.optimized.aluGroupCount > 0 && stats.optimized.aluCount >= stats.optimized.aluGroupCount);
+    assert(stats.optimized.literalCount > 0); // 0.37 has no inline constant
+    assert(stats.backend.texCount == 2);
+    GLSL_FreePixelShader(ps);
+}
+
+void TestShaderEstimate()
+{
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 color = texture(textureSampler, textureCoord);
+#ifdef EXTRA_FETCHES
+  color += texture(textureSampler, textureCoord * 2.0) + texture(textureSampler, textureCoord * 4.0);
+#endif
+  outputColor = color * uf_tint * 0.37;
+}
+)";
+    char infoLogBuffer[1024];
+    const char* extraFetches[] = {"EXTRA_FETCHES"};
+    GLSL_DEFINE_SET defineSets[2] = {{nullptr, 0}, {extraFetches, 1}};
+    GLSL_PROGRAM_ESTIMATE estimates[2];
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        GX2PixelShader** table = GLSL_CompilePixelShaderPermutations(psSrc, defineSets + i, 1, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+        assert(table && table[0]);
+        bool success = GLSL_EstimatePixelShader(table[0], estimates + i, false);
+        assert(success);
+        GLSL_FreePixelShaderPermutations(table, 1);
+    }
+    // the estimate decodes the same program the stats describe
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps);
+    GLSL_SHADER_STATS stats;
+    bool hasStats = GLSL_GetLastShaderStats(&stats);
+    assert(hasStats);
+    GLSL_PROGRAM_ESTIMATE estimate;
+    bool success = GLSL_EstimatePixelShader(ps, &estimate, false);
+    assert(success);
+    assert(estimate.aluGroupCount == stats.optimized.aluGroupCount && estimate.aluSlotCount == stats.optimized.aluCount);
+    assert(estimate.texCount == 1 && estimate.gprCount == stats.optimized.gprCount && estimate.exportCount > 0);
+    assert(estimate.cycles == estimates[0].cycles && estimate.wavefronts > 0 && estimate.cycles <= estimate.serialCycles);
+    GLSL_FreePixelShader(ps);
+    // more work has to cost more
+    assert(estimates[1].texCount == 3 && estimates[1].fetchCycles > estimates[0].fetchCycles);
+    assert(estimates[1].serialCycles > estimates[0].serialCycles);
+}
+
+void TestShaderInterpreter()
+{
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  if (textureCoord.y > 0.9)
+    discard;
+  vec4 color = texture(textureSampler, textureCoord) * uf_tint;
+  float sum = 0.0;
+  for (int i = 0; i < int(textureCoord.x * 8.0); i++)
+    sum += 0.125;
+  color.w = textureCoord.y > 0.5 ? sum : -sum;
+  outputColor = color;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps && ps->uniformVarCount == 1);
+    // loose uniforms are in block 15
+    uint32_t uniformData[16] = {};
+    const float tint[4] = {2.0f, 0.5f, 4.0f, 1.0f};
+    memcpy(uniformData + ps->uniformVars[0].offset / 4, tint, sizeof(tint));
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+    const float texels[2 * 2 * 4] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.25f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 1.0f, 0.75f, 0.75f, 0.75f, 1.0f};
+    GLSL_RUN_TEXTURE texture = {2, 2, texels, 0};
+    // textureCoord is interpolated into R0. The last quad is discarded
+    float coords[GLSL_RUN_MAX_LANES][4] = {};
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+    {
+        coords[l][0] = (l & 1) ? 0.75f : 0.25f;
+        coords[l][1] = l >= 60 ? 0.95f : ((l & 2) ? 0.75f : 0.25f);
+    }
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = GLSL_RUN_MAX_LANES;
+    input.inputGprs = (const uint32_t*)coords;
+    input.inputGprCount = 1;
+    input.uniformBlocks = uniformBlocks;
+    input.uniformBlockCount = 16;
+    input.textures = &texture;
+    input.textureCount = 1;
+    GLSL_RUN_RESULT* result = GLSL_RunPixelShader(ps, &input);
+    assert(result);
+    if (!result->success)
+        DebugLog("Interpreter failed: %s", result->error);
+    assert(result->success && (result->colorMask & 1));
+    assert(result->killedLanes == 0xF000000000000000ull);
+    for (uint32_t l = 0; l < 60; l++)
+    {
+        float color[4];
+        memcpy(color, result->colors[0][l], sizeof(color));
+        const float* texel = texels + ((l & 3) * 4);
+        float sum = (l & 1) ? 0.75f : 0.25f;
+        assert(color[0] == texel[0] * tint[0] && color[1] == texel[1] * tint[1] && color[2] == texel[2] * tint[2]);
+        assert(color[3] == ((l & 2) ? sum : -sum));
+    }
+    // the loop body runs up to 6 times
+    uint32_t maxExecuteCount = 0;
+    for (uint32_t i = 0; i < result->cfCount; i++)
+        maxExecuteCount = result->cfStats[i].executeCount > maxExecuteCount ? result->cfStats[i].executeCount : maxExecuteCount;
+    assert(maxExecuteCount >= 6 && result->texCount == 1 && result->aluCount >= result->aluGroupCount);
+    GLSL_FreeRunResult(result);
+    GLSL_FreePixelShader(ps);
+}
+
+// compile psSrc without and with featureFlag, run both programs on the input that setupInput fills in and check that they compute
+// the same colors. checkResult sees each run result before it is freed
+template<typename SetupInput, typename CheckResult>
+void CompileRunAndCompare(const char* psSrc, GLSL_COMPILER_FLAG featureFlag, GLSL_SHADER_STATS stats[2], SetupInput setupInput, CheckResult checkResult)
+{
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps[2];
+    const GLSL_COMPILER_FLAG flags[2] = {GLSL_COMPILER_FLAG_NONE, featureFlag};
+    for (int i = 0; i < 2; i++)
+    {
+        ps[i] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, flags[i]);
+        assert(ps[i]);
+        bool hasStats = GLSL_GetLastShaderStats(&stats[i]);
+        assert(hasStats);
+    }
+    // the flags only change the scheduling, both programs have the same uniform layout
+    GLSL_RUN_INPUT input = {};
+    setupInput(ps[0], input);
+    GLSL_RUN_RESULT* result[2];
+    for (int i = 0; i < 2; i++)
+    {
+        result[i] = GLSL_RunPixelShader(ps[i], &input);
+        assert(result[i] && result[i]->success && (result[i]->colorMask & 1));
+        checkResult(i, result[i]);
+    }
+    assert(memcmp(result[0]->colors[0], result[1]->colors[0], sizeof(result[0]->colors[0])) == 0);
+    for (int i = 0; i < 2; i++)
+    {
+        GLSL_FreeRunResult(result[i]);
+        GLSL_FreePixelShader(ps[i]);
+    }
+}
+
+void TestPackedAluGroups()
+{
+    // each group can read two constant pairs. The scalars and the vectors read four different uniforms, first-fit fills the first group
+    // with the two scalars and can't add the vectors to it, the lookahead pairs each vector with one scalar
+    const char* psSrc = R"(
+#version 450
+uniform vec4 uf_a;
+uniform vec4 uf_b;
+uniform vec4 uf_c;
+uniform vec4 uf_d;
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  float s0 = passColor.x * uf_a.x;
+  float s1 = passColor.y * uf_b.x;
+  vec4 t0 = passColor * uf_c.xyxy;
+  vec4 t1 = passColor.wzyx * uf_d.yxyx;
+  outputColor = t0 * s0 + t1 * s1;
+}
+)";
+    uint32_t uniformData[16] = {};
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    float colors[GLSL_RUN_MAX_LANES][4] = {};
+    GLSL_SHADER_STATS stats[2];
+    CompileRunAndCompare(psSrc, GLSL_COMPILER_FLAG_PACK_ALU_GROUPS, stats, [&](const GX2PixelShader* ps, GLSL_RUN_INPUT& input)
+    {
+        for (uint32_t u = 0; u < ps->uniformVarCount; u++)
+        {
+            const float value[4] = {1.5f - (float)u, -0.5f, 2.0f, 0.25f * (float)u};
+            memcpy(uniformData + ps->uniformVars[u].offset / 4, value, sizeof(value));
+        }
+        uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+        for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+                colors[l][c] = (float)((l * 7 + c * 3) % 11) * 0.125f - 0.5f;
+        }
+        input.laneCount = GLSL_RUN_MAX_LANES;
+        input.inputGprs = (const uint32_t*)colors;
+        input.inputGprCount = 1;
+        input.uniformBlocks = uniformBlocks;
+        input.uniformBlockCount = 16;
+    }, [](int, const GLSL_RUN_RESULT*) {});
+    DebugLog("ALU groups: %u -> %u (backend %u -> %u)", stats[0].optimized.aluGroupCount, stats[1].optimized.aluGroupCount,
+             stats[0].backend.aluGroupCount, stats[1].backend.aluGroupCount);
+    assert(stats[1].backend.aluCount == stats[0].backend.aluCount);
+    assert(stats[1].backend.aluGroupCount < stats[0].backend.aluGroupCount);
+}
+
+void TestKcacheLineGrouping()
+{
+    // lightData[0], [48] and [96] are in three different constant cache lines. The first reads are ready together and the default
+    // order locks lines 0 and 3 for a and b, then has to end the clause for line 6. Grouped by line, a and c share the clause and b follows
+    const char* psSrc = R"(
+#version 450
+layout(std140, binding = 1) uniform LightBlock
+{
+  vec4 lightData[128];
+};
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 a = max(passColor * lightData[0], passColor.wzyx);
+  vec4 b = max(passColor.yzwx * lightData[48], passColor.xwzy);
+  vec4 c = max(passColor.zwxy * lightData[96], passColor.wxyz * lightData[97]);
+  c = min(c * lightData[98], c.yzwx);
+  outputColor = max(min(a, c) * lightData[1], min(b, c) * lightData[49]);
+}
+)";
+    float lightData[128][4];
+    GLSL_RUN_BUFFER uniformBlocks[2] = {};
+    float colors[GLSL_RUN_MAX_LANES][4] = {};
+    GLSL_SHADER_STATS stats[2];
+    CompileRunAndCompare(psSrc, GLSL_COMPILER_FLAG_GROUP_KCACHE_LINES, stats, [&](const GX2PixelShader*, GLSL_RUN_INPUT& input)
+    {
+        for (uint32_t i = 0; i < 128; i++)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+                lightData[i][c] = (float)((i * 5 + c) % 9) * 0.25f - 1.0f;
+        }
+        uniformBlocks[1] = {(const uint32_t*)lightData, sizeof(lightData)};
+        for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+                colors[l][c] = (float)((l + c * 5) % 7) * 0.125f;
+        }
+        input.laneCount = GLSL_RUN_MAX_LANES;
+        input.inputGprs = (const uint32_t*)colors;
+        input.inputGprCount = 1;
+        input.uniformBlocks = uniformBlocks;
+        input.uniformBlockCount = 2;
+    }, [](int, const GLSL_RUN_RESULT*) {});
+    DebugLog("kcache splits: %u -> %u, ALU clauses: %u -> %u", stats[0].backend.kcacheSplitCount, stats[1].backend.kcacheSplitCount,
+             stats[0].backend.aluClauseCount, stats[1].backend.aluClauseCount);
+    assert(stats[1].backend.kcacheSplitCount < stats[0].backend.kcacheSplitCount);
+}
+
+void TestFetchHoisting()
+{
+    // the weights don't feed the taps. By default all ready ALU work is scheduled before the fetch clause, hoisting issues the fetches
+    // once the tap addresses are computed so the weights are computed while the fetches are in flight.
+    // The dynamically indexed array is kept in GPRs, which disables sb, so the run executes the order of the backend scheduler
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec2 uf_texelStep;
+layout(location = 0) in vec4 textureCoord;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 weights[12];
+  for (int i = 0; i < 12; i++)
+    weights[i] = fract(textureCoord.zwzw * float(i + 1) + textureCoord.wzwz * float(11 - i));
+  vec4 w = weights[clamp(int(textureCoord.z * 12.0), 0, 11)];
+  vec4 sum = vec4(0.0);
+  for (int t = 0; t < 4; t++)
+    sum += texture(textureSampler, textureCoord.xy + vec2(t & 1, t >> 1) * uf_texelStep);
+  outputColor = sum * w;
+}
+)";
+    uint32_t uniformData[16] = {};
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    const float texels[2 * 2 * 4] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.25f, 0.0f, 0.5f, 0.0f, 0.0f, 0.5f, 1.0f, 0.75f, 0.75f, 0.75f, 0.25f};
+    GLSL_RUN_TEXTURE texture = {2, 2, texels, 0};
+    float coords[GLSL_RUN_MAX_LANES][4] = {};
+    uint32_t aluGroupsBeforeFetch[2] = {};
+    GLSL_SHADER_STATS stats[2];
+    CompileRunAndCompare(psSrc, GLSL_COMPILER_FLAG_HOIST_FETCHES, stats, [&](const GX2PixelShader* ps, GLSL_RUN_INPUT& input)
+    {
+        const float texelStep[2] = {0.5f, 0.5f};
+        memcpy(uniformData + ps->uniformVars[0].offset / 4, texelStep, sizeof(texelStep));
+        uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+        for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+        {
+            coords[l][0] = (float)(l & 7) * 0.125f;
+            coords[l][1] = (float)(l >> 3) * 0.125f;
+            coords[l][2] = (float)(l % 12) * 0.0625f;
+            coords[l][3] = (float)(l % 5) * 0.25f;
+        }
+        input.laneCount = GLSL_RUN_MAX_LANES;
+        input.inputGprs = (const uint32_t*)coords;
+        input.inputGprCount = 1;
+        input.uniformBlocks = uniformBlocks;
+        input.uniformBlockCount = 16;
+        input.textures = &texture;
+        input.textureCount = 1;
+    }, [&](int i, const GLSL_RUN_RESULT* result)
+    {
+        assert(result->texCount == 4);
+        for (uint32_t cf = 0; cf < result->cfCount && result->cfStats[cf].fetchCount == 0; cf++)
+            aluGroupsBeforeFetch[i] += result->cfStats[cf].aluGroupCount;
+    });
+    DebugLog("fetch clauses: %u -> %u, ALU groups before the first fetch: %u -> %u", stats[0].backend.fetchClauseCount,
+             stats[1].backend.fetchClauseCount, aluGroupsBeforeFetch[0], aluGroupsBeforeFetch[1]);
+    assert(!stats[0].sbOptimized && !stats[1].sbOptimized);
+    assert(stats[0].backend.texCount == 4 && stats[1].backend.texCount == 4);
+    assert(stats[1].backend.fetchClauseCount <= stats[0].backend.fetchClauseCount);
+    assert(aluGroupsBeforeFetch[1] < aluGroupsBeforeFetch[0]);
+}
+
+void TestGprBudget()
+{
+    // the scaled constants are ready at the start of the block and are all computed up front, while each of them is only read by
+    // one step of the serial chain. Rematerializing them next to their readers keeps only the chain live
+    const char* psSrc = R"(
+#version 450
+uniform vec4 uf_scale;
+uniform vec4 uf_bias;
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 c0 = uf_scale * 2.5;
+  vec4 c1 = uf_bias.yzwx * 0.75;
+  vec4 c2 = uf_scale.zwxy * 1.25;
+  vec4 c3 = uf_bias.wxyz * 3.5;
+  vec4 c4 = uf_scale.wzyx * 0.375;
+  vec4 c5 = uf_bias.xwzy * 1.75;
+  vec4 r = passColor;
+  r = r * c0 + passColor.yzwx;
+  r = r * r.yzwx + c1;
+  r = r * c2 + r.zwxy;
+  r = r * r.wxyz + c3;
+  r = r * c4 + r.yzwx;
+  r = r * r.zwxy + c5;
+  outputColor = r;
+}
+)";
+    char infoLogBuffer[1024];
+    GLSL_SHADER_STATS stats[3];
+    GX2PixelShader* ps[3];
+    GLSL_SetGprBudget(0);
+    ps[0] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps[0]);
+    bool hasStats = GLSL_GetLastShaderStats(&stats[0]);
+    assert(hasStats && stats[0].rematerializedCount == 0);
+    // a budget which is already met and one which takes the register pressure variants to reach
+    const uint32_t budgets[3] = {0, stats[0].optimized.gprCount, stats[0].optimized.gprCount - 1};
+    for (int i = 1; i < 3; i++)
+    {
+        GLSL_SetGprBudget(budgets[i]);
+        ps[i] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+        assert(ps[i]);
+        hasStats = GLSL_GetLastShaderStats(&stats[i]);
+        assert(hasStats && stats[i].gprBudget == budgets[i]);
+    }
+    GLSL_SetGprBudget(0);
+    DebugLog("GPRs: %u, with budget %u: %u, %u values rematerialized", stats[0].optimized.gprCount, budgets[2], stats[2].optimized.gprCount,
+             stats[2].rematerializedCount);
+    assert(stats[1].optimized.gprCount == stats[0].optimized.gprCount && stats[1].optimized.ndw == stats[0].optimized.ndw);
+    assert(stats[2].optimized.gprCount < stats[0].optimized.gprCount && stats[2].optimized.gprCount <= budgets[2]);
+    assert(stats[2].rematerializedCount > 0);
+    // the variants compute the same colors. Without sb the operations can be folded differently, so allow rounding differences
+    uint32_t uniformData[16] = {};
+    // small values, the chain squares its intermediate results
+    const float values[2][4] = {{0.5f, -0.25f, 0.375f, 0.125f}, {0.25f, 0.5f, -0.125f, 0.375f}};
+    assert(ps[0]->uniformVarCount == 2);
+    for (uint32_t u = 0; u < 2; u++)
+        memcpy(uniformData + ps[0]->uniformVars[u].offset / 4, values[u], sizeof(values[u]));
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+    float colors[GLSL_RUN_MAX_LANES][4] = {};
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+            colors[l][c] = (float)((l * 5 + c * 3) % 13) * 0.125f - 0.75f;
+    }
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = GLSL_RUN_MAX_LANES;
+    input.inputGprs = (const uint32_t*)colors;
+    input.inputGprCount = 1;
+    input.uniformBlocks = uniformBlocks;
+    input.uniformBlockCount = 16;
+    GLSL_RUN_RESULT* result[3];
+    for (int i = 0; i < 3; i++)
+    {
+        result[i] = GLSL_RunPixelShader(ps[i], &input);
+        assert(result[i] && result[i]->success && (result[i]->colorMask & 1));
+    }
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            float expected, actual;
+            memcpy(&expected, &result[0]->colors[0][l][c], 4);
+            memcpy(&actual, &result[2]->colors[0][l][c], 4);
+            assert(fabsf(expected - actual) <= fabsf(expected) * 1e-5f + 1e-5f);
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        GLSL_FreeRunResult(result[i]);
+        GLSL_FreePixelShader(ps[i]);
+    }
+}
+
+void TestArraysInGprs()
+{
+    // 48 elements are above the default scratch threshold of 40
+    const char* psSrc = R"(
+#version 450
+uniform float uf_base;
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 palette[48];
+  for (int i = 0; i < 48; i++)
+    palette[i] = vec4(float(i), float(i) * uf_base, 1.0 - float(i), 0.5);
+  int idx = clamp(int(passColor.x), 0, 47);
+  outputColor = palette[idx] * 2.0 + palette[47 - idx];
+}
+)";
+    char infoLogBuffer[1024];
+    // default, arrays in GPRs and arrays in GPRs with a budget which leaves too little room for the array
+    const GLSL_COMPILER_FLAG flags[3] = {GLSL_COMPILER_FLAG_NONE, GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS, GLSL_COMPILER_FLAG_ARRAYS_IN_GPRS};
+    const uint32_t budgets[3] = {0, 0, 40};
+    GLSL_SHADER_STATS stats[3];
+    GX2PixelShader* ps[3];
+    for (int i = 0; i < 3; i++)
+    {
+        GLSL_SetGprBudget(budgets[i]);
+        ps[i] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, flags[i]);
+        assert(ps[i]);
+        bool hasStats = GLSL_GetLastShaderStats(&stats[i]);
+        assert(hasStats);
+    }
+    GLSL_SetGprBudget(0);
+    DebugLog("scratch: %u -> %u, GPRs: %u -> %u", stats[0].optimized.scratchSize, stats[1].optimized.scratchSize,
+             stats[0].optimized.gprCount, stats[1].optimized.gprCount);
+    assert(stats[0].optimized.scratchSize != 0);
+    assert(stats[1].optimized.scratchSize == 0 && stats[1].optimized.gprCount >= 48);
+    assert(stats[2].optimized.scratchSize != 0);
+    // the array is indexed relative to AR
+    uint32_t uniformData[16] = {};
+    const float base = 0.5f;
+    memcpy(uniformData + ps[1]->uniformVars[0].offset / 4, &base, sizeof(base));
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+    float colors[GLSL_RUN_MAX_LANES][4] = {};
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+        colors[l][0] = (float)l;
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = GLSL_RUN_MAX_LANES;
+    input.inputGprs = (const uint32_t*)colors;
+    input.inputGprCount = 1;
+    input.uniformBlocks = uniformBlocks;
+    input.uniformBlockCount = 16;
+    GLSL_RUN_RESULT* result = GLSL_RunPixelShader(ps[1], &input);
+    assert(result && result->success && (result->colorMask & 1));
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+    {
+        float idx = (float)(l < 47 ? l : 47);
+        const float expected[4] = {idx + 47.0f, (idx + 47.0f) * base, -44.0f - idx, 1.5f};
+        assert(memcmp(result->colors[0][l], expected, sizeof(expected)) == 0);
+    }
+    GLSL_FreeRunResult(result);
+    for (int i = 0; i < 3; i++)
+        GLSL_FreePixelShader(ps[i]);
+}
+
+void TestDirectPipeline()
+{
+    const char* vsSrc = R"(
+#version 450
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec2 inUV;
+uniform mat4 uf_mvp;
+layout(location = 0) out vec2 passUV;
+void main()
+{
+  gl_Position = uf_mvp * vec4(inPos, 1.0);
+  passUV = inUV;
+}
+)";
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec4 outGlow;
+void main()
+{
+  vec4 c = texture(textureSampler, passUV) * uf_tint;
+  outColor = c;
+  outGlow = c * c.a;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2VertexShader* vs = GLSL_CompileVertexShader(vsSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    GX2VertexShader* vsDirect = GLSL_CompileVertexShader(vsSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_DIRECT_PIPELINE);
+    assert(vs && vsDirect);
+    // skipping the state tracker and CSO bookkeeping must not change the result
+    assert(vs->size == vsDirect->size && memcmp(vs->program, vsDirect->program, vs->size) == 0);
+    assert(memcmp(&vs->regs, &vsDirect->regs, sizeof(vs->regs)) == 0);
+    GLSL_FreeVertexShader(vs);
+    GLSL_FreeVertexShader(vsDirect);
+
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    GX2PixelShader* psDirect = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_DIRECT_PIPELINE);
+    assert(ps && psDirect);
+    assert(ps->size == psDirect->size && memcmp(ps->program, psDirect->program, ps->size) == 0);
+    assert(memcmp(&ps->regs, &psDirect->regs, sizeof(ps->regs)) == 0);
+    GLSL_FreePixelShader(ps);
+    GLSL_FreePixelShader(psDirect);
+}
+
+// the r600 backend lowers the NIR in place by default. Compiling several shaders in a row through both pipelines has to work
+// and give the same programs as lowering a clone
+void TestNirInPlace()
+{
+    const char* vsSrc = R"(
+#version 450
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec2 inUV;
+uniform mat4 uf_mvp;
+layout(location = 0) out vec2 passUV;
+void main()
+{
+  gl_Position = uf_mvp * vec4(inPos, 1.0);
+  passUV = inUV * 0.5 + 0.25;
+}
+)";
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  vec4 c = texture(textureSampler, passUV);
+  for (int i = 0; i < 4; i++)
+    c = c * uf_tint + vec4(0.125 * float(i));
+  outColor = c;
+}
+)";
+    char infoLogBuffer[1024];
+    const GLSL_COMPILER_FLAG flags[2] = {GLSL_COMPILER_FLAG_NONE, GLSL_COMPILER_FLAG_DIRECT_PIPELINE};
+    for (int f = 0; f < 2; f++)
+    {
+        GX2VertexShader* vs[3];
+        GX2PixelShader* ps[3];
+        // back to back in place, then with a clone
+        for (int i = 0; i < 3; i++)
+        {
+            s_compiler->translateNirInPlace = i < 2;
+            vs[i] = GLSL_CompileVertexShader(vsSrc, infoLogBuffer, 1024, flags[f]);
+            ps[i] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, flags[f]);
+            assert(vs[i] && ps[i]);
+        }
+        s_compiler->translateNirInPlace = true;
+        for (int i = 1; i < 3; i++)
+        {
+            assert(vs[0]->size == vs[i]->size && memcmp(vs[0]->program, vs[i]->program, vs[0]->size) == 0);
+            assert(ps[0]->size == ps[i]->size && memcmp(ps[0]->program, ps[i]->program, ps[0]->size) == 0);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            GLSL_FreeVertexShader(vs[i]);
+            GLSL_FreePixelShader(ps[i]);
+        }
+    }
+}
+
+void TestPixelShaderKey()
+{
+    const char* psSrc = R"(
+#version 450
+uniform vec4 uf_color;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec4 outNormal;
+void main()
+{
+  outColor = vec4(passUV, 0.25, 0.5) * uf_color;
+  outNormal = vec4(passUV.yx, 0.75, 0.5);
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps);
+    assert(((ps->regs.sq_pgm_exports_ps >> 1) & 0xF) == 2); // EXPORT_COLORS
+    assert(ps->regs.cb_shader_mask == 0xFF && ps->regs.cb_shader_control == 3);
+    // a single bound color buffer drops the second export
+    GLSL_PIXEL_SHADER_KEY key = {};
+    key.colorBufferCount = 1;
+    key.alphaToOne = 1;
+    GLSL_SetPixelShaderKey(&key);
+    GX2PixelShader* psSingle = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    GLSL_SetPixelShaderKey(nullptr);
+    assert(psSingle);
+    assert(((psSingle->regs.sq_pgm_exports_ps >> 1) & 0xF) == 1);
+    assert(psSingle->regs.cb_shader_mask == 0xF && psSingle->regs.cb_shader_control == 1);
+    assert(psSingle->size <= ps->size);
+
+    uint32_t uniformData[16] = {};
+    const float color[4] = {2.0f, 4.0f, 8.0f, 0.5f};
+    memcpy(uniformData + psSingle->uniformVars[0].offset / 4, color, sizeof(color));
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+    float coords[4][4] = {{0.5f, 0.25f}, {1.0f, 0.5f}, {0.0f, 1.0f}, {0.25f, 0.75f}};
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = 4;
+    input.inputGprs = (const uint32_t*)coords;
+    input.inputGprCount = 1;
+    input.uniformBlocks = uniformBlocks;
+    input.uniformBlockCount = 16;
+    GLSL_RUN_RESULT* result = GLSL_RunPixelShader(psSingle, &input);
+    assert(result && result->success && result->colorMask == 1);
+    for (uint32_t l = 0; l < 4; l++)
+    {
+        float exported[4];
+        memcpy(exported, result->colors[0][l], sizeof(exported));
+        assert(exported[0] == coords[l][0] * 2.0f && exported[1] == coords[l][1] * 4.0f && exported[2] == 2.0f);
+        assert(exported[3] == 1.0f); // alpha-to-one
+    }
+    GLSL_FreeRunResult(result);
+    GLSL_FreePixelShader(ps);
+    GLSL_FreePixelShader(psSingle);
+}
+
+void TestBuiltinCallCache()
+{
+    // the same builtins are called with different parameter types, including implicit int to float conversions
+    const char* psSrc = R"(
+#version 450
+layout(location = 0) in vec2 uv;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  vec4 c;
+  c.x = clamp(uv.x * 4.0, 0, 1);
+  c.y = clamp(uv.y * 4.0, 0.0, 1.0);
+  c.z = dot(clamp(uv, 0.25, 0.5), vec2(1));
+  c.w = mix(clamp(uv.x, 0.0, 0.5), clamp(uv.y, 0, 0.5), 0.5);
+  outColor = c;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps);
+    float coords[4][4] = {{0.125f, 0.5f}, {0.5f, 0.0625f}, {0.25f, 0.75f}, {1.0f, 1.0f}};
+    const float expected[4][4] = {{0.5f, 1.0f, 0.75f, 0.3125f}, {1.0f, 0.25f, 0.75f, 0.28125f}, {1.0f, 1.0f, 0.75f, 0.375f}, {1.0f, 1.0f, 1.0f, 0.5f}};
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = 4;
+    input.inputGprs = (const uint32_t*)coords;
+    input.inputGprCount = 1;
+    GLSL_RUN_RESULT* result = GLSL_RunPixelShader(ps, &input);
+    assert(result && result->success && (result->colorMask & 1));
+    for (uint32_t l = 0; l < 4; l++)
+    {
+        float color[4];
+        memcpy(color, result->colors[0][l], sizeof(color));
+        for (uint32_t c = 0; c < 4; c++)
+            assert(color[c] == expected[l][c]);
+    }
+    GLSL_FreeRunResult(result);
+    GLSL_FreePixelShader(ps);
+}
+
+void TestTextureBaking()
+{
+    // 2D tiled RGBA8 with a generated mip chain. Level 1 is still macro tiled, the small levels fall back to 1D tiling
+    TextureSourceImage image;
+    image.width = 100;
+    image.height = 70;
+    image.format = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+    image.levels.resize(1);
+    image.levels[0].resize(image.width * image.height * 4);
+    for (size_t i = 0; i < image.levels[0].size(); i++)
+        image.levels[0][i] = (uint8_t)(i * 7 + (i >> 9));
+    TextureBakeOptions options;
+    options.swizzle = 0x300;
+    GX2Texture texture;
+    std::string error;
+    bool success = BakeTexture({image}, options, texture, error);
+    assert(success);
+    assert(texture.surface.mipLevels == 7 && texture.viewNumMips == 7);
+    assert(GetTextureLevelLayout(texture.surface, 1).tileMode == GX2_TILE_MODE_TILED_2D_THIN1);
+    assert(GetTextureLevelLayout(texture.surface, 6).tileMode == GX2_TILE_MODE_TILED_1D_THIN1);
+    for (uint32_t y = 0; y < image.height; y++)
+    {
+        for (uint32_t x = 0; x < image.width; x++)
+        {
+            const uint8_t* element = (const uint8_t*)texture.surface.image + GetTextureElementOffset(texture.surface, 0, x, y, 0);
+            assert(memcmp(element, image.levels[0].data() + (y * image.width + x) * 4, 4) == 0);
+        }
+    }
+    // level 1 is the 2x2 average of level 0
+    for (uint32_t y = 0; y < image.height / 2; y++)
+    {
+        for (uint32_t x = 0; x < image.width / 2; x++)
+        {
+            const uint8_t* element = (const uint8_t*)texture.surface.mipmaps + GetTextureElementOffset(texture.surface, 1, x, y, 0);
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                auto src = [&](uint32_t sx, uint32_t sy) { return (uint32_t)image.levels[0][(sy * image.width + sx) * 4 + c]; };
+                uint32_t expected = (src(x * 2, y * 2) + src(x * 2 + 1, y * 2) + src(x * 2, y * 2 + 1) + src(x * 2 + 1, y * 2 + 1) + 2) / 4;
+                assert(element[c] == expected);
+            }
+        }
+    }
+    FreeBakedTexture(texture);
+}
+
+void TestPreprocessing()
+{
+    // only #version/#extension/#line and comments, skips glcpp
+    const char* psPlain = R"(#version 450
+#extension GL_ARB_separate_shader_objects : enable
+/* tint applied
+   to the texture */
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint; // rgb and alpha
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+#line 20
+void main()
+{
+  outColor = texture(textureSampler, passUV) * uf_tint;
+}
+)";
+    // same shader through the macro expansion of glcpp
+    const char* psMacros = R"(#version 450
+#define TINT(c) ((c) * uf_tint)
+#ifdef GL_ES
+#error not an ES shader
+#endif
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = TINT(texture(textureSampler, passUV));
+}
+)";
+    // a line comment ending in a backslash continues onto the next line, only glcpp gets this right
+    const char* psContinuedComment = R"(#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint; // rgb and alpha \
+   not code, still part of the comment
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = texture(textureSampler, passUV) * uf_tint;
+}
+)";
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps[4];
+    GLSL_SHADER_STATS stats[4];
+    const char* sources[4] = {psPlain, psMacros, psMacros, psContinuedComment}; // the second macro compile uses the cached glcpp output
+    const uint32_t expectedPaths[4] = {GLSL_PREPROCESS_PATH_PASSTHROUGH, GLSL_PREPROCESS_PATH_GLCPP, GLSL_PREPROCESS_PATH_CACHED, GLSL_PREPROCESS_PATH_GLCPP};
+    for (int i = 0; i < 4; i++)
+    {
+        ps[i] = GLSL_CompilePixelShader(sources[i], infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+        assert(ps[i]);
+        bool hasStats = GLSL_GetLastShaderStats(&stats[i]);
+        assert(hasStats);
+        assert(stats[i].preprocessMicroseconds <= stats[i].compileMicroseconds);
+        assert(stats[i].preprocessPath == expectedPaths[i]);
+    }
+    for (int i = 1; i < 4; i++)
+    {
+        assert(ps[0]->size == ps[i]->size && memcmp(ps[0]->program, ps[i]->program, ps[0]->size) == 0);
+        assert(memcmp(&ps[0]->regs, &ps[i]->regs, sizeof(ps[0]->regs)) == 0);
+    }
+    for (int i = 0; i < 4; i++)
+        GLSL_FreePixelShader(ps[i]);
+
+    // the cache is shared by all instances, destroying another one (e.g. a permutation worker) must not release it
+    delete new CafeGLSLCompiler();
+    GX2PixelShader* psAgain = GLSL_CompilePixelShader(psMacros, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(psAgain);
+    GLSL_SHADER_STATS statsAgain;
+    bool hasStats = GLSL_GetLastShaderStats(&statsAgain);
+    assert(hasStats);
+    assert(statsAgain.preprocessPath == GLSL_PREPROCESS_PATH_CACHED);
+    GLSL_FreePixelShader(psAgain);
+}
+
+void TestShaderIncludes()
+{
+    const char* library = R"(
+#define TINT_SCALE 0.5
+vec4 ApplyTint(vec4 c, vec4 tint)
+{
+#ifdef DOUBLE_TINT
+  tint = tint * tint;
+#endif
+  return c * tint * TINT_SCALE;
+}
+)";
+    const char* psInclude = R"(#version 450
+#extension GL_ARB_shading_language_include : require
+%s
+#include "/lib/tint.glsl"
+layout(binding = 0) uniform sampler2D textureSampler;
+uniform vec4 uf_tint;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = ApplyTint(texture(textureSampler, passUV), uf_tint) * TINT_SCALE;
+}
+)";
+    bool success = GLSL_SetInclude("/lib/tint.glsl", library);
+    assert(success);
+    success = GLSL_SetInclude("no/leading/slash.glsl", library);
+    assert(!success);
+    char infoLogBuffer[1024];
+    char source[1024];
+    // the second compile of each variant expands the include from the cache. The define before the #include leads to a different expansion
+    const char* defines[4] = {"", "", "#define DOUBLE_TINT", "#define DOUBLE_TINT"};
+    GX2PixelShader* ps[4];
+    for (int i = 0; i < 4; i++)
+    {
+        snprintf(source, sizeof(source), psInclude, defines[i]);
+        ps[i] = GLSL_CompilePixelShader(source, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+        assert(ps[i]);
+    }
+    assert(ps[0]->size == ps[1]->size && memcmp(ps[0]->program, ps[1]->program, ps[0]->size) == 0);
+    assert(ps[2]->size == ps[3]->size && memcmp(ps[2]->program, ps[3]->program, ps[2]->size) == 0);
+    assert(ps[0]->size != ps[2]->size || memcmp(ps[0]->program, ps[2]->program, ps[0]->size) != 0);
+    for (int i = 0; i < 4; i++)
+        GLSL_FreePixelShader(ps[i]);
+    // removed includes are not found anymore
+    success = GLSL_SetInclude("/lib/tint.glsl", nullptr);
+    assert(success);
+    snprintf(source, sizeof(source), psInclude, "");
+    GX2PixelShader* psMissing = GLSL_CompilePixelShader(source, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(!psMissing);
+
+    // the include cache is shared by all instances. An expansion is only replayed if the includes nested in it still
+    // have the same source, here the API compiler and a second instance give /lib/scale.glsl different sources
+    const char* psNested = R"(#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/lib/wrap.glsl"
+uniform vec4 uf_tint;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = uf_tint * WRAP_SCALE;
+}
+)";
+    const char* wrap = "#include \"/lib/scale.glsl\"\n#define WRAP_SCALE (SCALE * 2.0)\n";
+    success = GLSL_SetInclude("/lib/wrap.glsl", wrap) && GLSL_SetInclude("/lib/scale.glsl", "#define SCALE 0.25\n");
+    assert(success);
+    CafeGLSLCompiler* other = new CafeGLSLCompiler();
+    success = other->SetInclude("/lib/wrap.glsl", wrap) && other->SetInclude("/lib/scale.glsl", "#define SCALE 0.75\n");
+    assert(success);
+    GX2PixelShader* psQuarter = GLSL_CompilePixelShader(psNested, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    GX2PixelShader* psOther = _CompilePixelShader(other, psNested, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(psQuarter && psOther);
+    assert(psQuarter->size != psOther->size || memcmp(psQuarter->program, psOther->program, psQuarter->size) != 0);
+    // changing the nested include in the first instance picks up the new source too
+    success = GLSL_SetInclude("/lib/scale.glsl", "#define SCALE 0.75\n");
+    assert(success);
+    GX2PixelShader* psChanged = GLSL_CompilePixelShader(psNested, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(psChanged);
+    assert(psChanged->size == psOther->size && memcmp(psChanged->program, psOther->program, psOther->size) == 0);
+    GLSL_FreePixelShader(psQuarter);
+    GLSL_FreePixelShader(psOther);
+    GLSL_FreePixelShader(psChanged);
+    delete other;
+    GLSL_SetInclude("/lib/wrap.glsl", nullptr);
+    GLSL_SetInclude("/lib/scale.glsl", nullptr);
+}
+
+void TestSizeOptimization()
+{
+    // a loop which is unrolled by default, literals used in many groups and an if with a large body
+    const char* psSrc = R"(
+#version 450
+uniform vec4 uf_scale;
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 c = passColor;
+  for (int i = 0; i < 12; i++)
+    c = fract(c * 1.618034 + uf_scale * float(i)) * 0.7071068 + vec4(0.1234567);
+  if (passColor.x > 0.0)
+  {
+    c.x = c.x * 1.618034 + sin(c.y) * 0.7071068;
+    c.y = c.y * 1.618034 - cos(c.z) * 0.7071068;
+    c.z = sqrt(abs(c.z * 1.618034)) + 0.1234567;
+    c.w = exp2(c.w * 0.7071068) - c.x * c.y * 1.618034;
+  }
+  outputColor = c;
+}
+)";
+    char infoLogBuffer[1024];
+    GLSL_SHADER_STATS stats[2];
+    GX2PixelShader* ps[2];
+    const GLSL_COMPILER_FLAG flags[2] = {GLSL_COMPILER_FLAG_NONE, GLSL_COMPILER_FLAG_OPTIMIZE_SIZE};
+    for (int i = 0; i < 2; i++)
+    {
+        ps[i] = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, flags[i]);
+        assert(ps[i]);
+        bool hasStats = GLSL_GetLastShaderStats(&stats[i]);
+        assert(hasStats);
+    }
+    DebugLog("Program size: %u -> %u dwords (baseline %u)", stats[0].optimized.ndw, stats[1].optimized.ndw, stats[1].sizeBaselineNdw);
+    assert(stats[0].sizeBaselineNdw == 0);
+    assert(stats[1].sizeBaselineNdw == stats[0].optimized.ndw);
+    // the loop stays rolled and the literals of its body are shared
+    assert(stats[1].optimized.ndw < stats[1].sizeBaselineNdw);
+    assert(ps[1]->size < ps[0]->size);
+    // both programs compute the same colors, up to rounding of the folded constants
+    uint32_t uniformData[16] = {};
+    const float scale[4] = {0.5f, -0.25f, 0.125f, 1.0f};
+    memcpy(uniformData + ps[0]->uniformVars[0].offset / 4, scale, sizeof(scale));
+    GLSL_RUN_BUFFER uniformBlocks[16] = {};
+    uniformBlocks[15] = {uniformData, sizeof(uniformData)};
+    float colors[GLSL_RUN_MAX_LANES][4] = {};
+    for (uint32_t l = 0; l < GLSL_RUN_MAX_LANES; l++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+            colors[l][c] = (float)((l * 5 + c * 3) % 13) * 0.125f - 0.75f;
+    }
+    GLSL_RUN_INPUT input = {};
+    input.laneCount = GLSL_RUN_MAX_LANES;
+    input.inputGprs = (const uint32_t*)colors;
+    input.inputGprCount = 1;
+    input.uniformBlocks = uniformBlocks;
+    input.uniformBlockCount = 16;
+    GLSL_RUN_RESULT* result[2];
+    for (int i = 0; i < 2; i++)
+    {
+        result[i] = GLSL_RunPixelShader(ps[i], &input);
+        assert(result[i] && result[i]->success && (result[i]->colorMask & 1));
+    }
+    const float* a = (const float*)result[0]->colors[0];
+    const float* b = (const float*)result[1]->colors[0];
+    for (uint32_t i = 0; i < sizeof(result[0]->colors[0]) / sizeof(float); i++)
+        assert(std::fabs(a[i] - b[i]) <= 1e-4f);
+    for (int i = 0; i < 2; i++)
+    {
+        GLSL_FreeRunResult(result[i]);
+        GLSL_FreePixelShader(ps[i]);
+    }
+    // each step of the chain depends on the previous one and encodes the literal in its own group. Shared, it is loaded by one MOV
+    // and every step reads the register
+    const char* literalSrc = R"(
+#version 450
+uniform vec4 uf_scale;
+layout(location = 0) in vec4 passColor;
+layout(location = 0) out vec4 outputColor;
+void main()
+{
+  vec4 c = passColor * 1.618034 + uf_scale;
+  c = c.yzwx * 1.618034 + passColor;
+  c = c.zwxy * 1.618034 + uf_scale.wzyx;
+  c = c.wxyz * 1.618034 + passColor.yzwx;
+  outputColor = c;
+}
+)";
+    // the same uniform and colors as above
+    CompileRunAndCompare(literalSrc, GLSL_COMPILER_FLAG_OPTIMIZE_SIZE, stats, [&](const GX2PixelShader* ps, GLSL_RUN_INPUT& literalInput)
+    {
+        memset(uniformData, 0, sizeof(uniformData));
+        memcpy(uniformData + ps->uniformVars[0].offset / 4, scale, sizeof(scale));
+        literalInput = input;
+    }, [](int, const GLSL_RUN_RESULT*) {});
+    DebugLog("Shared literal: %u -> %u literals, %u -> %u dwords", stats[0].optimized.literalCount, stats[1].optimized.literalCount,
+             stats[0].optimized.ndw, stats[1].optimized.ndw);
+    assert(stats[0].sbOptimized && stats[1].sbOptimized);
+    assert(stats[0].optimized.literalCount >= 4 && stats[1].optimized.literalCount == 1);
+    assert(stats[1].optimized.aluCount == stats[0].optimized.aluCount + 1);
+    assert(stats[1].optimized.ndw < stats[0].optimized.ndw);
+}
+
+void TestCompileServer()
+{
+#if !defined(__WUT__)
+    const char* psSource = R"(#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = texture(textureSampler, passUV).bgra;
+}
+)";
+    std::string socketPath = "/tmp/cafeglsl_test_" + std::to_string(getpid()) + ".sock";
+    std::thread server([&] { RunCompileServer(socketPath, 2); });
+
+    CompileServerRequest request;
+    request.output = CompileServerOutput::GX2_PROGRAM;
+    request.shaders.push_back({true, psSource});
+    CompileServerResponse response;
+    std::string error;
+    // wait for the server to listen
+    bool connected = false;
+    for (int i = 0; i < 100 && !connected; i++)
+    {
+        connected = SendCompileServerRequest(socketPath, request, response, error);
+        if (!connected)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    assert(connected && response.status == CompileServerStatus::OK);
+
+    // the program matches a compile in this process
+    char infoLogBuffer[1024];
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSource, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(ps);
+    uint32_t programSize;
+    memcpy(&programSize, response.payload.data(), sizeof(uint32_t));
+    assert(programSize == ps->size && response.payload.size() == sizeof(uint32_t) + ps->size);
+    assert(memcmp(response.payload.data() + sizeof(uint32_t), ps->program, ps->size) == 0);
+    GLSL_FreePixelShader(ps);
+
+    request.output = CompileServerOutput::GSH;
+    bool sent = SendCompileServerRequest(socketPath, request, response, error);
+    assert(sent && response.status == CompileServerStatus::OK && response.payload.size() > 4 && memcmp(response.payload.data(), "Gfx2", 4) == 0);
+
+    const char* errorSource = "#version 450\nvoid main() { undeclared = 1.0; }\n";
+    request.shaders[0].source = errorSource;
+    sent = SendCompileServerRequest(socketPath, request, response, error);
+    assert(sent && response.status == CompileServerStatus::COMPILE_ERROR && !response.payload.empty());
+
+    // raw connections, SendCompileServerRequest closes its connection after one request
+    auto connectRaw = [&]()
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socketPath.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+        return fd;
+    };
+    auto readResponseHeader = [](int fd, uint32_t* header)
+    {
+        size_t received = 0;
+        while (received < 2 * sizeof(uint32_t))
+        {
+            ssize_t n = recv(fd, (uint8_t*)header + received, 2 * sizeof(uint32_t) - received, 0);
+            assert(n > 0);
+            received += (size_t)n;
+        }
+    };
+
+    // a malformed request after a failed compile on the same connection gets an empty payload
+    int fd = connectRaw();
+    uint32_t compileHeader[8] = { 0x43475352, 1, (uint32_t)CompileServerCommand::COMPILE, 0, (uint32_t)CompileServerOutput::GX2_PROGRAM, 1, 0, (uint32_t)strlen(errorSource) };
+    send(fd, compileHeader, sizeof(compileHeader), 0);
+    send(fd, errorSource, strlen(errorSource), 0);
+    uint32_t responseHeader[2];
+    readResponseHeader(fd, responseHeader);
+    assert(responseHeader[0] == (uint32_t)CompileServerStatus::COMPILE_ERROR && responseHeader[1] > 0);
+    std::vector<uint8_t> infoLog(responseHeader[1]);
+    for (size_t received = 0; received < infoLog.size();)
+        received += (size_t)recv(fd, infoLog.data() + received, infoLog.size() - received, 0);
+    uint32_t badHeader[6] = { 0xDEADBEEF, 1, 0, 0, 0, 0 };
+    send(fd, badHeader, sizeof(badHeader), 0);
+    readResponseHeader(fd, responseHeader);
+    assert(responseHeader[0] == (uint32_t)CompileServerStatus::BAD_REQUEST && responseHeader[1] == 0);
+    close(fd);
+
+    // an idle client holding its connection open must not keep the server from shutting down
+    int idleFd = connectRaw();
+    // give a worker time to pick it up and block in recv
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CompileServerRequest shutdownRequest;
+    shutdownRequest.command = CompileServerCommand::SHUTDOWN;
+    sent = SendCompileServerRequest(socketPath, shutdownRequest, response, error);
+    assert(sent);
+    server.join();
+    close(idleFd);
+#endif
+}
+
+void TestCompressedContainer()
+{
+#ifdef HAVE_COMPRESSION
+    const char* vsSrc = R"(
+#version 450
+layout(location = 0) in vec4 attrPos;
+layout(location = 1) in vec2 attrUV;
+layout(location = 0) out vec2 passUV;
+void main()
+{
+  gl_Position = attrPos;
+  passUV = attrUV;
+}
+)";
+    const char* psSrc = R"(
+#version 450
+layout(binding = 0) uniform sampler2D textureSampler;
+layout(location = 0) in vec2 passUV;
+layout(location = 0) out vec4 outColor;
+void main()
+{
+  outColor = texture(textureSampler, passUV * 2.0) * vec4(0.5, 1.0, 1.0, 1.0);
+}
+)";
+    char infoLogBuffer[1024];
+    GX2VertexShader* vs = GLSL_CompileVertexShader(vsSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    GX2PixelShader* ps = GLSL_CompilePixelShader(psSrc, infoLogBuffer, 1024, GLSL_COMPILER_FLAG_NONE);
+    assert(vs && ps);
+    GFDFile file;
+    file.vertexShaders.push_back(*vs);
+    file.pixelShaders.push_back(*ps);
+    file.pixelShaders.push_back(*ps);
+    std::vector<uint8_t> plain, compressed;
+    bool success = writeFile(file, plain) && writeCompressedFile(file, compressed);
+    assert(success);
+    DebugLog("Compressed container: %u -> %u bytes", (uint32_t)plain.size(), (uint32_t)compressed.size());
+
+    // round trip to the plain layout
+    GFDCompressedReader reader;
+    success = reader.open(compressed.data(), compressed.size());
+    assert(success && reader.entries().size() == 3);
+    std::vector<uint8_t> roundTrip;
+    success = reader.readPlain(roundTrip);
+    assert(success && roundTrip == plain);
+
+    // random access to the second pixel shader, the program is decompressed into aligned memory
+    const GFDCompressedEntry* entry = reader.findEntry(GFDBlockType::PixelShaderHeader, 1);
+    assert(entry && entry->programSize == ps->size);
+    void* program = aligned_alloc(GFDProgramAlignment, (ps->size + GFDProgramAlignment - 1) & ~(GFDProgramAlignment - 1));
+    std::vector<uint8_t> blocks;
+    success = reader.readEntry(*entry, blocks, program);
+    assert(success && memcmp(program, ps->program, ps->size) == 0);
+    assert(blocks.size() + ps->size == entry->plainSize);
+    assert(memcmp(blocks.data(), plain.data() + entry->plainOffset, entry->programOffset) == 0);
+    // misaligned program memory is rejected
+    success = reader.readEntry(*entry, blocks, (uint8_t*)program + 4);
+    assert(!success);
+    free(program);
+    // corrupt data is detected
+    compressed[entry->dataOffset + entry->dataSize / 2] ^= 0x5A;
+    success = reader.readPlain(roundTrip) && roundTrip == plain;
+    assert(!success);
+
+    GLSL_FreeVertexShader(vs);
+    GLSL_FreePixelShader(ps);
+#endif
+}
+
 int RunTests()
 {
     DebugLog("Initialize compiler...\n");
@@ -161,6 +1468,27 @@ int RunTests()
 
     TestShader1();
     TestShader2();
+    TestShaderPermutations();
+    TestUniformSpecialization();
+    TestCompileArena();
+    TestShaderStats();
+    TestShaderEstimate();
+    TestShaderInterpreter();
+    TestPackedAluGroups();
+    TestKcacheLineGrouping();
+    TestFetchHoisting();
+    TestGprBudget();
+    TestArraysInGprs();
+    TestDirectPipeline();
+    TestNirInPlace();
+    TestPixelShaderKey();
+    TestBuiltinCallCache();
+    TestTextureBaking();
+    TestPreprocessing();
+    TestShaderIncludes();
+    TestSizeOptimization();
+    TestCompileServer();
+    TestCompressedContainer();
 
     DebugLog("Done!");
     GLSL_Shutdown();
@@ -0,0 +1,762 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#if !defined(__WUT__)
+#include <thread>
+#include <atomic>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "util/format_srgb.h"
+#include "util/format/u_format_s3tc.h"
+#include "util/format/u_format_rgtc.h"
+#include "gallium/drivers/r600/r600_formats.h"
+#include "gallium/drivers/r600/r600d.h"
+
+#include "texture.h"
+
+// Latte surface layout. The addrlib in src/amd only has Evergreen and newer hardware layers, so the R6xx/R7xx
+// address calculations are implemented here. Latte has 2 pipes, 4 banks and a 256 byte pipe interleave
+// only thin tile modes with a single sample are supported
+
+static constexpr uint32_t kNumPipes = 2;
+static constexpr uint32_t kNumBanks = 4;
+static constexpr uint32_t kPipeInterleaveBytes = 256;
+static constexpr uint32_t kMicroTileSize = 8; // width and height in elements
+static constexpr uint32_t kMacroTileWidth = kMicroTileSize * kNumBanks;
+static constexpr uint32_t kMacroTileHeight = kMicroTileSize * kNumPipes;
+static constexpr uint32_t kMaxMipLevels = 14;
+
+static uint32_t NextPow2(uint32_t v)
+{
+    uint32_t r = 1;
+    while (r < v)
+        r <<= 1;
+    return r;
+}
+
+static uint32_t AlignUp(uint32_t v, uint32_t alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+static bool IsBCnFormat(uint32_t format)
+{
+    uint32_t hwFormat = format & 0x3F;
+    return hwFormat >= FMT_BC1 && hwFormat <= FMT_BC5;
+}
+
+static bool IsSRGBFormat(uint32_t format)
+{
+    return (format & 0x400) != 0;
+}
+
+static uint32_t GetElementBits(uint32_t format)
+{
+    switch (format & 0x3F)
+    {
+    case FMT_BC1:
+    case FMT_BC4:
+        return 64;
+    case FMT_BC2:
+    case FMT_BC3:
+    case FMT_BC5:
+        return 128;
+    default:
+        return 32;
+    }
+}
+
+// size of the image data of a level in elements
+static void GetLevelDataSize(uint32_t width, uint32_t height, uint32_t format, uint32_t level, uint32_t& elementsX, uint32_t& elementsY)
+{
+    elementsX = std::max(1u, width >> level);
+    elementsY = std::max(1u, height >> level);
+    if (IsBCnFormat(format))
+    {
+        elementsX = (elementsX + 3) / 4;
+        elementsY = (elementsY + 3) / 4;
+    }
+}
+
+TextureLevelLayout GetTextureLevelLayout(const GX2Surface& surface, uint32_t level)
+{
+    uint32_t bpp = GetElementBits(surface.format);
+    uint32_t width = std::max(1u, surface.width >> level);
+    uint32_t height = std::max(1u, surface.height >> level);
+    uint32_t numSlices = std::max(1u, (uint32_t)surface.depth);
+    if (IsBCnFormat(surface.format))
+    {
+        // the base level is rounded to whole blocks, mips are rounded to a power of two first
+        width = level == 0 ? AlignUp(width, 4) : NextPow2(width);
+        height = level == 0 ? AlignUp(height, 4) : NextPow2(height);
+        width = std::max(1u, width / 4);
+        height = std::max(1u, height / 4);
+    }
+
+    TextureLevelLayout layout;
+    layout.tileMode = surface.tileMode;
+    if (level > 0)
+    {
+        width = NextPow2(width);
+        height = NextPow2(height);
+        numSlices = NextPow2(numSlices);
+        // macro tiled levels which are smaller than a macro tile fall back to 1D tiling
+        uint32_t microTileBytes = kMicroTileSize * kMicroTileSize * bpp / 8;
+        uint32_t widthAlignFactor = std::max(1u, kPipeInterleaveBytes / microTileBytes);
+        if (layout.tileMode == GX2_TILE_MODE_TILED_2D_THIN1 && (width < widthAlignFactor * kMacroTileWidth || height < kMacroTileHeight))
+            layout.tileMode = GX2_TILE_MODE_TILED_1D_THIN1;
+    }
+
+    uint32_t microTilesPerPipeInterleave = kPipeInterleaveBytes * 8 / bpp / (kMicroTileSize * kMicroTileSize);
+    uint32_t pitchAlign;
+    uint32_t heightAlign;
+    switch (layout.tileMode)
+    {
+    case GX2_TILE_MODE_LINEAR_ALIGNED:
+        pitchAlign = std::max(64u, kPipeInterleaveBytes * 8 / bpp);
+        heightAlign = 1;
+        layout.baseAlign = kPipeInterleaveBytes;
+        break;
+    case GX2_TILE_MODE_TILED_1D_THIN1:
+        pitchAlign = std::max(kMicroTileSize, microTilesPerPipeInterleave * kMicroTileSize);
+        heightAlign = kMicroTileSize;
+        layout.baseAlign = kPipeInterleaveBytes;
+        break;
+    default:
+        pitchAlign = std::max(kMacroTileWidth, microTilesPerPipeInterleave * kMacroTileWidth);
+        heightAlign = kMacroTileHeight;
+        layout.baseAlign = std::max(kMacroTileWidth * kMacroTileHeight * bpp / 8, heightAlign * pitchAlign * bpp / 8);
+        break;
+    }
+    layout.pitch = AlignUp(width, pitchAlign);
+    layout.height = AlignUp(height, heightAlign);
+    layout.depth = numSlices;
+    layout.size = layout.pitch * layout.height * layout.depth * bpp / 8;
+    return layout;
+}
+
+// element order inside a thin micro tile
+static uint32_t GetPixelIndexWithinMicroTile(uint32_t x, uint32_t y, uint32_t bpp)
+{
+    uint32_t x0 = x & 1, x1 = (x >> 1) & 1, x2 = (x >> 2) & 1;
+    uint32_t y0 = y & 1, y1 = (y >> 1) & 1, y2 = (y >> 2) & 1;
+    switch (bpp)
+    {
+    case 32:
+        return x0 | (x1 << 1) | (y0 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+    case 64:
+        return x0 | (y0 << 1) | (x1 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+    default:
+        return y0 | (x0 << 1) | (x1 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+    }
+}
+
+// locates the micro tile which contains x,y. For 1D tiling tileOffset is the byte offset of the micro tile
+// for 2D tiling it is the macro tile and slice offset without the bank and pipe bits, which are returned separately
+static void GetMicroTileLocation(const TextureLevelLayout& layout, uint32_t bpp, uint32_t swizzle, uint32_t x, uint32_t y, uint32_t slice, uint32_t& tileOffset, uint32_t& bankPipeBits)
+{
+    uint32_t sliceOffset = slice * (layout.pitch * layout.height * bpp / 8);
+    if (layout.tileMode == GX2_TILE_MODE_TILED_1D_THIN1)
+    {
+        uint32_t microTileBytes = kMicroTileSize * kMicroTileSize * bpp / 8;
+        tileOffset = sliceOffset + (x / kMicroTileSize + (y / kMicroTileSize) * (layout.pitch / kMicroTileSize)) * microTileBytes;
+        bankPipeBits = 0;
+        return;
+    }
+    uint32_t pipe = ((x >> 3) ^ (y >> 3)) & 1;
+    uint32_t bank = (((y >> 5) ^ (x >> 3)) & 1) | ((((y >> 4) ^ (x >> 4)) & 1) << 1);
+    uint32_t pipeSwizzle = (swizzle >> 8) & 1;
+    uint32_t bankSwizzle = (swizzle >> 9) & 3;
+    uint32_t rotation = kNumPipes * (kNumBanks / 2 - 1);
+    uint32_t bankPipe = pipe + kNumPipes * bank;
+    bankPipe ^= pipeSwizzle + kNumPipes * bankSwizzle + slice * rotation;
+    bankPipe %= kNumPipes * kNumBanks;
+    pipe = bankPipe % kNumPipes;
+    bank = bankPipe / kNumPipes;
+
+    uint32_t macroTileBytes = kMacroTileWidth * kMacroTileHeight * bpp / 8;
+    uint32_t macroTilesPerRow = layout.pitch / kMacroTileWidth;
+    uint32_t macroTileOffset = (x / kMacroTileWidth + (y / kMacroTileHeight) * macroTilesPerRow) * macroTileBytes;
+    // the pipe and bank bits are inserted above the pipe interleave, the remaining offset is divided accordingly
+    tileOffset = (macroTileOffset + sliceOffset) >> 3;
+    bankPipeBits = (pipe << 8) | (bank << 9);
+}
+
+static inline uint32_t GetElementAddress(const TextureLevelLayout& layout, uint32_t tileOffset, uint32_t bankPipeBits, uint32_t elementOffset)
+{
+    uint32_t offset = tileOffset + elementOffset;
+    if (layout.tileMode != GX2_TILE_MODE_TILED_2D_THIN1)
+        return offset;
+    return bankPipeBits | (offset & (kPipeInterleaveBytes - 1)) | ((offset & ~(kPipeInterleaveBytes - 1)) << 3);
+}
+
+uint32_t GetTextureElementOffset(const GX2Surface& surface, uint32_t level, uint32_t x, uint32_t y, uint32_t slice)
+{
+    TextureLevelLayout layout = GetTextureLevelLayout(surface, level);
+    uint32_t bpp = GetElementBits(surface.format);
+    if (layout.tileMode == GX2_TILE_MODE_LINEAR_ALIGNED)
+        return ((slice * layout.height + y) * layout.pitch + x) * (bpp / 8);
+    uint32_t tileOffset, bankPipeBits;
+    GetMicroTileLocation(layout, bpp, surface.swizzle, x, y, slice, tileOffset, bankPipeBits);
+    return GetElementAddress(layout, tileOffset, bankPipeBits, GetPixelIndexWithinMicroTile(x, y, bpp) * (bpp / 8));
+}
+
+// in every thin micro tile order the first bits of the pixel index come from x (or y0 for 128bit elements)
+// so a row of a micro tile is made of 16 byte runs which stay contiguous after tiling
+static inline void CopyRun(uint8_t* dst, const uint8_t* src)
+{
+#if defined(__SSE2__)
+    _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+#else
+    memcpy(dst, src, 16);
+#endif
+}
+
+// tiles one slice of a level. linear holds pitch * height elements
+static void TileLevel(const TextureLevelLayout& layout, uint32_t bpp, uint32_t swizzle, uint32_t slice, const uint8_t* linear, uint8_t* tiled)
+{
+    uint32_t bytesPerElement = bpp / 8;
+    uint32_t rowBytes = layout.pitch * bytesPerElement;
+    if (layout.tileMode == GX2_TILE_MODE_LINEAR_ALIGNED)
+    {
+        memcpy(tiled + slice * rowBytes * layout.height, linear, rowBytes * layout.height);
+        return;
+    }
+    const uint32_t runElements = 16 / bytesPerElement;
+    const uint32_t runsPerRow = kMicroTileSize / runElements;
+    uint32_t runOffsets[kMicroTileSize][kMicroTileSize];
+    for (uint32_t y = 0; y < kMicroTileSize; y++)
+    {
+        for (uint32_t run = 0; run < runsPerRow; run++)
+            runOffsets[y][run] = GetPixelIndexWithinMicroTile(run * runElements, y, bpp) * bytesPerElement;
+    }
+    for (uint32_t tileY = 0; tileY < layout.height; tileY += kMicroTileSize)
+    {
+        for (uint32_t tileX = 0; tileX < layout.pitch; tileX += kMicroTileSize)
+        {
+            uint32_t tileOffset, bankPipeBits;
+            GetMicroTileLocation(layout, bpp, swizzle, tileX, tileY, slice, tileOffset, bankPipeBits);
+            const uint8_t* src = linear + tileY * rowBytes + tileX * bytesPerElement;
+            for (uint32_t y = 0; y < kMicroTileSize; y++, src += rowBytes)
+            {
+                for (uint32_t run = 0; run < runsPerRow; run++)
+                    CopyRun(tiled + GetElementAddress(layout, tileOffset, bankPipeBits, runOffsets[y][run]), src + run * 16);
+            }
+        }
+    }
+}
+
+// runs func for every index in [0, count) on all hardware threads
+template<typename F>
+static void ParallelFor(uint32_t count, F func)
+{
+#if defined(__WUT__)
+    for (uint32_t i = 0; i < count; i++)
+        func(i);
+#else
+    uint32_t numThreads = std::max(1u, std::min(std::thread::hardware_concurrency(), count));
+    std::atomic<uint32_t> nextIndex{0};
+    auto workerFunc = [&]()
+    {
+        uint32_t index;
+        while ((index = nextIndex.fetch_add(1)) < count)
+            func(index);
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < numThreads - 1; i++)
+        threads.emplace_back(workerFunc);
+    workerFunc();
+    for (auto& thread : threads)
+        thread.join();
+#endif
+}
+
+// 2x2 box filter, sRGB colors are averaged in linear space
+static void DownsampleRGBA8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, bool isSRGB)
+{
+    for (uint32_t y = 0; y < dstHeight; y++)
+    {
+        const uint8_t* row0 = src + std::min(y * 2, srcHeight - 1) * srcWidth * 4;
+        const uint8_t* row1 = src + std::min(y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+        for (uint32_t x = 0; x < dstWidth; x++, dst += 4)
+        {
+            uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+            uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                if (isSRGB && c < 3)
+                {
+                    float sum = util_format_srgb_8unorm_to_linear_float(row0[x0 + c]) + util_format_srgb_8unorm_to_linear_float(row0[x1 + c]) +
+                                util_format_srgb_8unorm_to_linear_float(row1[x0 + c]) + util_format_srgb_8unorm_to_linear_float(row1[x1 + c]);
+                    dst[c] = util_format_linear_float_to_srgb_8unorm(sum * 0.25f);
+                }
+                else
+                    dst[c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+}
+
+// converts RGBA8 pixels into the elements of a BCn format
+static void CompressLevel(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t format, std::vector<uint8_t>& blocks)
+{
+    // the encoders read whole 4x4 blocks, edge pixels are repeated into the padding
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t paddedWidth = blocksX * 4;
+    std::vector<uint8_t> padded(paddedWidth * blocksY * 4 * 4);
+    for (uint32_t y = 0; y < blocksY * 4; y++)
+    {
+        const uint8_t* srcRow = rgba + std::min(y, height - 1) * width * 4;
+        uint8_t* dstRow = padded.data() + y * paddedWidth * 4;
+        memcpy(dstRow, srcRow, width * 4);
+        for (uint32_t x = width; x < paddedWidth; x++)
+            memcpy(dstRow + x * 4, srcRow + (width - 1) * 4, 4);
+    }
+    uint32_t blockRowBytes = blocksX * GetElementBits(format) / 8;
+    blocks.resize(blockRowBytes * blocksY);
+    switch (format & 0x3F)
+    {
+    case FMT_BC1:
+        util_format_dxt1_rgba_pack_rgba_8unorm(blocks.data(), blockRowBytes, padded.data(), paddedWidth * 4, paddedWidth, blocksY * 4);
+        break;
+    case FMT_BC2:
+        util_format_dxt3_rgba_pack_rgba_8unorm(blocks.data(), blockRowBytes, padded.data(), paddedWidth * 4, paddedWidth, blocksY * 4);
+        break;
+    case FMT_BC3:
+        util_format_dxt5_rgba_pack_rgba_8unorm(blocks.data(), blockRowBytes, padded.data(), paddedWidth * 4, paddedWidth, blocksY * 4);
+        break;
+    case FMT_BC4:
+        util_format_rgtc1_unorm_pack_rgba_8unorm(blocks.data(), blockRowBytes, padded.data(), paddedWidth * 4, paddedWidth, blocksY * 4);
+        break;
+    case FMT_BC5:
+        util_format_rgtc2_unorm_pack_rgba_8unorm(blocks.data(), blockRowBytes, padded.data(), paddedWidth * 4, paddedWidth, blocksY * 4);
+        break;
+    }
+}
+
+// swizzle applied by the sampler, same defaults as GX2InitTexture
+static uint32_t GetDefaultCompMap(uint32_t format)
+{
+    switch (format & 0x3F)
+    {
+    case FMT_BC4:
+        return 0x00040405; // R001
+    case FMT_BC5:
+        return 0x00010405; // RG01
+    default:
+        return 0x00010203; // RGBA
+    }
+}
+
+// same as GX2InitTextureRegs
+static void InitTextureRegs(GX2Texture& texture)
+{
+    const GX2Surface& surface = texture.surface;
+    uint32_t pitch = surface.pitch * (IsBCnFormat(surface.format) ? 4 : 1);
+    texture.regs[0] = S_038000_DIM(surface.dim) | S_038000_TILE_MODE(surface.tileMode) | S_038000_PITCH(pitch / 8 - 1) | S_038000_TEX_WIDTH(surface.width - 1);
+    texture.regs[1] = S_038004_TEX_HEIGHT(surface.height - 1) | S_038004_TEX_DEPTH(surface.dim == GX2_SURFACE_DIM_TEXTURE_2D_ARRAY ? surface.depth - 1 : 0) |
+                      S_038004_DATA_FORMAT(surface.format & 0x3F);
+    texture.regs[2] = S_038010_NUM_FORMAT_ALL(V_038010_SQ_NUM_FORMAT_NORM) | S_038010_FORCE_DEGAMMA(IsSRGBFormat(surface.format)) | S_038010_REQUEST_SIZE(2) |
+                      S_038010_DST_SEL_X((texture.compMap >> 24) & 7) | S_038010_DST_SEL_Y((texture.compMap >> 16) & 7) |
+                      S_038010_DST_SEL_Z((texture.compMap >> 8) & 7) | S_038010_DST_SEL_W(texture.compMap & 7) | S_038010_BASE_LEVEL(texture.viewFirstMip);
+    texture.regs[3] = S_038014_LAST_LEVEL(texture.viewFirstMip + texture.viewNumMips - 1) | S_038014_BASE_ARRAY(texture.viewFirstSlice) |
+                      S_038014_LAST_ARRAY(texture.viewFirstSlice + texture.viewNumSlices - 1);
+    texture.regs[4] = S_038018_MAX_ANISO(4) | S_038018_PERF_MODULATION(7) | S_038018_TYPE(V_038010_SQ_TEX_VTX_VALID_TEXTURE);
+}
+
+static void* AllocSurfaceData(uint32_t size, uint32_t alignment)
+{
+    size = AlignUp(size, alignment);
+    void* data = aligned_alloc(alignment, size);
+    memset(data, 0, size);
+    return data;
+}
+
+bool BakeTexture(const std::vector<TextureSourceImage>& slices, const TextureBakeOptions& options, GX2Texture& texture, std::string& error)
+{
+    if (slices.empty())
+    {
+        error = "No images";
+        return false;
+    }
+    const TextureSourceImage& baseImage = slices[0];
+    for (const auto& slice : slices)
+    {
+        if (slice.width != baseImage.width || slice.height != baseImage.height || slice.format != baseImage.format || slice.levels.size() != baseImage.levels.size())
+        {
+            error = "All slices must have the same size, format and number of mip levels";
+            return false;
+        }
+    }
+    if (options.tileMode != GX2_TILE_MODE_LINEAR_ALIGNED && options.tileMode != GX2_TILE_MODE_TILED_1D_THIN1 && options.tileMode != GX2_TILE_MODE_TILED_2D_THIN1)
+    {
+        error = "Unsupported tile mode " + std::to_string(options.tileMode);
+        return false;
+    }
+    bool isPrecompressed = baseImage.format != GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+    uint32_t format = options.format != GX2_SURFACE_FORMAT_INVALID ? options.format : baseImage.format;
+    if (isPrecompressed && (format & 0x3F) != (baseImage.format & 0x3F))
+    {
+        error = "Precompressed images can not be converted to another format";
+        return false;
+    }
+    uint32_t fullMipChain = 1;
+    while ((std::max(baseImage.width, baseImage.height) >> fullMipChain) > 0 && fullMipChain < kMaxMipLevels)
+        fullMipChain++;
+    uint32_t mipLevels = std::min(options.mipLevels ? options.mipLevels : fullMipChain, fullMipChain);
+    if (isPrecompressed)
+    {
+        // mips of precompressed images can only come from the file
+        if (options.mipLevels == 0)
+            mipLevels = std::min((uint32_t)baseImage.levels.size(), fullMipChain);
+        else if (mipLevels > baseImage.levels.size())
+        {
+            error = "The image only contains " + std::to_string(baseImage.levels.size()) + " mip levels";
+            return false;
+        }
+    }
+    uint32_t numSlices = (uint32_t)slices.size();
+
+    memset(&texture, 0, sizeof(GX2Texture));
+    GX2Surface& surface = texture.surface;
+    surface.dim = numSlices > 1 ? GX2_SURFACE_DIM_TEXTURE_2D_ARRAY : GX2_SURFACE_DIM_TEXTURE_2D;
+    surface.width = baseImage.width;
+    surface.height = baseImage.height;
+    surface.depth = numSlices;
+    surface.mipLevels = mipLevels;
+    surface.format = (GX2SurfaceFormat)format;
+    surface.use = GX2_SURFACE_USE_TEXTURE;
+    surface.tileMode = (GX2TileMode)options.tileMode;
+    surface.swizzle = options.swizzle & 0x700;
+
+    // mip levels after the first are stored in the mipmap buffer, each aligned to its own base alignment
+    std::vector<TextureLevelLayout> layouts(mipLevels);
+    std::vector<uint32_t> levelOffsets(mipLevels, 0);
+    for (uint32_t level = 0; level < mipLevels; level++)
+        layouts[level] = GetTextureLevelLayout(surface, level);
+    surface.imageSize = layouts[0].size;
+    surface.alignment = layouts[0].baseAlign;
+    surface.pitch = layouts[0].pitch;
+    uint32_t mipmapSize = 0;
+    for (uint32_t level = 1; level < mipLevels; level++)
+    {
+        mipmapSize = AlignUp(mipmapSize, layouts[level].baseAlign);
+        levelOffsets[level] = mipmapSize;
+        // the first offset is relative to the image, the others to the mipmap buffer
+        surface.mipLevelOffset[level - 1] = level == 1 ? AlignUp(surface.imageSize, layouts[level].baseAlign) : mipmapSize;
+        mipmapSize += layouts[level].size;
+    }
+    surface.mipmapSize = mipmapSize;
+    surface.image = AllocSurfaceData(surface.imageSize, surface.alignment);
+    surface.mipmaps = mipmapSize ? AllocSurfaceData(mipmapSize, surface.alignment) : nullptr;
+
+    // generate the mip chain of every slice. Level 0 is used directly from the image
+    std::vector<std::vector<std::vector<uint8_t>>> mipChains(numSlices);
+    if (!isPrecompressed)
+    {
+        ParallelFor(numSlices, [&](uint32_t slice)
+        {
+            auto& chain = mipChains[slice];
+            chain.resize(mipLevels);
+            for (uint32_t level = 1; level < mipLevels; level++)
+            {
+                const uint8_t* src = level == 1 ? slices[slice].levels[0].data() : chain[level - 1].data();
+                uint32_t srcWidth = std::max(1u, baseImage.width >> (level - 1)), srcHeight = std::max(1u, baseImage.height >> (level - 1));
+                uint32_t dstWidth = std::max(1u, baseImage.width >> level), dstHeight = std::max(1u, baseImage.height >> level);
+                chain[level].resize(dstWidth * dstHeight * 4);
+                DownsampleRGBA8(src, srcWidth, srcHeight, chain[level].data(), dstWidth, dstHeight, IsSRGBFormat(format));
+            }
+        });
+    }
+
+    // compress and tile every level of every slice
+    uint32_t bpp = GetElementBits(format);
+    uint32_t bytesPerElement = bpp / 8;
+    ParallelFor(numSlices * mipLevels, [&](uint32_t item)
+    {
+        uint32_t slice = item % numSlices;
+        uint32_t level = item / numSlices;
+        const TextureLevelLayout& layout = layouts[level];
+        uint32_t elementsX, elementsY;
+        GetLevelDataSize(baseImage.width, baseImage.height, format, level, elementsX, elementsY);
+
+        const uint8_t* elements;
+        std::vector<uint8_t> blocks;
+        if (isPrecompressed)
+            elements = slices[slice].levels[level].data();
+        else
+        {
+            elements = level == 0 ? slices[slice].levels[0].data() : mipChains[slice][level].data();
+            if (IsBCnFormat(format))
+            {
+                CompressLevel(elements, std::max(1u, baseImage.width >> level), std::max(1u, baseImage.height >> level), format, blocks);
+                elements = blocks.data();
+            }
+        }
+
+        // the tiler works on whole micro tiles, so the level is first copied into a buffer of the padded size
+        std::vector<uint8_t> padded((size_t)layout.pitch * layout.height * bytesPerElement, 0);
+        for (uint32_t y = 0; y < elementsY; y++)
+            memcpy(padded.data() + y * layout.pitch * bytesPerElement, elements + y * elementsX * bytesPerElement, elementsX * bytesPerElement);
+        uint8_t* dst = level == 0 ? (uint8_t*)surface.image : (uint8_t*)surface.mipmaps + levelOffsets[level];
+        TileLevel(layout, bpp, surface.swizzle, slice, padded.data(), dst);
+    });
+
+    texture.viewFirstMip = 0;
+    texture.viewNumMips = mipLevels;
+    texture.viewFirstSlice = 0;
+    texture.viewNumSlices = numSlices;
+    texture.compMap = GetDefaultCompMap(format);
+    InitTextureRegs(texture);
+    return true;
+}
+
+void FreeBakedTexture(GX2Texture& texture)
+{
+    free(texture.surface.image);
+    free(texture.surface.mipmaps);
+    texture.surface.image = nullptr;
+    texture.surface.mipmaps = nullptr;
+}
+
+bool ParseTextureFormat(const std::string& name, uint32_t& format)
+{
+    static const std::pair<const char*, uint32_t> formats[] =
+    {
+        {"rgba8", GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8},
+        {"rgba8_srgb", GX2_SURFACE_FORMAT_SRGB_R8_G8_B8_A8},
+        {"bc1", GX2_SURFACE_FORMAT_UNORM_BC1},
+        {"bc1_srgb", GX2_SURFACE_FORMAT_SRGB_BC1},
+        {"bc2", GX2_SURFACE_FORMAT_UNORM_BC2},
+        {"bc2_srgb", GX2_SURFACE_FORMAT_SRGB_BC2},
+        {"bc3", GX2_SURFACE_FORMAT_UNORM_BC3},
+        {"bc3_srgb", GX2_SURFACE_FORMAT_SRGB_BC3},
+        {"bc4", GX2_SURFACE_FORMAT_UNORM_BC4},
+        {"bc5", GX2_SURFACE_FORMAT_UNORM_BC5},
+    };
+    for (const auto& it : formats)
+    {
+        if (name == it.first)
+        {
+            format = it.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// image loading
+
+static uint32_t ReadU32LE(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+// reads the next whitespace separated token of a netpbm header, skipping comments
+static std::string ReadNetpbmToken(const std::vector<uint8_t>& data, size_t& pos)
+{
+    while (pos < data.size())
+    {
+        if (data[pos] == '#')
+        {
+            while (pos < data.size() && data[pos] != '\n')
+                pos++;
+        }
+        else if (isspace(data[pos]))
+            pos++;
+        else
+            break;
+    }
+    size_t start = pos;
+    while (pos < data.size() && !isspace(data[pos]))
+        pos++;
+    return std::string(data.begin() + start, data.begin() + pos);
+}
+
+// binary PPM (P6) or PAM (P7) with 8 bits per channel
+static bool LoadNetpbmImage(const std::vector<uint8_t>& data, TextureSourceImage& image, std::string& error)
+{
+    size_t pos = 0;
+    std::string magic = ReadNetpbmToken(data, pos);
+    uint32_t width = 0, height = 0, channels = 3, maxValue = 0;
+    if (magic == "P6")
+    {
+        width = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+        height = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+        maxValue = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+    }
+    else
+    {
+        std::string token;
+        while (!(token = ReadNetpbmToken(data, pos)).empty() && token != "ENDHDR")
+        {
+            if (token == "WIDTH")
+                width = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+            else if (token == "HEIGHT")
+                height = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+            else if (token == "DEPTH")
+                channels = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+            else if (token == "MAXVAL")
+                maxValue = (uint32_t)atoi(ReadNetpbmToken(data, pos).c_str());
+            else if (token == "TUPLTYPE")
+                ReadNetpbmToken(data, pos);
+        }
+    }
+    pos++; // single whitespace before the raster
+    if (width == 0 || height == 0 || maxValue != 255 || channels == 0 || channels > 4)
+    {
+        error = "Only 8 bit PPM and PAM images with 1 to 4 channels are supported";
+        return false;
+    }
+    if (data.size() < pos + (size_t)width * height * channels)
+    {
+        error = "Image data is truncated";
+        return false;
+    }
+    image.width = width;
+    image.height = height;
+    image.format = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+    image.levels.resize(1);
+    std::vector<uint8_t>& rgba = image.levels[0];
+    rgba.resize((size_t)width * height * 4);
+    const uint8_t* src = data.data() + pos;
+    for (size_t i = 0; i < (size_t)width * height; i++, src += channels)
+    {
+        // grayscale is expanded to RGB, alpha defaults to opaque
+        bool isGray = channels <= 2;
+        rgba[i * 4 + 0] = src[0];
+        rgba[i * 4 + 1] = isGray ? src[0] : src[1];
+        rgba[i * 4 + 2] = isGray ? src[0] : src[2];
+        rgba[i * 4 + 3] = channels == 2 ? src[1] : (channels == 4 ? src[3] : 255);
+    }
+    return true;
+}
+
+// DDS with BC1-5 data or uncompressed 32 bit pixels. Mips are only taken from compressed files
+static bool LoadDDSImage(const std::vector<uint8_t>& data, TextureSourceImage& image, std::string& error)
+{
+    if (data.size() < 128)
+    {
+        error = "DDS header is truncated";
+        return false;
+    }
+    const uint8_t* header = data.data();
+    uint32_t flags = ReadU32LE(header + 8);
+    image.height = ReadU32LE(header + 12);
+    image.width = ReadU32LE(header + 16);
+    uint32_t mipCount = (flags & 0x20000) ? std::max(1u, ReadU32LE(header + 28)) : 1;
+    uint32_t pixelFormatFlags = ReadU32LE(header + 80);
+    uint32_t fourCC = ReadU32LE(header + 84);
+    uint32_t rgbBitCount = ReadU32LE(header + 88);
+    if (image.width == 0 || image.height == 0)
+    {
+        error = "Invalid DDS size";
+        return false;
+    }
+    if (pixelFormatFlags & 0x4)
+    {
+        switch (fourCC)
+        {
+        case MakeFourCC('D', 'X', 'T', '1'):
+            image.format = GX2_SURFACE_FORMAT_UNORM_BC1;
+            break;
+        case MakeFourCC('D', 'X', 'T', '3'):
+            image.format = GX2_SURFACE_FORMAT_UNORM_BC2;
+            break;
+        case MakeFourCC('D', 'X', 'T', '5'):
+            image.format = GX2_SURFACE_FORMAT_UNORM_BC3;
+            break;
+        case MakeFourCC('A', 'T', 'I', '1'):
+        case MakeFourCC('B', 'C', '4', 'U'):
+            image.format = GX2_SURFACE_FORMAT_UNORM_BC4;
+            break;
+        case MakeFourCC('A', 'T', 'I', '2'):
+        case MakeFourCC('B', 'C', '5', 'U'):
+            image.format = GX2_SURFACE_FORMAT_UNORM_BC5;
+            break;
+        default:
+            error = "Unsupported DDS pixel format";
+            return false;
+        }
+    }
+    else if ((pixelFormatFlags & 0x40) && rgbBitCount == 32)
+    {
+        image.format = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+        mipCount = 1;
+    }
+    else
+    {
+        error = "Unsupported DDS pixel format";
+        return false;
+    }
+
+    size_t pos = 128;
+    image.levels.resize(std::min(mipCount, kMaxMipLevels));
+    for (uint32_t level = 0; level < image.levels.size(); level++)
+    {
+        uint32_t elementsX, elementsY;
+        GetLevelDataSize(image.width, image.height, image.format, level, elementsX, elementsY);
+        size_t levelSize = (size_t)elementsX * elementsY * GetElementBits(image.format) / 8;
+        if (data.size() < pos + levelSize)
+        {
+            error = "DDS data is truncated";
+            return false;
+        }
+        image.levels[level].assign(data.begin() + pos, data.begin() + pos + levelSize);
+        pos += levelSize;
+    }
+    if (image.format == GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8)
+    {
+        // reorder the channels according to the masks, a missing alpha mask means opaque
+        uint32_t masks[4] = {ReadU32LE(header + 92), ReadU32LE(header + 96), ReadU32LE(header + 100), (pixelFormatFlags & 0x1) ? ReadU32LE(header + 104) : 0};
+        std::vector<uint8_t>& pixels = image.levels[0];
+        for (size_t i = 0; i < pixels.size(); i += 4)
+        {
+            uint32_t pixel = ReadU32LE(pixels.data() + i);
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                if (masks[c] == 0)
+                {
+                    pixels[i + c] = c == 3 ? 255 : 0;
+                    continue;
+                }
+                uint32_t shift = 0;
+                while (((masks[c] >> shift) & 1) == 0)
+                    shift++;
+                pixels[i + c] = (uint8_t)((pixel & masks[c]) >> shift);
+            }
+        }
+    }
+    return true;
+}
+
+bool LoadTextureImage(const std::string& path, TextureSourceImage& image, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        error = "Failed to open file: " + path;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() >= 4 && memcmp(data.data(), "DDS ", 4) == 0)
+        return LoadDDSImage(data, image, error);
+    if (data.size() >= 2 && data[0] == 'P' && (data[1] == '6' || data[1] == '7'))
+        return LoadNetpbmImage(data, image, error);
+    error = "Unknown image format: " + path;
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gx2_definitions.h"
+
+// offline texture baking. Images are filtered, compressed and tiled into the Latte surface layout on the host
+// so the console can use the .gtx data as-is
+
+struct TextureSourceImage
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8 for decoded images, otherwise precompressed BCn data
+    std::vector<std::vector<uint8_t>> levels; // linear rows of elements (4x4 blocks for BCn)
+};
+
+struct TextureBakeOptions
+{
+    uint32_t format{GX2_SURFACE_FORMAT_INVALID}; // invalid selects RGBA8 or the format of a precompressed image
+    uint32_t tileMode{GX2_TILE_MODE_TILED_2D_THIN1}; // linear aligned, 1D thin or 2D thin
+    uint32_t mipLevels{0}; // 0 builds the full mip chain
+    uint32_t swizzle{0}; // GX2Surface::swizzle, bits 8-10 select the bank and pipe swizzle of macro tiled levels
+};
+
+// layout of a single mip level in elements
+struct TextureLevelLayout
+{
+    uint32_t tileMode; // small levels of 2D tiled surfaces fall back to 1D tiling
+    uint32_t pitch;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t size;
+    uint32_t baseAlign;
+};
+
+bool LoadTextureImage(const std::string& path, TextureSourceImage& image, std::string& error); // PAM, binary PPM or DDS
+bool ParseTextureFormat(const std::string& name, uint32_t& format);
+bool BakeTexture(const std::vector<TextureSourceImage>& slices, const TextureBakeOptions& options, GX2Texture& texture, std::string& error);
+void FreeBakedTexture(GX2Texture& texture);
+
+TextureLevelLayout GetTextureLevelLayout(const GX2Surface& surface, uint32_t level);
+uint32_t GetTextureElementOffset(const GX2Surface& surface, uint32_t level, uint32_t x, uint32_t y, uint32_t slice); // relative to the level
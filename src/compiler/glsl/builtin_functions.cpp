@@ -1402,6 +1402,31 @@ builtin_builder::~builtin_builder()
    simple_mtx_unlock(&builtins_lock);
 }
 
+/* CafeGLSL: overload resolution of a builtin only depends on the function,
+ * the types of the actual parameters and the version and extension state of
+ * the shader. The result is cached per parse state so repeated calls skip
+ * the availability and implicit conversion checks of every overload.
+ */
+#define BUILTIN_CALL_CACHE_MAX_PARAMS 8
+
+struct builtin_call_key {
+   const ir_function *function;
+   const glsl_type *param_types[BUILTIN_CALL_CACHE_MAX_PARAMS];
+   unsigned num_params;
+};
+
+static uint32_t
+builtin_call_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(builtin_call_key));
+}
+
+static bool
+builtin_call_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(builtin_call_key)) == 0;
+}
+
 ir_function_signature *
 builtin_builder::find(_mesa_glsl_parse_state *state,
                       const char *name, exec_list *actual_parameters)
@@ -1419,10 +1444,44 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    if (f == NULL)
       return NULL;
 
+   builtin_call_key key;
+   memset(&key, 0, sizeof(key));
+   key.function = f;
+   bool cacheable = true;
+   foreach_in_list(ir_rvalue, actual, actual_parameters) {
+      if (key.num_params == BUILTIN_CALL_CACHE_MAX_PARAMS) {
+         cacheable = false;
+         break;
+      }
+      key.param_types[key.num_params++] = actual->type;
+   }
+
+   uint32_t hash = 0;
+   if (cacheable) {
+      hash = builtin_call_key_hash(&key);
+      if (state->builtin_call_cache == NULL) {
+         state->builtin_call_cache =
+            _mesa_hash_table_create(state, builtin_call_key_hash,
+                                    builtin_call_key_equal);
+      } else {
+         struct hash_entry *entry =
+            _mesa_hash_table_search_pre_hashed(state->builtin_call_cache,
+                                               hash, &key);
+         if (entry)
+            return (ir_function_signature *) entry->data;
+      }
+   }
+
    ir_function_signature *sig =
       f->matching_signature(state, actual_parameters, true);
-   if (sig == NULL)
-      return NULL;
+
+   if (cacheable) {
+      builtin_call_key *stored_key = (builtin_call_key *)
+         linear_alloc_child(state->linalloc, sizeof(key));
+      memcpy(stored_key, &key, sizeof(key));
+      _mesa_hash_table_insert_pre_hashed(state->builtin_call_cache, hash,
+                                         stored_key, sig);
+   }
 
    return sig;
 }
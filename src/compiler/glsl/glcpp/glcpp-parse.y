@@ -31,6 +31,10 @@
 #include "glcpp.h"
 #include "main/mtypes.h"
 #include "util/strndup.h"
+#include "util/mesa-sha1.h"
+#include "util/simple_mtx.h"
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
 
 const char *
 _mesa_lookup_shader_include(struct gl_context *ctx, char *path,
@@ -42,6 +46,13 @@ _mesa_get_shader_include_cursor(struct gl_shared_state *shared);
 void
 _mesa_set_shader_include_cursor(struct gl_shared_state *shared, size_t cursor);
 
+size_t
+_mesa_get_shader_include_path_count(struct gl_shared_state *shared);
+
+const char *
+_mesa_lookup_shader_include_sha1(struct gl_context *ctx, char *path,
+                                 bool error_check, unsigned char *sha1);
+
 static void
 yyerror(YYLTYPE *locp, glcpp_parser_t *parser, const char *error);
 
@@ -168,6 +179,23 @@ struct define_include {
 static void
 glcpp_parser_copy_defines(const void *key, void *data, void *closure);
 
+static void
+_glcpp_add_include_dep(glcpp_parser_t *parser, const char *path,
+                       const unsigned char *sha1);
+
+static bool
+_glcpp_include_cache_key(glcpp_parser_t *parser, const char *shader,
+                         unsigned char *key);
+
+static bool
+_glcpp_parser_replay_include(glcpp_parser_t *parser, YYLTYPE *loc,
+                             const unsigned char *key);
+
+static void
+_glcpp_include_cache_store(glcpp_parser_t *parser,
+                           glcpp_parser_t *include_parser,
+                           const unsigned char *key);
+
 static void
 add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
 
@@ -359,19 +387,39 @@ control_line_success:
 			start = strchr($2, '<');
 		}
 		char *path = strndup(start + 1, strlen(start + 1) - 1);
+		/* the lookup tokenises the path in place */
+		char *dep_path = ralloc_strdup(parser, path);
 
+		unsigned char source_sha1[SHA1_DIGEST_LENGTH];
 		const char *shader =
-			_mesa_lookup_shader_include(parser->gl_ctx, path, false);
+			_mesa_lookup_shader_include_sha1(parser->gl_ctx, path,
+							 false, source_sha1);
 		free(path);
 
-		if (!shader)
+		/* CafeGLSL: the expansion of an include only depends on
+		 * its source, the macros defined so far and the sources of
+		 * the includes nested in it. Include files that were
+		 * expanded the same way before are replayed from the cache.
+		 */
+		unsigned char cache_key[SHA1_DIGEST_LENGTH];
+		bool cacheable = shader &&
+			_glcpp_include_cache_key(parser, shader, cache_key);
+
+		if (!shader) {
 			glcpp_error(&@1, parser, "%s not found", $2);
-		else {
+			/* an include nested in a cached one may be added later */
+			_glcpp_add_include_dep(parser, dep_path, source_sha1);
+		} else if (cacheable &&
+			 _glcpp_parser_replay_include(parser, &@1, cache_key)) {
+			/* Nothing else to do */
+		} else {
 			/* Create a temporary parser with the same settings */
 			glcpp_parser_t *tmp_parser =
 				glcpp_parser_create(parser->gl_ctx, parser->extensions, parser->state);
 			tmp_parser->version_set = true;
 			tmp_parser->version = parser->version;
+			_glcpp_add_include_dep(tmp_parser, dep_path,
+					       source_sha1);
 
 			/* Set the shader source and run the lexer */
 			glcpp_lex_set_source_string(tmp_parser, shader);
@@ -398,6 +446,9 @@ control_line_success:
 			 * preprocessor output.
 			 */
 			glcpp_parser_parse(tmp_parser);
+			if (cacheable && !tmp_parser->error)
+				_glcpp_include_cache_store(parser, tmp_parser,
+							   cache_key);
 			_mesa_string_buffer_printf(parser->info_log, "%s",
 						   tmp_parser->info_log->buf);
 			_mesa_string_buffer_printf(parser->output, "%s",
@@ -415,6 +466,8 @@ control_line_success:
 			hash_table_call_foreach(tmp_parser->defines,
 						glcpp_parser_copy_defines,
 						&di);
+			util_dynarray_append_dynarray(&parser->include_deps,
+						      &tmp_parser->include_deps);
 
 			/* Destroy tmp parser memory we no longer need */
 			glcpp_lex_destroy(tmp_parser->scanner);
@@ -1520,6 +1573,8 @@ glcpp_parser_create(struct gl_context *gl_ctx,
 
    parser->is_gles = false;
 
+   util_dynarray_init(&parser->include_deps, parser);
+
    return parser;
 }
 
@@ -2552,3 +2607,288 @@ glcpp_parser_copy_defines(const void *key, void *data, void *closure)
 
    _mesa_hash_table_insert(di->parser->defines, identifier, macro);
 }
+
+/* CafeGLSL: expansions of include files, shared by all parsers and all
+ * shared states. Besides the output every entry keeps the macros the include
+ * defined as #define lines, lexing those is far cheaper than expanding the
+ * include again. The include file itself is part of the key, the files it
+ * includes in turn are kept as dependencies, which are checked against the
+ * include tree of the parser before an entry is replayed.
+ */
+struct glcpp_include_dep {
+   char *path;
+   unsigned char sha1[SHA1_DIGEST_LENGTH];
+};
+
+struct include_cache_entry {
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   char *output;
+   char *info_log;
+   char *defines;
+   struct glcpp_include_dep *deps;
+   unsigned num_deps;
+   size_t size;
+};
+
+#define INCLUDE_CACHE_MAX_BYTES (8 * 1024 * 1024)
+
+static simple_mtx_t include_cache_lock = SIMPLE_MTX_INITIALIZER;
+static void *include_cache_mem_ctx;
+static struct hash_table *include_cache;
+static size_t include_cache_bytes;
+
+static uint32_t
+_include_cache_hash(const void *key)
+{
+   return _mesa_hash_data(key, SHA1_DIGEST_LENGTH);
+}
+
+static bool
+_include_cache_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, SHA1_DIGEST_LENGTH) == 0;
+}
+
+static void
+_include_cache_clear_locked(void)
+{
+   ralloc_free(include_cache_mem_ctx);
+   include_cache_mem_ctx = NULL;
+   include_cache = NULL;
+   include_cache_bytes = 0;
+}
+
+static void
+_include_cache_remove_locked(struct hash_entry *entry)
+{
+   struct include_cache_entry *cached = entry->data;
+   include_cache_bytes -= cached->size;
+   _mesa_hash_table_remove(include_cache, entry);
+   ralloc_free(cached);
+}
+
+void
+glcpp_release_include_cache(void)
+{
+   simple_mtx_lock(&include_cache_lock);
+   _include_cache_clear_locked();
+   simple_mtx_unlock(&include_cache_lock);
+}
+
+void
+glcpp_evict_include_cache(const unsigned char *sha1)
+{
+   simple_mtx_lock(&include_cache_lock);
+   if (include_cache) {
+      hash_table_foreach(include_cache, entry) {
+         struct include_cache_entry *cached = entry->data;
+         for (unsigned i = 0; i < cached->num_deps; i++) {
+            if (memcmp(cached->deps[i].sha1, sha1, SHA1_DIGEST_LENGTH) == 0) {
+               _include_cache_remove_locked(entry);
+               break;
+            }
+         }
+      }
+   }
+   simple_mtx_unlock(&include_cache_lock);
+}
+
+static void
+_glcpp_add_include_dep(glcpp_parser_t *parser, const char *path,
+                       const unsigned char *sha1)
+{
+   struct glcpp_include_dep dep;
+   dep.path = (char *) path;
+   memcpy(dep.sha1, sha1, SHA1_DIGEST_LENGTH);
+   util_dynarray_append(&parser->include_deps, struct glcpp_include_dep, dep);
+}
+
+/* Whether every include the entry looked up still has the same source */
+static bool
+_glcpp_include_deps_valid(glcpp_parser_t *parser,
+                          const struct include_cache_entry *cached)
+{
+   for (unsigned i = 0; i < cached->num_deps; i++) {
+      /* the lookup tokenises the path in place */
+      char *path = strdup(cached->deps[i].path);
+      unsigned char sha1[SHA1_DIGEST_LENGTH];
+      _mesa_lookup_shader_include_sha1(parser->gl_ctx, path, false, sha1);
+      free(path);
+      if (memcmp(sha1, cached->deps[i].sha1, SHA1_DIGEST_LENGTH))
+         return false;
+   }
+   return true;
+}
+
+static void
+_macro_print(struct _mesa_string_buffer *out, macro_t *macro)
+{
+   _mesa_string_buffer_printf(out, "#define %s", macro->identifier);
+   if (macro->is_function) {
+      _mesa_string_buffer_append_char(out, '(');
+      if (macro->parameters) {
+         for (string_node_t *node = macro->parameters->head; node;
+              node = node->next) {
+            _mesa_string_buffer_append(out, node->str);
+            if (node->next)
+               _mesa_string_buffer_append_char(out, ',');
+         }
+      }
+      _mesa_string_buffer_append_char(out, ')');
+   }
+   _mesa_string_buffer_append_char(out, ' ');
+   if (macro->replacements) {
+      for (token_node_t *node = macro->replacements->head; node;
+           node = node->next)
+         _token_print(out, node->token);
+   }
+   _mesa_string_buffer_append_char(out, '\n');
+}
+
+static bool
+_glcpp_include_cache_key(glcpp_parser_t *parser, const char *shader,
+                         unsigned char *key)
+{
+   /* relative includes nested in the file depend on the include paths */
+   if (_mesa_get_shader_include_path_count(parser->gl_ctx->Shared))
+      return false;
+
+   /* the macro table is unordered, the macros are combined commutatively */
+   struct _mesa_string_buffer *text = _mesa_string_buffer_create(NULL, 256);
+   uint64_t macros_hash[2] = { 0, 0 };
+   hash_table_foreach(parser->defines, entry) {
+      _mesa_string_buffer_clear(text);
+      _macro_print(text, entry->data);
+      macros_hash[0] += XXH64(text->buf, text->length, 0);
+      macros_hash[1] += XXH64(text->buf, text->length, 1);
+   }
+   _mesa_string_buffer_destroy(text);
+
+   struct mesa_sha1 sha1;
+   _mesa_sha1_init(&sha1);
+   _mesa_sha1_update(&sha1, shader, strlen(shader));
+   _mesa_sha1_update(&sha1, macros_hash, sizeof(macros_hash));
+   _mesa_sha1_update(&sha1, &parser->version, sizeof(parser->version));
+   _mesa_sha1_update(&sha1, &parser->api, sizeof(parser->api));
+   _mesa_sha1_final(&sha1, key);
+   return true;
+}
+
+static bool
+_glcpp_parser_replay_include(glcpp_parser_t *parser, YYLTYPE *loc,
+                             const unsigned char *key)
+{
+   simple_mtx_lock(&include_cache_lock);
+   struct hash_entry *entry = include_cache ?
+      _mesa_hash_table_search(include_cache, key) : NULL;
+   if (!entry) {
+      simple_mtx_unlock(&include_cache_lock);
+      return false;
+   }
+   struct include_cache_entry *cached = entry->data;
+   if (!_glcpp_include_deps_valid(parser, cached)) {
+      simple_mtx_unlock(&include_cache_lock);
+      return false;
+   }
+   _mesa_string_buffer_printf(parser->output, "#include\n%s",
+                              cached->output);
+   _mesa_string_buffer_append(parser->info_log, cached->info_log);
+   for (unsigned i = 0; i < cached->num_deps; i++) {
+      _glcpp_add_include_dep(parser,
+                             ralloc_strdup(parser, cached->deps[i].path),
+                             cached->deps[i].sha1);
+   }
+   char *defines = ralloc_strdup(parser, cached->defines);
+   simple_mtx_unlock(&include_cache_lock);
+
+   if (!defines[0])
+      return true;
+
+   /* Define the macros of the include the same way its expansion would */
+   glcpp_parser_t *tmp_parser =
+      glcpp_parser_create(parser->gl_ctx, parser->extensions, parser->state);
+   tmp_parser->version_set = true;
+   tmp_parser->version = parser->version;
+   glcpp_lex_set_source_string(tmp_parser, defines);
+   glcpp_parser_parse(tmp_parser);
+
+   struct define_include di;
+   di.parser = parser;
+   di.loc = loc;
+   ralloc_steal(parser, tmp_parser);
+   hash_table_call_foreach(tmp_parser->defines, glcpp_parser_copy_defines,
+                           &di);
+
+   glcpp_lex_destroy(tmp_parser->scanner);
+   _mesa_hash_table_destroy(tmp_parser->defines, NULL);
+   return true;
+}
+
+static void
+_glcpp_include_cache_store(glcpp_parser_t *parser,
+                           glcpp_parser_t *include_parser,
+                           const unsigned char *key)
+{
+   /* the include parser starts out with the macros of the parent, only the
+    * ones it added or replaced are kept
+    */
+   struct _mesa_string_buffer *defines =
+      _mesa_string_buffer_create(NULL, 256);
+   hash_table_foreach(include_parser->defines, entry) {
+      struct hash_entry *previous =
+         _mesa_hash_table_search(parser->defines, entry->key);
+      if (!previous || previous->data != entry->data)
+         _macro_print(defines, entry->data);
+   }
+
+   const struct glcpp_include_dep *deps =
+      util_dynarray_begin(&include_parser->include_deps);
+   unsigned num_deps = util_dynarray_num_elements(&include_parser->include_deps,
+                                                  struct glcpp_include_dep);
+
+   size_t size = include_parser->output->length +
+                 include_parser->info_log->length + defines->length;
+   for (unsigned i = 0; i < num_deps; i++)
+      size += sizeof(*deps) + strlen(deps[i].path);
+   if (size > INCLUDE_CACHE_MAX_BYTES / 4) {
+      _mesa_string_buffer_destroy(defines);
+      return;
+   }
+
+   simple_mtx_lock(&include_cache_lock);
+   if (include_cache_bytes + size > INCLUDE_CACHE_MAX_BYTES)
+      _include_cache_clear_locked();
+   if (!include_cache) {
+      include_cache_mem_ctx = ralloc_context(NULL);
+      include_cache = _mesa_hash_table_create(include_cache_mem_ctx,
+                                              _include_cache_hash,
+                                              _include_cache_equal);
+   }
+   /* an entry of the same key was expanded with different nested includes,
+    * e.g. in another shared state, the latest expansion wins
+    */
+   uint32_t hash = _include_cache_hash(key);
+   struct hash_entry *previous_entry =
+      _mesa_hash_table_search_pre_hashed(include_cache, hash, key);
+   if (previous_entry)
+      _include_cache_remove_locked(previous_entry);
+
+   struct include_cache_entry *cached =
+      ralloc(include_cache_mem_ctx, struct include_cache_entry);
+   memcpy(cached->key, key, SHA1_DIGEST_LENGTH);
+   cached->output = ralloc_strdup(cached, include_parser->output->buf);
+   cached->info_log = ralloc_strdup(cached, include_parser->info_log->buf);
+   cached->defines = ralloc_strdup(cached, defines->buf);
+   cached->num_deps = num_deps;
+   cached->deps = ralloc_array(cached, struct glcpp_include_dep, num_deps);
+   for (unsigned i = 0; i < num_deps; i++) {
+      cached->deps[i].path = ralloc_strdup(cached->deps, deps[i].path);
+      memcpy(cached->deps[i].sha1, deps[i].sha1, SHA1_DIGEST_LENGTH);
+   }
+   cached->size = size;
+   _mesa_hash_table_insert_pre_hashed(include_cache, hash, cached->key,
+                                      cached);
+   include_cache_bytes += size;
+   simple_mtx_unlock(&include_cache_lock);
+   _mesa_string_buffer_destroy(defines);
+}
@@ -35,6 +35,8 @@
 
 #include "util/string_buffer.h"
 
+#include "util/u_dynarray.h"
+
 struct gl_context;
 
 #define yyscan_t void*
@@ -228,6 +230,11 @@ struct glcpp_parser {
 	bool has_new_source_number;
 	int new_source_number;
 	bool is_gles;
+
+	/* CafeGLSL: glcpp_include_dep of every #include expanded so far,
+	 * nested ones included
+	 */
+	struct util_dynarray include_deps;
 };
 
 glcpp_parser_t *
@@ -248,6 +255,16 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 		 glcpp_extension_iterator extensions, void *state,
 		 struct gl_context *g_ctx);
 
+/* CafeGLSL: frees the cached expansions of #include files */
+void
+glcpp_release_include_cache(void);
+
+/* CafeGLSL: frees the cached expansions which looked up an include source
+ * with this SHA1
+ */
+void
+glcpp_evict_include_cache(const unsigned char *sha1);
+
 /* Functions for writing to the info log */
 
 void
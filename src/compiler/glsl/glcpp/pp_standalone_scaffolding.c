@@ -27,7 +27,9 @@
  * compiling builtins).
  */
 
+#include <string.h>
 #include "pp_standalone_scaffolding.h"
+#include "util/mesa-sha1.h"
 
 const char *
 _mesa_lookup_shader_include(struct gl_context *ctx, char *path,
@@ -55,3 +57,23 @@ _mesa_set_shader_include_cursor(struct gl_shared_state *shared,
    (void) shared;
    (void) cursor;
 }
+
+size_t
+_mesa_get_shader_include_path_count(struct gl_shared_state *shared)
+{
+   (void) shared;
+
+   return 0;
+}
+
+const char *
+_mesa_lookup_shader_include_sha1(struct gl_context *ctx, char *path,
+                                 bool error_check, unsigned char *sha1)
+{
+   (void) ctx;
+   (void) path;
+   (void) error_check;
+
+   memset(sha1, 0, SHA1_DIGEST_LENGTH);
+   return NULL;
+}
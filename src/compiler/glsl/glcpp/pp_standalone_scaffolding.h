@@ -44,4 +44,11 @@ void
 _mesa_set_shader_include_cursor(struct gl_shared_state *shared,
                                 size_t cursor);
 
+size_t
+_mesa_get_shader_include_path_count(struct gl_shared_state *shared);
+
+const char *
+_mesa_lookup_shader_include_sha1(struct gl_context *ctx, char *path,
+                                 bool error_check, unsigned char *sha1);
+
 #endif /* PP_STANDALONE_SCAFFOLDING_H */
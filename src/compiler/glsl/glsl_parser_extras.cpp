@@ -32,8 +32,12 @@
 #include "main/shaderobj.h"
 #include "util/u_atomic.h" /* for p_atomic_cmpxchg */
 #include "util/ralloc.h"
+#include "util/hash_table.h"
 #include "util/disk_cache.h"
 #include "util/mesa-sha1.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+#include "util/string_buffer.h"
 #include "ast.h"
 #include "glsl_parser_extras.h"
 #include "glsl_parser.h"
@@ -78,6 +82,7 @@ _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
    this->loop_nesting_ast = NULL;
 
    this->uses_builtin_functions = false;
+   this->builtin_call_cache = NULL;
 
    /* Set default language version and extensions */
    this->language_version = 110;
@@ -851,6 +856,10 @@ _mesa_glsl_process_extension(const char *name, YYLTYPE *name_locp,
       return false;
    }
 
+   /* CafeGLSL: the builtins that are available might change */
+   if (state->builtin_call_cache)
+      _mesa_hash_table_clear(state->builtin_call_cache, NULL);
+
    /* If we're in a desktop context but with an ES shader, use an ES API enum
     * to verify extension availability.
     */
@@ -2214,6 +2223,239 @@ can_skip_compile(struct gl_context *ctx, struct gl_shader *shader,
    return false;
 }
 
+/* CafeGLSL: sources whose only directives are #version, #extension and #line
+ * don't need glcpp, the GLSL lexer handles these itself. Comments are the
+ * only thing the lexer can't deal with, they are replaced by whitespace the
+ * same way glcpp does. Returns NULL if the source has to go through glcpp.
+ */
+static const char *
+passthrough_preprocess(void *mem_ctx, const char *source)
+{
+   struct _mesa_string_buffer *out =
+      _mesa_string_buffer_create(mem_ctx, strlen(source) + 1);
+   bool in_comment = false;
+   const char *p = source;
+
+   while (*p) {
+      const char *line_end = strchr(p, '\n');
+      if (!line_end)
+         line_end = p + strlen(p);
+
+      bool directive = false;
+      if (!in_comment) {
+         const char *c = p;
+         while (c < line_end && (*c == ' ' || *c == '\t'))
+            c++;
+         if (c < line_end && *c == '#') {
+            c++;
+            while (c < line_end && (*c == ' ' || *c == '\t'))
+               c++;
+            if (strncmp(c, "line", 4) == 0) {
+               /* only the numeric forms, anything else needs macro expansion */
+               for (c += 4; c < line_end && *c != '/'; c++) {
+                  if (*c != ' ' && *c != '\t' && *c != '\r' &&
+                      (*c < '0' || *c > '9'))
+                     goto fallback;
+               }
+            } else if (strncmp(c, "version", 7) != 0 &&
+                       strncmp(c, "extension", 9) != 0) {
+               goto fallback;
+            }
+            directive = true;
+         }
+      }
+
+      for (const char *c = p; c < line_end; c++) {
+         if (in_comment) {
+            /* glcpp joins continued lines first, a backslash can split
+             * the end of the comment
+             */
+            if (*c == '\\')
+               goto fallback;
+            if (c[0] == '*' && c[1] == '/') {
+               in_comment = false;
+               c++;
+            }
+            continue;
+         }
+         if (c[0] == '/' && c[1] == '/') {
+            /* glcpp continues a line comment ending in a backslash onto
+             * the next line
+             */
+            if (memchr(c, '\\', line_end - c))
+               goto fallback;
+            break;
+         }
+         if (c[0] == '/' && c[1] == '*') {
+            in_comment = true;
+            _mesa_string_buffer_append_char(out, ' ');
+            c++;
+            continue;
+         }
+         if (*c == '\r') {
+            /* glcpp treats a lone CR as a line break, the lexer doesn't */
+            if (c + 1 == line_end && *line_end == '\n')
+               continue;
+            goto fallback;
+         }
+         /* line continuations, stray directives and predefined macros */
+         if (*c == '\\')
+            goto fallback;
+         if (!directive && (*c == '#' || strncmp(c, "__", 2) == 0 ||
+                            strncmp(c, "GL_", 3) == 0))
+            goto fallback;
+         _mesa_string_buffer_append_char(out, *c);
+      }
+
+      if (!*line_end)
+         break;
+      _mesa_string_buffer_append_char(out, '\n');
+      p = line_end + 1;
+   }
+
+   if (in_comment)
+      goto fallback;
+
+   _mesa_string_buffer_crimp_to_fit(out);
+   ralloc_steal(mem_ctx, out->buf);
+   {
+      const char *result = out->buf;
+      _mesa_string_buffer_destroy(out);
+      return result;
+   }
+
+fallback:
+   _mesa_string_buffer_destroy(out);
+   return NULL;
+}
+
+/* CafeGLSL: glcpp output of previous compiles. The key is the hash of the
+ * whole source together with everything that decides which macros are
+ * predefined, so only a compile of the exact same source hits. Sources that
+ * merely share a prelude are expanded in full every time, unless the prelude
+ * is moved into an #include file, whose expansion and macros glcpp replays
+ * from its include cache. Sources with #include bypass this cache.
+ */
+struct preprocess_cache_entry {
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   char *output;
+   char *info_log;
+};
+
+#define PREPROCESS_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+static simple_mtx_t preprocess_cache_lock = SIMPLE_MTX_INITIALIZER;
+static void *preprocess_cache_mem_ctx;
+static struct hash_table *preprocess_cache;
+static size_t preprocess_cache_bytes;
+
+static uint32_t
+preprocess_cache_hash(const void *key)
+{
+   return _mesa_hash_data(key, SHA1_DIGEST_LENGTH);
+}
+
+static bool
+preprocess_cache_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, SHA1_DIGEST_LENGTH) == 0;
+}
+
+static void
+preprocess_cache_key(struct gl_context *ctx,
+                     struct _mesa_glsl_parse_state *state,
+                     const char *source, unsigned char *key)
+{
+   struct mesa_sha1 sha1;
+   _mesa_sha1_init(&sha1);
+   _mesa_sha1_update(&sha1, source, strlen(source));
+   _mesa_sha1_update(&sha1, &state->stage, sizeof(state->stage));
+   _mesa_sha1_update(&sha1, &ctx->API, sizeof(ctx->API));
+   _mesa_sha1_update(&sha1, &ctx->Extensions, sizeof(ctx->Extensions));
+   _mesa_sha1_update(&sha1, &ctx->Const.DisableGLSLLineContinuations,
+                     sizeof(ctx->Const.DisableGLSLLineContinuations));
+   _mesa_sha1_final(&sha1, key);
+}
+
+void
+_mesa_glsl_release_preprocess_cache(void)
+{
+   simple_mtx_lock(&preprocess_cache_lock);
+   ralloc_free(preprocess_cache_mem_ctx);
+   preprocess_cache_mem_ctx = NULL;
+   preprocess_cache = NULL;
+   preprocess_cache_bytes = 0;
+   simple_mtx_unlock(&preprocess_cache_lock);
+   glcpp_release_include_cache();
+}
+
+static int
+preprocess_source(struct gl_context *ctx, struct _mesa_glsl_parse_state *state,
+                  const char **source, enum gl_preprocess_path *path)
+{
+   const char *passthrough = passthrough_preprocess(state, *source);
+   if (passthrough) {
+      *source = passthrough;
+      *path = PREPROCESS_PASSTHROUGH;
+      return 0;
+   }
+
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   preprocess_cache_key(ctx, state, *source, key);
+
+   simple_mtx_lock(&preprocess_cache_lock);
+   struct hash_entry *entry = preprocess_cache ?
+      _mesa_hash_table_search(preprocess_cache, key) : NULL;
+   if (entry) {
+      struct preprocess_cache_entry *cached =
+         (struct preprocess_cache_entry *) entry->data;
+      *source = ralloc_strdup(state, cached->output);
+      ralloc_strcat(&state->info_log, cached->info_log);
+      simple_mtx_unlock(&preprocess_cache_lock);
+      *path = PREPROCESS_CACHED;
+      return 0;
+   }
+   simple_mtx_unlock(&preprocess_cache_lock);
+
+   size_t info_log_length = strlen(state->info_log);
+   int error = glcpp_preprocess(state, source, &state->info_log,
+                                add_builtin_defines, state, ctx);
+   if (error)
+      return error;
+
+   size_t size = strlen(*source) + strlen(state->info_log + info_log_length);
+   if (size > PREPROCESS_CACHE_MAX_BYTES / 4)
+      return 0;
+
+   simple_mtx_lock(&preprocess_cache_lock);
+   if (preprocess_cache_bytes + size > PREPROCESS_CACHE_MAX_BYTES) {
+      ralloc_free(preprocess_cache_mem_ctx);
+      preprocess_cache_mem_ctx = NULL;
+      preprocess_cache = NULL;
+      preprocess_cache_bytes = 0;
+   }
+   if (!preprocess_cache) {
+      preprocess_cache_mem_ctx = ralloc_context(NULL);
+      preprocess_cache = _mesa_hash_table_create(preprocess_cache_mem_ctx,
+                                                 preprocess_cache_hash,
+                                                 preprocess_cache_equal);
+   }
+   uint32_t hash = preprocess_cache_hash(key);
+   if (!_mesa_hash_table_search_pre_hashed(preprocess_cache, hash, key)) {
+      struct preprocess_cache_entry *cached =
+         ralloc(preprocess_cache_mem_ctx, struct preprocess_cache_entry);
+      memcpy(cached->key, key, sizeof(key));
+      cached->output = ralloc_strdup(cached, *source);
+      cached->info_log = ralloc_strdup(cached,
+                                       state->info_log + info_log_length);
+      _mesa_hash_table_insert_pre_hashed(preprocess_cache, hash,
+                                         cached->key, cached);
+      preprocess_cache_bytes += size;
+   }
+   simple_mtx_unlock(&preprocess_cache_lock);
+   return 0;
+}
+
 void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
                           bool dump_ast, bool dump_hir, bool force_recompile)
@@ -2245,17 +2487,43 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
                         false))
       return;
 
-    struct _mesa_glsl_parse_state *state =
-      new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
+   /* In arena mode shader->ir is created up front and owns the arena, the
+    * parse state and with it the lexer, AST and all IR generated during this
+    * compile are allocated from it.
+    */
+   void *state_ctx = shader;
+   if (ctx->Const.GLSLUseCompileArena) {
+      ralloc_free(shader->ir);
+      shader->ir = ::new(ralloc_arena_context(shader, sizeof(exec_list))) exec_list;
+      state_ctx = shader->ir;
+   }
+
+   struct _mesa_glsl_parse_state *state =
+      new(state_ctx) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
 
    if (ctx->Const.GenerateTemporaryNames)
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
                               false, true);
 
-   if (!source_has_shader_include || !force_recompile) {
-      state->error = glcpp_preprocess(state, &source, &state->info_log,
-                                      add_builtin_defines, state, ctx);
+   /* CafeGLSL: preprocessing time is reported separately in the stats */
+   int64_t preprocess_start = os_time_get_nano();
+   shader->PreprocessPath = PREPROCESS_GLCPP;
+   if (source_has_shader_include) {
+      /* CafeGLSL: only the fallback source from the disk cache has its
+       * includes already expanded, compiles that are always forced must
+       * still resolve them
+       */
+      if (!force_recompile || !shader->FallbackSource) {
+         state->error = glcpp_preprocess(state, &source, &state->info_log,
+                                         add_builtin_defines, state, ctx);
+      } else {
+         shader->PreprocessPath = PREPROCESS_CACHED;
+      }
+   } else {
+      state->error = preprocess_source(ctx, state, &source,
+                                       &shader->PreprocessPath);
    }
+   shader->PreprocessNanoseconds = os_time_get_nano() - preprocess_start;
 
    /* Now that we have run the preprocessor we can check the shader cache and
     * skip compilation if possible for those shaders that contained a shader
@@ -2280,8 +2548,10 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       printf("\n\n");
    }
 
-   ralloc_free(shader->ir);
-   shader->ir = new(shader) exec_list;
+   if (!ctx->Const.GLSLUseCompileArena) {
+      ralloc_free(shader->ir);
+      shader->ir = new(shader) exec_list;
+   }
    if (!state->error && !state->translation_unit.is_empty())
       _mesa_ast_to_hir(shader->ir, state);
 
@@ -918,6 +918,14 @@ struct _mesa_glsl_parse_state {
    const struct gl_extensions *extensions;
 
    bool uses_builtin_functions;
+
+   /**
+    * CafeGLSL: builtin overload resolutions of this shader, keyed on the
+    * function and the actual parameter types. Cleared whenever #extension
+    * changes which builtins are available.
+    */
+   struct hash_table *builtin_call_cache;
+
    bool fs_uses_gl_fragcoord;
 
    /**
@@ -1067,6 +1075,14 @@ extern int glcpp_preprocess(void *ctx, const char **shader, char **info_log,
                             struct _mesa_glsl_parse_state *state,
                             struct gl_context *gl_ctx);
 
+/* CafeGLSL: frees the cached expansions of #include files */
+extern void glcpp_release_include_cache(void);
+
+/* CafeGLSL: frees the cached expansions which looked up an include source
+ * with this SHA1
+ */
+extern void glcpp_evict_include_cache(const unsigned char *sha1);
+
 extern void
 _mesa_glsl_copy_symbols_from_table(struct exec_list *shader_ir,
                                    struct glsl_symbol_table *src,
@@ -37,6 +37,12 @@ extern void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 			  bool dump_ast, bool dump_hir, bool force_recompile);
 
+/* CafeGLSL: frees the preprocessor output cached across compiles, including
+ * the expanded #include files
+ */
+extern void
+_mesa_glsl_release_preprocess_cache(void);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -22,6 +22,7 @@
  */
 
 #include <stdio.h>
+#include <atomic>
 #include "main/macros.h"
 #include "compiler/glsl/glsl_parser_extras.h"
 #include "glsl_types.h"
@@ -43,6 +44,70 @@ hash_table *glsl_type::subroutine_types = NULL;
  */
 static uint32_t glsl_type_users = 0;
 
+namespace {
+
+/* CafeGLSL: lock-free front of the array and explicit matrix type tables,
+ * so concurrent compiles don't serialize on hash_mutex for types that exist
+ * already. The tables only grow while there are type users, so a published
+ * type stays valid until glsl_type_singleton_decref() releases all of them.
+ * Readers probe without the mutex, types are published under it right after
+ * they were inserted into the hash table. Misses and types that didn't fit
+ * fall back to the locked hash tables, which stay the owners.
+ */
+template<unsigned Size>
+class published_type_set {
+public:
+   template<typename Match>
+   const glsl_type *find(uint32_t hash, Match match) const
+   {
+      for (unsigned i = 0; i < max_probes; i++) {
+         const glsl_type *t =
+            slots[(hash + i) & (Size - 1)].load(std::memory_order_acquire);
+         if (t == NULL)
+            return NULL;
+         if (match(t))
+            return t;
+      }
+      return NULL;
+   }
+
+   /* Caller holds glsl_type::hash_mutex. */
+   void publish(uint32_t hash, const glsl_type *t)
+   {
+      for (unsigned i = 0; i < max_probes; i++) {
+         std::atomic<const glsl_type *> &slot = slots[(hash + i) & (Size - 1)];
+         if (slot.load(std::memory_order_relaxed) == NULL) {
+            slot.store(t, std::memory_order_release);
+            return;
+         }
+      }
+   }
+
+   /* Caller holds glsl_type::hash_mutex and there are no type users left. */
+   void clear()
+   {
+      for (unsigned i = 0; i < Size; i++)
+         slots[i].store(NULL, std::memory_order_relaxed);
+   }
+
+private:
+   static const unsigned max_probes = 8;
+   std::atomic<const glsl_type *> slots[Size];
+};
+
+published_type_set<1024> published_array_types;
+published_type_set<256> published_explicit_matrix_types;
+
+inline uint32_t
+published_type_hash(uintptr_t a, uint32_t b, uint32_t c)
+{
+   uint64_t h = (uint64_t) a * 0x9e3779b97f4a7c15ull;
+   h ^= ((uint64_t) b << 32 | c) * 0xc2b2ae3d27d4eb4full;
+   return (uint32_t) (h ^ (h >> 29));
+}
+
+} /* anonymous namespace */
+
 glsl_type::glsl_type(GLenum gl_type,
                      glsl_base_type base_type, unsigned vector_elements,
                      unsigned matrix_columns, const char *name,
@@ -536,6 +601,9 @@ glsl_type_singleton_decref()
       return;
    }
 
+   published_array_types.clear();
+   published_explicit_matrix_types.clear();
+
    if (glsl_type::explicit_matrix_types != NULL) {
       _mesa_hash_table_destroy(glsl_type::explicit_matrix_types,
                                hash_free_type_function);
@@ -683,6 +751,21 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns,
 
       assert(columns > 1 || (rows > 1 && !row_major));
 
+      const uint32_t published_hash =
+         published_type_hash(base_type << 16 | rows << 8 | columns,
+                             explicit_stride, explicit_alignment << 1 | row_major);
+      const glsl_type *published = published_explicit_matrix_types.find(
+         published_hash, [&](const glsl_type *t) {
+            return t->base_type == base_type &&
+                   t->vector_elements == rows &&
+                   t->matrix_columns == columns &&
+                   t->explicit_stride == explicit_stride &&
+                   t->explicit_alignment == explicit_alignment &&
+                   t->interface_row_major == row_major;
+         });
+      if (published)
+         return published;
+
       char name[128];
       snprintf(name, sizeof(name), "%sx%ua%uB%s", bare_type->name,
                explicit_stride, explicit_alignment, row_major ? "RM" : "");
@@ -707,6 +790,7 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns,
 
          entry = _mesa_hash_table_insert(explicit_matrix_types,
                                          t->name, (void *)t);
+         published_explicit_matrix_types.publish(published_hash, t);
       }
 
       assert(((glsl_type *) entry->data)->base_type == base_type);
@@ -1237,6 +1321,16 @@ glsl_type::get_array_instance(const glsl_type *base,
     * shaders.  For example, two shaders may have different record types
     * named 'foo'.
     */
+   const uint32_t published_hash =
+      published_type_hash((uintptr_t) base, array_size, explicit_stride);
+   const glsl_type *published = published_array_types.find(
+      published_hash, [&](const glsl_type *t) {
+         return t->fields.array == base && t->length == array_size &&
+                t->explicit_stride == explicit_stride;
+      });
+   if (published)
+      return published;
+
    char key[128];
    snprintf(key, sizeof(key), "%p[%u]x%uB", (void *) base, array_size,
             explicit_stride);
@@ -1256,6 +1350,7 @@ glsl_type::get_array_instance(const glsl_type *base,
       entry = _mesa_hash_table_insert(array_types,
                                       strdup(key),
                                       (void *) t);
+      published_array_types.publish(published_hash, t);
    }
 
    assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_ARRAY);
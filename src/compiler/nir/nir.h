@@ -3693,6 +3693,11 @@ typedef struct nir_shader_compiler_options {
    unsigned max_unroll_iterations_aggressive;
    unsigned max_unroll_iterations_fp64;
 
+   /* CafeGLSL: favour small programs. Loops are only unrolled if forced or if
+    * the unrolled body stays tiny, and backends flatten fewer branches.
+    */
+   bool optimize_size;
+
    bool lower_uniforms_to_ubo;
 
    /* If the precision is ignored, backends that don't handle
@@ -35,6 +35,8 @@
  * we set it to 26.
  */
 #define LOOP_UNROLL_LIMIT 26
+/* CafeGLSL: cost limit of an unrolled loop with nir_shader_compiler_options::optimize_size */
+#define LOOP_UNROLL_SIZE_LIMIT 32
 
 /* Prepare this loop for unrolling by first converting to lcssa and then
  * converting the phis from the top level of the loop body to regs.
@@ -887,6 +889,10 @@ check_unrolling_restrictions(nir_shader *shader, nir_loop *loop)
    unsigned cost_limit = max_iter * LOOP_UNROLL_LIMIT;
    unsigned cost = li->instr_cost * trip_count;
 
+   /* CafeGLSL: every unrolled iteration is a copy of the body */
+   if (shader->options->optimize_size)
+      cost_limit = MIN2(cost_limit, LOOP_UNROLL_SIZE_LIMIT);
+
    if (cost <= cost_limit && trip_count <= max_iter)
       return true;
 
@@ -48,9 +48,9 @@ static inline unsigned int r600_bytecode_get_num_operands(const struct r600_byte
 	return r600_isa_alu(alu->op)->src_count;
 }
 
-static struct r600_bytecode_cf *r600_bytecode_cf(void)
+static struct r600_bytecode_cf *r600_bytecode_cf(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_cf *cf = CALLOC_STRUCT(r600_bytecode_cf);
+	struct r600_bytecode_cf *cf = slab_zalloc(&bc->cf_pool.child);
 
 	if (!cf)
 		return NULL;
@@ -62,9 +62,9 @@ static struct r600_bytecode_cf *r600_bytecode_cf(void)
 	return cf;
 }
 
-static struct r600_bytecode_alu *r600_bytecode_alu(void)
+static struct r600_bytecode_alu *r600_bytecode_alu(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_alu *alu = CALLOC_STRUCT(r600_bytecode_alu);
+	struct r600_bytecode_alu *alu = slab_zalloc(&bc->alu_pool.child);
 
 	if (!alu)
 		return NULL;
@@ -72,9 +72,9 @@ static struct r600_bytecode_alu *r600_bytecode_alu(void)
 	return alu;
 }
 
-static struct r600_bytecode_vtx *r600_bytecode_vtx(void)
+static struct r600_bytecode_vtx *r600_bytecode_vtx(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_vtx *vtx = CALLOC_STRUCT(r600_bytecode_vtx);
+	struct r600_bytecode_vtx *vtx = slab_zalloc(&bc->vtx_pool.child);
 
 	if (!vtx)
 		return NULL;
@@ -82,9 +82,9 @@ static struct r600_bytecode_vtx *r600_bytecode_vtx(void)
 	return vtx;
 }
 
-static struct r600_bytecode_tex *r600_bytecode_tex(void)
+static struct r600_bytecode_tex *r600_bytecode_tex(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_tex *tex = CALLOC_STRUCT(r600_bytecode_tex);
+	struct r600_bytecode_tex *tex = slab_zalloc(&bc->tex_pool.child);
 
 	if (!tex)
 		return NULL;
@@ -92,9 +92,9 @@ static struct r600_bytecode_tex *r600_bytecode_tex(void)
 	return tex;
 }
 
-static struct r600_bytecode_gds *r600_bytecode_gds(void)
+static struct r600_bytecode_gds *r600_bytecode_gds(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_gds *gds = CALLOC_STRUCT(r600_bytecode_gds);
+	struct r600_bytecode_gds *gds = slab_zalloc(&bc->gds_pool.child);
 
 	if (gds == NULL)
 		return NULL;
@@ -170,11 +170,18 @@ void r600_bytecode_init(struct r600_bytecode *bc,
 	bc->family = family;
 	bc->has_compressed_msaa_texturing = has_compressed_msaa_texturing;
 	bc->stack.entry_size = stack_entry_size(family);
+
+	/* CafeGLSL: nodes are slab allocated, pages are only allocated on first use */
+	slab_create(&bc->cf_pool, sizeof(struct r600_bytecode_cf), 64);
+	slab_create(&bc->alu_pool, sizeof(struct r600_bytecode_alu), 256);
+	slab_create(&bc->vtx_pool, sizeof(struct r600_bytecode_vtx), 32);
+	slab_create(&bc->tex_pool, sizeof(struct r600_bytecode_tex), 32);
+	slab_create(&bc->gds_pool, sizeof(struct r600_bytecode_gds), 8);
 }
 
 int r600_bytecode_add_cf(struct r600_bytecode *bc)
 {
-	struct r600_bytecode_cf *cf = r600_bytecode_cf();
+	struct r600_bytecode_cf *cf = r600_bytecode_cf(bc);
 
 	if (!cf)
 		return -ENOMEM;
@@ -1142,6 +1149,7 @@ static int r600_bytecode_alloc_kcache_lines(struct r600_bytecode *bc,
 
 	if ((r = r600_bytecode_alloc_inst_kcache_lines(bc, kcache, alu))) {
 		/* can't alloc, need to start new clause */
+		bc->nkcache_splits++;
 
 		/* Make sure the CF ends with an "last" instruction when
 		 * we split an ALU group because of a new CF */
@@ -1261,7 +1269,7 @@ int r600_load_ar(struct r600_bytecode *bc, bool for_src)
 int r600_bytecode_add_alu_type(struct r600_bytecode *bc,
 		const struct r600_bytecode_alu *alu, unsigned type)
 {
-	struct r600_bytecode_alu *nalu = r600_bytecode_alu();
+	struct r600_bytecode_alu *nalu = r600_bytecode_alu(bc);
 	struct r600_bytecode_alu *lalu;
 	int i, r;
 
@@ -1295,7 +1303,7 @@ int r600_bytecode_add_alu_type(struct r600_bytecode *bc,
                   bc->cf_last->curr_bs_head->last = 1;
 		r = r600_bytecode_add_cf(bc);
 		if (r) {
-			free(nalu);
+			slab_free_st(&bc->alu_pool, nalu);
 			return r;
 		}
 	}
@@ -1319,7 +1327,7 @@ int r600_bytecode_add_alu_type(struct r600_bytecode *bc,
 	/* Setup the kcache for this ALU instruction. This will start a new
 	 * ALU clause if needed. */
 	if ((r = r600_bytecode_alloc_kcache_lines(bc, nalu, type))) {
-		free(nalu);
+		slab_free_st(&bc->alu_pool, nalu);
 		return r;
 	}
 
@@ -1449,7 +1457,7 @@ static inline boolean last_inst_was_not_vtx_fetch(struct r600_bytecode *bc)
 static int r600_bytecode_add_vtx_internal(struct r600_bytecode *bc, const struct r600_bytecode_vtx *vtx,
 					  bool use_tc)
 {
-	struct r600_bytecode_vtx *nvtx = r600_bytecode_vtx();
+	struct r600_bytecode_vtx *nvtx = r600_bytecode_vtx(bc);
 	int r;
 
 	if (!nvtx)
@@ -1468,7 +1476,7 @@ static int r600_bytecode_add_vtx_internal(struct r600_bytecode *bc, const struct
 	    bc->force_add_cf) {
 		r = r600_bytecode_add_cf(bc);
 		if (r) {
-			free(nvtx);
+			slab_free_st(&bc->vtx_pool, nvtx);
 			return r;
 		}
 		switch (bc->gfx_level) {
@@ -1487,7 +1495,7 @@ static int r600_bytecode_add_vtx_internal(struct r600_bytecode *bc, const struct
 			break;
 		default:
 			R600_ERR("Unknown gfx level %d.\n", bc->gfx_level);
-			free(nvtx);
+			slab_free_st(&bc->vtx_pool, nvtx);
 			return -EINVAL;
 		}
 	}
@@ -1516,7 +1524,7 @@ int r600_bytecode_add_vtx_tc(struct r600_bytecode *bc, const struct r600_bytecod
 
 int r600_bytecode_add_tex(struct r600_bytecode *bc, const struct r600_bytecode_tex *tex)
 {
-	struct r600_bytecode_tex *ntex = r600_bytecode_tex();
+	struct r600_bytecode_tex *ntex = r600_bytecode_tex(bc);
 	int r;
 
 	if (!ntex)
@@ -1558,7 +1566,7 @@ int r600_bytecode_add_tex(struct r600_bytecode *bc, const struct r600_bytecode_t
 	        bc->force_add_cf) {
 		r = r600_bytecode_add_cf(bc);
 		if (r) {
-			free(ntex);
+			slab_free_st(&bc->tex_pool, ntex);
 			return r;
 		}
 		bc->cf_last->op = CF_OP_TEX;
@@ -1580,7 +1588,7 @@ int r600_bytecode_add_tex(struct r600_bytecode *bc, const struct r600_bytecode_t
 
 int r600_bytecode_add_gds(struct r600_bytecode *bc, const struct r600_bytecode_gds *gds)
 {
-	struct r600_bytecode_gds *ngds = r600_bytecode_gds();
+	struct r600_bytecode_gds *ngds = r600_bytecode_gds(bc);
 	int r;
 
 	if (ngds == NULL)
@@ -1597,7 +1605,7 @@ int r600_bytecode_add_gds(struct r600_bytecode *bc, const struct r600_bytecode_g
 	    bc->force_add_cf) {
 		r = r600_bytecode_add_cf(bc);
 		if (r) {
-			free(ngds);
+			slab_free_st(&bc->gds_pool, ngds);
 			return r;
 		}
 		bc->cf_last->op = CF_OP_GDS;
@@ -1855,8 +1863,10 @@ int r600_bytecode_build(struct r600_bytecode *bc)
 		}
 		cf->addr = addr;
 		addr += cf->ndw;
-		bc->ndw = cf->addr + cf->ndw;
 	}
+	/* CafeGLSL: the last clause ends the program, so addr is the exact size. Keep the buffer zeroed since
+	 * the fetch clause alignment and the padding dword of GDS instructions are never written */
+	bc->ndw = addr;
 	free(bc->bytecode);
 	bc->bytecode = calloc(4, bc->ndw);
 	if (bc->bytecode == NULL)
@@ -1947,40 +1957,88 @@ void r600_bytecode_clear(struct r600_bytecode *bc)
 	free(bc->bytecode);
 	bc->bytecode = NULL;
 
+	if (!bc->cf_pool.child.parent)
+		return;
+
+	/* CafeGLSL: returning a node to its pool is a list push, the pages are released by
+	 * slab_destroy once all of their elements are free again */
 	LIST_FOR_EACH_ENTRY_SAFE(cf, next_cf, &bc->cf, list) {
 		struct r600_bytecode_alu *alu = NULL, *next_alu;
 		struct r600_bytecode_tex *tex = NULL, *next_tex;
-		struct r600_bytecode_tex *vtx = NULL, *next_vtx;
+		struct r600_bytecode_vtx *vtx = NULL, *next_vtx;
 		struct r600_bytecode_gds *gds = NULL, *next_gds;
 
 		LIST_FOR_EACH_ENTRY_SAFE(alu, next_alu, &cf->alu, list) {
-			free(alu);
+			slab_free_st(&bc->alu_pool, alu);
 		}
 
-		list_inithead(&cf->alu);
-
 		LIST_FOR_EACH_ENTRY_SAFE(tex, next_tex, &cf->tex, list) {
-			free(tex);
+			slab_free_st(&bc->tex_pool, tex);
 		}
 
-		list_inithead(&cf->tex);
-
 		LIST_FOR_EACH_ENTRY_SAFE(vtx, next_vtx, &cf->vtx, list) {
-			free(vtx);
+			slab_free_st(&bc->vtx_pool, vtx);
 		}
 
-		list_inithead(&cf->vtx);
-
 		LIST_FOR_EACH_ENTRY_SAFE(gds, next_gds, &cf->gds, list) {
-			free(gds);
+			slab_free_st(&bc->gds_pool, gds);
 		}
 
-		list_inithead(&cf->gds);
-
-		free(cf);
+		slab_free_st(&bc->cf_pool, cf);
 	}
 
-	list_inithead(&cf->list);
+	slab_destroy(&bc->cf_pool);
+	slab_destroy(&bc->alu_pool);
+	slab_destroy(&bc->vtx_pool);
+	slab_destroy(&bc->tex_pool);
+	slab_destroy(&bc->gds_pool);
+
+	list_inithead(&bc->cf);
+	bc->cf_last = NULL;
+}
+
+/* CafeGLSL: counts the program as built from the cf list. After sb replaced the
+ * bytecode the list is stale and bc->sb_opt_stats describes the final program */
+void r600_bytecode_collect_stats(struct r600_bytecode *bc, struct r600_bytecode_stats *stats)
+{
+	struct r600_bytecode_cf *cf = NULL;
+	struct r600_bytecode_alu *alu = NULL;
+	struct r600_bytecode_vtx *vtx = NULL;
+	struct r600_bytecode_tex *tex = NULL;
+	uint32_t literal[4];
+	unsigned nliteral;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->ndw = bc->ndw;
+	stats->ngpr = bc->ngpr;
+	stats->nstack = bc->nstack;
+	stats->nkcache_splits = bc->nkcache_splits;
+
+	LIST_FOR_EACH_ENTRY(cf, &bc->cf, list) {
+		const struct cf_op_info *cfop = r600_isa_cf(cf->op);
+
+		if (cfop->flags & CF_ALU) {
+			stats->nalu_clauses++;
+			nliteral = 0;
+			LIST_FOR_EACH_ENTRY(alu, &cf->alu, list) {
+				stats->nalu++;
+				r600_bytecode_alu_nliterals(alu, literal, &nliteral);
+				if (alu->last) {
+					stats->nalu_groups++;
+					stats->nliterals += nliteral;
+					nliteral = 0;
+				}
+			}
+		} else if (cfop->flags & CF_FETCH) {
+			stats->nfetch_clauses++;
+			LIST_FOR_EACH_ENTRY(vtx, &cf->vtx, list)
+				stats->nvtx++;
+			LIST_FOR_EACH_ENTRY(tex, &cf->tex, list)
+				stats->ntex++;
+		} else {
+			stats->ncf++;
+		}
+	}
 }
 
 static int print_swizzle(unsigned swz)
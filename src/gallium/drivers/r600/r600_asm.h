@@ -26,6 +26,7 @@
 #include "r600_pipe.h"
 #include "r600_isa.h"
 #include "tgsi/tgsi_exec.h"
+#include "util/slab.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -253,6 +254,22 @@ struct r600_stack_info {
 	int entry_size;
 };
 
+/* CafeGLSL: codegen metrics of a program, layout matches the sb shader_stats counters */
+struct r600_bytecode_stats {
+	unsigned			ndw;
+	unsigned			ngpr;
+	unsigned			nstack;
+	unsigned			ncf; /* clause instructions not included */
+	unsigned			nalu_clauses;
+	unsigned			nfetch_clauses;
+	unsigned			nalu;
+	unsigned			nalu_groups;
+	unsigned			nliterals;
+	unsigned			ntex;
+	unsigned			nvtx;
+	unsigned			nkcache_splits; /* ALU clauses ended because no kcache set was left */
+};
+
 struct r600_bytecode {
 	enum amd_gfx_level			gfx_level;
 	enum radeon_family		family;
@@ -286,6 +303,20 @@ struct r600_bytecode {
 	int n_pending_outputs;
 	boolean			need_wait_ack; /* emit a pending WAIT_ACK prior to control flow */
 	boolean			precise;
+	/* CafeGLSL: set by r600_sb_bytecode_process when the optimized program replaced the bytecode */
+	boolean			sb_optimized;
+	struct r600_bytecode_stats	sb_src_stats;
+	struct r600_bytecode_stats	sb_opt_stats;
+	/* CafeGLSL: ALU clause splits caused by kcache pressure in the scheduler and here */
+	unsigned			nkcache_splits;
+	/* CafeGLSL: values the scheduler recomputed next to their readers */
+	unsigned			nrematerialized;
+	/* CafeGLSL: per bytecode node pools, see r600_bytecode_clear */
+	struct slab_mempool		cf_pool;
+	struct slab_mempool		alu_pool;
+	struct slab_mempool		vtx_pool;
+	struct slab_mempool		tex_pool;
+	struct slab_mempool		gds_pool;
 };
 
 /* eg_asm.c */
@@ -327,6 +358,7 @@ int r600_bytecode_add_alu_type(struct r600_bytecode *bc,
 		const struct r600_bytecode_alu *alu, unsigned type);
 void r600_bytecode_special_constants(uint32_t value, unsigned *sel);
 void r600_bytecode_disasm(struct r600_bytecode *bc);
+void r600_bytecode_collect_stats(struct r600_bytecode *bc, struct r600_bytecode_stats *stats);
 void r600_bytecode_alu_read(struct r600_bytecode *bc,
 		struct r600_bytecode_alu *alu, uint32_t word0, uint32_t word1);
 int r600_load_ar(struct r600_bytecode *bc, bool for_src);
@@ -496,6 +496,15 @@ struct r600_scratch_buffer {
 	unsigned				item_size;
 };
 
+/* CafeGLSL: a 32bit uniform word with a value that is known at compile time.
+ * Loads of specialized words are replaced with constants before the NIR is optimized */
+struct r600_uniform_specialization {
+	unsigned			buffer_index; /* constant buffer index as used by load_ubo */
+	unsigned			offset; /* in bytes */
+	uint32_t			value;
+	bool				still_loaded; /* set if at least one load could not be replaced */
+};
+
 struct r600_context {
 	struct r600_common_context	b;
 	struct r600_screen		*screen;
@@ -625,6 +634,26 @@ struct r600_context {
 	bool cmd_buf_is_compute;
 	struct pipe_resource *append_fence;
 	uint32_t append_fence_id;
+
+	/* CafeGLSL: queried right before a shader is translated, the list stays owned by the caller */
+	void (*get_uniform_specializations)(void *data, struct r600_uniform_specialization **list, unsigned *count);
+	void *uniform_specialization_data;
+	/* CafeGLSL: R600_SCHED_* flags passed to the sfn scheduler */
+	unsigned sched_flags;
+	/* CafeGLSL: if non-zero, indirectly indexed temp arrays are kept in GPRs
+	 * as long as all of them fit into this many registers, instead of moving
+	 * every array with more than 40 elements to scratch memory */
+	unsigned max_array_gprs;
+	/* CafeGLSL: every selector is translated once and its NIR freed right
+	 * after, so r600_shader_from_nir lowers the NIR in place instead of a
+	 * clone */
+	bool nir_in_place;
+	/* CafeGLSL: render target setup of the precompiled pixel shaders. A
+	 * non-zero ps_nr_cbufs replaces the count derived from the shader
+	 * outputs */
+	unsigned ps_nr_cbufs;
+	bool ps_dual_source_blend;
+	bool ps_alpha_to_one;
 };
 
 static inline void r600_emit_command_buffer(struct radeon_cmdbuf *cs,
@@ -1074,6 +1103,19 @@ struct r600_pipe_shader_selector *r600_create_shader_state_tokens(struct pipe_co
 int r600_shader_select(struct pipe_context *ctx,
 		       struct r600_pipe_shader_selector* sel,
 		       bool *dirty, bool precompile);
+/* CafeGLSL: build a shader without the CSO hooks and r600_shader_select.
+ * The selector takes ownership of the NIR in state, the variant is compiled
+ * with the given key and becomes sel->current.
+ */
+struct r600_pipe_shader_selector *r600_create_shader_selector(struct pipe_context *ctx,
+							       const struct pipe_shader_state *state,
+							       unsigned pipe_shader_type);
+void r600_shader_precompile_key(const struct pipe_context *ctx,
+				const struct r600_pipe_shader_selector *sel,
+				union r600_shader_key *key);
+int r600_create_shader_variant(struct pipe_context *ctx,
+			       struct r600_pipe_shader_selector *sel,
+			       const union r600_shader_key *key);
 
 void r600_delete_shader_selector(struct pipe_context *ctx,
 				 struct r600_pipe_shader_selector *sel);
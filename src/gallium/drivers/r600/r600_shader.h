@@ -41,6 +41,13 @@ extern "C" {
  * With both:        LS | HS  | ES  | GS | VS | PS
  */
 
+/* CafeGLSL: optional policies of the sfn scheduler, see r600::schedule */
+#define R600_SCHED_PACK_ALU_GROUPS	(1 << 0)
+#define R600_SCHED_GROUP_KCACHE_LINES	(1 << 1)
+#define R600_SCHED_HOIST_FETCHES	(1 << 2)
+#define R600_SCHED_MIN_REGISTERS	(1 << 3)
+#define R600_SCHED_OPTIMIZE_SIZE	(1 << 4) /* read by sb, favours small programs */
+
 struct r600_shader_io {
 	unsigned		name;
 	unsigned		gpr;
@@ -871,7 +871,7 @@ static inline void r600_shader_selector_key(const struct pipe_context *ctx,
 	}
 }
 
-static void
+void
 r600_shader_precompile_key(const struct pipe_context *ctx,
 			   const struct r600_pipe_shader_selector *sel,
 			   union r600_shader_key *key)
@@ -890,7 +890,9 @@ r600_shader_precompile_key(const struct pipe_context *ctx,
 	case PIPE_SHADER_GEOMETRY:
 		break;
 
-	case PIPE_SHADER_FRAGMENT:
+	case PIPE_SHADER_FRAGMENT: {
+		const struct r600_context *rctx = (const struct r600_context *)ctx;
+
 		key->ps.image_size_const_offset = sel->info.file_max[TGSI_FILE_IMAGE];
 
 		/* This is used for gl_FragColor output expansion to the number
@@ -898,7 +900,18 @@ r600_shader_precompile_key(const struct pipe_context *ctx,
 		 * to unused cbufs.
 		 */
 		key->ps.nr_cbufs = sel->info.file_max[TGSI_FILE_OUTPUT] + 1;
+
+		/* CafeGLSL: the caller knows the color buffers that get bound */
+		if (rctx->ps_nr_cbufs)
+			key->ps.nr_cbufs = rctx->ps_nr_cbufs;
+		key->ps.alpha_to_one = rctx->ps_alpha_to_one;
+		/* Dual-source blending only makes sense with nr_cbufs == 1. */
+		if (key->ps.nr_cbufs == 1 && rctx->ps_dual_source_blend) {
+			key->ps.nr_cbufs = 2;
+			key->ps.dual_source_blend = 1;
+		}
 		break;
+	}
 
 	case PIPE_SHADER_TESS_CTRL:
 		/* Prim mode comes from the TES, but we need some valid value. */
@@ -978,6 +991,34 @@ int r600_shader_select(struct pipe_context *ctx,
 	return 0;
 }
 
+/* CafeGLSL: compile a single variant with an explicit key. There is no
+ * variant lookup, the selector is expected to have no variants yet.
+ */
+int r600_create_shader_variant(struct pipe_context *ctx,
+			       struct r600_pipe_shader_selector *sel,
+			       const union r600_shader_key *key)
+{
+	struct r600_pipe_shader *shader;
+	int r;
+
+	assert(!sel->current);
+	shader = CALLOC(1, sizeof(struct r600_pipe_shader));
+	shader->selector = sel;
+
+	r = r600_pipe_shader_create(ctx, shader, *key);
+	if (unlikely(r)) {
+		R600_ERR("Failed to build shader variant (type=%u) %d\n",
+			 sel->type, r);
+		FREE(shader);
+		return r;
+	}
+
+	memcpy(&shader->key, key, sizeof(*key));
+	sel->num_shaders = 1;
+	sel->current = shader;
+	return 0;
+}
+
 struct r600_pipe_shader_selector *r600_create_shader_state_tokens(struct pipe_context *ctx,
 								  const void *prog, enum pipe_shader_ir ir,
 								  unsigned pipe_shader_type)
@@ -1005,9 +1046,9 @@ struct r600_pipe_shader_selector *r600_create_shader_state_tokens(struct pipe_co
 	return sel;
 }
 
-static void *r600_create_shader_state(struct pipe_context *ctx,
-			       const struct pipe_shader_state *state,
-			       unsigned pipe_shader_type)
+struct r600_pipe_shader_selector *r600_create_shader_selector(struct pipe_context *ctx,
+							       const struct pipe_shader_state *state,
+							       unsigned pipe_shader_type)
 {
 	int i;
 	struct r600_pipe_shader_selector *sel;
@@ -1056,6 +1097,16 @@ static void *r600_create_shader_state(struct pipe_context *ctx,
 		break;
 	}
 
+	return sel;
+}
+
+static void *r600_create_shader_state(struct pipe_context *ctx,
+			       const struct pipe_shader_state *state,
+			       unsigned pipe_shader_type)
+{
+	struct r600_pipe_shader_selector *sel =
+		r600_create_shader_selector(ctx, state, pipe_shader_type);
+
 	/* Precompile the shader with the expected shader key, to reduce jank at
 	 * draw time. Also produces output for shader-db.
 	 */
@@ -642,11 +642,15 @@ struct shader_stats {
 	unsigned	fetch_clauses;
 	unsigned	fetch;
 	unsigned	alu_groups;
+	unsigned	literals;
+	unsigned	tex;
+	unsigned	vtx;
 
 	unsigned	shaders;		// number of shaders (for accumulated stats)
 
 	shader_stats() : ndw(), ngpr(), nstack(), cf(), alu(), alu_clauses(),
-			fetch_clauses(), fetch(), alu_groups(), shaders() {}
+			fetch_clauses(), fetch(), alu_groups(), literals(), tex(), vtx(),
+			shaders() {}
 
 	void collect(node *n);
 	void accumulate(shader_stats &s);
@@ -961,6 +965,10 @@ public:
 		bc.resize(size);
 	}
 
+	void reserve(unsigned sz) {
+		bc.reserve(sz);
+	}
+
 	void set_size(unsigned sz) {
 		assert(sz >= bc.size());
 		bc.resize(sz);
@@ -37,8 +37,7 @@ int bc_builder::build() {
 
 	container_node *root = sh.root;
 	int cf_cnt = 0;
-
-	// FIXME reserve total size to avoid reallocs
+	unsigned clause_ndw = 0;
 
 	for (node_iterator it = root->begin(), end = root->end();
 			it != end; ++it) {
@@ -53,9 +52,18 @@ int bc_builder::build() {
 		if (flags & CF_ALU) {
 			if (cf->bc.is_alu_extended())
 				cf_cnt++;
+			for (node_iterator I = cf->begin(), E = cf->end(); I != E; ++I) {
+				alu_group_node *g = static_cast<alu_group_node*>(*I);
+				clause_ndw += (g->count() << 1) + ((g->literals.size() + 1) & ~1u);
+			}
+		} else if (flags & CF_FETCH) {
+			// worst case alignment of the clause start
+			clause_ndw += 3 + (cf->count() << 2);
 		}
 	}
 
+	// reserve the whole program up front to avoid reallocs
+	bb.reserve((cf_cnt << 1) + clause_ndw);
 	bb.set_size(cf_cnt << 1);
 	bb.seek(cf_cnt << 1);
 
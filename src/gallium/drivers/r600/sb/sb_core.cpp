@@ -87,6 +87,20 @@ void r600_sb_context_destroy(void * sctx) {
 	}
 }
 
+static void export_stats(const shader_stats &s, r600_bytecode_stats *out) {
+	out->ndw = s.ndw;
+	out->ngpr = s.ngpr;
+	out->nstack = s.nstack;
+	out->ncf = s.cf;
+	out->nalu_clauses = s.alu_clauses;
+	out->nfetch_clauses = s.fetch_clauses;
+	out->nalu = s.alu;
+	out->nalu_groups = s.alu_groups;
+	out->nliterals = s.literals;
+	out->ntex = s.tex;
+	out->nvtx = s.vtx;
+}
+
 int r600_sb_bytecode_process(struct r600_context *rctx,
                              struct r600_bytecode *bc,
                              struct r600_shader *pshader,
@@ -115,6 +129,7 @@ int r600_sb_bytecode_process(struct r600_context *rctx,
 	}
 
 	shader *sh = parser.get_shader();
+	sh->optimize_size = (rctx->sched_flags & R600_SCHED_OPTIMIZE_SIZE) != 0;
 
 	if (dump_bytecode) {
 		bc_dump(*sh, bc->bytecode, bc->ndw).run();
@@ -209,6 +224,12 @@ int r600_sb_bytecode_process(struct r600_context *rctx,
 	sh->dce_flags = DF_REMOVE_DEAD | DF_REMOVE_UNUSED;
 	SB_RUN_PASS(dce_cleanup,		1);
 
+	// CafeGLSL: after gvn, which would fold the literals back into the uses
+	if (sh->optimize_size) {
+		SB_RUN_PASS(literal_sharing,	1);
+		SB_RUN_PASS(def_use,			0);
+	}
+
 	SB_RUN_PASS(ra_split,			0);
 	SB_RUN_PASS(def_use,			0);
 
@@ -262,6 +283,14 @@ int r600_sb_bytecode_process(struct r600_context *rctx,
 
 		bc->ngpr = sh->ngpr;
 		bc->nstack = sh->nstack;
+
+		sh->opt_stats.ndw = bc->ndw;
+		sh->collect_stats(true);
+		export_stats(sh->src_stats, &bc->sb_src_stats);
+		export_stats(sh->opt_stats, &bc->sb_opt_stats);
+		bc->sb_src_stats.nkcache_splits = bc->nkcache_splits;
+		bc->sb_opt_stats.nkcache_splits = sh->kcache_splits;
+		bc->sb_optimized = true;
 	} else {
 		SB_DUMP_STAT( sblog << "sb: dry run: optimized bytecode is not used\n"; );
 	}
@@ -272,8 +301,10 @@ int r600_sb_bytecode_process(struct r600_context *rctx,
 		sblog << "sb: processing shader " << shader_id << " done ( "
 				<< ((double)t)/1000000.0 << " ms ).\n";
 
-		sh->opt_stats.ndw = bc->ndw;
-		sh->collect_stats(true);
+		if (sb_context::dry_run) {
+			sh->opt_stats.ndw = nbc.ndw();
+			sh->collect_stats(true);
+		}
 
 		sblog << "src stats: ";
 		sh->src_stats.dump();
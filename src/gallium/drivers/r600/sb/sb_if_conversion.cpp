@@ -172,6 +172,12 @@ bool if_conversion::check_and_convert(region_node *r) {
 	if (real_alu_count > 400)
 		return false;
 
+	// CafeGLSL: for size the removed CF instructions are weighed against the
+	// select added per phi. Large bodies gain nothing from predication besides
+	// the CF instructions but keep the values of both sides alive
+	if (sh.optimize_size && (real_alu_count > 64 || (r->phi && r->phi->count() > 4)))
+		return false;
+
 	IFC_DUMP( sblog << "if_cvt: processing...\n"; );
 
 	value *select = get_select_value_for_em(sh, em);
@@ -28,6 +28,7 @@
 #define SB_PASS_H_
 
 #include <stack>
+#include <map>
 
 namespace r600_sb {
 
@@ -410,6 +411,23 @@ struct bool_op_info {
 	alu_node *n;
 };
 
+// CafeGLSL: with optimize_size, literals used by many ALU instructions are
+// loaded into a register once instead of being encoded in every ALU group
+class literal_sharing : public pass {
+
+	typedef std::vector<std::pair<alu_node*, unsigned> > literal_uses;
+
+	std::map<unsigned, literal_uses> uses;
+
+public:
+
+	literal_sharing(shader &sh) : pass(sh), uses() {}
+
+	virtual int run();
+
+	void collect_uses(container_node *c);
+};
+
 class peephole : public pass {
 
 public:
@@ -32,6 +32,9 @@
 #define PPH_DUMP(q)
 #endif
 
+#include <algorithm>
+#include <functional>
+
 #include "sb_shader.h"
 #include "sb_pass.h"
 
@@ -365,4 +368,71 @@ bool peephole::get_bool_op_info(value* b, bool_op_info& bop) {
 	return false;
 }
 
+// CafeGLSL: every ALU group encodes its literals after the instructions,
+// padded to a multiple of 2 dwords. A literal which is used by many groups is
+// smaller as a MOV (2 dwords + 2 literal dwords) and a register read in every
+// use. gcm places the MOV in front of the first use outside of loops
+static const unsigned literal_sharing_min_uses = 4;
+// every shared literal occupies a register while it is live
+static const unsigned literal_sharing_max_values = 8;
+
+int literal_sharing::run() {
+
+	collect_uses(sh.root);
+
+	std::vector<std::pair<unsigned, unsigned> > candidates;
+	for (std::map<unsigned, literal_uses>::iterator I = uses.begin(),
+			E = uses.end(); I != E; ++I) {
+		if (I->second.size() >= literal_sharing_min_uses)
+			candidates.push_back(std::make_pair(I->second.size(), I->first));
+	}
+
+	// most used first, ties by value to keep the output deterministic
+	std::sort(candidates.begin(), candidates.end(),
+			std::greater<std::pair<unsigned, unsigned> >());
+	if (candidates.size() > literal_sharing_max_values)
+		candidates.resize(literal_sharing_max_values);
+
+	for (unsigned i = 0; i < candidates.size(); ++i) {
+		literal_uses &lu = uses[candidates[i].second];
+		value *l = lu.front().first->src[lu.front().second];
+		value *t = sh.create_temp_value();
+
+		sh.root->push_front(sh.create_mov(t, l));
+
+		for (literal_uses::iterator I = lu.begin(), E = lu.end(); I != E; ++I)
+			I->first->src[I->second] = t;
+	}
+	return 0;
+}
+
+void literal_sharing::collect_uses(container_node *c) {
+
+	for (node_iterator I = c->begin(), E = c->end(); I != E; ++I) {
+		node *n = *I;
+
+		// the slots of packed instructions are scheduled together, leave them
+		if (n->is_alu_packed())
+			continue;
+
+		if (n->is_container()) {
+			collect_uses(static_cast<container_node*>(n));
+			continue;
+		}
+
+		if (!n->is_alu_inst())
+			continue;
+
+		alu_node *a = static_cast<alu_node*>(n);
+		if (a->bc.op_ptr->flags & (AF_MOVA | AF_LDS))
+			continue;
+
+		for (unsigned s = 0; s < a->src.size(); ++s) {
+			value *v = a->src[s];
+			if (v && v->kind == VLK_CONST && v->is_literal())
+				uses[v->literal_value.u].push_back(std::make_pair(a, s));
+		}
+	}
+}
+
 } // namespace r600_sb
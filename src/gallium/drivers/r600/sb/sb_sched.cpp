@@ -2052,8 +2052,10 @@ bool alu_clause_tracker::check_clause_limits() {
 	if (slot_count + slots > MAX_ALU_SLOTS - reserve_slots)
 		return false;
 
-	if (!kt.try_reserve(gt))
+	if (!kt.try_reserve(gt)) {
+		++sh.kcache_splits;
 		return false;
+	}
 
 	return true;
 }
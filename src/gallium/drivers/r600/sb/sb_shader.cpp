@@ -35,12 +35,12 @@ shader::shader(sb_context &sctx, shader_target t, unsigned id)
   prep_regs_count(), pred_sels(),
   regions(), inputs(), undef(), val_pool(sizeof(value)),
   pool(), all_nodes(), src_stats(), opt_stats(), errors(),
-  optimized(), id(id),
+  optimized(), kcache_splits(), id(id),
   coal(*this), bbs(),
   target(t), ex(*this), vt(ex), root(),
   compute_interferences(),
   has_alu_predication(),
-  uses_gradients(), safe_math(), ngpr(), nstack(), dce_flags() {}
+  uses_gradients(), safe_math(), optimize_size(), ngpr(), nstack(), dce_flags() {}
 
 bool shader::assign_slot(alu_node* n, alu_node *slots[5]) {
 
@@ -492,9 +492,6 @@ alu_node* shader::clone(alu_node* n) {
 }
 
 void shader::collect_stats(bool opt) {
-	if (!sb_context::dump_stat)
-		return;
-
 	shader_stats &s = opt ? opt_stats : src_stats;
 
 	s.shaders = 1;
@@ -502,6 +499,11 @@ void shader::collect_stats(bool opt) {
 	s.nstack = nstack;
 	s.collect(root);
 
+	// CafeGLSL: the per shader stats are always kept for the compiler, only the
+	// accumulated ones depend on dump_stat
+	if (!sb_context::dump_stat)
+		return;
+
 	if (opt)
 		ctx.opt_stats.accumulate(s);
 	else
@@ -613,13 +615,20 @@ sched_queue_id shader::get_queue_id(node* n) {
 void shader_stats::collect(node *n) {
 	if (n->is_alu_inst())
 		++alu;
-	else if (n->is_fetch_inst())
+	else if (n->is_fetch_inst()) {
+		unsigned flags = static_cast<fetch_node*>(n)->bc.op_ptr->flags;
 		++fetch;
-	else if (n->is_container()) {
+		if (flags & FF_VTX)
+			++vtx;
+		else if (!(flags & (FF_GDS | FF_MEM)))
+			++tex;
+	} else if (n->is_container()) {
 		container_node *c = static_cast<container_node*>(n);
 
-		if (n->is_alu_group())
+		if (n->is_alu_group()) {
 			++alu_groups;
+			literals += static_cast<alu_group_node*>(n)->literals.size();
+		}
 		else if (n->is_alu_clause())
 			++alu_clauses;
 		else if (n->is_fetch_clause())
@@ -647,6 +656,9 @@ void shader_stats::accumulate(shader_stats& s) {
 	fetch += s.fetch;
 	fetch_clauses += s.fetch_clauses;
 	cf += s.cf;
+	literals += s.literals;
+	tex += s.tex;
+	vtx += s.vtx;
 }
 
 void shader_stats::dump() {
@@ -654,7 +666,7 @@ void shader_stats::dump() {
 			<< ", alu groups:" << alu_groups << ", alu clauses: " << alu_clauses
 			<< ", alu:" << alu << ", fetch:" << fetch
 			<< ", fetch clauses:" << fetch_clauses
-			<< ", cf:" << cf;
+			<< ", cf:" << cf << ", lit:" << literals;
 
 	if (shaders > 1)
 		sblog << ", shaders:" << shaders;
@@ -283,6 +283,9 @@ public:
 
 	bool optimized;
 
+	// CafeGLSL: clauses the post scheduler ended because of kcache pressure
+	unsigned kcache_splits;
+
 	unsigned id;
 
 	coalescer coal;
@@ -306,6 +309,9 @@ public:
 
 	bool safe_math;
 
+	// CafeGLSL: R600_SCHED_OPTIMIZE_SIZE, passes prefer smaller programs
+	bool optimize_size;
+
 	unsigned ngpr, nstack;
 
 	unsigned dce_flags;
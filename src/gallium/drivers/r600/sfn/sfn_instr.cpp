@@ -381,6 +381,26 @@ Block::try_reserve_kcache(const AluInstr& instr)
    return true;
 }
 
+int
+Block::kcache_reservation_cost(const AluInstr& instr) const
+{
+   auto kcache = m_kcache;
+
+   for (auto& src : instr.sources()) {
+      auto u = src->as_uniform();
+      if (u && !try_reserve_kcache(*u, kcache))
+         return -1;
+   }
+
+   int cost = 0;
+   for (unsigned i = 0; i < kcache.size(); ++i) {
+      if (kcache[i].mode != m_kcache[i].mode || kcache[i].bank != m_kcache[i].bank ||
+          kcache[i].addr != m_kcache[i].addr)
+         ++cost;
+   }
+   return cost;
+}
+
 void
 Block::set_chipclass(r600_chip_class chip_class)
 {
@@ -220,6 +220,10 @@ public:
 
    bool kcache_reservation_failed() const { return m_kcache_alloc_failed; }
 
+   /* CafeGLSL: number of kcache sets that would be added or extended to
+    * reserve the uniforms of instr, -1 if they don't fit */
+   int kcache_reservation_cost(const AluInstr& instr) const;
+
    int inc_rat_emitted() { return ++m_emitted_rat_instr; }
 
    static void set_chipclass(r600_chip_class chip_class);
@@ -44,6 +44,7 @@
 #include "sfn_shader.h"
 #include "util/u_prim.h"
 
+#include <map>
 #include <vector>
 
 namespace r600 {
@@ -344,6 +345,94 @@ private:
    }
 };
 
+/* CafeGLSL: Replace loads of uniform words with a known value by constants.
+ * Components that are not specialized are still taken from the original load.
+ * Words that are accessed with a dynamic offset can't be replaced and are
+ * flagged as still_loaded so that the caller keeps them in the uniform table */
+class SpecializeUniformLoads : public NirLowerInstruction {
+public:
+   SpecializeUniformLoads(r600_uniform_specialization *list, unsigned count):
+      m_list(list),
+      m_count(count)
+   {
+   }
+
+private:
+   bool filter(const nir_instr *instr) const override
+   {
+      if (instr->type != nir_instr_type_intrinsic)
+         return false;
+
+      auto intr = nir_instr_as_intrinsic(instr);
+      if (intr->intrinsic != nir_intrinsic_load_ubo)
+         return false;
+
+      auto bufid = nir_src_as_const_value(intr->src[0]);
+      return bufid && has_buffer(bufid->u32);
+   }
+
+   nir_ssa_def *lower(nir_instr *instr) override
+   {
+      auto intr = nir_instr_as_intrinsic(instr);
+      unsigned buffer_index = nir_src_as_uint(intr->src[0]);
+      auto offset = nir_src_as_const_value(intr->src[1]);
+
+      if (!offset || intr->dest.ssa.bit_size != 32) {
+         mark_range_loaded(buffer_index,
+                           nir_intrinsic_range_base(intr),
+                           nir_intrinsic_range(intr));
+         return nullptr;
+      }
+
+      nir_ssa_def *comps[NIR_MAX_VEC_COMPONENTS];
+      bool progress = false;
+      for (unsigned i = 0; i < intr->dest.ssa.num_components; ++i) {
+         auto spec = find(buffer_index, offset->u32 + 4 * i);
+         if (spec) {
+            comps[i] = nir_imm_int(b, spec->value);
+            progress = true;
+         } else {
+            comps[i] = nir_channel(b, &intr->dest.ssa, i);
+         }
+      }
+      if (!progress)
+         return nullptr;
+      return nir_vec(b, comps, intr->dest.ssa.num_components);
+   }
+
+   bool has_buffer(unsigned buffer_index) const
+   {
+      for (unsigned i = 0; i < m_count; ++i) {
+         if (m_list[i].buffer_index == buffer_index)
+            return true;
+      }
+      return false;
+   }
+
+   r600_uniform_specialization *find(unsigned buffer_index, unsigned offset) const
+   {
+      for (unsigned i = 0; i < m_count; ++i) {
+         if (m_list[i].buffer_index == buffer_index && m_list[i].offset == offset)
+            return &m_list[i];
+      }
+      return nullptr;
+   }
+
+   void mark_range_loaded(unsigned buffer_index, unsigned range_base, unsigned range)
+   {
+      for (unsigned i = 0; i < m_count; ++i) {
+         auto& spec = m_list[i];
+         if (spec.buffer_index != buffer_index)
+            continue;
+         if (range == ~0u || (spec.offset >= range_base && spec.offset - range_base < range))
+            spec.still_loaded = true;
+      }
+   }
+
+   r600_uniform_specialization *m_list;
+   unsigned m_count;
+};
+
 } // namespace r600
 
 static nir_intrinsic_op
@@ -493,6 +582,60 @@ r600_get_natural_size_align_bytes(const struct glsl_type *type,
    }
 }
 
+/* CafeGLSL: nir_lower_vars_to_scratch moves every indirectly indexed temp
+ * array that is larger than a size threshold (in the units of
+ * r600_get_natural_size_align_bytes) to scratch memory, the others are
+ * kept in GPRs and accessed relative to AR. Pick the largest threshold
+ * for which the arrays that stay in GPRs need at most max_gprs registers
+ * in total. */
+static unsigned
+r600_gpr_array_threshold(nir_shader *sh, unsigned max_gprs)
+{
+   std::map<nir_variable *, unsigned> indirect_arrays;
+   nir_foreach_function(function, sh)
+   {
+      if (!function->impl)
+         continue;
+      nir_foreach_block(block, function->impl)
+      {
+         nir_foreach_instr(instr, block)
+         {
+            if (instr->type != nir_instr_type_intrinsic)
+               continue;
+            auto intr = nir_instr_as_intrinsic(instr);
+            if (intr->intrinsic != nir_intrinsic_load_deref &&
+                intr->intrinsic != nir_intrinsic_store_deref)
+               continue;
+            auto deref = nir_src_as_deref(intr->src[0]);
+            if (!nir_deref_mode_is(deref, nir_var_function_temp) ||
+                !nir_deref_instr_has_indirect(deref))
+               continue;
+            auto var = nir_deref_instr_get_variable(deref);
+            if (var)
+               indirect_arrays[var] = glsl_count_vec4_slots(var->type, false, false);
+         }
+      }
+   }
+
+   /* GPRs needed by all indirect arrays of a size */
+   std::map<unsigned, unsigned> gprs_by_size;
+   for (auto& [var, gprs] : indirect_arrays) {
+      unsigned size, align;
+      r600_get_natural_size_align_bytes(var->type, &size, &align);
+      gprs_by_size[size] += gprs;
+   }
+
+   unsigned threshold = 0;
+   unsigned used_gprs = 0;
+   for (auto& [size, gprs] : gprs_by_size) {
+      if (used_gprs + gprs > max_gprs)
+         break;
+      used_gprs += gprs;
+      threshold = size;
+   }
+   return threshold;
+}
+
 static bool
 r600_lower_shared_io_impl(nir_function *func)
 {
@@ -638,6 +781,23 @@ r600_opt_indirect_fbo_loads(nir_shader *shader)
    return r600::OptIndirectUBOLoads().run(shader);
 }
 
+static bool
+r600_specialize_uniforms(nir_shader *shader, struct r600_context *rctx)
+{
+   if (!rctx->get_uniform_specializations)
+      return false;
+
+   r600_uniform_specialization *list = nullptr;
+   unsigned count = 0;
+   rctx->get_uniform_specializations(rctx->uniform_specialization_data, &list, &count);
+   if (!count)
+      return false;
+
+   /* Offsets are often only constant after folding the address calculation */
+   NIR_PASS_V(shader, nir_opt_constant_folding);
+   return r600::SpecializeUniformLoads(list, count).run(shader);
+}
+
 static bool
 optimize_once(nir_shader *shader)
 {
@@ -660,7 +820,10 @@ optimize_once(nir_shader *shader)
    NIR_PASS(progress, shader, nir_opt_if, nir_opt_if_optimize_phi_true_false);
    NIR_PASS(progress, shader, nir_opt_dead_cf);
    NIR_PASS(progress, shader, nir_opt_cse);
-   NIR_PASS(progress, shader, nir_opt_peephole_select, 200, true, true);
+   /* CafeGLSL: a flattened if keeps both sides and adds a select per phi, only
+    * small bodies are smaller without the branch */
+   NIR_PASS(progress, shader, nir_opt_peephole_select,
+            shader->options->optimize_size ? 8 : 200, true, true);
 
    NIR_PASS(progress, shader, nir_opt_conditional_discard);
    NIR_PASS(progress, shader, nir_opt_dce);
@@ -805,9 +968,18 @@ r600_shader_from_nir(struct r600_context *rctx,
       fprintf(stderr, "END PRE-OPT-NIR--------------------------------------\n\n");
    }
 
-   auto sh = nir_shader_clone(sel->nir, sel->nir);
-   r600::sort_uniforms(sel->nir);
+   /* CafeGLSL: a clone is only needed if sel->nir is translated again. The
+    * uniforms of the original were sorted after cloning, which had no effect
+    * on the translated copy, so the in place path leaves them as they are */
+   nir_shader *sh;
+   if (rctx->nir_in_place) {
+      sh = sel->nir;
+   } else {
+      sh = nir_shader_clone(sel->nir, sel->nir);
+      r600::sort_uniforms(sel->nir);
+   }
 
+   NIR_PASS_V(sh, r600_specialize_uniforms, rctx);
 
    while (optimize_once(sh))
       ;
@@ -907,10 +1079,13 @@ r600_shader_from_nir(struct r600_context *rctx,
    NIR_PASS_V(sh, nir_remove_dead_variables, nir_var_shader_in, NULL);
    NIR_PASS_V(sh, nir_remove_dead_variables, nir_var_shader_out, NULL);
 
+   /* CafeGLSL: optionally keep larger arrays in GPRs */
+   unsigned scratch_threshold =
+      rctx->max_array_gprs ? r600_gpr_array_threshold(sh, rctx->max_array_gprs) : 40;
    NIR_PASS_V(sh,
               nir_lower_vars_to_scratch,
               nir_var_function_temp,
-              40,
+              scratch_threshold,
               r600_get_natural_size_align_bytes);
 
    while (optimize_once(sh))
@@ -993,7 +1168,7 @@ r600_shader_from_nir(struct r600_context *rctx,
       }
    }
 
-   auto scheduled_shader = r600::schedule(shader);
+   auto scheduled_shader = r600::schedule(shader, rctx->sched_flags);
    if (r600::sfn_log.has_debug_flag(r600::SfnLog::steps)) {
       std::cerr << "Shader after scheduling\n";
       shader->print(std::cerr);
@@ -1044,6 +1219,8 @@ r600_shader_from_nir(struct r600_context *rctx,
       assert(0);
       return -1;
    }
+   pipeshader->shader.bc.nkcache_splits += scheduled_shader->kcache_clause_splits();
+   pipeshader->shader.bc.nrematerialized = scheduled_shader->rematerialized_values();
 
    if (sh->info.stage == MESA_SHADER_GEOMETRY) {
       r600::sfn_log << r600::SfnLog::shader_info
@@ -1053,7 +1230,9 @@ r600_shader_from_nir(struct r600_context *rctx,
    } else {
       r600::sfn_log << r600::SfnLog::shader_info << "This is not a Geometry shader\n";
    }
-   ralloc_free(sh);
+   /* CafeGLSL: lowered in place, r600_pipe_shader_create frees sel->nir */
+   if (sh != sel->nir)
+      ralloc_free(sh);
 
    return 0;
 }
@@ -36,7 +36,10 @@
 #include "sfn_instr_tex.h"
 
 #include <algorithm>
+#include <functional>
+#include <map>
 #include <sstream>
+#include <unordered_set>
 
 namespace r600 {
 
@@ -137,11 +140,14 @@ public:
 
 class BlockSheduler {
 public:
-   BlockSheduler(r600_chip_class chip_class);
+   BlockSheduler(r600_chip_class chip_class, unsigned sched_flags);
    void run(Shader *shader);
 
    void finalize();
 
+   int kcache_splits() const { return m_kcache_splits; }
+   int rematerialized_values() const { return m_rematerialized_values; }
+
 private:
    void
    schedule_block(Block& in_block, Shader::ShaderBlocks& out_blocks, ValueFactory& vf);
@@ -168,6 +174,14 @@ private:
 
    bool schedule_alu_to_group_vec(AluGroup *group);
    bool schedule_alu_to_group_trans(AluGroup *group, std::list<AluInstr *>& readylist);
+   bool schedule_alu_to_group_lookahead(AluGroup *group);
+   void order_by_kcache_lines(std::list<AluInstr *>& ready);
+   void order_by_live_registers(std::list<AluInstr *>& ready);
+   void rematerialize_values(CollectInstructions& cir, ValueFactory& vf);
+
+   void mark_fetch_feeders(CollectInstructions& cir);
+   bool hoist_fetches();
+   bool fetch_feeder_ready() const;
 
    bool schedule_exports(Shader::ShaderBlocks& out_blocks,
                          std::list<ExportInstr *>& ready_list);
@@ -208,10 +222,18 @@ private:
    int m_lds_addr_count{0};
    int m_alu_groups_schduled{0};
    r600_chip_class m_chip_class;
+   unsigned m_sched_flags;
+   int m_kcache_splits{0};
+   int m_rematerialized_values{0};
+
+   /* ALU instructions the sources of not yet scheduled fetches depend on,
+    * and the scheduled fetches whose results are still used */
+   std::unordered_set<const Instr *> m_fetch_feeders;
+   std::list<const InstrWithVectorResult *> m_live_fetches;
 };
 
 Shader *
-schedule(Shader *original)
+schedule(Shader *original, unsigned sched_flags)
 {
    Block::set_chipclass(original->chip_class());
    AluGroup::set_chipclass(original->chip_class());
@@ -227,9 +249,11 @@ schedule(Shader *original)
    // to be able to re-start scheduling
 
    auto scheduled_shader = original;
-   BlockSheduler s(original->chip_class());
+   BlockSheduler s(original->chip_class(), sched_flags);
    s.run(scheduled_shader);
    s.finalize();
+   scheduled_shader->set_kcache_clause_splits(s.kcache_splits());
+   scheduled_shader->set_rematerialized_values(s.rematerialized_values());
 
    sfn_log << SfnLog::schedule << "Scheduled shader\n";
    if (sfn_log.has_debug_flag(SfnLog::schedule)) {
@@ -241,14 +265,18 @@ schedule(Shader *original)
    return scheduled_shader;
 }
 
-BlockSheduler::BlockSheduler(r600_chip_class chip_class):
+BlockSheduler::BlockSheduler(r600_chip_class chip_class, unsigned sched_flags):
     current_shed(sched_alu),
     m_last_pos(nullptr),
     m_last_pixel(nullptr),
     m_last_param(nullptr),
     m_current_block(nullptr),
-    m_chip_class(chip_class)
+    m_chip_class(chip_class),
+    m_sched_flags(sched_flags)
 {
+   /* CafeGLSL: hoisting fetches extends the live ranges of their results */
+   if (m_sched_flags & R600_SCHED_MIN_REGISTERS)
+      m_sched_flags &= ~R600_SCHED_HOIST_FETCHES;
 }
 
 void
@@ -283,6 +311,12 @@ BlockSheduler::schedule_block(Block& in_block,
    CollectInstructions cir(vf);
    in_block.accept(cir);
 
+   if (m_sched_flags & R600_SCHED_MIN_REGISTERS)
+      rematerialize_values(cir, vf);
+
+   if (m_sched_flags & R600_SCHED_HOIST_FETCHES)
+      mark_fetch_feeders(cir);
+
    bool have_instr = collect_ready(cir);
 
    m_current_block = new Block(in_block.nesting_depth(), in_block.id());
@@ -323,6 +357,13 @@ BlockSheduler::schedule_block(Block& in_block,
             current_shed = sched_rat;
          else if (tex_ready.size() > (m_chip_class >= ISA_CC_EVERGREEN ? 15 : 7))
             current_shed = sched_tex;
+         /* CafeGLSL: all fetch addresses that can be computed now are
+          * done, emit the fetches in one clause before the remaining ALU
+          * work so that their latency is hidden behind it */
+         else if ((m_sched_flags & R600_SCHED_HOIST_FETCHES) &&
+                  (!tex_ready.empty() || !fetches_ready.empty()) &&
+                  !fetch_feeder_ready() && hoist_fetches())
+            current_shed = tex_ready.empty() ? sched_fetch : sched_tex;
       }
 
       switch (current_shed) {
@@ -474,6 +515,7 @@ bool
 BlockSheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
 {
    bool success = false;
+   bool is_new_group = false;
    AluGroup *group = nullptr;
 
    bool has_alu_ready = !alu_vec_ready.empty() || !alu_trans_ready.empty();
@@ -497,6 +539,7 @@ BlockSheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
       if (!m_current_block->try_reserve_kcache(*group)) {
          start_new_block(out_blocks, Block::alu);
          m_current_block->set_instr_flag(Instr::force_cf);
+         ++m_kcache_splits;
       }
 
       if (!m_current_block->try_reserve_kcache(*group))
@@ -506,7 +549,18 @@ BlockSheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
       success = true;
    } else if (has_alu_ready) {
       group = new AluGroup();
+      is_new_group = true;
       sfn_log << SfnLog::schedule << "START new ALU group\n";
+
+      if (m_sched_flags & R600_SCHED_MIN_REGISTERS) {
+         order_by_live_registers(alu_vec_ready);
+         order_by_live_registers(alu_trans_ready);
+      }
+
+      if (m_sched_flags & R600_SCHED_GROUP_KCACHE_LINES) {
+         order_by_kcache_lines(alu_vec_ready);
+         order_by_kcache_lines(alu_trans_ready);
+      }
    } else {
       return false;
    }
@@ -516,6 +570,11 @@ BlockSheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
    int free_slots = group->free_slots();
 
    while (free_slots && has_alu_ready) {
+      /* CafeGLSL: pick the best filling subset of the first ready
+       * instructions, the greedy passes below fill what is left */
+      if ((m_sched_flags & R600_SCHED_PACK_ALU_GROUPS) && is_new_group && !has_lds_ready)
+         success |= schedule_alu_to_group_lookahead(group);
+
       if (!alu_vec_ready.empty())
          success |= schedule_alu_to_group_vec(group);
 
@@ -543,6 +602,7 @@ BlockSheduler::schedule_alu(Shader::ShaderBlocks& out_blocks)
          // kcache reservation failed, so we have to start a new CF
          start_new_block(out_blocks, Block::alu);
          m_current_block->set_instr_flag(Instr::force_cf);
+         ++m_kcache_splits;
       } else {
          return false;
       }
@@ -591,6 +651,8 @@ BlockSheduler::schedule_tex(Shader::ShaderBlocks& out_blocks)
 
       (*ii)->set_scheduled();
       m_current_block->push_back(*ii);
+      if (m_sched_flags & R600_SCHED_HOIST_FETCHES)
+         m_live_fetches.push_back(*ii);
       tex_ready.erase(ii);
       return true;
    }
@@ -604,6 +666,11 @@ BlockSheduler::schedule_vtx(Shader::ShaderBlocks& out_blocks)
       start_new_block(out_blocks, Block::vtx);
       m_current_block->set_instr_flag(Instr::force_cf);
    }
+   if (m_sched_flags & R600_SCHED_HOIST_FETCHES) {
+      auto n = std::min<size_t>(fetches_ready.size(), m_current_block->remaining_slots());
+      auto end = std::next(fetches_ready.begin(), n);
+      m_live_fetches.insert(m_live_fetches.end(), fetches_ready.begin(), end);
+   }
    return schedule_block(fetches_ready);
 }
 
@@ -712,6 +779,556 @@ BlockSheduler::schedule_alu_to_group_trans(AluGroup *group,
    return success;
 }
 
+/* CafeGLSL: fetch hoisting. The ALU instructions that compute the sources
+ * of the fetches in the block get a higher priority, and the fetches are
+ * emitted as soon as no such instruction is ready. This results in few
+ * large fetch clauses that are issued early. Every fetch result that is
+ * still in use holds a register, so the policy is suspended while
+ * hoist_fetch_max_live results are live, and the default order is used. */
+
+static const unsigned hoist_fetch_max_live = 12;
+
+void
+BlockSheduler::mark_fetch_feeders(CollectInstructions& cir)
+{
+   m_fetch_feeders.clear();
+   m_live_fetches.clear();
+
+   std::vector<Instr *> worklist;
+   auto add_parents = [this, &worklist](const Register *reg) {
+      if (!reg)
+         return;
+      for (auto p : reg->parents()) {
+         if (!p->is_scheduled() && m_fetch_feeders.insert(p).second)
+            worklist.push_back(p);
+      }
+   };
+
+   for (auto tex : cir.tex) {
+      for (int i = 0; i < 4; ++i)
+         add_parents(tex->src()[i]);
+   }
+   for (auto fetch : cir.fetches)
+      add_parents(&fetch->src());
+
+   while (!worklist.empty()) {
+      auto alu = worklist.back()->as_alu();
+      worklist.pop_back();
+      if (!alu)
+         continue;
+      for (auto& s : alu->sources())
+         add_parents(s->as_register());
+   }
+}
+
+bool
+BlockSheduler::hoist_fetches()
+{
+   m_live_fetches.remove_if([](const InstrWithVectorResult *fetch) {
+      for (int i = 0; i < 4; ++i) {
+         auto reg = fetch->dst()[i];
+         if (!reg)
+            continue;
+         for (auto u : reg->uses()) {
+            if (!u->is_scheduled())
+               return false;
+         }
+      }
+      return true;
+   });
+   return m_live_fetches.size() < hoist_fetch_max_live;
+}
+
+bool
+BlockSheduler::fetch_feeder_ready() const
+{
+   for (auto alu : alu_vec_ready) {
+      if (m_fetch_feeders.count(alu))
+         return true;
+   }
+   for (auto alu : alu_trans_ready) {
+      if (m_fetch_feeders.count(alu))
+         return true;
+   }
+   for (auto group : alu_groups_ready) {
+      for (auto alu : *group) {
+         if (alu && m_fetch_feeders.count(alu))
+            return true;
+      }
+   }
+   return false;
+}
+
+/* CafeGLSL: kcache aware ordering. Instructions that only read constants
+ * from lines the current clause already locked go first, then those that
+ * need a new line, ordered by how many ready instructions read from that
+ * line, and last the ones that can't be added to this clause at all. This
+ * way a clause uses up its lines before the next lines are locked, and
+ * fewer clauses have to be ended because the kcache sets are exhausted.
+ * The sort is stable so that the priority order is kept otherwise. */
+void
+BlockSheduler::order_by_kcache_lines(std::list<AluInstr *>& ready)
+{
+   auto line_key = [](const UniformValue& u) {
+      return (u.kcache_bank() << 16) | ((u.sel() - 512) >> 4);
+   };
+
+   std::map<int, int> line_readers;
+   for (auto list : {&alu_vec_ready, &alu_trans_ready}) {
+      for (auto alu : *list) {
+         for (auto& src : alu->sources()) {
+            auto u = src->as_uniform();
+            if (u)
+               ++line_readers[line_key(*u)];
+         }
+      }
+   }
+   if (line_readers.empty())
+      return;
+
+   std::map<const AluInstr *, std::pair<int, int>> order;
+   for (auto alu : ready) {
+      int cost = m_current_block->kcache_reservation_cost(*alu);
+      int readers = 0;
+      if (cost > 0) {
+         for (auto& src : alu->sources()) {
+            auto u = src->as_uniform();
+            if (u)
+               readers = std::max(readers, line_readers[line_key(*u)]);
+         }
+      }
+      int rank = cost == 0 ? 0 : (cost > 0 ? 1 : 2);
+      order[alu] = std::make_pair(rank, -readers);
+   }
+
+   ready.sort([&order](const AluInstr *lhs, const AluInstr *rhs) {
+      return order[lhs] < order[rhs];
+   });
+}
+
+/* CafeGLSL: register pressure mode. Among the ready instructions the ones
+ * that end the most live ranges go first, i.e. those that are the last
+ * pending reader of an SSA value, and an instruction that starts a new
+ * live range is only picked when nothing better is ready. The score is
+ * re-evaluated for every group because it changes with each scheduled
+ * instruction. LDS instructions keep their place in front. */
+
+static int
+live_register_delta(const AluInstr& alu)
+{
+   int delta = 0;
+   std::vector<const Register *> seen;
+   for (auto& s : alu.sources()) {
+      auto r = s->as_register();
+      if (!r || !r->has_flag(Register::ssa) ||
+          std::find(seen.begin(), seen.end(), r) != seen.end())
+         continue;
+      seen.push_back(r);
+
+      int pending = 0;
+      for (auto u : r->uses()) {
+         if (!u->is_scheduled())
+            ++pending;
+      }
+      if (pending == 1)
+         ++delta;
+   }
+
+   auto dest = alu.dest();
+   if (dest && alu.has_alu_flag(alu_write) && dest->has_flag(Register::ssa))
+      --delta;
+   return delta;
+}
+
+void
+BlockSheduler::order_by_live_registers(std::list<AluInstr *>& ready)
+{
+   std::map<const AluInstr *, std::pair<int, int>> order;
+   for (auto alu : ready)
+      order[alu] = std::make_pair(alu->has_lds_access() ? 0 : 1,
+                                  -live_register_delta(*alu));
+
+   ready.sort([&order](const AluInstr *lhs, const AluInstr *rhs) {
+      return order[lhs] < order[rhs];
+   });
+}
+
+/* CafeGLSL: rematerialization. A value that is computed by a single cheap
+ * ALU instruction from constants only (literals, inline constants and
+ * direct kcache reads) is re-computed for each of its ALU readers in the
+ * block instead of holding a register from the first to the last read.
+ * The copies inherit the position of the original, so with the ordering
+ * above they are scheduled right before their reader. The first reader
+ * keeps the original unless the value is also read by non-ALU
+ * instructions, and at most remat_max_copies copies are made per value. */
+
+static const unsigned remat_max_copies = 4;
+
+static bool
+is_rematerializable(const AluInstr& alu)
+{
+   static const std::set<EAluOp> cheap_ops = {op1_mov,
+                                              op2_add,
+                                              op2_mul,
+                                              op2_mul_ieee,
+                                              op2_max,
+                                              op2_min,
+                                              op2_add_int,
+                                              op2_sub_int,
+                                              op2_and_int,
+                                              op2_or_int,
+                                              op2_xor_int};
+
+   if (alu.has_alu_flag(alu_is_lds) || alu.alu_slots() != 1 ||
+       !alu.has_alu_flag(alu_write) || !cheap_ops.count(alu.opcode()))
+      return false;
+
+   for (auto f : {alu_src0_rel, alu_src1_rel, alu_src2_rel, alu_dst_rel,
+                  alu_update_exec, alu_update_pred, alu_64bit_op}) {
+      if (alu.has_alu_flag(f))
+         return false;
+   }
+
+   auto dest = alu.dest();
+   if (!dest || !dest->has_flag(Register::ssa) ||
+       (dest->pin() != pin_free && dest->pin() != pin_none))
+      return false;
+
+   for (auto& s : alu.sources()) {
+      if (s->as_register())
+         return false;
+      auto u = s->as_uniform();
+      if (u && u->buf_addr())
+         return false;
+   }
+   return true;
+}
+
+void
+BlockSheduler::rematerialize_values(CollectInstructions& cir, ValueFactory& vf)
+{
+   std::unordered_set<const Instr *> pending(cir.alu_vec.begin(), cir.alu_vec.end());
+   pending.insert(cir.alu_trans.begin(), cir.alu_trans.end());
+
+   for (auto i = cir.alu_vec.begin(); i != cir.alu_vec.end(); ++i) {
+      auto alu = *i;
+      if (!is_rematerializable(*alu))
+         continue;
+
+      std::vector<AluInstr *> readers;
+      bool other_readers = false;
+      for (auto u : alu->dest()->uses()) {
+         auto reader = u->as_alu();
+         if (reader && pending.count(reader) && reader->alu_slots() == 1)
+            readers.push_back(reader);
+         else
+            other_readers = true;
+      }
+
+      std::sort(readers.begin(), readers.end(), [](const AluInstr *lhs, const AluInstr *rhs) {
+         return lhs->index() < rhs->index();
+      });
+      if (!other_readers && !readers.empty())
+         readers.erase(readers.begin());
+      if (readers.size() > remat_max_copies)
+         readers.resize(remat_max_copies);
+
+      std::set<AluModifiers> flags;
+      for (int f = 0; f < alu_flag_count; ++f) {
+         if (f != alu_op3 && alu->has_alu_flag(AluModifiers(f)))
+            flags.insert(AluModifiers(f));
+      }
+
+      for (auto reader : readers) {
+         /* Redirect the reader first, the copy registers itself as a parent
+          * of dest and a user of its sources when it is created, so it must
+          * only be built once it is known to be scheduled. */
+         auto dest = vf.temp_register();
+         if (!reader->replace_source(alu->dest(), dest))
+            continue;
+         auto copy = new AluInstr(alu->opcode(), dest, alu->sources(), flags, 1);
+         copy->set_blockid(alu->block_id(), alu->index());
+         pending.insert(copy);
+         ++m_rematerialized_values;
+
+         sfn_log << SfnLog::schedule << "Rematerialize " << *alu << " for " << *reader
+                 << "\n";
+
+         auto pos = std::find(cir.alu_vec.begin(), cir.alu_vec.end(), reader);
+         cir.alu_vec.insert(pos != cir.alu_vec.end() ? pos : std::next(i), copy);
+      }
+   }
+}
+
+/* CafeGLSL: lookahead group packing. The first ready instructions are
+ * placed into a model of the group that tracks the used channels, the
+ * read ports and literals (AluReadportReservation) and the indirect
+ * address, without touching the instructions. The subset that fills most
+ * slots wins, ties go to fewer literal dwords and then to the higher
+ * priority instructions. kcache lines are only checked on commit. */
+
+static const int lookahead_vec_window = 8;
+static const int lookahead_trans_window = 4;
+
+struct AluGroupModel {
+   AluReadportReservation readports;
+   PRegister addr{nullptr};
+   int used_chans{0};
+   int param_used{-1};
+};
+
+static bool
+model_indirect_access(AluGroupModel& model, const AluInstr& instr)
+{
+   auto [indirect_addr, for_src, is_index] = instr.indirect_addr();
+   if (!indirect_addr)
+      return true;
+   if (!model.addr) {
+      model.addr = indirect_addr;
+      return true;
+   }
+   return indirect_addr->equal_to(*model.addr);
+}
+
+/* Same channel choice as AluGroup::add_vec_instructions */
+static int
+model_vec_chan(const AluInstr& instr, int used_chans)
+{
+   int chan = instr.dest_chan();
+   if (!(used_chans & (1 << chan)))
+      return chan;
+
+   auto dest = instr.dest();
+   if (!dest || (dest->pin() != pin_free && dest->pin() != pin_group))
+      return -1;
+
+   int free_mask = 0xf & ~used_chans;
+   for (auto p : dest->parents()) {
+      auto alu = p->as_alu();
+      if (alu)
+         free_mask &= alu->allowed_dest_chan_mask();
+   }
+   for (auto u : dest->uses())
+      free_mask &= u->allowed_src_chan_mask();
+
+   for (int i = 0; i < 4; ++i) {
+      if (free_mask & (1 << i))
+         return i;
+   }
+   return -1;
+}
+
+static bool
+model_add_vec(AluGroupModel& model, const AluInstr& instr)
+{
+   AluGroupModel m = model;
+   if (!model_indirect_access(m, instr))
+      return false;
+
+   int param_src = -1;
+   for (auto& s : instr.sources()) {
+      auto is = s->as_inline_const();
+      if (is)
+         param_src = is->sel() - ALU_SRC_PARAM_BASE;
+   }
+   if (param_src >= 0) {
+      if (m.param_used < 0)
+         m.param_used = param_src;
+      else if (m.param_used != param_src)
+         return false;
+   }
+
+   int chan = model_vec_chan(instr, m.used_chans);
+   if (chan < 0)
+      return false;
+
+   AluBankSwizzle first = instr.bank_swizzle();
+   AluBankSwizzle last = first;
+   if (first == alu_vec_unknown) {
+      first = alu_vec_012;
+      last = alu_vec_unknown;
+   } else {
+      ++last;
+   }
+
+   for (AluBankSwizzle i = first; i != last; ++i) {
+      auto readports = m.readports;
+      if (readports.schedule_vec_instruction(instr, i)) {
+         m.readports = readports;
+         m.used_chans |= 1 << chan;
+         model = m;
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool
+model_add_trans(AluGroupModel& model, const AluInstr& instr, r600_chip_class chip_class)
+{
+   if (!AluGroup::has_t() || instr.has_alu_flag(alu_is_lds))
+      return false;
+
+   auto opinfo = alu_ops.find(instr.opcode());
+   assert(opinfo != alu_ops.end());
+   if (!opinfo->second.can_channel(AluOp::t, chip_class))
+      return false;
+
+   /* A vector op in the trans slot needs its vector channel to be used,
+    * add_trans_instructions would otherwise fill it with a nop. A free dest
+    * is moved to a used channel. */
+   if (!instr.has_alu_flag(alu_is_trans) && !(model.used_chans & (1 << instr.dest_chan()))) {
+      auto dest = instr.dest();
+      if (!dest || dest->pin() != pin_free || !model.used_chans)
+         return false;
+   }
+
+   AluGroupModel m = model;
+   if (!model_indirect_access(m, instr))
+      return false;
+
+   for (AluBankSwizzle i = sq_alu_scl_201; i != sq_alu_scl_unknown; ++i) {
+      auto readports = m.readports;
+      if (readports.schedule_trans_instruction(instr, i)) {
+         m.readports = readports;
+         model = m;
+         return true;
+      }
+   }
+   return false;
+}
+
+bool
+BlockSheduler::schedule_alu_to_group_lookahead(AluGroup *group)
+{
+   using ReadyIter = std::list<AluInstr *>::iterator;
+
+   auto eligible = [](const AluInstr *alu) {
+      return !alu->has_lds_access() && !alu->has_alu_flag(alu_is_lds);
+   };
+
+   std::vector<ReadyIter> vec_window;
+   for (auto i = alu_vec_ready.begin();
+        i != alu_vec_ready.end() && vec_window.size() < lookahead_vec_window; ++i) {
+      if (eligible(*i))
+         vec_window.push_back(i);
+   }
+
+   std::vector<ReadyIter> trans_window;
+   for (auto i = alu_trans_ready.begin();
+        i != alu_trans_ready.end() && trans_window.size() < lookahead_trans_window; ++i) {
+      if (eligible(*i))
+         trans_window.push_back(i);
+   }
+
+   const int nvec = vec_window.size();
+   if (nvec + trans_window.size() < 2)
+      return false;
+
+   /* trans choice: index into trans_window, or nvec + index into vec_window */
+   struct Choice {
+      unsigned vec_mask{0};
+      int trans{-1};
+      int score{-1};
+      int fill{0};
+   } best;
+
+   auto evaluate = [&](const AluGroupModel& model, unsigned vec_mask, int bonus) {
+      int trans = -1;
+      int trans_bonus = 0;
+      AluGroupModel with_trans = model;
+      for (unsigned i = 0; i < trans_window.size() && trans < 0; ++i) {
+         with_trans = model;
+         if (model_add_trans(with_trans, **trans_window[i], m_chip_class)) {
+            trans = i;
+            trans_bonus = lookahead_vec_window;
+         }
+      }
+      for (int i = 0; i < nvec && trans < 0; ++i) {
+         if (vec_mask & (1 << i))
+            continue;
+         with_trans = model;
+         if (model_add_trans(with_trans, **vec_window[i], m_chip_class)) {
+            trans = nvec + i;
+            trans_bonus = lookahead_vec_window - i;
+         }
+      }
+      const AluGroupModel& final_model = trans >= 0 ? with_trans : model;
+
+      int fill = util_bitcount(model.used_chans) + (trans >= 0 ? 1 : 0);
+      int literal_dwords = (final_model.readports.m_nliterals + 1) & ~1;
+      int score = fill * 1024 - literal_dwords * 16 + bonus + trans_bonus;
+      if (score > best.score) {
+         best.vec_mask = vec_mask;
+         best.trans = trans;
+         best.score = score;
+         best.fill = fill;
+      }
+   };
+
+   std::function<void(int, const AluGroupModel&, unsigned, int)> search =
+      [&](int idx, const AluGroupModel& model, unsigned vec_mask, int bonus) {
+         int fill = util_bitcount(model.used_chans);
+         /* even with all remaining candidates and the trans slot this
+          * can't beat the best fill */
+         if (fill + std::min(nvec - idx, 4 - fill) + 1 < best.fill)
+            return;
+
+         if (idx == nvec || fill == 4) {
+            evaluate(model, vec_mask, bonus);
+            return;
+         }
+
+         AluGroupModel with = model;
+         if (model_add_vec(with, **vec_window[idx]))
+            search(idx + 1, with, vec_mask | (1 << idx),
+                   bonus + lookahead_vec_window - idx);
+         search(idx + 1, model, vec_mask, bonus);
+      };
+
+   search(0, AluGroupModel(), 0, 0);
+
+   if (best.fill == 0)
+      return false;
+
+   sfn_log << SfnLog::schedule << "Lookahead: fill " << best.fill << " of "
+           << nvec << " vec and " << trans_window.size() << " trans candidates\n";
+
+   bool success = false;
+   for (int i = 0; i < nvec; ++i) {
+      if (!(best.vec_mask & (1 << i)))
+         continue;
+      auto instr = *vec_window[i];
+      if (!m_current_block->try_reserve_kcache(*instr))
+         continue;
+      if (group->add_vec_instructions(instr)) {
+         alu_vec_ready.erase(vec_window[i]);
+         success = true;
+      }
+   }
+
+   if (best.trans >= 0) {
+      bool from_trans = best.trans < (int)trans_window.size();
+      auto& readylist = from_trans ? alu_trans_ready : alu_vec_ready;
+      auto it = from_trans ? trans_window[best.trans] : vec_window[best.trans - nvec];
+      auto instr = *it;
+
+      /* if a vec commit above failed the vector channel check of the model
+       * might no longer hold, leave the slot to the greedy pass then */
+      int used_chans = ~group->free_slots() & 0xf;
+      bool chan_ok = instr->has_alu_flag(alu_is_trans) ||
+                     (used_chans & (1 << instr->dest_chan())) ||
+                     (instr->dest() && instr->dest()->pin() == pin_free && used_chans);
+
+      if (chan_ok && m_current_block->try_reserve_kcache(*instr) &&
+          group->add_trans_instructions(instr)) {
+         readylist.erase(it);
+         success = true;
+      }
+   }
+   return success;
+}
+
 template <typename I>
 bool
 BlockSheduler::schedule(std::list<I *>& ready_list)
@@ -843,6 +1460,11 @@ BlockSheduler::collect_ready_alu_vec(std::list<AluInstr *>& ready,
 
          priority += 100 * (*i)->register_priority();
 
+         /* CafeGLSL: compute fetch addresses first */
+         if ((m_sched_flags & R600_SCHED_HOIST_FETCHES) && m_fetch_feeders.count(*i) &&
+             hoist_fetches())
+            priority += 10000;
+
          (*i)->add_priority(priority);
          ready.push_back(*i);
 
@@ -31,8 +31,9 @@
 
 namespace r600 {
 
+/* CafeGLSL: sched_flags is a combination of R600_SCHED_* flags */
 Shader *
-schedule(Shader *original);
+schedule(Shader *original, unsigned sched_flags = 0);
 
 }
 
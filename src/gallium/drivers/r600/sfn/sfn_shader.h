@@ -230,6 +230,13 @@ public:
 
    int atomic_file_count() const { return m_atomic_file_count; }
 
+   /* CafeGLSL: ALU clauses the scheduler had to end because the kcache
+    * lines of the next instructions could not be locked */
+   int kcache_clause_splits() const { return m_kcache_clause_splits; }
+   void set_kcache_clause_splits(int n) { m_kcache_clause_splits = n; }
+   int rematerialized_values() const { return m_rematerialized_values; }
+   void set_rematerialized_values(int n) { m_rematerialized_values = n; }
+
    PRegister atomic_update();
    int remap_atomic_base(int base);
    auto evaluate_resource_offset(nir_intrinsic_instr *instr, int src_id)
@@ -345,6 +352,8 @@ private:
    uint32_t m_next_hwatomic_loc{0};
    std::unordered_map<int, int> m_atomic_base_map;
    uint32_t m_atomic_file_count{0};
+   int m_kcache_clause_splits{0};
+   int m_rematerialized_values{0};
    PRegister m_atomic_update{nullptr};
    PRegister m_rat_return_address{nullptr};
 
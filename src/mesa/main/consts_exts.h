@@ -824,6 +824,13 @@ struct gl_constants
     */
    bool GenerateTemporaryNames;
 
+   /**
+    * CafeGLSL: allocate the parse state, AST and IR of a compile from an arena
+    * owned by gl_shader::ir (see ralloc_arena_context).  Memory of IR dropped
+    * by the compile time passes is only returned when the IR is freed.
+    */
+   bool GLSLUseCompileArena;
+
    /*
     * Maximum value supported for an index in DrawElements and friends.
     *
@@ -135,6 +135,16 @@ enum gl_compile_status
    COMPILE_SKIPPED
 };
 
+/**
+ * CafeGLSL: how the source of the last compile was preprocessed
+ */
+enum gl_preprocess_path
+{
+   PREPROCESS_GLCPP = 0,
+   PREPROCESS_PASSTHROUGH, /**< no glcpp, only comments were stripped */
+   PREPROCESS_CACHED,      /**< glcpp output of an earlier compile */
+};
+
 /**
  * A GLSL shader object.
  */
@@ -227,6 +237,10 @@ struct gl_shader
 
    /* ARB_gl_spirv related data */
    struct gl_shader_spirv_data *spirv_data;
+
+   /* CafeGLSL: time the last compile spent in the preprocessor */
+   uint64_t PreprocessNanoseconds;
+   enum gl_preprocess_path PreprocessPath;
 };
 
 /**
@@ -3242,6 +3242,10 @@ struct sh_incl_path_ht_entry
 {
    struct hash_table *path;
    char *shader_source;
+   /* CafeGLSL: identifies the source in the glcpp include cache, all zero
+    * without a source
+    */
+   unsigned char source_sha1[SHA1_DIGEST_LENGTH];
 };
 
 struct shader_includes {
@@ -3269,6 +3273,12 @@ _mesa_get_shader_include_cursor(struct gl_shared_state *shared)
    return shared->ShaderIncludes->relative_path_cursor;
 }
 
+size_t
+_mesa_get_shader_include_path_count(struct gl_shared_state *shared)
+{
+   return shared->ShaderIncludes->num_include_paths;
+}
+
 void
 _mesa_set_shader_include_cursor(struct gl_shared_state *shared, size_t cursor)
 {
@@ -3491,6 +3501,43 @@ _mesa_lookup_shader_include(struct gl_context *ctx, char *path,
    return shader_include ? shader_include->shader_source : NULL;
 }
 
+const char *
+_mesa_lookup_shader_include_sha1(struct gl_context *ctx, char *path,
+                                 bool error_check, unsigned char *sha1)
+{
+   struct sh_incl_path_ht_entry *shader_include =
+      lookup_shader_include(ctx, path, error_check);
+
+   if (!shader_include || !shader_include->shader_source) {
+      memset(sha1, 0, SHA1_DIGEST_LENGTH);
+      return NULL;
+   }
+   memcpy(sha1, shader_include->source_sha1, SHA1_DIGEST_LENGTH);
+   return shader_include->shader_source;
+}
+
+/* CafeGLSL: replaces the source of an include tree node. Expansions cached by
+ * glcpp which looked up the old source are dropped, those of other paths and
+ * other shared states stay.
+ */
+static void
+replace_shader_include_source(struct sh_incl_path_ht_entry *sh_incl_ht_entry,
+                              char *source)
+{
+   unsigned char old_sha1[SHA1_DIGEST_LENGTH];
+   memcpy(old_sha1, sh_incl_ht_entry->source_sha1, SHA1_DIGEST_LENGTH);
+
+   free(sh_incl_ht_entry->shader_source);
+   sh_incl_ht_entry->shader_source = source;
+   if (source)
+      _mesa_sha1_compute(source, strlen(source), sh_incl_ht_entry->source_sha1);
+   else
+      memset(sh_incl_ht_entry->source_sha1, 0, SHA1_DIGEST_LENGTH);
+
+   if (memcmp(old_sha1, sh_incl_ht_entry->source_sha1, SHA1_DIGEST_LENGTH))
+      glcpp_evict_include_cache(old_sha1);
+}
+
 static char *
 copy_string(struct gl_context *ctx, const char *str, int str_len,
             const char *caller)
@@ -3511,35 +3558,21 @@ copy_string(struct gl_context *ctx, const char *str, int str_len,
    return cp;
 }
 
-GLvoid GLAPIENTRY
-_mesa_NamedStringARB(GLenum type, GLint namelen, const GLchar *name,
-                     GLint stringlen, const GLchar *string)
+/* CafeGLSL: stores string_cp as the include source of name_cp, NULL removes
+ * it. Takes ownership of string_cp.
+ */
+static bool
+set_named_string(struct gl_context *ctx, char *name_cp, char *string_cp,
+                 bool error_check)
 {
-   GET_CURRENT_CONTEXT(ctx);
-   const char *caller = "glNamedStringARB";
-
-   if (type != GL_SHADER_INCLUDE_ARB) {
-      _mesa_error(ctx, GL_INVALID_VALUE, "%s(invalid type)", caller);
-      return;
-   }
-
-   char *name_cp = copy_string(ctx, name, namelen, caller);
-   char *string_cp = copy_string(ctx, string, stringlen, caller);
-   if (!name_cp || !string_cp) {
-      free(string_cp);
-      free(name_cp);
-      return;
-   }
-
    void *mem_ctx = ralloc_context(NULL);
    struct sh_incl_path_entry *path_list;
 
    if (!validate_and_tokenise_sh_incl(ctx, mem_ctx, &path_list, name_cp,
-                                      true)) {
+                                      error_check)) {
       free(string_cp);
-      free(name_cp);
       ralloc_free(mem_ctx);
-      return;
+      return false;
    }
 
    simple_mtx_lock(&ctx->Shared->ShaderIncludeMutex);
@@ -3565,16 +3598,49 @@ _mesa_NamedStringARB(GLenum type, GLint namelen, const GLchar *name,
 
       path_ht = sh_incl_ht_entry->path;
 
-      if (list_last_entry(&path_list->list, struct sh_incl_path_entry, list) == entry) {
-         free(sh_incl_ht_entry->shader_source);
-         sh_incl_ht_entry->shader_source = string_cp;
-      }
+      if (list_last_entry(&path_list->list, struct sh_incl_path_entry, list) == entry)
+         replace_shader_include_source(sh_incl_ht_entry, string_cp);
    }
 
    simple_mtx_unlock(&ctx->Shared->ShaderIncludeMutex);
 
-   free(name_cp);
    ralloc_free(mem_ctx);
+   return true;
+}
+
+bool
+_mesa_set_shader_include(struct gl_context *ctx, const char *name,
+                         const char *source)
+{
+   char *name_cp = strdup(name);
+   bool success = set_named_string(ctx, name_cp,
+                                   source ? strdup(source) : NULL, false);
+   free(name_cp);
+   return success;
+}
+
+GLvoid GLAPIENTRY
+_mesa_NamedStringARB(GLenum type, GLint namelen, const GLchar *name,
+                     GLint stringlen, const GLchar *string)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   const char *caller = "glNamedStringARB";
+
+   if (type != GL_SHADER_INCLUDE_ARB) {
+      _mesa_error(ctx, GL_INVALID_VALUE, "%s(invalid type)", caller);
+      return;
+   }
+
+   char *name_cp = copy_string(ctx, name, namelen, caller);
+   char *string_cp = copy_string(ctx, string, stringlen, caller);
+   if (!name_cp || !string_cp) {
+      free(string_cp);
+      free(name_cp);
+      return;
+   }
+
+   set_named_string(ctx, name_cp, string_cp, true);
+   free(name_cp);
 }
 
 GLvoid GLAPIENTRY
@@ -3599,8 +3665,7 @@ _mesa_DeleteNamedStringARB(GLint namelen, const GLchar *name)
 
    simple_mtx_lock(&ctx->Shared->ShaderIncludeMutex);
 
-   free(shader_include->shader_source);
-   shader_include->shader_source = NULL;
+   replace_shader_include_source(shader_include, NULL);
 
    simple_mtx_unlock(&ctx->Shared->ShaderIncludeMutex);
 
@@ -190,6 +190,9 @@ _mesa_init_shader_includes(struct gl_shared_state *shared);
 size_t
 _mesa_get_shader_include_cursor(struct gl_shared_state *shared);
 
+size_t
+_mesa_get_shader_include_path_count(struct gl_shared_state *shared);
+
 void
 _mesa_set_shader_include_cursor(struct gl_shared_state *shared, size_t cusor);
 
@@ -200,6 +203,18 @@ const char *
 _mesa_lookup_shader_include(struct gl_context *ctx, char *path,
                             bool error_check);
 
+/* CafeGLSL: also returns the SHA1 of the source, all zero if not found */
+const char *
+_mesa_lookup_shader_include_sha1(struct gl_context *ctx, char *path,
+                                 bool error_check, unsigned char *sha1);
+
+/* CafeGLSL: glNamedStringARB/glDeleteNamedStringARB (source NULL) without a
+ * current context. Returns false if name is not a valid path.
+ */
+bool
+_mesa_set_shader_include(struct gl_context *ctx, const char *name,
+                         const char *source);
+
 #ifdef __cplusplus
 }
 #endif
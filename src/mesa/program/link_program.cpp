@@ -79,6 +79,18 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
          _mesa_spirv_link_shaders(ctx, prog);
    }
 
+   /* CafeGLSL: Shaders are never relinked. The linked shaders own a copy of
+    * the IR, so free the compiled IR before NIR conversion and the backend
+    * allocate theirs.
+    */
+   if (prog->data->LinkStatus && !spirv) {
+      for (i = 0; i < prog->NumShaders; i++) {
+         ralloc_free(prog->Shaders[i]->ir);
+         prog->Shaders[i]->ir = NULL;
+         prog->Shaders[i]->symbols = NULL;
+      }
+   }
+
    /* If LinkStatus is LINKING_SUCCESS, then reset sampler validated to true.
     * Validation happens via the LinkShader call below. If LinkStatus is
     * LINKING_SKIPPED, then SamplersValidated will have been restored from the
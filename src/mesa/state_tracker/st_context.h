@@ -188,6 +188,17 @@ struct st_context
     */
    boolean allow_st_finalize_nir_twice;
 
+   /* CafeGLSL: don't create the default variant at link time. The caller
+    * takes gl_program::nir and hands it to the driver itself.
+    */
+   boolean skip_default_variant;
+
+   /* CafeGLSL: every program is built into exactly one variant, which takes
+    * ownership of gl_program::nir. No serialized NIR is kept for further
+    * variants.
+    */
+   boolean single_variant;
+
    /**
     * If a shader can be created when we get its source.
     * This means it has only 1 variant, not counting glBitmap and
@@ -623,7 +623,6 @@ get_nir_shader(struct st_context *st, struct gl_program *prog)
        * serialized NIR to save memory.
        */
       prog->nir = NULL;
-      assert(prog->serialized_nir && prog->serialized_nir_size);
       return nir;
    }
 
@@ -631,6 +630,7 @@ get_nir_shader(struct st_context *st, struct gl_program *prog)
    const struct nir_shader_compiler_options *options =
       st_get_nir_compiler_options(st, prog->info.stage);
 
+   assert(prog->serialized_nir && prog->serialized_nir_size);
    blob_reader_init(&blob_reader, prog->serialized_nir, prog->serialized_nir_size);
    return nir_deserialize(NULL, options, &blob_reader);
 }
@@ -1346,12 +1346,17 @@ st_finalize_program(struct st_context *st, struct gl_program *prog)
       /* This is only needed for ARB_vp/fp programs and when the disk cache
        * is disabled. If the disk cache is enabled, GLSL programs are
        * serialized in write_nir_to_cache.
+       *
+       * CafeGLSL: Skipped if the only variant takes ownership of prog->nir,
+       * see st_context::single_variant.
        */
-      st_serialize_nir(prog);
+      if (!st->single_variant)
+         st_serialize_nir(prog);
    }
 
    /* Always create the default variant of the program. */
-   st_precompile_shader_variant(st, prog);
+   if (!st->skip_default_variant)
+      st_precompile_shader_variant(st, prog);
 }
 
 /**
@@ -24,6 +24,7 @@
 #ifdef HAVE_COMPRESSION
 
 #include <assert.h>
+#include <stdlib.h>
 
 /* Ensure that zlib uses 'const' in 'z_const' declarations. */
 #ifndef ZLIB_CONST
@@ -163,4 +164,127 @@ util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
+
+/* CafeGLSL: streaming decompression */
+enum util_compress_codec
+util_compress_get_codec(void)
+{
+#ifdef HAVE_ZSTD
+   return UTIL_COMPRESS_CODEC_ZSTD;
+#else
+   return UTIL_COMPRESS_CODEC_ZLIB;
+#endif
+}
+
+struct util_inflate_stream {
+#ifdef HAVE_ZSTD
+   ZSTD_DStream *dstream;
+   ZSTD_inBuffer in;
+   size_t last_ret;
+#elif defined(HAVE_ZLIB)
+   z_stream strm;
+   int last_ret;
+#endif
+};
+
+struct util_inflate_stream *
+util_compress_inflate_begin(const uint8_t *in_data, size_t in_data_size)
+{
+   struct util_inflate_stream *stream = calloc(1, sizeof(*stream));
+   if (!stream)
+      return NULL;
+#ifdef HAVE_ZSTD
+   stream->dstream = ZSTD_createDStream();
+   if (!stream->dstream || ZSTD_isError(ZSTD_initDStream(stream->dstream))) {
+      ZSTD_freeDStream(stream->dstream);
+      free(stream);
+      return NULL;
+   }
+   stream->in.src = in_data;
+   stream->in.size = in_data_size;
+   stream->in.pos = 0;
+   stream->last_ret = 1;
+#elif defined(HAVE_ZLIB)
+   stream->strm.zalloc = Z_NULL;
+   stream->strm.zfree = Z_NULL;
+   stream->strm.opaque = Z_NULL;
+   stream->strm.next_in = in_data;
+   stream->strm.avail_in = in_data_size;
+   if (inflateInit(&stream->strm) != Z_OK) {
+      free(stream);
+      return NULL;
+   }
+   stream->last_ret = Z_OK;
+#else
+   STATIC_ASSERT(false);
+#endif
+   return stream;
+}
+
+bool
+util_compress_inflate_next(struct util_inflate_stream *stream,
+                           uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   ZSTD_outBuffer out = { out_data, out_data_size, 0 };
+   while (out.pos < out.size) {
+      /* 0 means the frame is complete */
+      if (stream->last_ret == 0)
+         return false;
+      size_t in_pos = stream->in.pos, out_pos = out.pos;
+      stream->last_ret = ZSTD_decompressStream(stream->dstream, &out, &stream->in);
+      if (ZSTD_isError(stream->last_ret))
+         return false;
+      /* truncated input */
+      if (stream->in.pos == in_pos && out.pos == out_pos)
+         return false;
+   }
+   return true;
+#elif defined(HAVE_ZLIB)
+   stream->strm.next_out = out_data;
+   stream->strm.avail_out = out_data_size;
+   while (stream->strm.avail_out > 0) {
+      if (stream->last_ret == Z_STREAM_END)
+         return false;
+      stream->last_ret = inflate(&stream->strm, Z_NO_FLUSH);
+      if (stream->last_ret != Z_OK && stream->last_ret != Z_STREAM_END)
+         return false;
+   }
+   return true;
+#else
+   STATIC_ASSERT(false);
+#endif
+}
+
+bool
+util_compress_inflate_end(struct util_inflate_stream *stream)
+{
+   bool complete;
+#ifdef HAVE_ZSTD
+   /* the end of the frame may not have been decoded yet if the output ended
+    * exactly at it
+    */
+   if (stream->last_ret != 0 && !ZSTD_isError(stream->last_ret)) {
+      uint8_t dummy;
+      ZSTD_outBuffer out = { &dummy, 0, 0 };
+      stream->last_ret = ZSTD_decompressStream(stream->dstream, &out, &stream->in);
+   }
+   complete = stream->last_ret == 0 && stream->in.pos == stream->in.size;
+   ZSTD_freeDStream(stream->dstream);
+#elif defined(HAVE_ZLIB)
+   if (stream->last_ret == Z_OK) {
+      uint8_t dummy;
+      stream->strm.next_out = &dummy;
+      stream->strm.avail_out = 0;
+      stream->last_ret = inflate(&stream->strm, Z_NO_FLUSH);
+   }
+   complete = stream->last_ret == Z_STREAM_END && stream->strm.avail_in == 0;
+   (void)inflateEnd(&stream->strm);
+#else
+   STATIC_ASSERT(false);
+#endif
+   free(stream);
+   return complete;
+}
+
 #endif
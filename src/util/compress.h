@@ -37,4 +37,32 @@ size_t
 util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
                       uint8_t *out_data, size_t out_buff_size);
 
+/* CafeGLSL: streaming decompression of one compressed buffer, the output is
+ * produced in pieces which can go to different destinations
+ */
+enum util_compress_codec {
+   UTIL_COMPRESS_CODEC_ZLIB = 1,
+   UTIL_COMPRESS_CODEC_ZSTD = 2,
+};
+
+/* the codec util_compress_deflate produces and util_compress_inflate accepts */
+enum util_compress_codec
+util_compress_get_codec(void);
+
+struct util_inflate_stream;
+
+struct util_inflate_stream *
+util_compress_inflate_begin(const uint8_t *in_data, size_t in_data_size);
+
+/* decompresses exactly out_data_size bytes, returns false if the stream is
+ * corrupt or ends before
+ */
+bool
+util_compress_inflate_next(struct util_inflate_stream *stream,
+                           uint8_t *out_data, size_t out_data_size);
+
+/* returns true if the whole stream was consumed */
+bool
+util_compress_inflate_end(struct util_inflate_stream *stream);
+
 #endif
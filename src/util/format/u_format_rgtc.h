@@ -30,6 +30,10 @@
 
 #include "c99_compat.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void
 util_format_rgtc1_unorm_fetch_rgba_8unorm(uint8_t *restrict dst, const uint8_t *restrict src, unsigned i, unsigned j);
 
@@ -125,4 +129,8 @@ void
 util_format_rgtc2_snorm_fetch_rgba(void *restrict dst, const uint8_t *restrict src, unsigned i, unsigned j);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
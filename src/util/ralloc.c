@@ -32,9 +32,24 @@
 #include "util/macros.h"
 #include "util/u_math.h"
 #include "util/u_printf.h"
+#include "util/u_thread.h"
 
 #include "ralloc.h"
 
+/* Heap size of a malloc'd block, only used for the allocation statistics. */
+#if defined(__GLIBC__) || defined(__NEWLIB__)
+#include <malloc.h>
+#define heap_block_size(block) malloc_usable_size(block)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define heap_block_size(block) malloc_size(block)
+#elif defined(_WIN32)
+#include <malloc.h>
+#define heap_block_size(block) _msize(block)
+#else
+#define heap_block_size(block) ((size_t)0)
+#endif
+
 #define CANARY 0x5A1106
 
 #if defined(__LP64__) || defined(_WIN64)
@@ -52,11 +67,6 @@ struct ralloc_header
 {
    HEADER_ALIGN
 
-#ifndef NDEBUG
-   /* A canary value used to determine whether a pointer is ralloc'd. */
-   unsigned canary;
-#endif
-
    struct ralloc_header *parent;
 
    /* The first child (head of a linked list) */
@@ -67,6 +77,14 @@ struct ralloc_header
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+#ifndef NDEBUG
+   /* A canary value used to determine whether a pointer is ralloc'd. */
+   unsigned canary : 24;
+#endif
+
+   /* ARENA_* flags.  Packed with the canary, so the header keeps its size. */
+   unsigned arena_flags : 8;
 };
 
 typedef struct ralloc_header ralloc_header;
@@ -74,6 +92,218 @@ typedef struct ralloc_header ralloc_header;
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
+static __THREAD_INITIAL_EXEC struct ralloc_stats stats;
+
+/* Off until ralloc_reset_stats(), so allocations don't pay for the counters
+ * and the heap block size lookups unless a caller asked for them.
+ */
+static __THREAD_INITIAL_EXEC bool stats_enabled;
+
+static inline void
+stats_add_heap_block(void *block)
+{
+   if (likely(!stats_enabled))
+      return;
+   stats.heap_bytes += heap_block_size(block);
+   if (stats.heap_bytes > stats.peak_heap_bytes)
+      stats.peak_heap_bytes = stats.heap_bytes;
+}
+
+static inline void
+stats_remove_heap_block(void *block)
+{
+   if (likely(!stats_enabled))
+      return;
+   stats.heap_bytes -= heap_block_size(block);
+}
+
+void
+ralloc_get_stats(struct ralloc_stats *out)
+{
+   *out = stats;
+}
+
+void
+ralloc_reset_stats(void)
+{
+   stats_enabled = true;
+   stats.malloc_count = 0;
+   stats.arena_count = 0;
+   stats.linear_count = 0;
+   stats.peak_heap_bytes = stats.heap_bytes;
+}
+
+void
+ralloc_stop_stats(void)
+{
+   stats_enabled = false;
+}
+
+/* Arena contexts
+ *
+ * Blocks below an arena context are bump allocated from large chunks instead
+ * of being malloc'd one by one.  They keep their regular ralloc header, so
+ * stealing, destructors and ralloc_parent work as usual, but freeing them
+ * only releases their memory if they happen to be the most recent
+ * allocation.  All chunks are released at once when the arena context
+ * itself is freed.
+ *
+ * The arena is found through the ralloc_arena_prefix in front of the header
+ * of arena blocks and of the arena context, which is malloc'd together with
+ * its prefix.  Other blocks don't pay for the arena mode.
+ */
+
+#define ARENA_CONTEXT (1 << 0)
+#define ARENA_BLOCK   (1 << 1)
+
+#define ARENA_MIN_CHUNK_SIZE (16 * 1024)
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+struct ralloc_arena_chunk {
+   HEADER_ALIGN
+   struct ralloc_arena_chunk *next;
+};
+
+/* The size of an arena block is needed to resize it, it is unused for the
+ * arena context.
+ */
+struct ralloc_arena_prefix {
+   HEADER_ALIGN
+   struct ralloc_arena *arena;
+   size_t size;
+};
+
+struct ralloc_arena {
+   struct ralloc_arena_chunk *chunks;
+   char *next_free;  /* unused space of the latest regular chunk */
+   char *end;
+   size_t chunk_size; /* size of the next regular chunk */
+};
+
+static struct ralloc_arena_chunk *
+arena_add_chunk(struct ralloc_arena *arena, size_t size)
+{
+   struct ralloc_arena_chunk *chunk = malloc(sizeof(struct ralloc_arena_chunk) + size);
+   if (unlikely(chunk == NULL))
+      return NULL;
+
+   if (unlikely(stats_enabled))
+      stats.malloc_count++;
+   stats_add_heap_block(chunk);
+   chunk->next = arena->chunks;
+   arena->chunks = chunk;
+   return chunk;
+}
+
+static ralloc_header *
+arena_alloc(struct ralloc_arena *arena, size_t size)
+{
+   size_t block_size = align64(size + sizeof(ralloc_header),
+                               alignof(ralloc_header));
+   size_t full_size = sizeof(struct ralloc_arena_prefix) + block_size;
+   struct ralloc_arena_prefix *prefix;
+
+   if (unlikely(full_size > arena->chunk_size / 4)) {
+      /* Large blocks get a chunk of their own, so the space left in the
+       * current chunk isn't wasted.
+       */
+      struct ralloc_arena_chunk *chunk = arena_add_chunk(arena, full_size);
+      if (unlikely(chunk == NULL))
+         return NULL;
+      prefix = (struct ralloc_arena_prefix *) &chunk[1];
+   } else {
+      if (unlikely((size_t) (arena->end - arena->next_free) < full_size)) {
+         struct ralloc_arena_chunk *chunk =
+            arena_add_chunk(arena, arena->chunk_size);
+         if (unlikely(chunk == NULL))
+            return NULL;
+         arena->next_free = (char *) &chunk[1];
+         arena->end = arena->next_free + arena->chunk_size;
+         arena->chunk_size = MIN2(arena->chunk_size * 2, ARENA_MAX_CHUNK_SIZE);
+      }
+      prefix = (struct ralloc_arena_prefix *) arena->next_free;
+      arena->next_free += full_size;
+   }
+
+   if (unlikely(stats_enabled))
+      stats.arena_count++;
+   prefix->arena = arena;
+   prefix->size = block_size;
+   return (ralloc_header *) &prefix[1];
+}
+
+static struct ralloc_arena_prefix *
+get_arena_prefix(ralloc_header *info)
+{
+   return ((struct ralloc_arena_prefix *) info) - 1;
+}
+
+/* The arena which children of this block are carved out of, NULL if they
+ * are malloc'd.
+ */
+static struct ralloc_arena *
+get_arena(ralloc_header *info)
+{
+   return info->arena_flags != 0 ? get_arena_prefix(info)->arena : NULL;
+}
+
+static bool
+is_latest_arena_block(ralloc_header *info)
+{
+   struct ralloc_arena_prefix *prefix = get_arena_prefix(info);
+   return (char *) info + prefix->size == prefix->arena->next_free;
+}
+
+/* Arena blocks are only grown in place if they are the most recent
+ * allocation, otherwise they are copied into a new block.
+ */
+static ralloc_header *
+arena_resize(ralloc_header *old, size_t size)
+{
+   struct ralloc_arena_prefix *prefix = get_arena_prefix(old);
+   struct ralloc_arena *arena = prefix->arena;
+   size_t block_size = align64(size + sizeof(ralloc_header),
+                               alignof(ralloc_header));
+   ralloc_header *info;
+
+   if (block_size <= prefix->size)
+      return old;
+
+   if (is_latest_arena_block(old) &&
+       (size_t) (arena->end - (char *) old) >= block_size) {
+      arena->next_free = (char *) old + block_size;
+      prefix->size = block_size;
+      return old;
+   }
+
+   info = arena_alloc(arena, size);
+   if (unlikely(info == NULL))
+      return NULL;
+   memcpy(info, old, prefix->size);
+   return info;
+}
+
+static void
+arena_free_block(ralloc_header *info)
+{
+   if (is_latest_arena_block(info))
+      get_arena_prefix(info)->arena->next_free = (char *) get_arena_prefix(info);
+}
+
+static void
+arena_destroy(struct ralloc_arena *arena)
+{
+   struct ralloc_arena_chunk *chunk = arena->chunks;
+   while (chunk != NULL) {
+      struct ralloc_arena_chunk *next = chunk->next;
+      stats_remove_heap_block(chunk);
+      free(chunk);
+      chunk = next;
+   }
+   stats_remove_heap_block(arena);
+   free(arena);
+}
+
 static ralloc_header *
 get_header(const void *ptr)
 {
@@ -98,31 +328,9 @@ add_child(ralloc_header *parent, ralloc_header *info)
    }
 }
 
-void *
-ralloc_context(const void *ctx)
-{
-   return ralloc_size(ctx, 0);
-}
-
-void *
-ralloc_size(const void *ctx, size_t size)
+static void *
+init_header(ralloc_header *parent, ralloc_header *info, unsigned arena_flags)
 {
-   /* Some malloc allocation doesn't always align to 16 bytes even on 64 bits
-    * system, from Android bionic/tests/malloc_test.cpp:
-    *  - Allocations of a size that rounds up to a multiple of 16 bytes
-    *    must have at least 16 byte alignment.
-    *  - Allocations of a size that rounds up to a multiple of 8 bytes and
-    *    not 16 bytes, are only required to have at least 8 byte alignment.
-    */
-   void *block = malloc(align64(size + sizeof(ralloc_header),
-                                alignof(ralloc_header)));
-   ralloc_header *info;
-   ralloc_header *parent;
-
-   if (unlikely(block == NULL))
-      return NULL;
-
-   info = (ralloc_header *) block;
    /* measurements have shown that calloc is slower (because of
     * the multiplication overflow checking?), so clear things
     * manually
@@ -132,8 +340,7 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
-
-   parent = ctx != NULL ? get_header(ctx) : NULL;
+   info->arena_flags = arena_flags;
 
    add_child(parent, info);
 
@@ -144,6 +351,44 @@ ralloc_size(const void *ctx, size_t size)
    return PTR_FROM_HEADER(info);
 }
 
+void *
+ralloc_context(const void *ctx)
+{
+   return ralloc_size(ctx, 0);
+}
+
+void *
+ralloc_size(const void *ctx, size_t size)
+{
+   ralloc_header *parent = ctx != NULL ? get_header(ctx) : NULL;
+   struct ralloc_arena *arena = parent != NULL ? get_arena(parent) : NULL;
+   void *block;
+
+   if (arena != NULL) {
+      block = arena_alloc(arena, size);
+   } else {
+      /* Some malloc allocation doesn't always align to 16 bytes even on 64
+       * bits system, from Android bionic/tests/malloc_test.cpp:
+       *  - Allocations of a size that rounds up to a multiple of 16 bytes
+       *    must have at least 16 byte alignment.
+       *  - Allocations of a size that rounds up to a multiple of 8 bytes and
+       *    not 16 bytes, are only required to have at least 8 byte alignment.
+       */
+      block = malloc(align64(size + sizeof(ralloc_header),
+                             alignof(ralloc_header)));
+      if (likely(block != NULL) && unlikely(stats_enabled)) {
+         stats.malloc_count++;
+         stats_add_heap_block(block);
+      }
+   }
+
+   if (unlikely(block == NULL))
+      return NULL;
+
+   return init_header(parent, (ralloc_header *) block,
+                      arena != NULL ? ARENA_BLOCK : 0);
+}
+
 void *
 rzalloc_size(const void *ctx, size_t size)
 {
@@ -162,8 +407,21 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, align64(size + sizeof(ralloc_header),
-                               alignof(ralloc_header)));
+   if (old->arena_flags & ARENA_BLOCK) {
+      info = arena_resize(old, size);
+   } else {
+      /* the prefix of an arena context is part of its heap block */
+      size_t offset = (old->arena_flags & ARENA_CONTEXT) ?
+                      sizeof(struct ralloc_arena_prefix) : 0;
+      char *old_block = (char *) old - offset;
+      char *block;
+
+      stats_remove_heap_block(old_block);
+      block = realloc(old_block, offset + align64(size + sizeof(ralloc_header),
+                                                  alignof(ralloc_header)));
+      stats_add_heap_block(block != NULL ? block : old_block);
+      info = block != NULL ? (ralloc_header *) (block + offset) : NULL;
+   }
 
    if (info == NULL)
       return NULL;
@@ -296,7 +554,53 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (info->arena_flags & ARENA_BLOCK) {
+      arena_free_block(info);
+      return;
+   }
+
+   void *block = info;
+   if (info->arena_flags & ARENA_CONTEXT) {
+      block = get_arena_prefix(info);
+      arena_destroy(get_arena_prefix(info)->arena);
+   }
+
+   stats_remove_heap_block(block);
+   free(block);
+}
+
+void *
+ralloc_arena_context(const void *ctx, size_t size)
+{
+   ralloc_header *parent = ctx != NULL ? get_header(ctx) : NULL;
+   struct ralloc_arena_prefix *prefix;
+   struct ralloc_arena *arena;
+
+   /* Nested arena contexts share the outer arena. */
+   if (parent != NULL && get_arena(parent) != NULL)
+      return ralloc_size(ctx, size);
+
+   arena = malloc(sizeof(struct ralloc_arena));
+   if (unlikely(arena == NULL))
+      return NULL;
+   prefix = malloc(sizeof(struct ralloc_arena_prefix) +
+                   align64(size + sizeof(ralloc_header),
+                           alignof(ralloc_header)));
+   if (unlikely(prefix == NULL)) {
+      free(arena);
+      return NULL;
+   }
+   if (unlikely(stats_enabled))
+      stats.malloc_count += 2;
+   stats_add_heap_block(arena);
+   stats_add_heap_block(prefix);
+   arena->chunks = NULL;
+   arena->next_free = NULL;
+   arena->end = NULL;
+   arena->chunk_size = ARENA_MIN_CHUNK_SIZE;
+   prefix->arena = arena;
+   prefix->size = 0;
+   return init_header(parent, (ralloc_header *) &prefix[1], ARENA_CONTEXT);
 }
 
 void
@@ -310,6 +614,11 @@ ralloc_steal(const void *new_ctx, void *ptr)
    info = get_header(ptr);
    parent = new_ctx ? get_header(new_ctx) : NULL;
 
+   /* Arena blocks are released with their arena, they can't outlive it. */
+   assert(!(info->arena_flags & ARENA_BLOCK) ||
+          (parent != NULL &&
+           get_arena(parent) == get_arena_prefix(info)->arena));
+
    unlink_block(info);
 
    add_child(parent, info);
@@ -1004,6 +1313,8 @@ linear_alloc_child(void *parent, unsigned size)
    assert(first->magic == LMAGIC);
    assert(!latest->next);
 
+   if (unlikely(stats_enabled))
+      stats.linear_count++;
    size = ALIGN_POT(size, SUBALLOC_ALIGNMENT);
    full_size = sizeof(linear_size_chunk) + size;
 
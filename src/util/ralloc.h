@@ -91,6 +91,52 @@ extern "C" {
  */
 void *ralloc_context(const void *ctx);
 
+/**
+ * Allocate a new arena context with \p size bytes of memory.
+ *
+ * Blocks allocated below an arena context are carved out of large chunks
+ * owned by the arena instead of being malloc'd individually.  They behave
+ * like any other ralloc'd block, except that freeing them does not return
+ * their memory to the heap: all chunks are released in one go when the arena
+ * context is freed.  Arena blocks therefore must stay below a context of the
+ * same arena, ralloc_steal() asserts this in debug builds.
+ *
+ * If \p ctx is already part of an arena, the new context shares it.
+ */
+void *ralloc_arena_context(const void *ctx, size_t size);
+
+/**
+ * Allocation statistics of the calling thread.  They are only collected
+ * between ralloc_reset_stats() and ralloc_stop_stats().
+ */
+struct ralloc_stats {
+   unsigned long long malloc_count; /**< heap allocations, including arena chunks */
+   unsigned long long arena_count;  /**< blocks carved out of an arena */
+   unsigned long long linear_count; /**< linear_alloc_child() calls */
+   /**
+    * Heap bytes currently owned by ralloc.  Blocks freed on another thread
+    * than they were allocated on, or allocated while collection was off and
+    * freed while it is on, make this drift, so only differences are
+    * meaningful.  Always 0 on platforms which can't report the size of
+    * a heap block.
+    */
+   long long heap_bytes;
+   long long peak_heap_bytes;
+};
+
+void ralloc_get_stats(struct ralloc_stats *stats);
+
+/**
+ * Reset the counters of the calling thread and start a new peak measurement
+ * at the current heap usage.  Turns collection on for the calling thread.
+ */
+void ralloc_reset_stats(void);
+
+/**
+ * Turn collection off for the calling thread, the counters keep their values.
+ */
+void ralloc_stop_stats(void);
+
 /**
  * Allocate memory chained off of the given context.
  *